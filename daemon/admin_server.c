@@ -86,6 +86,11 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
     size_t freeWorkers;
     size_t nPrioWorkers;
     size_t jobQueueDepth;
+    unsigned long long poolHits;
+    unsigned long long poolMisses;
+    size_t poolMessages;
+    size_t poolBuffers;
+    unsigned long long poolBytes;
     virTypedParameterPtr tmpparams = NULL;
 
     virCheckFlags(0, -1);
@@ -129,6 +134,34 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
                               jobQueueDepth) < 0)
         goto cleanup;
 
+    virNetMessagePoolGetStats(&poolHits, &poolMisses, &poolMessages,
+                              &poolBuffers, &poolBytes);
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams,
+                                &maxparams, VIR_THREADPOOL_MESSAGE_POOL_HITS,
+                                poolHits) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams,
+                                &maxparams, VIR_THREADPOOL_MESSAGE_POOL_MISSES,
+                                poolMisses) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams,
+                              &maxparams, VIR_THREADPOOL_MESSAGE_POOL_MESSAGES,
+                              poolMessages) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams,
+                              &maxparams, VIR_THREADPOOL_MESSAGE_POOL_BUFFERS,
+                              poolBuffers) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams,
+                                &maxparams, VIR_THREADPOOL_MESSAGE_POOL_BYTES,
+                                poolBytes) < 0)
+        goto cleanup;
+
     *params = tmpparams;
     tmpparams = NULL;
     ret = 0;
@@ -225,6 +258,7 @@ adminClientGetInfo(virNetServerClientPtr client,
     const char *attr = NULL;
     virTypedParameterPtr tmpparams = NULL;
     virIdentityPtr identity = NULL;
+    virNetServerClientTxStats txStats;
 
     virCheckFlags(0, -1);
 
@@ -294,6 +328,25 @@ adminClientGetInfo(virNetServerClientPtr client,
                                 VIR_CLIENT_INFO_SELINUX_CONTEXT, attr) < 0))
         goto cleanup;
 
+    virNetServerClientGetTxStats(client, &txStats);
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              VIR_CLIENT_INFO_TX_QUEUE_MESSAGES,
+                              txStats.messages) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_TX_QUEUE_BYTES,
+                                txStats.bytes) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_TX_QUEUE_OVERFLOWS,
+                                txStats.overflows) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_TX_EVENTS_DROPPED,
+                                txStats.dropped) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_TX_EVENTS_COALESCED,
+                                txStats.coalesced) < 0)
+        goto cleanup;
+
     *params = tmpparams;
     tmpparams = NULL;
     ret = 0;
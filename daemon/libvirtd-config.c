@@ -287,6 +287,7 @@ daemonConfigNew(bool privileged ATTRIBUTE_UNUSED)
 
     data->max_requests = 20;
     data->max_client_requests = 5;
+    data->max_client_write_batch = VIR_NET_SERVER_CLIENT_WRITE_BATCH;
 
     data->audit_level = 1;
     data->audit_logging = 0;
@@ -368,6 +369,7 @@ daemonConfigFree(struct daemonConfig *data)
     }
     VIR_FREE(data->sasl_allowed_username_list);
     VIR_FREE(data->tls_priority);
+    VIR_FREE(data->client_tx_policy);
 
     VIR_FREE(data->key_file);
     VIR_FREE(data->ca_file);
@@ -455,6 +457,13 @@ daemonConfigLoadOptions(struct daemonConfig *data,
 
     GET_CONF_INT(conf, filename, max_requests);
     GET_CONF_UINT(conf, filename, max_client_requests);
+    GET_CONF_UINT(conf, filename, max_client_write_batch);
+    GET_CONF_UINT(conf, filename, max_client_tx_messages);
+    GET_CONF_UINT(conf, filename, max_client_tx_bytes);
+    GET_CONF_STR(conf, filename, client_tx_policy);
+    GET_CONF_INT(conf, filename, ordered_client_requests);
+    GET_CONF_UINT(conf, filename, io_threads);
+    GET_CONF_INT(conf, filename, worker_queues);
 
     GET_CONF_UINT(conf, filename, admin_min_workers);
     GET_CONF_UINT(conf, filename, admin_max_workers);
@@ -73,6 +73,13 @@ struct daemonConfig {
 
     int max_requests;
     int max_client_requests;
+    unsigned int max_client_write_batch;
+    unsigned int max_client_tx_messages;
+    unsigned int max_client_tx_bytes;
+    char *client_tx_policy;
+    int ordered_client_requests;
+    unsigned int io_threads;
+    int worker_queues;
 
     int log_level;
     char *log_filters;
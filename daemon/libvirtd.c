@@ -1204,6 +1204,7 @@ int main(int argc, char **argv) {
     bool implicit_conf = false;
     char *run_dir = NULL;
     mode_t old_umask;
+    int txPolicy = VIR_NET_SERVER_CLIENT_TX_POLICY_DROP;
 
     struct option opts[] = {
         { "verbose", no_argument, &verbose, 'v'},
@@ -1437,6 +1438,24 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+    virNetServerSetClientWriteBatch(srv, config->max_client_write_batch);
+
+    if (config->client_tx_policy &&
+        (txPolicy = virNetServerClientTxPolicyTypeFromString(config->client_tx_policy)) < 0) {
+        VIR_ERROR(_("invalid client tx policy: %s"), config->client_tx_policy);
+        ret = VIR_DAEMON_ERR_CONFIG;
+        goto cleanup;
+    }
+    virNetServerSetClientTxLimits(srv, config->max_client_tx_messages,
+                                  config->max_client_tx_bytes, txPolicy);
+
+    virNetServerSetOrderedCalls(srv, config->ordered_client_requests != 0);
+    if (virNetServerSetIOThreads(srv, config->io_threads) < 0 ||
+        virNetServerSetWorkerQueues(srv, config->worker_queues != 0) < 0) {
+        ret = VIR_DAEMON_ERR_INIT;
+        goto cleanup;
+    }
+
     if (!(dmn = virNetDaemonNew()) ||
         virNetDaemonAddServer(dmn, srv) < 0) {
         ret = VIR_DAEMON_ERR_INIT;
@@ -63,6 +63,14 @@ struct daemonClientPrivate {
     daemonClientEventCallbackPtr *storageEventCallbacks;
     size_t nstorageEventCallbacks;
     bool closeRegistered;
+    bool largeStreamChunks; /* set by REMOTE_PROC_CONNECT_ENABLE_FEATURE */
+
+    /* Events of remoteProgram waiting to be sent in one message,
+     * the timer is only set for clients which asked for batches */
+    int eventBatchTimer;
+    remote_connect_event_batch_entry *eventBatch;
+    size_t neventBatch;
+    size_t eventBatchBytes;
 
 # if WITH_SASL
     virNetSASLSessionPtr sasl;
@@ -57,6 +57,9 @@
 
 VIR_LOG_INIT("daemon.remote");
 
+/* Batched events are sent as soon as they add up to this many bytes */
+#define REMOTE_EVENT_BATCH_BYTES_MAX (256 * 1024)
+
 #if SIZEOF_LONG < 8
 # define HYPER_TO_TYPE(_type, _to, _from)                               \
     do {                                                                \
@@ -120,6 +123,13 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
                               xdrproc_t proc,
                               void *data);
 
+static void
+remoteEventBatchClear(struct daemonClientPrivate *priv);
+
+static bool
+remoteEventCoalesce(virNetMessagePtr old,
+                    virNetMessagePtr msg);
+
 static void
 remoteEventCallbackFree(void *opaque)
 {
@@ -1478,6 +1488,7 @@ void remoteClientFreeFunc(void *data)
         virObjectUnref(sysident);
     }
 
+    remoteEventBatchClear(priv);
     VIR_FREE(priv);
 }
 
@@ -1487,6 +1498,16 @@ static void remoteClientCloseFunc(virNetServerClientPtr client)
     struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
 
     daemonRemoveAllClientStreams(priv->streams);
+
+    /* Nothing can be sent anymore, the timer holds a
+     * reference on the client */
+    virMutexLock(&priv->lock);
+    if (priv->eventBatchTimer >= 0) {
+        virEventRemoveTimeout(priv->eventBatchTimer);
+        priv->eventBatchTimer = -1;
+    }
+    remoteEventBatchClear(priv);
+    virMutexUnlock(&priv->lock);
 }
 
 
@@ -1503,8 +1524,10 @@ void *remoteClientInitHook(virNetServerClientPtr client,
         virReportSystemError(errno, "%s", _("unable to init mutex"));
         return NULL;
     }
+    priv->eventBatchTimer = -1;
 
     virNetServerClientSetCloseHook(client, remoteClientCloseFunc);
+    virNetServerClientSetCoalesceFunc(client, remoteEventCoalesce);
     return priv;
 }
 
@@ -3716,12 +3739,17 @@ remoteDispatchConnectDomainEventDeregister(virNetServerPtr server ATTRIBUTE_UNUS
     return rv;
 }
 
+/*
+ * Queue an event message carrying @nevents events for @client. The
+ * message may be dropped if the client cannot keep up with them.
+ */
 static void
-remoteDispatchObjectEventSend(virNetServerClientPtr client,
-                              virNetServerProgramPtr program,
-                              int procnr,
-                              xdrproc_t proc,
-                              void *data)
+remoteDispatchObjectEventSendNow(virNetServerClientPtr client,
+                                 virNetServerProgramPtr program,
+                                 int procnr,
+                                 xdrproc_t proc,
+                                 void *data,
+                                 size_t nevents)
 {
     virNetMessagePtr msg;
 
@@ -3734,6 +3762,7 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
     msg->header.type = VIR_NET_MESSAGE;
     msg->header.serial = 1;
     msg->header.status = VIR_NET_OK;
+    msg->nevents = nevents;
 
     if (virNetMessageEncodeHeader(msg) < 0)
         goto cleanup;
@@ -3742,7 +3771,8 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
         goto cleanup;
 
     VIR_DEBUG("Queue event %d %zu", procnr, msg->bufferLength);
-    virNetServerClientSendMessage(client, msg);
+    if (virNetServerClientSendMessage(client, msg) < 0)
+        goto cleanup;
 
     xdr_free(proc, data);
     return;
@@ -3752,6 +3782,205 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
     xdr_free(proc, data);
 }
 
+
+/*
+ * Events which only report the latest value of something end with
+ * that value, everything before it identifies the callback and the
+ * object. A newer such event thus supersedes a queued one with the
+ * same leading bytes.
+ */
+static bool
+remoteEventCoalesce(virNetMessagePtr old,
+                    virNetMessagePtr msg)
+{
+    size_t valueLen;
+
+    if (old->header.prog != msg->header.prog ||
+        old->header.proc != msg->header.proc ||
+        old->bufferLength != msg->bufferLength ||
+        msg->header.prog != REMOTE_PROGRAM)
+        return false;
+
+    switch ((remote_procedure) msg->header.proc) {
+    case REMOTE_PROC_DOMAIN_EVENT_RTC_CHANGE:
+    case REMOTE_PROC_DOMAIN_EVENT_CALLBACK_RTC_CHANGE:
+    case REMOTE_PROC_DOMAIN_EVENT_BALLOON_CHANGE:
+    case REMOTE_PROC_DOMAIN_EVENT_CALLBACK_BALLOON_CHANGE:
+        valueLen = 8;
+        break;
+    case REMOTE_PROC_DOMAIN_EVENT_CALLBACK_MIGRATION_ITERATION:
+        valueLen = 4;
+        break;
+    default:
+        return false;
+    }
+
+    if (msg->bufferLength < valueLen)
+        return false;
+
+    return memcmp(old->buffer, msg->buffer,
+                  msg->bufferLength - valueLen) == 0;
+}
+
+
+static void
+remoteEventBatchClear(struct daemonClientPrivate *priv)
+{
+    remote_connect_event_batch_msg batch;
+
+    batch.events.events_len = priv->neventBatch;
+    batch.events.events_val = priv->eventBatch;
+    xdr_free((xdrproc_t)xdr_remote_connect_event_batch_msg, (char *)&batch);
+
+    priv->eventBatch = NULL;
+    priv->neventBatch = 0;
+    priv->eventBatchBytes = 0;
+}
+
+
+/*
+ * Must be called with priv->lock held
+ */
+static void
+remoteEventBatchFlushLocked(virNetServerClientPtr client,
+                            struct daemonClientPrivate *priv)
+{
+    remote_connect_event_batch_msg batch;
+
+    if (!priv->neventBatch)
+        return;
+
+    VIR_DEBUG("Sending batch of %zu events, %zu bytes",
+              priv->neventBatch, priv->eventBatchBytes);
+
+    batch.events.events_len = priv->neventBatch;
+    batch.events.events_val = priv->eventBatch;
+    priv->eventBatch = NULL;
+    priv->neventBatch = 0;
+    priv->eventBatchBytes = 0;
+    virEventUpdateTimeout(priv->eventBatchTimer, -1);
+
+    remoteDispatchObjectEventSendNow(client, remoteProgram,
+                                     REMOTE_PROC_CONNECT_EVENT_BATCH,
+                                     (xdrproc_t)xdr_remote_connect_event_batch_msg,
+                                     &batch, batch.events.events_len);
+}
+
+
+static void
+remoteEventBatchTimer(int timer ATTRIBUTE_UNUSED,
+                      void *opaque)
+{
+    virNetServerClientPtr client = opaque;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    virMutexLock(&priv->lock);
+    remoteEventBatchFlushLocked(client, priv);
+    virMutexUnlock(&priv->lock);
+}
+
+
+/*
+ * Encode @data the way it would be encoded as the payload of
+ * a message of its own and append it to the batch of @client.
+ * Must be called with priv->lock held.
+ *
+ * Returns 0 on success, -1 if the event has to be sent on its own.
+ */
+static int
+remoteEventBatchAppendLocked(virNetServerClientPtr client,
+                             struct daemonClientPrivate *priv,
+                             int procnr,
+                             xdrproc_t proc,
+                             void *data)
+{
+    remote_connect_event_batch_entry entry;
+    unsigned int size = 1024;
+    XDR xdr;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.procedure = procnr;
+
+    /* Events are tiny, so the first try almost always fits */
+    for (;;) {
+        bool encoded;
+
+        if (VIR_REALLOC_N(entry.payload.payload_val, size) < 0)
+            goto error;
+
+        xdrmem_create(&xdr, entry.payload.payload_val, size, XDR_ENCODE);
+        encoded = (*proc)(&xdr, data, 0);
+        entry.payload.payload_len = xdr_getpos(&xdr);
+        xdr_destroy(&xdr);
+
+        if (encoded)
+            break;
+
+        if (size >= REMOTE_CONNECT_EVENT_BATCH_PAYLOAD_MAX)
+            goto error;
+        size *= 4;
+        if (size > REMOTE_CONNECT_EVENT_BATCH_PAYLOAD_MAX)
+            size = REMOTE_CONNECT_EVENT_BATCH_PAYLOAD_MAX;
+    }
+
+    if (priv->neventBatch == REMOTE_CONNECT_EVENT_BATCH_MAX ||
+        priv->eventBatchBytes + entry.payload.payload_len >
+        REMOTE_EVENT_BATCH_BYTES_MAX)
+        remoteEventBatchFlushLocked(client, priv);
+
+    priv->eventBatchBytes += entry.payload.payload_len;
+    if (VIR_APPEND_ELEMENT(priv->eventBatch, priv->neventBatch, entry) < 0) {
+        priv->eventBatchBytes -= entry.payload.payload_len;
+        goto error;
+    }
+
+    if (priv->neventBatch == 1)
+        virEventUpdateTimeout(priv->eventBatchTimer, 0);
+
+    xdr_free(proc, data);
+    return 0;
+
+ error:
+    VIR_FREE(entry.payload.payload_val);
+    return -1;
+}
+
+
+/*
+ * Events of clients which asked for batches are held back until
+ * the event loop gets to the batch timer, which is usually once
+ * the event queue of the driver has been flushed completely, and
+ * then sent in a single message.
+ */
+static void
+remoteDispatchObjectEventSend(virNetServerClientPtr client,
+                              virNetServerProgramPtr program,
+                              int procnr,
+                              xdrproc_t proc,
+                              void *data)
+{
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    virMutexLock(&priv->lock);
+
+    if (priv->eventBatchTimer >= 0) {
+        if (program == remoteProgram &&
+            remoteEventBatchAppendLocked(client, priv, procnr,
+                                         proc, data) == 0) {
+            virMutexUnlock(&priv->lock);
+            return;
+        }
+
+        /* Anything sent on its own must not overtake the batch */
+        remoteEventBatchFlushLocked(client, priv);
+    }
+
+    remoteDispatchObjectEventSendNow(client, program, procnr, proc, data, 1);
+    virMutexUnlock(&priv->lock);
+}
+
 static int
 remoteDispatchSecretGetValue(virNetServerPtr server ATTRIBUTE_UNUSED,
                              virNetServerClientPtr client ATTRIBUTE_UNUSED,
@@ -4404,6 +4633,11 @@ static int remoteDispatchConnectSupportsFeature(virNetServerPtr server ATTRIBUTE
         supported = 1;
         break;
 
+    case VIR_DRV_FEATURE_REMOTE_LARGE_STREAM_CHUNKS:
+    case VIR_DRV_FEATURE_REMOTE_EVENT_BATCH:
+        supported = 1;
+        break;
+
     default:
         if ((supported = virConnectSupportsFeature(priv->conn, args->feature)) < 0)
             goto cleanup;
@@ -4421,6 +4655,61 @@ static int remoteDispatchConnectSupportsFeature(virNetServerPtr server ATTRIBUTE
 }
 
 
+static int
+remoteDispatchConnectEnableFeature(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                   virNetServerClientPtr client,
+                                   virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                   virNetMessageErrorPtr rerr,
+                                   remote_connect_enable_feature_args *args,
+                                   remote_connect_enable_feature_ret *ret)
+{
+    int rv = -1;
+    int enabled = 0;
+    unsigned int flags = args->flags;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    /* Only clients which can cope with the behaviour ask for it */
+    virMutexLock(&priv->lock);
+    switch (args->feature) {
+    case VIR_DRV_FEATURE_REMOTE_LARGE_STREAM_CHUNKS:
+        priv->largeStreamChunks = true;
+        enabled = 1;
+        break;
+
+    case VIR_DRV_FEATURE_REMOTE_EVENT_BATCH:
+        if (priv->eventBatchTimer < 0) {
+            priv->eventBatchTimer = virEventAddTimeout(-1, remoteEventBatchTimer,
+                                                       virObjectRef(client),
+                                                       virObjectFreeCallback);
+            if (priv->eventBatchTimer < 0)
+                virObjectUnref(client);
+        }
+        enabled = priv->eventBatchTimer >= 0;
+        break;
+
+    default:
+        break;
+    }
+    virMutexUnlock(&priv->lock);
+
+    ret->enabled = enabled;
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    return rv;
+}
+
+
 static int
 remoteDispatchDomainOpenGraphics(virNetServerPtr server ATTRIBUTE_UNUSED,
                                  virNetServerClientPtr client ATTRIBUTE_UNUSED,
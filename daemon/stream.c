@@ -29,6 +29,8 @@
 #include "virlog.h"
 #include "virnetserverclient.h"
 #include "virerror.h"
+#include "virfile.h"
+#include "fdstream.h"
 
 #define VIR_FROM_THIS VIR_FROM_STREAMS
 
@@ -72,6 +74,17 @@ daemonStreamHandleAbort(virNetServerClientPtr client,
 
 
 
+/* Largest amount of data to send to the client in one message.
+ * Must be called with stream->priv->lock held */
+static size_t
+daemonStreamChunkSize(daemonClientStream *stream)
+{
+    if (stream->priv->largeStreamChunks)
+        return VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
+    return VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+}
+
+
 static void
 daemonStreamUpdateEvents(daemonClientStream *stream)
 {
@@ -713,6 +726,69 @@ daemonStreamHandleWrite(virNetServerClientPtr client,
 
 
 
+/*
+ * When the stream reads from a pipe and the client connection
+ * is neither encrypted nor tunnelled, the data is queued for
+ * splicing straight into the socket instead of being copied
+ * through a message buffer.
+ *
+ * Returns -2 if the data has to be read normally, otherwise
+ * the same as daemonStreamHandleRead
+ */
+static int
+daemonStreamHandleReadSplice(virNetServerClientPtr client,
+                             daemonClientStream *stream)
+{
+    virNetMessagePtr msg;
+    virNetMessageError rerr;
+    size_t len = daemonStreamChunkSize(stream);
+    int fd;
+
+    if (!virNetServerClientHasSplice(client))
+        return -2;
+
+    if ((fd = virFDStreamGetSpliceFD(stream->st, &len)) == -2)
+        return -2;
+
+    memset(&rerr, 0, sizeof(rerr));
+
+    if (!(msg = virNetMessageNew(false))) {
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+
+    if (fd < 0) {
+        if (virNetServerProgramSendStreamError(remoteProgram,
+                                               client,
+                                               msg,
+                                               &rerr,
+                                               stream->procedure,
+                                               stream->serial) < 0) {
+            virNetMessageFree(msg);
+            return -1;
+        }
+        return 0;
+    }
+
+    stream->tx = false;
+
+    msg->cb = daemonStreamMessageFinished;
+    msg->opaque = stream;
+    stream->refs++;
+    if (virNetServerProgramSendStreamSplice(remoteProgram,
+                                            client,
+                                            msg,
+                                            stream->procedure,
+                                            stream->serial,
+                                            fd, len) < 0) {
+        virNetMessageFree(msg);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 /*
  * Invoked when a stream is signalled as having data
  * available to read. This reads up to one message
@@ -730,7 +806,7 @@ daemonStreamHandleRead(virNetServerClientPtr client,
     virNetMessagePtr msg = NULL;
     virNetMessageError rerr;
     char *buffer;
-    size_t bufferLen = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t bufferLen = daemonStreamChunkSize(stream);
     int ret = -1;
     int rv;
 
@@ -749,6 +825,9 @@ daemonStreamHandleRead(virNetServerClientPtr client,
     if (!stream->tx)
         return 0;
 
+    if ((rv = daemonStreamHandleReadSplice(client, stream)) != -2)
+        return rv;
+
     memset(&rerr, 0, sizeof(rerr));
 
     if (VIR_ALLOC_N(buffer, bufferLen) < 0)
@@ -189,6 +189,66 @@ virAdmServerPtr virAdmConnectLookupServer(virAdmConnectPtr conn,
 
 # define VIR_THREADPOOL_JOB_QUEUE_DEPTH "jobQueueDepth"
 
+/**
+ * VIR_THREADPOOL_MESSAGE_POOL_HITS:
+ * Macro for the messagePoolHits attribute: represents the number of RPC
+ * message buffers the daemon took from its pool of released buffers
+ * instead of allocating new ones, as VIR_TYPED_PARAM_ULLONG. The message
+ * pool is shared by all servers of the daemon.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_MESSAGE_POOL_HITS "messagePoolHits"
+
+/**
+ * VIR_THREADPOOL_MESSAGE_POOL_MISSES:
+ * Macro for the messagePoolMisses attribute: represents the number of RPC
+ * message buffers the daemon had to allocate because its pool had no
+ * suitable one, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_MESSAGE_POOL_MISSES "messagePoolMisses"
+
+/**
+ * VIR_THREADPOOL_MESSAGE_POOL_MESSAGES:
+ * Macro for the messagePoolMessages attribute: represents the number of
+ * released RPC messages currently kept for reuse, as VIR_TYPED_PARAM_UINT.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_MESSAGE_POOL_MESSAGES "messagePoolMessages"
+
+/**
+ * VIR_THREADPOOL_MESSAGE_POOL_BUFFERS:
+ * Macro for the messagePoolBuffers attribute: represents the number of
+ * released RPC message buffers currently kept for reuse, as
+ * VIR_TYPED_PARAM_UINT.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_MESSAGE_POOL_BUFFERS "messagePoolBuffers"
+
+/**
+ * VIR_THREADPOOL_MESSAGE_POOL_BYTES:
+ * Macro for the messagePoolBytes attribute: represents the memory held by
+ * the buffers counted in VIR_THREADPOOL_MESSAGE_POOL_BUFFERS, in bytes, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_MESSAGE_POOL_BYTES "messagePoolBytes"
+
 /* Tunables for a server workerpool */
 int virAdmServerGetThreadPoolParameters(virAdmServerPtr srv,
                                         virTypedParameterPtr *params,
@@ -345,6 +405,64 @@ virAdmServerLookupClient(virAdmServerPtr srv,
 
 # define VIR_CLIENT_INFO_SELINUX_CONTEXT "selinux_context"
 
+/* Client transmit queue info */
+
+/**
+ * VIR_CLIENT_INFO_TX_QUEUE_MESSAGES:
+ * Macro represents the number of replies and events queued for sending to
+ * the client, as VIR_TYPED_PARAM_UINT.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_TX_QUEUE_MESSAGES "tx_queue_messages"
+
+/**
+ * VIR_CLIENT_INFO_TX_QUEUE_BYTES:
+ * Macro represents the size in bytes of the replies and events queued for
+ * sending to the client, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_TX_QUEUE_BYTES "tx_queue_bytes"
+
+/**
+ * VIR_CLIENT_INFO_TX_QUEUE_OVERFLOWS:
+ * Macro represents the number of events which found the client's transmit
+ * queue at its limits since the client connected, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_TX_QUEUE_OVERFLOWS "tx_queue_overflows"
+
+/**
+ * VIR_CLIENT_INFO_TX_EVENTS_DROPPED:
+ * Macro represents the number of events dropped to keep the client's
+ * transmit queue within its limits, each event of a dropped batch
+ * counted on its own, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_TX_EVENTS_DROPPED "tx_events_dropped"
+
+/**
+ * VIR_CLIENT_INFO_TX_EVENTS_COALESCED:
+ * Macro represents the number of queued events dropped because a newer
+ * event made them redundant, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_TX_EVENTS_COALESCED "tx_events_coalesced"
+
 int virAdmClientGetInfo(virAdmClientPtr client,
                         virTypedParameterPtr *params,
                         int *nparams,
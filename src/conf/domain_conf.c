@@ -45,6 +45,7 @@
 #include "virfile.h"
 #include "virbitmap.h"
 #include "count-one-bits.h"
+#include "stat-time.h"
 #include "secret_conf.h"
 #include "netdev_vport_profile_conf.h"
 #include "netdev_bandwidth_conf.h"
@@ -17533,6 +17534,328 @@ virDomainObjParseFile(const char *filename,
     return obj;
 }
 
+/*
+ * The status cache is a binary file kept next to the status XML of a
+ * domain, which loading prefers over the XML as long as the XML is
+ * still the one it was written along with:
+ *
+ *   magic, format version                        (32 bits each)
+ *   libvirt version                              (64 bits)
+ *   driver private data version                  (32 bits)
+ *   inode, size, mtime (s, ns) of the status XML (64 bits each)
+ *   state, reason                                (32 bits each)
+ *   pid, taint                                   (64 bits each)
+ *   definition
+ *   driver private data, see binaryFormat
+ *
+ * The definition has no binary form and is stored as its status XML,
+ * everything else the status XML holds is binary. Strings are stored
+ * as their 32 bit length followed by their bytes, a length of
+ * UINT32_MAX standing for NULL. Values are in host byte order, since
+ * only the libvirtd build which wrote a cache will use it.
+ */
+#define VIR_DOMAIN_STATUS_CACHE_MAGIC 0x5344564c /* "LVDS" */
+#define VIR_DOMAIN_STATUS_CACHE_VERSION 1
+#define VIR_DOMAIN_STATUS_CACHE_MAX_SIZE (16 * 1024 * 1024)
+
+
+void
+virDomainStatusCachePutU32(virBufferPtr buf, uint32_t val)
+{
+    virBufferAdd(buf, (const char *) &val, sizeof(val));
+}
+
+
+void
+virDomainStatusCachePutU64(virBufferPtr buf, uint64_t val)
+{
+    virBufferAdd(buf, (const char *) &val, sizeof(val));
+}
+
+
+static void
+virDomainStatusCachePutBytes(virBufferPtr buf, const char *str, size_t len)
+{
+    virDomainStatusCachePutU32(buf, len);
+    virBufferAdd(buf, str, len);
+}
+
+
+void
+virDomainStatusCachePutString(virBufferPtr buf, const char *str)
+{
+    if (!str) {
+        virDomainStatusCachePutU32(buf, UINT32_MAX);
+        return;
+    }
+
+    virDomainStatusCachePutBytes(buf, str, strlen(str));
+}
+
+
+static int
+virDomainStatusCacheGet(virDomainStatusCacheReaderPtr reader,
+                        void *val,
+                        size_t len)
+{
+    if (reader->len - reader->pos < len) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("truncated domain status cache '%s'"),
+                       reader->filename);
+        return -1;
+    }
+
+    memcpy(val, reader->data + reader->pos, len);
+    reader->pos += len;
+    return 0;
+}
+
+
+int
+virDomainStatusCacheGetU32(virDomainStatusCacheReaderPtr reader,
+                           uint32_t *val)
+{
+    return virDomainStatusCacheGet(reader, val, sizeof(*val));
+}
+
+
+int
+virDomainStatusCacheGetU64(virDomainStatusCacheReaderPtr reader,
+                           uint64_t *val)
+{
+    return virDomainStatusCacheGet(reader, val, sizeof(*val));
+}
+
+
+int
+virDomainStatusCacheGetString(virDomainStatusCacheReaderPtr reader,
+                              char **str)
+{
+    uint32_t len;
+
+    *str = NULL;
+
+    if (virDomainStatusCacheGetU32(reader, &len) < 0)
+        return -1;
+
+    if (len == UINT32_MAX)
+        return 0;
+
+    if (reader->len - reader->pos < len) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("truncated domain status cache '%s'"),
+                       reader->filename);
+        return -1;
+    }
+
+    if (VIR_STRNDUP(*str, reader->data + reader->pos, len) < 0)
+        return -1;
+    reader->pos += len;
+    return 0;
+}
+
+
+/* Counts come from the file, don't let them make us allocate more than
+ * it could possibly describe */
+int
+virDomainStatusCacheGetCount(virDomainStatusCacheReaderPtr reader,
+                             size_t *count)
+{
+    uint32_t val;
+
+    if (virDomainStatusCacheGetU32(reader, &val) < 0)
+        return -1;
+
+    if (val > (reader->len - reader->pos) / sizeof(uint32_t)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("malformed domain status cache '%s'"),
+                       reader->filename);
+        return -1;
+    }
+
+    *count = val;
+    return 0;
+}
+
+
+/* Whether @xmlopt lets a status cache hold everything the status XML
+ * does */
+static bool
+virDomainStatusCacheSupported(virDomainXMLOptionPtr xmlopt)
+{
+    return !xmlopt->privateData.parse || xmlopt->privateData.binaryParse;
+}
+
+
+/**
+ * virDomainObjParseStatusCache:
+ * @statusDir: directory holding the status of the domain
+ * @name: name of the domain
+ * @caps: capabilities
+ * @xmlopt: XML parser configuration
+ * @flags: bitwise-OR of virDomainDefParseFlags
+ * @obj: filled with the domain object
+ *
+ * Loads the status of domain @name from its status cache rather than
+ * its status XML. The cache is only used while the status XML in
+ * @statusDir is still the one it was written along with, as the XML
+ * stays the authoritative copy.
+ *
+ * Returns 1 if @obj was loaded, 0 if there is no usable cache and -1
+ * with an error reported if the cache is damaged. In both latter cases
+ * the caller should parse the status XML instead.
+ */
+int
+virDomainObjParseStatusCache(const char *statusDir,
+                             const char *name,
+                             virCapsPtr caps,
+                             virDomainXMLOptionPtr xmlopt,
+                             unsigned int flags,
+                             virDomainObjPtr *obj)
+{
+    virDomainStatusCacheReader reader;
+    char *cacheFile = NULL;
+    char *statusFile = NULL;
+    char *data = NULL;
+    char *defxml = NULL;
+    virDomainObjPtr tmp = NULL;
+    struct stat sb;
+    struct timespec mtime;
+    uint64_t ino, size, mtimeSec, mtimeNsec, pid, taint;
+    uint32_t magic, version, privVersion, state, reason;
+    uint64_t selfvers;
+    int len;
+    int ret = -1;
+
+    *obj = NULL;
+
+    if (!virDomainStatusCacheSupported(xmlopt))
+        return 0;
+
+    if (!(cacheFile = virDomainStatusCacheFile(statusDir, name)) ||
+        !(statusFile = virDomainConfigFile(statusDir, name)))
+        goto cleanup;
+
+    if (!virFileExists(cacheFile)) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if ((len = virFileReadAll(cacheFile, VIR_DOMAIN_STATUS_CACHE_MAX_SIZE,
+                              &data)) < 0)
+        goto cleanup;
+
+    memset(&reader, 0, sizeof(reader));
+    reader.filename = cacheFile;
+    reader.data = data;
+    reader.len = len;
+
+    if (virDomainStatusCacheGetU32(&reader, &magic) < 0)
+        goto cleanup;
+    if (magic != VIR_DOMAIN_STATUS_CACHE_MAGIC) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("'%s' is not a domain status cache"), cacheFile);
+        goto cleanup;
+    }
+
+    if (virDomainStatusCacheGetU32(&reader, &version) < 0 ||
+        virDomainStatusCacheGetU64(&reader, &selfvers) < 0 ||
+        virDomainStatusCacheGetU32(&reader, &privVersion) < 0 ||
+        virDomainStatusCacheGetU64(&reader, &ino) < 0 ||
+        virDomainStatusCacheGetU64(&reader, &size) < 0 ||
+        virDomainStatusCacheGetU64(&reader, &mtimeSec) < 0 ||
+        virDomainStatusCacheGetU64(&reader, &mtimeNsec) < 0)
+        goto cleanup;
+
+    if (version != VIR_DOMAIN_STATUS_CACHE_VERSION ||
+        selfvers != LIBVIR_VERSION_NUMBER ||
+        privVersion != xmlopt->privateData.binaryVersion) {
+        VIR_DEBUG("Status cache '%s' was written by another libvirt",
+                  cacheFile);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (stat(statusFile, &sb) < 0) {
+        VIR_DEBUG("Cannot stat status XML '%s': %d", statusFile, errno);
+        ret = 0;
+        goto cleanup;
+    }
+    mtime = get_stat_mtime(&sb);
+
+    if (ino != (uint64_t) sb.st_ino ||
+        size != (uint64_t) sb.st_size ||
+        mtimeSec != (uint64_t) mtime.tv_sec ||
+        mtimeNsec != (uint64_t) mtime.tv_nsec) {
+        VIR_DEBUG("Status cache '%s' is older than '%s'",
+                  cacheFile, statusFile);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (virDomainStatusCacheGetU32(&reader, &state) < 0 ||
+        virDomainStatusCacheGetU32(&reader, &reason) < 0 ||
+        virDomainStatusCacheGetU64(&reader, &pid) < 0 ||
+        virDomainStatusCacheGetU64(&reader, &taint) < 0)
+        goto cleanup;
+
+    if (state >= VIR_DOMAIN_LAST ||
+        !virDomainStateReasonToString(state, reason)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("invalid domain state %u:%u in '%s'"),
+                       state, reason, cacheFile);
+        goto cleanup;
+    }
+
+    if (taint >> VIR_DOMAIN_TAINT_LAST) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("invalid taint flags 0x%llx in '%s'"),
+                       (unsigned long long) taint, cacheFile);
+        goto cleanup;
+    }
+
+    if (virDomainStatusCacheGetString(&reader, &defxml) < 0)
+        goto cleanup;
+    if (!defxml) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("no domain config in '%s'"), cacheFile);
+        goto cleanup;
+    }
+
+    if (!(tmp = virDomainObjNew(xmlopt)))
+        goto cleanup;
+
+    if (!(tmp->def = virDomainDefParseString(defxml, caps, xmlopt, flags)))
+        goto cleanup;
+
+    virDomainObjSetState(tmp, state, reason);
+    tmp->pid = (pid_t) pid;
+    tmp->taint = taint;
+
+    if (xmlopt->privateData.binaryParse &&
+        xmlopt->privateData.binaryParse(&reader, tmp, &xmlopt->config) < 0)
+        goto cleanup;
+
+    if (reader.pos != reader.len) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("trailing data in domain status cache '%s'"),
+                       cacheFile);
+        goto cleanup;
+    }
+
+    *obj = tmp;
+    tmp = NULL;
+    ret = 1;
+
+ cleanup:
+    virObjectUnref(tmp);
+    VIR_FREE(defxml);
+    VIR_FREE(data);
+    VIR_FREE(cacheFile);
+    VIR_FREE(statusFile);
+    return ret;
+}
+
 
 static bool
 virDomainTimerDefCheckABIStability(virDomainTimerDefPtr src,
@@ -23583,11 +23906,17 @@ virDomainDefFormat(virDomainDefPtr def, virCapsPtr caps, unsigned int flags)
 }
 
 
-char *
-virDomainObjFormat(virDomainXMLOptionPtr xmlopt,
-                   virDomainObjPtr obj,
-                   virCapsPtr caps,
-                   unsigned int flags)
+/*
+ * Like virDomainObjFormat, also returning the offset and length of the
+ * definition within the result in @defStart and @defLen.
+ */
+static char *
+virDomainObjFormatInternal(virDomainXMLOptionPtr xmlopt,
+                           virDomainObjPtr obj,
+                           virCapsPtr caps,
+                           unsigned int flags,
+                           size_t *defStart,
+                           size_t *defLen)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     int state;
@@ -23611,8 +23940,10 @@ virDomainObjFormat(virDomainXMLOptionPtr xmlopt,
         xmlopt->privateData.format(&buf, obj) < 0)
         goto error;
 
+    *defStart = virBufferUse(&buf);
     if (virDomainDefFormatInternal(obj->def, caps, flags, &buf) < 0)
         goto error;
+    *defLen = virBufferUse(&buf) - *defStart;
 
     virBufferAdjustIndent(&buf, -2);
     virBufferAddLit(&buf, "</domstatus>\n");
@@ -23627,6 +23958,20 @@ virDomainObjFormat(virDomainXMLOptionPtr xmlopt,
     return NULL;
 }
 
+
+char *
+virDomainObjFormat(virDomainXMLOptionPtr xmlopt,
+                   virDomainObjPtr obj,
+                   virCapsPtr caps,
+                   unsigned int flags)
+{
+    size_t defStart;
+    size_t defLen;
+
+    return virDomainObjFormatInternal(xmlopt, obj, caps, flags,
+                                      &defStart, &defLen);
+}
+
 static bool
 virDomainDeviceIsUSB(virDomainDeviceDefPtr dev)
 {
@@ -23800,6 +24145,108 @@ virDomainSaveConfig(const char *configDir,
     return ret;
 }
 
+/*
+ * Write the status cache of @obj right after its status XML was saved,
+ * @def pointing to the definition within that XML. The cache is not
+ * synced to disk: should a crash lose or tear it, it no longer matches
+ * the status XML and is ignored.
+ */
+static int
+virDomainSaveStatusCache(virDomainXMLOptionPtr xmlopt,
+                         const char *statusDir,
+                         virDomainObjPtr obj,
+                         const char *def,
+                         size_t deflen)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *statusFile = NULL;
+    char *cacheFile = NULL;
+    char *newFile = NULL;
+    char *data = NULL;
+    size_t len;
+    struct stat sb;
+    struct timespec mtime;
+    int state;
+    int reason;
+    int fd = -1;
+    int ret = -1;
+
+    if (!(statusFile = virDomainConfigFile(statusDir, obj->def->name)) ||
+        !(cacheFile = virDomainStatusCacheFile(statusDir, obj->def->name)) ||
+        virAsprintf(&newFile, "%s.new", cacheFile) < 0)
+        goto cleanup;
+
+    if (stat(statusFile, &sb) < 0) {
+        virReportSystemError(errno, _("cannot stat file '%s'"), statusFile);
+        goto cleanup;
+    }
+    mtime = get_stat_mtime(&sb);
+
+    virDomainStatusCachePutU32(&buf, VIR_DOMAIN_STATUS_CACHE_MAGIC);
+    virDomainStatusCachePutU32(&buf, VIR_DOMAIN_STATUS_CACHE_VERSION);
+    virDomainStatusCachePutU64(&buf, LIBVIR_VERSION_NUMBER);
+    virDomainStatusCachePutU32(&buf, xmlopt->privateData.binaryVersion);
+
+    virDomainStatusCachePutU64(&buf, sb.st_ino);
+    virDomainStatusCachePutU64(&buf, sb.st_size);
+    virDomainStatusCachePutU64(&buf, mtime.tv_sec);
+    virDomainStatusCachePutU64(&buf, mtime.tv_nsec);
+
+    state = virDomainObjGetState(obj, &reason);
+    virDomainStatusCachePutU32(&buf, state);
+    virDomainStatusCachePutU32(&buf, reason);
+    virDomainStatusCachePutU64(&buf, obj->pid);
+    virDomainStatusCachePutU64(&buf, obj->taint);
+
+    virDomainStatusCachePutBytes(&buf, def, deflen);
+
+    if (xmlopt->privateData.binaryFormat &&
+        xmlopt->privateData.binaryFormat(&buf, obj) < 0)
+        goto cleanup;
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+
+    len = virBufferUse(&buf);
+    data = virBufferContentAndReset(&buf);
+
+    if ((fd = open(newFile, O_WRONLY | O_CREAT | O_TRUNC,
+                   S_IRUSR | S_IWUSR)) < 0) {
+        virReportSystemError(errno, _("cannot create file '%s'"), newFile);
+        goto cleanup;
+    }
+
+    if (safewrite(fd, data, len) < 0) {
+        virReportSystemError(errno, _("cannot write data to file '%s'"),
+                             newFile);
+        goto cleanup;
+    }
+
+    if (VIR_CLOSE(fd) < 0) {
+        virReportSystemError(errno, _("cannot save file '%s'"), newFile);
+        goto cleanup;
+    }
+
+    if (rename(newFile, cacheFile) < 0) {
+        virReportSystemError(errno, _("cannot rename file '%s' as '%s'"),
+                             newFile, cacheFile);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    if (ret < 0 && newFile)
+        unlink(newFile);
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(data);
+    VIR_FREE(statusFile);
+    VIR_FREE(cacheFile);
+    VIR_FREE(newFile);
+    return ret;
+}
+
 int
 virDomainSaveStatus(virDomainXMLOptionPtr xmlopt,
                     const char *statusDir,
@@ -23814,13 +24261,25 @@ virDomainSaveStatus(virDomainXMLOptionPtr xmlopt,
 
     int ret = -1;
     char *xml;
+    size_t defStart;
+    size_t defLen;
 
-    if (!(xml = virDomainObjFormat(xmlopt, obj, caps, flags)))
+    if (!(xml = virDomainObjFormatInternal(xmlopt, obj, caps, flags,
+                                           &defStart, &defLen)))
         goto cleanup;
 
     if (virDomainSaveXML(statusDir, obj->def, xml))
         goto cleanup;
 
+    if (statusDir &&
+        virDomainStatusCacheSupported(xmlopt) &&
+        virDomainSaveStatusCache(xmlopt, statusDir, obj,
+                                 xml + defStart, defLen) < 0) {
+        VIR_WARN("Unable to save status cache of domain %s: %s",
+                 obj->def->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
     ret = 0;
  cleanup:
     VIR_FREE(xml);
@@ -23833,7 +24292,7 @@ virDomainDeleteConfig(const char *configDir,
                       const char *autostartDir,
                       virDomainObjPtr dom)
 {
-    char *configFile = NULL, *autostartLink = NULL;
+    char *configFile = NULL, *autostartLink = NULL, *cacheFile = NULL;
     int ret = -1;
 
     if ((configFile = virDomainConfigFile(configDir, dom->def->name)) == NULL)
@@ -23841,11 +24300,18 @@ virDomainDeleteConfig(const char *configDir,
     if ((autostartLink = virDomainConfigFile(autostartDir,
                                              dom->def->name)) == NULL)
         goto cleanup;
+    if ((cacheFile = virDomainStatusCacheFile(configDir,
+                                              dom->def->name)) == NULL)
+        goto cleanup;
 
     /* Not fatal if this doesn't work */
     unlink(autostartLink);
     dom->autostart = 0;
 
+    /* Only status directories have one, and a stale cache is
+     * never used anyway */
+    unlink(cacheFile);
+
     if (unlink(configFile) < 0 &&
         errno != ENOENT) {
         virReportSystemError(errno,
@@ -23859,6 +24325,7 @@ virDomainDeleteConfig(const char *configDir,
  cleanup:
     VIR_FREE(configFile);
     VIR_FREE(autostartLink);
+    VIR_FREE(cacheFile);
     return ret;
 }
 
@@ -23872,6 +24339,16 @@ char
     return ret;
 }
 
+char *
+virDomainStatusCacheFile(const char *dir,
+                         const char *name)
+{
+    char *ret;
+
+    ignore_value(virAsprintf(&ret, "%s/%s.cache", dir, name));
+    return ret;
+}
+
 /* Translates a device name of the form (regex) "[fhv]d[a-z]+" into
  * the corresponding bus,index combination (e.g. sda => (0,0), sdi (1,1),
  *                                               hdd => (1,1), vdaa => (0,26))
@@ -2399,6 +2399,22 @@ typedef int (*virDomainXMLPrivateDataParseFunc)(xmlXPathContextPtr,
                                                 virDomainObjPtr,
                                                 virDomainDefParserConfigPtr);
 
+/* Reads the binary status cache, see virDomainObjParseStatusCache */
+typedef struct _virDomainStatusCacheReader virDomainStatusCacheReader;
+typedef virDomainStatusCacheReader *virDomainStatusCacheReaderPtr;
+struct _virDomainStatusCacheReader {
+    const char *filename;
+    const char *data;
+    size_t len;
+    size_t pos;
+};
+
+typedef int (*virDomainXMLPrivateDataBinaryFormatFunc)(virBufferPtr,
+                                                       virDomainObjPtr);
+typedef int (*virDomainXMLPrivateDataBinaryParseFunc)(virDomainStatusCacheReaderPtr,
+                                                      virDomainObjPtr,
+                                                      virDomainDefParserConfigPtr);
+
 typedef struct _virDomainXMLPrivateDataCallbacks virDomainXMLPrivateDataCallbacks;
 typedef virDomainXMLPrivateDataCallbacks *virDomainXMLPrivateDataCallbacksPtr;
 struct _virDomainXMLPrivateDataCallbacks {
@@ -2408,6 +2424,12 @@ struct _virDomainXMLPrivateDataCallbacks {
     virDomainXMLPrivateDataNewFunc    hostdevNew;
     virDomainXMLPrivateDataFormatFunc format;
     virDomainXMLPrivateDataParseFunc  parse;
+    /* Private data in the binary status cache. Drivers which parse
+     * private data but leave these unset get no status cache. The
+     * version has to change along with the binary format. */
+    virDomainXMLPrivateDataBinaryFormatFunc binaryFormat;
+    virDomainXMLPrivateDataBinaryParseFunc  binaryParse;
+    unsigned int binaryVersion;
 };
 
 virDomainXMLOptionPtr virDomainXMLOptionNew(virDomainDefParserConfigPtr config,
@@ -2648,6 +2670,24 @@ virDomainObjPtr virDomainObjParseFile(const char *filename,
                                       virCapsPtr caps,
                                       virDomainXMLOptionPtr xmlopt,
                                       unsigned int flags);
+int virDomainObjParseStatusCache(const char *statusDir,
+                                 const char *name,
+                                 virCapsPtr caps,
+                                 virDomainXMLOptionPtr xmlopt,
+                                 unsigned int flags,
+                                 virDomainObjPtr *obj);
+
+void virDomainStatusCachePutU32(virBufferPtr buf, uint32_t val);
+void virDomainStatusCachePutU64(virBufferPtr buf, uint64_t val);
+void virDomainStatusCachePutString(virBufferPtr buf, const char *str);
+int virDomainStatusCacheGetU32(virDomainStatusCacheReaderPtr reader,
+                               uint32_t *val);
+int virDomainStatusCacheGetU64(virDomainStatusCacheReaderPtr reader,
+                               uint64_t *val);
+int virDomainStatusCacheGetString(virDomainStatusCacheReaderPtr reader,
+                                  char **str);
+int virDomainStatusCacheGetCount(virDomainStatusCacheReaderPtr reader,
+                                 size_t *count);
 
 bool virDomainDefCheckABIStability(virDomainDefPtr src,
                                    virDomainDefPtr dst);
@@ -2847,6 +2887,8 @@ int virDomainDeleteConfig(const char *configDir,
 
 char *virDomainConfigFile(const char *dir,
                           const char *name);
+char *virDomainStatusCacheFile(const char *dir,
+                               const char *name);
 
 int virDiskNameToBusDeviceIndex(virDomainDiskDefPtr disk,
                                 int *busIdx,
@@ -573,6 +573,22 @@ virDomainEventJobCompletedDispose(void *obj)
 }
 
 
+/* Events which only carry the latest value of some state of the
+ * domain, so that a newer one supersedes any older one */
+static bool
+virDomainEventCanCoalesce(int eventID)
+{
+    switch (eventID) {
+    case VIR_DOMAIN_EVENT_ID_RTC_CHANGE:
+    case VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE:
+    case VIR_DOMAIN_EVENT_ID_MIGRATION_ITERATION:
+        return true;
+    }
+
+    return false;
+}
+
+
 static void *
 virDomainEventNew(virClassPtr klass,
                   int eventID,
@@ -598,6 +614,8 @@ virDomainEventNew(virClassPtr klass,
                                     id, name, uuid)))
         return NULL;
 
+    event->parent.coalesce = virDomainEventCanCoalesce(eventID);
+
     return (virObjectEventPtr)event;
 }
 
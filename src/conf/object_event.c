@@ -60,6 +60,8 @@ struct _virObjectEventState {
     int timer;
     /* Flag if we're in process of dispatching */
     bool isDispatching;
+    /* Drop queued events superseded by newer ones */
+    bool coalesce;
     virMutex lock;
 };
 
@@ -597,6 +599,26 @@ virObjectEventStateNew(void)
 }
 
 
+/**
+ * virObjectEventStateSetCoalesce:
+ * @state: the event state object
+ * @coalesce: whether to coalesce events
+ *
+ * With @coalesce set, an event which was not dispatched yet is
+ * dropped once a newer event of the same type for the same object
+ * is queued, if the type of event only ever describes the latest
+ * state of the object.
+ */
+void
+virObjectEventStateSetCoalesce(virObjectEventStatePtr state,
+                               bool coalesce)
+{
+    virObjectEventStateLock(state);
+    state->coalesce = coalesce;
+    virObjectEventStateUnlock(state);
+}
+
+
 /**
  * virObjectEventNew:
  * @klass: subclass of event to be created
@@ -669,6 +691,37 @@ virObjectEventQueuePush(virObjectEventQueuePtr evtQueue,
 }
 
 
+/**
+ * virObjectEventQueueCoalesce:
+ * @evtQueue: the object event queue
+ * @event: the event about to be added
+ *
+ * Internal function to drop the events of a virObjectEventQueue
+ * which are superseded by @event
+ */
+static void
+virObjectEventQueueCoalesce(virObjectEventQueuePtr evtQueue,
+                            virObjectEventPtr event)
+{
+    size_t i = evtQueue->count;
+
+    while (i-- > 0) {
+        virObjectEventPtr old = evtQueue->events[i];
+
+        if (!old->coalesce ||
+            old->parent.klass != event->parent.klass ||
+            old->eventID != event->eventID ||
+            old->remoteID != event->remoteID ||
+            memcmp(old->meta.uuid, event->meta.uuid, VIR_UUID_BUFLEN) != 0)
+            continue;
+
+        VIR_DEBUG("obj=%p superseded by obj=%p", old, event);
+        virObjectUnref(old);
+        VIR_DELETE_ELEMENT(evtQueue->events, i, evtQueue->count);
+    }
+}
+
+
 static bool
 virObjectEventDispatchMatchCallback(virObjectEventPtr event,
                                     virObjectEventCallbackPtr cb)
@@ -767,6 +820,8 @@ virObjectEventStateQueueRemote(virObjectEventStatePtr state,
     virObjectEventStateLock(state);
 
     event->remoteID = remoteID;
+    if (state->coalesce && event->coalesce)
+        virObjectEventQueueCoalesce(state->queue, event);
     if (virObjectEventQueuePush(state->queue, event) < 0) {
         VIR_DEBUG("Error adding event to queue");
         virObjectUnref(event);
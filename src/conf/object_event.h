@@ -46,6 +46,9 @@ typedef virObjectEventState *virObjectEventStatePtr;
 void virObjectEventStateFree(virObjectEventStatePtr state);
 virObjectEventStatePtr
 virObjectEventStateNew(void);
+void
+virObjectEventStateSetCoalesce(virObjectEventStatePtr state,
+                               bool coalesce);
 
 /**
  * virConnectObjectEventGenericCallback:
@@ -50,6 +50,7 @@ struct _virObjectEvent {
     virObjectMeta meta;
     int remoteID;
     virObjectEventDispatchFunc dispatch;
+    bool coalesce; /* A newer event of the same kind supersedes this one */
 };
 
 /**
@@ -422,16 +422,28 @@ virStoragePoolObjListFree(virStoragePoolObjListPtr pools)
         virStoragePoolObjFree(pools->objs[i]);
     VIR_FREE(pools->objs);
     pools->count = 0;
+
+    virHashFree(pools->objsUUID);
+    virHashFree(pools->objsName);
+    pools->objsUUID = NULL;
+    pools->objsName = NULL;
 }
 
 void
 virStoragePoolObjRemove(virStoragePoolObjListPtr pools,
                         virStoragePoolObjPtr pool)
 {
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
     size_t i;
 
     virStoragePoolObjUnlock(pool);
 
+    virUUIDFormat(pool->def->uuid, uuidstr);
+    if (virHashLookup(pools->objsUUID, uuidstr) == pool)
+        virHashRemoveEntry(pools->objsUUID, uuidstr);
+    if (virHashLookup(pools->objsName, pool->def->name) == pool)
+        virHashRemoveEntry(pools->objsName, pool->def->name);
+
     for (i = 0; i < pools->count; i++) {
         virStoragePoolObjLock(pools->objs[i]);
         if (pools->objs[i] == pool) {
@@ -1698,32 +1710,26 @@ virStoragePoolObjPtr
 virStoragePoolObjFindByUUID(virStoragePoolObjListPtr pools,
                             const unsigned char *uuid)
 {
-    size_t i;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virStoragePoolObjPtr pool;
 
-    for (i = 0; i < pools->count; i++) {
-        virStoragePoolObjLock(pools->objs[i]);
-        if (!memcmp(pools->objs[i]->def->uuid, uuid, VIR_UUID_BUFLEN))
-            return pools->objs[i];
-        virStoragePoolObjUnlock(pools->objs[i]);
-    }
+    virUUIDFormat(uuid, uuidstr);
+    if ((pool = virHashLookup(pools->objsUUID, uuidstr)))
+        virStoragePoolObjLock(pool);
 
-    return NULL;
+    return pool;
 }
 
 virStoragePoolObjPtr
 virStoragePoolObjFindByName(virStoragePoolObjListPtr pools,
                             const char *name)
 {
-    size_t i;
+    virStoragePoolObjPtr pool;
 
-    for (i = 0; i < pools->count; i++) {
-        virStoragePoolObjLock(pools->objs[i]);
-        if (STREQ(pools->objs[i]->def->name, name))
-            return pools->objs[i];
-        virStoragePoolObjUnlock(pools->objs[i]);
-    }
+    if ((pool = virHashLookup(pools->objsName, name)))
+        virStoragePoolObjLock(pool);
 
-    return NULL;
+    return pool;
 }
 
 virStoragePoolObjPtr
@@ -1742,60 +1748,222 @@ virStoragePoolSourceFindDuplicateDevices(virStoragePoolObjPtr pool,
     return NULL;
 }
 
+/*
+ * Free the volumes of @vols and empty it. Slots which are NULL
+ * are skipped, which lets callers keep some of the volumes.
+ */
+void
+virStorageVolDefListClear(virStorageVolDefListPtr vols)
+{
+    size_t i;
+    for (i = 0; i < vols->count; i++)
+        virStorageVolDefFree(vols->objs[i]);
+
+    VIR_FREE(vols->objs);
+    vols->count = 0;
+
+    virHashFree(vols->objsKey);
+    virHashFree(vols->objsName);
+    virHashFree(vols->objsPath);
+    vols->objsKey = NULL;
+    vols->objsName = NULL;
+    vols->objsPath = NULL;
+}
+
 void
 virStoragePoolObjClearVols(virStoragePoolObjPtr pool)
 {
+    virStorageVolDefListClear(&pool->volumes);
+}
+
+/*
+ * Move the volumes of @pool to @vols, leaving the pool without
+ * volumes. @vols must be released with virStorageVolDefListClear.
+ */
+void
+virStoragePoolObjTakeVols(virStoragePoolObjPtr pool,
+                          virStorageVolDefListPtr vols)
+{
+    *vols = pool->volumes;
+    memset(&pool->volumes, 0, sizeof(pool->volumes));
+}
+
+
+/*
+ * Make @name resolve to @payload in @table, creating the table on
+ * first use. An existing mapping is kept, so that, as with a scan
+ * of the list, the first object added under a name wins.
+ */
+static int
+virStorageObjIndexAdd(virHashTablePtr *table,
+                      const char *name,
+                      void *payload)
+{
+    if (!name)
+        return 0;
+
+    if (!*table && !(*table = virHashCreate(50, NULL)))
+        return -1;
+
+    if (virHashLookup(*table, name))
+        return 0;
+
+    return virHashAddEntry(*table, name, payload);
+}
+
+
+typedef const char *(*virStorageVolDefFieldFunc)(virStorageVolDefPtr vol);
+
+static const char *
+virStorageVolDefGetKey(virStorageVolDefPtr vol)
+{
+    return vol->key;
+}
+
+static const char *
+virStorageVolDefGetName(virStorageVolDefPtr vol)
+{
+    return vol->name;
+}
+
+static const char *
+virStorageVolDefGetPath(virStorageVolDefPtr vol)
+{
+    return vol->target.path;
+}
+
+
+/*
+ * Drop the mapping for @vol from @table, handing the name over to
+ * the first remaining volume sharing it, if any.
+ */
+static void
+virStorageVolDefListIndexRemove(virStorageVolDefListPtr list,
+                                virHashTablePtr table,
+                                virStorageVolDefFieldFunc field,
+                                virStorageVolDefPtr vol)
+{
+    const char *name = field(vol);
     size_t i;
-    for (i = 0; i < pool->volumes.count; i++)
-        virStorageVolDefFree(pool->volumes.objs[i]);
 
-    VIR_FREE(pool->volumes.objs);
-    pool->volumes.count = 0;
+    if (!name || virHashLookup(table, name) != vol)
+        return;
+
+    for (i = 0; i < list->count; i++) {
+        const char *other = field(list->objs[i]);
+
+        if (list->objs[i] != vol && other && STREQ(other, name)) {
+            ignore_value(virHashUpdateEntry(table, name, list->objs[i]));
+            return;
+        }
+    }
+
+    virHashRemoveEntry(table, name);
 }
 
-virStorageVolDefPtr
-virStorageVolDefFindByKey(virStoragePoolObjPtr pool,
-                          const char *key)
+
+static void
+virStoragePoolObjUnindexVol(virStoragePoolObjPtr pool,
+                            virStorageVolDefPtr vol)
+{
+    virStorageVolDefListPtr list = &pool->volumes;
+
+    virStorageVolDefListIndexRemove(list, list->objsKey,
+                                    virStorageVolDefGetKey, vol);
+    virStorageVolDefListIndexRemove(list, list->objsName,
+                                    virStorageVolDefGetName, vol);
+    virStorageVolDefListIndexRemove(list, list->objsPath,
+                                    virStorageVolDefGetPath, vol);
+}
+
+
+/**
+ * virStoragePoolObjAddVol:
+ * @pool: locked pool object
+ * @vol: volume definition
+ *
+ * Append @vol to the volumes of @pool, which takes over ownership
+ * of it. The key, name and target path of @vol must be filled in
+ * already and must not change while it is part of the pool.
+ *
+ * Returns 0 on success, -1 on error in which case @vol is still
+ * owned by the caller.
+ */
+int
+virStoragePoolObjAddVol(virStoragePoolObjPtr pool,
+                        virStorageVolDefPtr vol)
+{
+    virStorageVolDefListPtr list = &pool->volumes;
+
+    if (virStorageObjIndexAdd(&list->objsKey, vol->key, vol) < 0 ||
+        virStorageObjIndexAdd(&list->objsName, vol->name, vol) < 0 ||
+        virStorageObjIndexAdd(&list->objsPath, vol->target.path, vol) < 0)
+        goto error;
+
+    if (VIR_APPEND_ELEMENT_COPY(list->objs, list->count, vol) < 0)
+        goto error;
+
+    return 0;
+
+ error:
+    virStoragePoolObjUnindexVol(pool, vol);
+    return -1;
+}
+
+
+/**
+ * virStoragePoolObjRemoveVol:
+ * @pool: locked pool object
+ * @vol: volume definition
+ *
+ * Remove @vol from the volumes of @pool and free it.
+ */
+void
+virStoragePoolObjRemoveVol(virStoragePoolObjPtr pool,
+                           virStorageVolDefPtr vol)
 {
     size_t i;
 
-    for (i = 0; i < pool->volumes.count; i++)
-        if (STREQ(pool->volumes.objs[i]->key, key))
-            return pool->volumes.objs[i];
+    for (i = 0; i < pool->volumes.count; i++) {
+        if (pool->volumes.objs[i] == vol) {
+            VIR_INFO("Deleting volume '%s' from storage pool '%s'",
+                     vol->name, pool->def->name);
+            virStoragePoolObjUnindexVol(pool, vol);
+            virStorageVolDefFree(vol);
 
-    return NULL;
+            VIR_DELETE_ELEMENT(pool->volumes.objs, i, pool->volumes.count);
+            break;
+        }
+    }
+}
+
+
+virStorageVolDefPtr
+virStorageVolDefFindByKey(virStoragePoolObjPtr pool,
+                          const char *key)
+{
+    return virHashLookup(pool->volumes.objsKey, key);
 }
 
 virStorageVolDefPtr
 virStorageVolDefFindByPath(virStoragePoolObjPtr pool,
                            const char *path)
 {
-    size_t i;
-
-    for (i = 0; i < pool->volumes.count; i++)
-        if (STREQ(pool->volumes.objs[i]->target.path, path))
-            return pool->volumes.objs[i];
-
-    return NULL;
+    return virHashLookup(pool->volumes.objsPath, path);
 }
 
 virStorageVolDefPtr
 virStorageVolDefFindByName(virStoragePoolObjPtr pool,
                            const char *name)
 {
-    size_t i;
-
-    for (i = 0; i < pool->volumes.count; i++)
-        if (STREQ(pool->volumes.objs[i]->name, name))
-            return pool->volumes.objs[i];
-
-    return NULL;
+    return virHashLookup(pool->volumes.objsName, name);
 }
 
 virStoragePoolObjPtr
 virStoragePoolObjAssignDef(virStoragePoolObjListPtr pools,
                            virStoragePoolDefPtr def)
 {
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
     virStoragePoolObjPtr pool;
 
     if ((pool = virStoragePoolObjFindByName(pools, def->name))) {
@@ -1821,14 +1989,26 @@ virStoragePoolObjAssignDef(virStoragePoolObjListPtr pools,
     virStoragePoolObjLock(pool);
     pool->active = 0;
 
-    if (VIR_APPEND_ELEMENT_COPY(pools->objs, pools->count, pool) < 0) {
-        virStoragePoolObjUnlock(pool);
-        virStoragePoolObjFree(pool);
-        return NULL;
-    }
+    virUUIDFormat(def->uuid, uuidstr);
+    if (virStorageObjIndexAdd(&pools->objsUUID, uuidstr, pool) < 0)
+        goto error;
+    if (virStorageObjIndexAdd(&pools->objsName, def->name, pool) < 0)
+        goto error;
+
+    if (VIR_APPEND_ELEMENT_COPY(pools->objs, pools->count, pool) < 0)
+        goto error;
     pool->def = def;
 
     return pool;
+
+ error:
+    if (virHashLookup(pools->objsUUID, uuidstr) == pool)
+        virHashRemoveEntry(pools->objsUUID, uuidstr);
+    if (virHashLookup(pools->objsName, def->name) == pool)
+        virHashRemoveEntry(pools->objsName, def->name);
+    virStoragePoolObjUnlock(pool);
+    virStoragePoolObjFree(pool);
+    return NULL;
 }
 
 static virStoragePoolObjPtr
@@ -29,6 +29,7 @@
 # include "virstoragefile.h"
 # include "virbitmap.h"
 # include "virthread.h"
+# include "virhash.h"
 # include "device_conf.h"
 # include "node_device_conf.h"
 # include "object_event.h"
@@ -71,6 +72,17 @@ struct _virStorageVolDef {
 
     virStorageVolSource source;
     virStorageSource target;
+
+    /* stat() of the target when it was last probed, so that
+     * a refresh can skip files which did not change since */
+    struct {
+        bool valid;
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        struct timespec mtime;
+        struct timespec ctime;
+    } probed;
 };
 
 typedef struct _virStorageVolDefList virStorageVolDefList;
@@ -78,6 +90,12 @@ typedef virStorageVolDefList *virStorageVolDefListPtr;
 struct _virStorageVolDefList {
     size_t count;
     virStorageVolDefPtr *objs;
+
+    /* key, name and path -> virStorageVolDef mappings for
+     * O(1) lookup. They do not own the volumes, @objs does */
+    virHashTablePtr objsKey;
+    virHashTablePtr objsName;
+    virHashTablePtr objsPath;
 };
 
 VIR_ENUM_DECL(virStorageVol)
@@ -283,6 +301,11 @@ typedef virStoragePoolObjList *virStoragePoolObjListPtr;
 struct _virStoragePoolObjList {
     size_t count;
     virStoragePoolObjPtr *objs;
+
+    /* uuid string and name -> virStoragePoolObj mappings for
+     * O(1) lookup. They do not own the pools, @objs does */
+    virHashTablePtr objsUUID;
+    virHashTablePtr objsName;
 };
 
 typedef struct _virStorageDriverState virStorageDriverState;
@@ -300,6 +323,12 @@ struct _virStorageDriverState {
 
     /* Immutable pointer, self-locking APIs */
     virObjectEventStatePtr storageEventState;
+
+    /* pool name -> watch on the target directory of an active
+     * pool. Pools are started and stopped without holding @lock,
+     * so this has a lock of its own */
+    virMutex watchLock;
+    virHashTablePtr poolWatches;
 };
 
 typedef struct _virStoragePoolSourceList virStoragePoolSourceList;
@@ -351,6 +380,14 @@ virStorageVolDefFindByName(virStoragePoolObjPtr pool,
                            const char *name);
 
 void virStoragePoolObjClearVols(virStoragePoolObjPtr pool);
+void virStoragePoolObjTakeVols(virStoragePoolObjPtr pool,
+                               virStorageVolDefListPtr vols);
+void virStorageVolDefListClear(virStorageVolDefListPtr vols);
+int virStoragePoolObjAddVol(virStoragePoolObjPtr pool,
+                            virStorageVolDefPtr vol)
+    ATTRIBUTE_RETURN_CHECK;
+void virStoragePoolObjRemoveVol(virStoragePoolObjPtr pool,
+                                virStorageVolDefPtr vol);
 
 virStoragePoolDefPtr virStoragePoolDefParseString(const char *xml);
 virStoragePoolDefPtr virStoragePoolDefParseFile(const char *filename);
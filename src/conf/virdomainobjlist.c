@@ -26,10 +26,12 @@
 
 #include "internal.h"
 #include "datatypes.h"
+#include "intprops.h"
 #include "virdomainobjlist.h"
 #include "snapshot_conf.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virhostcpu.h"
 #include "virlog.h"
 #include "virstring.h"
 
@@ -42,7 +44,7 @@ static void virDomainObjListDispose(void *obj);
 
 
 struct _virDomainObjList {
-    virObjectLockable parent;
+    virObjectRWLockable parent;
 
     /* uuid string -> virDomainObj  mapping
      * for O(1), lockless lookup-by-uuid */
@@ -51,12 +53,17 @@ struct _virDomainObjList {
     /* name -> virDomainObj mapping for O(1),
      * lockless lookup-by-name */
     virHashTable *objsName;
+
+    /* id string -> virDomainObj mapping for O(1) lookup-by-id.
+     * Drivers assign def->id directly, so entries are only hints
+     * that are validated on lookup and repaired when stale */
+    virHashTable *objsID;
 };
 
 
 static int virDomainObjListOnceInit(void)
 {
-    if (!(virDomainObjListClass = virClassNew(virClassForObjectLockable(),
+    if (!(virDomainObjListClass = virClassNew(virClassForObjectRWLockable(),
                                               "virDomainObjList",
                                               sizeof(virDomainObjList),
                                               virDomainObjListDispose)))
@@ -74,11 +81,12 @@ virDomainObjListPtr virDomainObjListNew(void)
     if (virDomainObjListInitialize() < 0)
         return NULL;
 
-    if (!(doms = virObjectLockableNew(virDomainObjListClass)))
+    if (!(doms = virObjectRWLockableNew(virDomainObjListClass)))
         return NULL;
 
     if (!(doms->objs = virHashCreate(50, virObjectFreeHashData)) ||
-        !(doms->objsName = virHashCreate(50, virObjectFreeHashData))) {
+        !(doms->objsName = virHashCreate(50, virObjectFreeHashData)) ||
+        !(doms->objsID = virHashCreate(50, virObjectFreeHashData))) {
         virObjectUnref(doms);
         return NULL;
     }
@@ -93,6 +101,7 @@ static void virDomainObjListDispose(void *obj)
 
     virHashFree(doms->objs);
     virHashFree(doms->objsName);
+    virHashFree(doms->objsID);
 }
 
 
@@ -112,17 +121,119 @@ static int virDomainObjListSearchID(const void *payload,
     return want;
 }
 
+static int virDomainObjListSearchObj(const void *payload,
+                                     const void *name ATTRIBUTE_UNUSED,
+                                     const void *data)
+{
+    return payload == data;
+}
+
+
+/*
+ * virDomainObjListIndexID:
+ *
+ * Record @obj as the domain running with @id. Failure to
+ * update the index is not fatal as lookups fall back to
+ * a full scan. The caller must hold the lock on @doms.
+ */
+static void
+virDomainObjListIndexID(virDomainObjListPtr doms,
+                        virDomainObjPtr obj,
+                        int id)
+{
+    char idstr[INT_BUFSIZE_BOUND(id)];
+
+    if (id < 0)
+        return;
+
+    snprintf(idstr, sizeof(idstr), "%d", id);
+    if (virHashUpdateEntry(doms->objsID, idstr, obj) < 0) {
+        virResetLastError();
+        return;
+    }
+    virObjectRef(obj);
+}
+
+
+/*
+ * virDomainObjListLookupIDIndex:
+ *
+ * Return the domain the ID index records for @id if it is
+ * still running with that ID, NULL otherwise. The index is
+ * not modified, so a shared lock on @doms is sufficient.
+ */
+static virDomainObjPtr
+virDomainObjListLookupIDIndex(virDomainObjListPtr doms,
+                              int id)
+{
+    char idstr[INT_BUFSIZE_BOUND(id)];
+    virDomainObjPtr obj;
+
+    if (id < 0)
+        return NULL;
+
+    snprintf(idstr, sizeof(idstr), "%d", id);
+    if ((obj = virHashLookup(doms->objsID, idstr)) &&
+        virDomainObjListSearchID(obj, NULL, &id))
+        return obj;
+
+    return NULL;
+}
+
+
+/*
+ * virDomainObjListLookupID:
+ *
+ * Find the active domain with @id, consulting the ID index
+ * first and falling back to scanning all domains if the
+ * index has no valid entry. The caller must hold the
+ * exclusive lock on @doms.
+ */
+static virDomainObjPtr
+virDomainObjListLookupID(virDomainObjListPtr doms,
+                         int id)
+{
+    char idstr[INT_BUFSIZE_BOUND(id)];
+    virDomainObjPtr obj;
+
+    if (id < 0)
+        return NULL;
+
+    snprintf(idstr, sizeof(idstr), "%d", id);
+    if ((obj = virHashLookup(doms->objsID, idstr))) {
+        if (virDomainObjListSearchID(obj, NULL, &id))
+            return obj;
+        /* The domain was stopped or restarted under a new ID */
+        virHashRemoveEntry(doms->objsID, idstr);
+    }
+
+    if ((obj = virHashSearch(doms->objs, virDomainObjListSearchID, &id)))
+        virDomainObjListIndexID(doms, obj, id);
+
+    return obj;
+}
+
+
 static virDomainObjPtr
 virDomainObjListFindByIDInternal(virDomainObjListPtr doms,
                                  int id,
                                  bool ref)
 {
     virDomainObjPtr obj;
-    virObjectLock(doms);
-    obj = virHashSearch(doms->objs, virDomainObjListSearchID, &id);
+
+    if (id < 0)
+        return NULL;
+
+    /* Only a stale or missing index entry needs the exclusive lock */
+    virObjectRWLockRead(doms);
+    if (!(obj = virDomainObjListLookupIDIndex(doms, id))) {
+        virObjectRWUnlock(doms);
+        virObjectRWLockWrite(doms);
+        obj = virDomainObjListLookupID(doms, id);
+    }
     if (ref) {
         virObjectRef(obj);
-        virObjectUnlock(doms);
+        virObjectRWUnlock(doms);
     }
     if (obj) {
         virObjectLock(obj);
@@ -134,7 +245,7 @@ virDomainObjListFindByIDInternal(virDomainObjListPtr doms,
         }
     }
     if (!ref)
-        virObjectUnlock(doms);
+        virObjectRWUnlock(doms);
     return obj;
 }
 
@@ -160,13 +271,13 @@ virDomainObjListFindByUUIDInternal(virDomainObjListPtr doms,
     char uuidstr[VIR_UUID_STRING_BUFLEN];
     virDomainObjPtr obj;
 
-    virObjectLock(doms);
+    virObjectRWLockRead(doms);
     virUUIDFormat(uuid, uuidstr);
 
     obj = virHashLookup(doms->objs, uuidstr);
     if (ref) {
         virObjectRef(obj);
-        virObjectUnlock(doms);
+        virObjectRWUnlock(doms);
     }
     if (obj) {
         virObjectLock(obj);
@@ -178,7 +289,7 @@ virDomainObjListFindByUUIDInternal(virDomainObjListPtr doms,
         }
     }
     if (!ref)
-        virObjectUnlock(doms);
+        virObjectRWUnlock(doms);
     return obj;
 }
 
@@ -204,10 +315,10 @@ virDomainObjPtr virDomainObjListFindByName(virDomainObjListPtr doms,
 {
     virDomainObjPtr obj;
 
-    virObjectLock(doms);
+    virObjectRWLockRead(doms);
     obj = virHashLookup(doms->objsName, name);
     virObjectRef(obj);
-    virObjectUnlock(doms);
+    virObjectRWUnlock(doms);
     if (obj) {
         virObjectLock(obj);
         if (obj->removing) {
@@ -309,6 +420,10 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
          * reference counter */
         virObjectRef(vm);
     }
+
+    if (flags & VIR_DOMAIN_OBJ_LIST_ADD_LIVE)
+        virDomainObjListIndexID(doms, vm, vm->def->id);
+
  cleanup:
     return vm;
 
@@ -327,9 +442,9 @@ virDomainObjPtr virDomainObjListAdd(virDomainObjListPtr doms,
 {
     virDomainObjPtr ret;
 
-    virObjectLock(doms);
+    virObjectRWLockWrite(doms);
     ret = virDomainObjListAddLocked(doms, def, xmlopt, flags, oldDef);
-    virObjectUnlock(doms);
+    virObjectRWUnlock(doms);
     return ret;
 }
 
@@ -349,13 +464,14 @@ void virDomainObjListRemove(virDomainObjListPtr doms,
     virObjectRef(dom);
     virObjectUnlock(dom);
 
-    virObjectLock(doms);
+    virObjectRWLockWrite(doms);
     virObjectLock(dom);
     virHashRemoveEntry(doms->objs, uuidstr);
     virHashRemoveEntry(doms->objsName, dom->def->name);
+    virHashRemoveSet(doms->objsID, virDomainObjListSearchObj, dom);
     virObjectUnlock(dom);
     virObjectUnref(dom);
-    virObjectUnlock(doms);
+    virObjectRWUnlock(doms);
 }
 
 
@@ -394,7 +510,7 @@ virDomainObjListRename(virDomainObjListPtr doms,
      * hold a lock on dom but not refcount it. */
     virObjectRef(dom);
     virObjectUnlock(dom);
-    virObjectLock(doms);
+    virObjectRWLockWrite(doms);
     virObjectLock(dom);
     virObjectUnref(dom);
 
@@ -420,7 +536,7 @@ virDomainObjListRename(virDomainObjListPtr doms,
 
     ret = 0;
  cleanup:
-    virObjectUnlock(doms);
+    virObjectRWUnlock(doms);
     VIR_FREE(old_name);
     return ret;
 }
@@ -440,119 +556,247 @@ void virDomainObjListRemoveLocked(virDomainObjListPtr doms,
 
     virHashRemoveEntry(doms->objs, uuidstr);
     virHashRemoveEntry(doms->objsName, dom->def->name);
+    virHashRemoveSet(doms->objsID, virDomainObjListSearchObj, dom);
     virObjectUnlock(dom);
 }
 
 
-static virDomainObjPtr
-virDomainObjListLoadConfig(virDomainObjListPtr doms,
-                           virCapsPtr caps,
-                           virDomainXMLOptionPtr xmlopt,
-                           const char *configDir,
-                           const char *autostartDir,
-                           const char *name,
-                           virDomainLoadConfigNotify notify,
-                           void *opaque)
+/* Most threads parsing the files of a config or status directory */
+#define VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS 16
+
+/* A file of a config or status directory. Files are parsed in
+ * parallel and only then added to the list, one after another */
+typedef struct _virDomainObjListLoadFile virDomainObjListLoadFile;
+typedef virDomainObjListLoadFile *virDomainObjListLoadFilePtr;
+struct _virDomainObjListLoadFile {
+    char *name;
+
+    virDomainDefPtr def;    /* Config */
+    int autostart;
+    virDomainObjPtr obj;    /* Status */
+};
+
+typedef struct _virDomainObjListLoadData virDomainObjListLoadData;
+typedef virDomainObjListLoadData *virDomainObjListLoadDataPtr;
+struct _virDomainObjListLoadData {
+    const char *configDir;
+    const char *autostartDir;
+    int liveStatus;
+    virCapsPtr caps;
+    virDomainXMLOptionPtr xmlopt;
+
+    virDomainObjListLoadFilePtr files;
+    size_t nfiles;
+
+    virMutex lock;
+    size_t next;
+};
+
+
+static void
+virDomainObjListParseConfig(virDomainObjListLoadDataPtr data,
+                            virDomainObjListLoadFilePtr file)
 {
     char *configFile = NULL, *autostartLink = NULL;
     virDomainDefPtr def = NULL;
-    virDomainObjPtr dom;
     int autostart;
-    virDomainDefPtr oldDef = NULL;
 
-    if ((configFile = virDomainConfigFile(configDir, name)) == NULL)
-        goto error;
-    if (!(def = virDomainDefParseFile(configFile, caps, xmlopt,
+    if ((configFile = virDomainConfigFile(data->configDir, file->name)) == NULL)
+        goto cleanup;
+    if (!(def = virDomainDefParseFile(configFile, data->caps, data->xmlopt,
                                       VIR_DOMAIN_DEF_PARSE_INACTIVE |
                                       VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
                                       VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)))
-        goto error;
+        goto cleanup;
 
-    if ((autostartLink = virDomainConfigFile(autostartDir, name)) == NULL)
-        goto error;
+    if ((autostartLink = virDomainConfigFile(data->autostartDir,
+                                             file->name)) == NULL)
+        goto cleanup;
 
     if ((autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
-        goto error;
+        goto cleanup;
+
+    file->def = def;
+    file->autostart = autostart;
+    def = NULL;
+
+ cleanup:
+    VIR_FREE(configFile);
+    VIR_FREE(autostartLink);
+    virDomainDefFree(def);
+}
+
+
+static virDomainObjPtr
+virDomainObjListLoadConfig(virDomainObjListPtr doms,
+                           virDomainXMLOptionPtr xmlopt,
+                           virDomainObjListLoadFilePtr file,
+                           virDomainLoadConfigNotify notify,
+                           void *opaque)
+{
+    virDomainObjPtr dom;
+    virDomainDefPtr oldDef = NULL;
 
-    if (!(dom = virDomainObjListAddLocked(doms, def, xmlopt, 0, &oldDef)))
-        goto error;
+    if (!(dom = virDomainObjListAddLocked(doms, file->def, xmlopt, 0, &oldDef)))
+        return NULL;
+    file->def = NULL;
 
-    dom->autostart = autostart;
+    dom->autostart = file->autostart;
 
     if (notify)
         (*notify)(dom, oldDef == NULL, opaque);
 
     virDomainDefFree(oldDef);
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
     return dom;
+}
 
- error:
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
-    virDomainDefFree(def);
-    return NULL;
+
+static void
+virDomainObjListParseStatus(virDomainObjListLoadDataPtr data,
+                            virDomainObjListLoadFilePtr file)
+{
+    unsigned int flags = VIR_DOMAIN_DEF_PARSE_STATUS |
+                         VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
+                         VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
+                         VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
+                         VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
+    char *statusFile = NULL;
+
+    if (virDomainObjParseStatusCache(data->configDir, file->name,
+                                     data->caps, data->xmlopt, flags,
+                                     &file->obj) > 0)
+        return;
+
+    /* The status XML is authoritative, a damaged cache doesn't matter */
+    if (virGetLastError()) {
+        VIR_WARN("Ignoring status cache of domain %s: %s",
+                 file->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    if ((statusFile = virDomainConfigFile(data->configDir, file->name)) == NULL)
+        return;
+
+    file->obj = virDomainObjParseFile(statusFile, data->caps, data->xmlopt,
+                                      flags);
+
+    VIR_FREE(statusFile);
 }
 
 
 static virDomainObjPtr
 virDomainObjListLoadStatus(virDomainObjListPtr doms,
-                           const char *statusDir,
-                           const char *name,
-                           virCapsPtr caps,
-                           virDomainXMLOptionPtr xmlopt,
+                           virDomainObjListLoadFilePtr file,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    char *statusFile = NULL;
-    virDomainObjPtr obj = NULL;
+    virDomainObjPtr obj = file->obj;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-    if ((statusFile = virDomainConfigFile(statusDir, name)) == NULL)
-        goto error;
-
-    if (!(obj = virDomainObjParseFile(statusFile, caps, xmlopt,
-                                      VIR_DOMAIN_DEF_PARSE_STATUS |
-                                      VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
-                                      VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)))
-        goto error;
-
     virUUIDFormat(obj->def->uuid, uuidstr);
 
     if (virHashLookup(doms->objs, uuidstr) != NULL) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("unexpected domain %s already exists"),
                        obj->def->name);
-        goto error;
+        return NULL;
     }
 
     if (virHashAddEntry(doms->objs, uuidstr, obj) < 0)
-        goto error;
+        return NULL;
 
     if (virHashAddEntry(doms->objsName, obj->def->name, obj) < 0) {
         virHashRemoveEntry(doms->objs, uuidstr);
-        goto error;
+        return NULL;
     }
 
     /* Since domain is in two hash tables, increment the
      * reference counter */
     virObjectRef(obj);
+    file->obj = NULL;
 
     if (notify)
         (*notify)(obj, 1, opaque);
 
-    VIR_FREE(statusFile);
     return obj;
+}
 
- error:
-    virObjectUnref(obj);
-    VIR_FREE(statusFile);
-    return NULL;
+
+static void
+virDomainObjListParseWorker(void *opaque)
+{
+    virDomainObjListLoadDataPtr data = opaque;
+
+    while (true) {
+        size_t i;
+
+        virMutexLock(&data->lock);
+        i = data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (i >= data->nfiles)
+            break;
+
+        /* NB: ignoring errors, so one malformed config doesn't
+           kill the whole process */
+        VIR_INFO("Loading config file '%s.xml'", data->files[i].name);
+        if (data->liveStatus)
+            virDomainObjListParseStatus(data, &data->files[i]);
+        else
+            virDomainObjListParseConfig(data, &data->files[i]);
+    }
+}
+
+
+/*
+ * Parse all files of @data, spread over a thread per CPU. The
+ * calling thread takes part too, so that failing to spawn the
+ * others only makes things slower.
+ */
+static int
+virDomainObjListParseFiles(virDomainObjListLoadDataPtr data)
+{
+    virThread workers[VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS - 1];
+    size_t maxworkers = ARRAY_CARDINALITY(workers);
+    size_t nworkers = 0;
+    size_t i;
+    int ncpus;
+
+    if (virMutexInit(&data->lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        return -1;
+    }
+
+    if ((ncpus = virHostCPUGetCount()) > 0 &&
+        ncpus - 1 < maxworkers)
+        maxworkers = ncpus - 1;
+    else if (ncpus < 0)
+        virResetLastError();
+
+    while (nworkers < maxworkers &&
+           nworkers + 1 < data->nfiles) {
+        if (virThreadCreate(&workers[nworkers], true,
+                            virDomainObjListParseWorker, data) < 0) {
+            VIR_WARN("Failed to create thread to load domain configs");
+            break;
+        }
+        nworkers++;
+    }
+
+    virDomainObjListParseWorker(data);
+
+    for (i = 0; i < nworkers; i++)
+        virThreadJoin(&workers[i]);
+
+    virMutexDestroy(&data->lock);
+    return 0;
 }
 
 
+/*
+ * The files are parsed in parallel first, without holding the
+ * list lock, and the domains then added in directory order.
+ */
 int
 virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                const char *configDir,
@@ -563,8 +807,16 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                virDomainLoadConfigNotify notify,
                                void *opaque)
 {
+    virDomainObjListLoadData data = {
+        .configDir = configDir,
+        .autostartDir = autostartDir,
+        .liveStatus = liveStatus,
+        .caps = caps,
+        .xmlopt = xmlopt,
+    };
     DIR *dir;
     struct dirent *entry;
+    size_t i;
     int ret = -1;
     int rc;
 
@@ -573,34 +825,38 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
     if ((rc = virDirOpenIfExists(&dir, configDir)) <= 0)
         return rc;
 
-    virObjectLock(doms);
-
     while ((ret = virDirRead(dir, &entry, configDir)) > 0) {
-        virDomainObjPtr dom;
+        virDomainObjListLoadFile file = { NULL };
 
         if (!virFileStripSuffix(entry->d_name, ".xml"))
             continue;
 
-        /* NB: ignoring errors, so one malformed config doesn't
-           kill the whole process */
-        VIR_INFO("Loading config file '%s.xml'", entry->d_name);
-        if (liveStatus)
-            dom = virDomainObjListLoadStatus(doms,
-                                             configDir,
-                                             entry->d_name,
-                                             caps,
-                                             xmlopt,
-                                             notify,
-                                             opaque);
-        else
-            dom = virDomainObjListLoadConfig(doms,
-                                             caps,
-                                             xmlopt,
-                                             configDir,
-                                             autostartDir,
-                                             entry->d_name,
-                                             notify,
-                                             opaque);
+        if (VIR_STRDUP(file.name, entry->d_name) < 0 ||
+            VIR_APPEND_ELEMENT(data.files, data.nfiles, file) < 0) {
+            VIR_FREE(file.name);
+            ret = -1;
+            break;
+        }
+    }
+
+    VIR_DIR_CLOSE(dir);
+
+    /* Whatever was found so far is loaded even after an error */
+    if (virDomainObjListParseFiles(&data) < 0)
+        ret = -1;
+
+    virObjectRWLockWrite(doms);
+
+    for (i = 0; i < data.nfiles; i++) {
+        virDomainObjListLoadFilePtr file = &data.files[i];
+        virDomainObjPtr dom = NULL;
+
+        if (file->obj)
+            dom = virDomainObjListLoadStatus(doms, file, notify, opaque);
+        else if (file->def)
+            dom = virDomainObjListLoadConfig(doms, xmlopt, file,
+                                             notify, opaque);
+
         if (dom) {
             if (!liveStatus)
                 dom->persistent = 1;
@@ -608,8 +864,14 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
         }
     }
 
-    VIR_DIR_CLOSE(dir);
-    virObjectUnlock(doms);
+    virObjectRWUnlock(doms);
+
+    for (i = 0; i < data.nfiles; i++) {
+        VIR_FREE(data.files[i].name);
+        virDomainDefFree(data.files[i].def);
+        virObjectUnref(data.files[i].obj);
+    }
+    VIR_FREE(data.files);
     return ret;
 }
 
@@ -653,9 +915,9 @@ virDomainObjListNumOfDomains(virDomainObjListPtr doms,
                              virConnectPtr conn)
 {
     struct virDomainObjListData data = { filter, conn, active, 0 };
-    virObjectLock(doms);
-    virHashForEach(doms->objs, virDomainObjListCount, &data);
-    virObjectUnlock(doms);
+    virObjectRWLockRead(doms);
+    virHashForEachReadOnly(doms->objs, virDomainObjListCount, &data);
+    virObjectRWUnlock(doms);
     return data.count;
 }
 
@@ -697,9 +959,9 @@ virDomainObjListGetActiveIDs(virDomainObjListPtr doms,
 {
     struct virDomainIDData data = { filter, conn,
                                     0, maxids, ids };
-    virObjectLock(doms);
-    virHashForEach(doms->objs, virDomainObjListCopyActiveIDs, &data);
-    virObjectUnlock(doms);
+    virObjectRWLockRead(doms);
+    virHashForEachReadOnly(doms->objs, virDomainObjListCopyActiveIDs, &data);
+    virObjectRWUnlock(doms);
     return data.numids;
 }
 
@@ -751,9 +1013,10 @@ virDomainObjListGetInactiveNames(virDomainObjListPtr doms,
     struct virDomainNameData data = { filter, conn,
                                       0, 0, maxnames, names };
     size_t i;
-    virObjectLock(doms);
-    virHashForEach(doms->objs, virDomainObjListCopyInactiveNames, &data);
-    virObjectUnlock(doms);
+    virObjectRWLockRead(doms);
+    virHashForEachReadOnly(doms->objs, virDomainObjListCopyInactiveNames,
+                           &data);
+    virObjectRWUnlock(doms);
     if (data.oom) {
         for (i = 0; i < data.numnames; i++)
             VIR_FREE(data.names[i]);
@@ -792,9 +1055,9 @@ virDomainObjListForEach(virDomainObjListPtr doms,
     struct virDomainListIterData data = {
         callback, opaque, 0,
     };
-    virObjectLock(doms);
+    virObjectRWLockWrite(doms);
     virHashForEach(doms->objs, virDomainObjListHelper, &data);
-    virObjectUnlock(doms);
+    virObjectRWUnlock(doms);
     return data.ret;
 }
 
@@ -925,15 +1188,16 @@ virDomainObjListCollect(virDomainObjListPtr domlist,
 {
     struct virDomainListData data = { NULL, 0 };
 
-    virObjectLock(domlist);
+    virObjectRWLockRead(domlist);
     sa_assert(domlist->objs);
     if (VIR_ALLOC_N(data.vms, virHashSize(domlist->objs)) < 0) {
-        virObjectUnlock(domlist);
+        virObjectRWUnlock(domlist);
         return -1;
     }
 
-    virHashForEach(domlist->objs, virDomainObjListCollectIterator, &data);
-    virObjectUnlock(domlist);
+    virHashForEachReadOnly(domlist->objs, virDomainObjListCollectIterator,
+                           &data);
+    virObjectRWUnlock(domlist);
 
     virDomainObjListFilter(&data.vms, &data.nvms, conn, filter, flags);
 
@@ -962,7 +1226,7 @@ virDomainObjListConvert(virDomainObjListPtr domlist,
     *nvms = 0;
     *vms = NULL;
 
-    virObjectLock(domlist);
+    virObjectRWLockRead(domlist);
     for (i = 0; i < ndoms; i++) {
         virDomainPtr dom = doms[i];
 
@@ -972,7 +1236,7 @@ virDomainObjListConvert(virDomainObjListPtr domlist,
             if (skip_missing)
                 continue;
 
-            virObjectUnlock(domlist);
+            virObjectRWUnlock(domlist);
             virReportError(VIR_ERR_NO_DOMAIN,
                            _("no domain with matching uuid '%s' (%s)"),
                            uuidstr, dom->name);
@@ -982,12 +1246,12 @@ virDomainObjListConvert(virDomainObjListPtr domlist,
         virObjectRef(vm);
 
         if (VIR_APPEND_ELEMENT(*vms, *nvms, vm) < 0) {
-            virObjectUnlock(domlist);
+            virObjectRWUnlock(domlist);
             virObjectUnref(vm);
             goto error;
         }
     }
-    virObjectUnlock(domlist);
+    virObjectRWUnlock(domlist);
 
     sa_assert(*vms);
     virDomainObjListFilter(vms, nvms, conn, filter, flags);
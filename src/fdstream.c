@@ -27,6 +27,7 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
+#include <sys/ioctl.h>
 #if HAVE_SYS_UN_H
 # include <sys/un.h>
 #endif
@@ -56,6 +57,7 @@ struct virFDStreamData {
     virCommandPtr cmd;
     unsigned long long offset;
     unsigned long long length;
+    bool splice;        /* @fd is the read end of a pipe */
 
     int watch;
     int events;         /* events the stream callback is subscribed for */
@@ -492,6 +494,64 @@ static virStreamDriver virFDStreamDrv = {
     .streamEventRemoveCallback = virFDStreamRemoveCallback
 };
 
+
+/**
+ * virFDStreamGetSpliceFD:
+ * @st: the stream
+ * @nbytes: maximum number of bytes to claim, updated with the amount claimed
+ *
+ * Claims data already waiting in the pipe @st reads from, so that the
+ * caller can splice it elsewhere instead of copying it out with
+ * virStreamRecv. The claimed bytes count as read from @st.
+ *
+ * Returns a duplicate of the pipe FD which the caller must close,
+ * -2 if @st is not backed by a pipe or no data is waiting, in which
+ * case virStreamRecv must be used, or -1 on error.
+ */
+int virFDStreamGetSpliceFD(virStreamPtr st, size_t *nbytes)
+{
+    struct virFDStreamData *fdst = st->privateData;
+    int avail;
+    int ret = -2;
+
+    if (st->driver != &virFDStreamDrv || !fdst)
+        return -2;
+
+    virMutexLock(&fdst->lock);
+
+    if (!fdst->splice)
+        goto cleanup;
+
+    if (fdst->length) {
+        if (fdst->length == fdst->offset)
+            goto cleanup;
+
+        if ((fdst->length - fdst->offset) < *nbytes)
+            *nbytes = fdst->length - fdst->offset;
+    }
+
+    /* Leave EOF and errors to virStreamRecv */
+    if (ioctl(fdst->fd, FIONREAD, &avail) < 0 || avail <= 0)
+        goto cleanup;
+
+    if (*nbytes > (size_t) avail)
+        *nbytes = avail;
+
+    if ((ret = dup(fdst->fd)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot duplicate stream file descriptor"));
+        goto cleanup;
+    }
+
+    if (fdst->length)
+        fdst->offset += *nbytes;
+
+ cleanup:
+    virMutexUnlock(&fdst->lock);
+    return ret;
+}
+
+
 static int virFDStreamOpenInternal(virStreamPtr st,
                                    int fd,
                                    virCommandPtr cmd,
@@ -499,6 +559,7 @@ static int virFDStreamOpenInternal(virStreamPtr st,
                                    unsigned long long length)
 {
     struct virFDStreamData *fdst;
+    struct stat sb;
 
     VIR_DEBUG("st=%p fd=%d cmd=%p errfd=%d length=%llu",
               st, fd, cmd, errfd, length);
@@ -516,6 +577,8 @@ static int virFDStreamOpenInternal(virStreamPtr st,
     fdst->cmd = cmd;
     fdst->errfd = errfd;
     fdst->length = length;
+    fdst->splice = fstat(fd, &sb) == 0 && S_ISFIFO(sb.st_mode) &&
+                   (fcntl(fd, F_GETFL) & O_ACCMODE) == O_RDONLY;
     if (virMutexInit(&fdst->lock) < 0) {
         VIR_FREE(fdst);
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -62,6 +62,8 @@ int virFDStreamOpenBlockDevice(virStreamPtr st,
                                unsigned long long length,
                                int oflags);
 
+int virFDStreamGetSpliceFD(virStreamPtr st, size_t *nbytes);
+
 int virFDStreamSetInternalCloseCb(virStreamPtr st,
                                   virFDStreamInternalCloseCb cb,
                                   void *opaque,
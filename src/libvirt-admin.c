@@ -952,6 +952,11 @@ virAdmServerLookupClient(virAdmServerPtr srv,
  * even though a TCP client is able to restrict access to certain APIs for
  * itself.
  *
+ * Besides identity, @params also describe the queue of messages waiting to
+ * be sent to the client and how many events were dropped or coalesced to
+ * keep it within the limits configured for the server, which tells apart
+ * clients that do not keep up with the events they subscribed to.
+ *
  * Returns 0 if the information has been successfully retrieved or -1 in case
  * of an error.
  */
@@ -11458,6 +11458,10 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  * applicable for the current state of the guest domain, or their retrieval
  * was not successful.
  *
+ * If the hypervisor gave up on some of the requested statistics of a domain
+ * because gathering them would take too long, the record of that domain
+ * contains a "partial" field set to true (boolean).
+ *
  * Using 0 for @stats returns all stats groups supported by the given
  * hypervisor.
  *
@@ -331,7 +331,7 @@ virStreamSendAll(virStreamPtr stream,
                  void *opaque)
 {
     char *bytes = NULL;
-    size_t want = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t want = VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
     int ret = -1;
     VIR_DEBUG("stream=%p, handler=%p, opaque=%p", stream, handler, opaque);
 
@@ -424,7 +424,7 @@ virStreamRecvAll(virStreamPtr stream,
                  void *opaque)
 {
     char *bytes = NULL;
-    size_t want = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t want = VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
     int ret = -1;
     VIR_DEBUG("stream=%p, handler=%p, opaque=%p", stream, handler, opaque);
 
@@ -123,6 +123,21 @@ enum {
      * Support for driver close callback rpc
      */
     VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK = 15,
+
+    /*
+     * Support for stream data messages carrying up to
+     * VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX bytes. The server only sends
+     * them to clients which enabled this through
+     * REMOTE_PROC_CONNECT_ENABLE_FEATURE
+     */
+    VIR_DRV_FEATURE_REMOTE_LARGE_STREAM_CHUNKS = 16,
+
+    /*
+     * Support for several events being delivered in one
+     * REMOTE_PROC_CONNECT_EVENT_BATCH message, to clients which
+     * enabled this through REMOTE_PROC_CONNECT_ENABLE_FEATURE
+     */
+    VIR_DRV_FEATURE_REMOTE_EVENT_BATCH = 17,
 };
 
 
@@ -383,19 +383,59 @@ struct virQEMUCapsSearchData {
 static virClassPtr virQEMUCapsClass;
 static void virQEMUCapsDispose(void *obj);
 
+/* Flag names to flags plus one, so that no flag maps to NULL */
+static virHashTablePtr virQEMUCapsFlagNames;
+
 static int virQEMUCapsOnceInit(void)
 {
+    size_t i;
+
     if (!(virQEMUCapsClass = virClassNew(virClassForObject(),
                                          "virQEMUCaps",
                                          sizeof(virQEMUCaps),
                                          virQEMUCapsDispose)))
         return -1;
 
+    if (!(virQEMUCapsFlagNames = virHashCreate(QEMU_CAPS_LAST, NULL)))
+        return -1;
+
+    for (i = 0; i < QEMU_CAPS_LAST; i++) {
+        if (virHashAddEntry(virQEMUCapsFlagNames,
+                            virQEMUCapsTypeToString(i),
+                            (void *) (i + 1)) < 0)
+            return -1;
+    }
+
     return 0;
 }
 
 VIR_ONCE_GLOBAL_INIT(virQEMUCaps)
 
+
+/**
+ * virQEMUCapsFlagFromString:
+ * @name: name of a capability flag
+ *
+ * Same as virQEMUCapsTypeFromString, except that it takes constant
+ * time rather than comparing @name to every known flag. Cache and
+ * status XML list each flag by name, so this adds up.
+ *
+ * Returns the flag or -1 if @name is not known.
+ */
+int
+virQEMUCapsFlagFromString(const char *name)
+{
+    void *flag;
+
+    if (virQEMUCapsInitialize() < 0)
+        return virQEMUCapsTypeFromString(name);
+
+    if (!(flag = virHashLookup(virQEMUCapsFlagNames, name)))
+        return -1;
+
+    return (size_t) flag - 1;
+}
+
 static virArch virQEMUCapsArchFromString(const char *arch)
 {
     if (STREQ(arch, "i386"))
@@ -1066,6 +1106,159 @@ virQEMUCapsInitPages(virCapsPtr caps)
 }
 
 
+/* Most binaries probed at once by virQEMUCapsCacheProbeAll */
+#define VIR_QEMU_CAPS_PROBE_WORKERS 8
+
+struct virQEMUCapsProbeData {
+    virQEMUCapsCachePtr cache;
+    char **binaries;
+    char **targets; /* binaries with all symlinks resolved */
+    size_t nbinaries;
+
+    virMutex lock;
+    size_t next;
+};
+
+
+static void
+virQEMUCapsProbeWorker(void *opaque)
+{
+    struct virQEMUCapsProbeData *data = opaque;
+
+    while (true) {
+        virQEMUCapsPtr qemuCaps;
+        size_t i;
+
+        virMutexLock(&data->lock);
+        i = data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (i >= data->nbinaries)
+            break;
+
+        /* Failures are reported once the binary is actually used */
+        if (!(qemuCaps = virQEMUCapsCacheLookup(data->cache,
+                                                data->binaries[i])))
+            virResetLastError();
+        virObjectUnref(qemuCaps);
+    }
+}
+
+
+/*
+ * Add @binary to the list of binaries to probe, unless it is the same
+ * file as one of them, which distributions often make qemu-kvm.
+ */
+static int
+virQEMUCapsProbeDataAdd(struct virQEMUCapsProbeData *data,
+                        char *binary)
+{
+    char *target = NULL;
+    size_t n = data->nbinaries;
+    size_t i;
+
+    if (virFileResolveAllLinks(binary, &target) < 0) {
+        virResetLastError();
+        if (VIR_STRDUP(target, binary) < 0)
+            goto error;
+    }
+
+    for (i = 0; i < data->nbinaries; i++) {
+        if (STREQ(data->targets[i], target)) {
+            VIR_DEBUG("Skipping %s, same as %s", binary, data->binaries[i]);
+            VIR_FREE(target);
+            VIR_FREE(binary);
+            return 0;
+        }
+    }
+
+    if (VIR_APPEND_ELEMENT_COPY(data->targets, n, target) < 0 ||
+        VIR_APPEND_ELEMENT(data->binaries, data->nbinaries, binary) < 0)
+        goto error;
+
+    return 0;
+
+ error:
+    VIR_FREE(target);
+    VIR_FREE(binary);
+    return -1;
+}
+
+
+/*
+ * Fill @cache with the capabilities of every binary virQEMUCapsInit is
+ * going to look at, probing up to VIR_QEMU_CAPS_PROBE_WORKERS of them
+ * in parallel. Most of the time of a probe is spent waiting for QEMU,
+ * which is why this helps even on hosts with few CPUs.
+ */
+static void
+virQEMUCapsCacheProbeAll(virQEMUCapsCachePtr cache,
+                         virArch hostarch)
+{
+    const char *kvmbins[] = {
+        "/usr/libexec/qemu-kvm", /* RHEL */
+        "qemu-kvm", /* Fedora */
+        "kvm", /* Debian/Ubuntu */
+    };
+    struct virQEMUCapsProbeData data = { .cache = cache };
+    virThread workers[VIR_QEMU_CAPS_PROBE_WORKERS - 1];
+    size_t nworkers = 0;
+    size_t i;
+
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        char *binary = virQEMUCapsFindBinaryForArch(hostarch, i);
+
+        if (binary && virQEMUCapsProbeDataAdd(&data, binary) < 0)
+            goto cleanup;
+    }
+
+    /* virQEMUCapsInitGuest only uses the first KVM binary it finds */
+    for (i = 0; i < ARRAY_CARDINALITY(kvmbins); i++) {
+        char *binary = virFindFileInPath(kvmbins[i]);
+
+        if (!binary)
+            continue;
+
+        if (virQEMUCapsProbeDataAdd(&data, binary) < 0)
+            goto cleanup;
+        break;
+    }
+
+    if (data.nbinaries == 0)
+        return;
+
+    if (virMutexInit(&data.lock) < 0)
+        goto cleanup;
+
+    while (nworkers < ARRAY_CARDINALITY(workers) &&
+           nworkers + 1 < data.nbinaries) {
+        if (virThreadCreate(&workers[nworkers], true,
+                            virQEMUCapsProbeWorker, &data) < 0) {
+            VIR_WARN("Failed to create thread to probe QEMU binaries");
+            break;
+        }
+        nworkers++;
+    }
+
+    virQEMUCapsProbeWorker(&data);
+
+    for (i = 0; i < nworkers; i++)
+        virThreadJoin(&workers[i]);
+
+    virMutexDestroy(&data.lock);
+
+ cleanup:
+    /* Anything not probed here is probed when it is needed */
+    virResetLastError();
+    for (i = 0; i < data.nbinaries; i++) {
+        VIR_FREE(data.binaries[i]);
+        VIR_FREE(data.targets[i]);
+    }
+    VIR_FREE(data.binaries);
+    VIR_FREE(data.targets);
+}
+
+
 virCapsPtr virQEMUCapsInit(virQEMUCapsCachePtr cache)
 {
     virCapsPtr caps;
@@ -1100,6 +1293,10 @@ virCapsPtr virQEMUCapsInit(virQEMUCapsCachePtr cache)
     virCapabilitiesAddHostMigrateTransport(caps, "tcp");
     virCapabilitiesAddHostMigrateTransport(caps, "rdma");
 
+    /* Probing a binary means starting it, so get them all
+     * probed at once before looking at them one by one */
+    virQEMUCapsCacheProbeAll(cache, hostarch);
+
     /* QEMU can support pretty much every arch that exists,
      * so just probe for them all - we gracefully fail
      * if a qemu-system-$ARCH binary can't be found
@@ -2849,7 +3046,7 @@ virQEMUCapsLoadCache(virQEMUCapsPtr qemuCaps, const char *filename,
                            _("missing flag name in QEMU capabilities cache"));
             goto cleanup;
         }
-        flag = virQEMUCapsTypeFromString(str);
+        flag = virQEMUCapsFlagFromString(str);
         if (flag < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("Unknown qemu capabilities flag %s"), str);
@@ -3131,11 +3328,436 @@ virQEMUCapsSaveCache(virQEMUCapsPtr qemuCaps, const char *filename)
     return ret;
 }
 
+
+/*
+ * The binary cache sits next to the XML one and is preferred on load,
+ * as it needs no parsing. It's only ever read by the libvirtd build that
+ * wrote it (see selfctime and selfvers), hence host byte order:
+ *
+ *   magic, format version
+ *   qemuctime, selfctime, selfvers   (64 bits each)
+ *   usedQMP, nflags, flags...        (32 bits each)
+ *   version, kvmVersion, package, arch
+ *   ncpus, cpu names...
+ *   nmachines, (name, alias, maxCpus)...
+ *   ngic, (version, implementation)...
+ *
+ * Strings are stored as their 32 bit length followed by their bytes, a
+ * length of UINT32_MAX standing for NULL.
+ */
+#define QEMU_CAPS_BINARY_MAGIC 0x51435056 /* "VPCQ" */
+#define QEMU_CAPS_BINARY_VERSION 1
+#define QEMU_CAPS_BINARY_MAX_SIZE (16 * 1024 * 1024)
+
+typedef struct _virQEMUCapsBinaryReader virQEMUCapsBinaryReader;
+typedef virQEMUCapsBinaryReader *virQEMUCapsBinaryReaderPtr;
+struct _virQEMUCapsBinaryReader {
+    const char *filename;
+    const char *data;
+    size_t len;
+    size_t pos;
+};
+
+
+static void
+virQEMUCapsBinaryPutU32(virBufferPtr buf, uint32_t val)
+{
+    virBufferAdd(buf, (const char *) &val, sizeof(val));
+}
+
+
+static void
+virQEMUCapsBinaryPutU64(virBufferPtr buf, uint64_t val)
+{
+    virBufferAdd(buf, (const char *) &val, sizeof(val));
+}
+
+
+static void
+virQEMUCapsBinaryPutString(virBufferPtr buf, const char *str)
+{
+    if (!str) {
+        virQEMUCapsBinaryPutU32(buf, UINT32_MAX);
+        return;
+    }
+
+    virQEMUCapsBinaryPutU32(buf, strlen(str));
+    virBufferAdd(buf, str, strlen(str));
+}
+
+
+static int
+virQEMUCapsBinaryGet(virQEMUCapsBinaryReaderPtr reader,
+                     void *val,
+                     size_t len)
+{
+    if (reader->len - reader->pos < len) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("truncated QEMU capabilities cache '%s'"),
+                       reader->filename);
+        return -1;
+    }
+
+    memcpy(val, reader->data + reader->pos, len);
+    reader->pos += len;
+    return 0;
+}
+
+
+static int
+virQEMUCapsBinaryGetU32(virQEMUCapsBinaryReaderPtr reader, uint32_t *val)
+{
+    return virQEMUCapsBinaryGet(reader, val, sizeof(*val));
+}
+
+
+static int
+virQEMUCapsBinaryGetU64(virQEMUCapsBinaryReaderPtr reader, uint64_t *val)
+{
+    return virQEMUCapsBinaryGet(reader, val, sizeof(*val));
+}
+
+
+static int
+virQEMUCapsBinaryGetString(virQEMUCapsBinaryReaderPtr reader, char **str)
+{
+    uint32_t len;
+
+    *str = NULL;
+
+    if (virQEMUCapsBinaryGetU32(reader, &len) < 0)
+        return -1;
+
+    if (len == UINT32_MAX)
+        return 0;
+
+    if (reader->len - reader->pos < len) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("truncated QEMU capabilities cache '%s'"),
+                       reader->filename);
+        return -1;
+    }
+
+    if (VIR_STRNDUP(*str, reader->data + reader->pos, len) < 0)
+        return -1;
+    reader->pos += len;
+    return 0;
+}
+
+
+/* Counts come from the file, don't let them make us allocate more than
+ * it could possibly describe */
+static int
+virQEMUCapsBinaryGetCount(virQEMUCapsBinaryReaderPtr reader,
+                          size_t *count)
+{
+    uint32_t val;
+
+    if (virQEMUCapsBinaryGetU32(reader, &val) < 0)
+        return -1;
+
+    if (val > (reader->len - reader->pos) / sizeof(uint32_t)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("malformed QEMU capabilities cache '%s'"),
+                       reader->filename);
+        return -1;
+    }
+
+    *count = val;
+    return 0;
+}
+
+
+/**
+ * virQEMUCapsFormatBinaryCache:
+ * @qemuCaps: capabilities to format
+ * @selfCTime: ctime of the libvirtd binary
+ * @selfVersion: version of the libvirtd binary
+ * @len: filled with the length of the returned data
+ *
+ * Formats @qemuCaps the way virQEMUCapsLoadBinaryCache reads them back.
+ *
+ * Returns the data or NULL on error.
+ */
+char *
+virQEMUCapsFormatBinaryCache(virQEMUCapsPtr qemuCaps,
+                             time_t selfCTime,
+                             unsigned long selfVersion,
+                             size_t *len)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t nflags = 0;
+    size_t i;
+
+    virQEMUCapsBinaryPutU32(&buf, QEMU_CAPS_BINARY_MAGIC);
+    virQEMUCapsBinaryPutU32(&buf, QEMU_CAPS_BINARY_VERSION);
+
+    virQEMUCapsBinaryPutU64(&buf, qemuCaps->ctime);
+    virQEMUCapsBinaryPutU64(&buf, selfCTime);
+    virQEMUCapsBinaryPutU64(&buf, selfVersion);
+
+    virQEMUCapsBinaryPutU32(&buf, qemuCaps->usedQMP);
+
+    for (i = 0; i < QEMU_CAPS_LAST; i++) {
+        if (virQEMUCapsGet(qemuCaps, i))
+            nflags++;
+    }
+    virQEMUCapsBinaryPutU32(&buf, nflags);
+    for (i = 0; i < QEMU_CAPS_LAST; i++) {
+        if (virQEMUCapsGet(qemuCaps, i))
+            virQEMUCapsBinaryPutU32(&buf, i);
+    }
+
+    virQEMUCapsBinaryPutU32(&buf, qemuCaps->version);
+    virQEMUCapsBinaryPutU32(&buf, qemuCaps->kvmVersion);
+    virQEMUCapsBinaryPutString(&buf, qemuCaps->package);
+    virQEMUCapsBinaryPutU32(&buf, qemuCaps->arch);
+
+    virQEMUCapsBinaryPutU32(&buf, qemuCaps->ncpuDefinitions);
+    for (i = 0; i < qemuCaps->ncpuDefinitions; i++)
+        virQEMUCapsBinaryPutString(&buf, qemuCaps->cpuDefinitions[i]);
+
+    virQEMUCapsBinaryPutU32(&buf, qemuCaps->nmachineTypes);
+    for (i = 0; i < qemuCaps->nmachineTypes; i++) {
+        virQEMUCapsBinaryPutString(&buf, qemuCaps->machineTypes[i]);
+        virQEMUCapsBinaryPutString(&buf, qemuCaps->machineAliases[i]);
+        virQEMUCapsBinaryPutU32(&buf, qemuCaps->machineMaxCpus[i]);
+    }
+
+    virQEMUCapsBinaryPutU32(&buf, qemuCaps->ngicCapabilities);
+    for (i = 0; i < qemuCaps->ngicCapabilities; i++) {
+        virQEMUCapsBinaryPutU32(&buf, qemuCaps->gicCapabilities[i].version);
+        virQEMUCapsBinaryPutU32(&buf,
+                                qemuCaps->gicCapabilities[i].implementation);
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    *len = virBufferUse(&buf);
+    return virBufferContentAndReset(&buf);
+}
+
+
+/**
+ * virQEMUCapsLoadBinaryCache:
+ * @qemuCaps: capabilities to fill in
+ * @filename: cache file written by virQEMUCapsFormatBinaryCache
+ * @qemuctime: filled with the ctime of the QEMU binary
+ * @selfctime: filled with the ctime of the libvirtd which wrote the file
+ * @selfvers: filled with the version of the libvirtd which wrote the file
+ *
+ * The binary counterpart of virQEMUCapsLoadCache.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virQEMUCapsLoadBinaryCache(virQEMUCapsPtr qemuCaps,
+                           const char *filename,
+                           time_t *qemuctime,
+                           time_t *selfctime,
+                           unsigned long *selfvers)
+{
+    virQEMUCapsBinaryReader reader = { .filename = filename };
+    char *data = NULL;
+    int len;
+    uint32_t u32;
+    uint64_t u64;
+    size_t n;
+    size_t i;
+    int ret = -1;
+
+    if ((len = virFileReadAll(filename, QEMU_CAPS_BINARY_MAX_SIZE, &data)) < 0)
+        goto cleanup;
+
+    reader.data = data;
+    reader.len = len;
+
+    if (virQEMUCapsBinaryGetU32(&reader, &u32) < 0)
+        goto cleanup;
+    if (u32 != QEMU_CAPS_BINARY_MAGIC) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("'%s' is not a QEMU capabilities cache"), filename);
+        goto cleanup;
+    }
+
+    if (virQEMUCapsBinaryGetU32(&reader, &u32) < 0)
+        goto cleanup;
+    if (u32 != QEMU_CAPS_BINARY_VERSION) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unsupported version %u of QEMU capabilities "
+                         "cache '%s'"), u32, filename);
+        goto cleanup;
+    }
+
+    if (virQEMUCapsBinaryGetU64(&reader, &u64) < 0)
+        goto cleanup;
+    *qemuctime = (time_t)u64;
+    if (virQEMUCapsBinaryGetU64(&reader, &u64) < 0)
+        goto cleanup;
+    *selfctime = (time_t)u64;
+    if (virQEMUCapsBinaryGetU64(&reader, &u64) < 0)
+        goto cleanup;
+    *selfvers = u64;
+
+    if (virQEMUCapsBinaryGetU32(&reader, &u32) < 0)
+        goto cleanup;
+    qemuCaps->usedQMP = !!u32;
+
+    if (virQEMUCapsBinaryGetCount(&reader, &n) < 0)
+        goto cleanup;
+    for (i = 0; i < n; i++) {
+        if (virQEMUCapsBinaryGetU32(&reader, &u32) < 0)
+            goto cleanup;
+        if (u32 >= QEMU_CAPS_LAST) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unknown qemu capabilities flag %u"), u32);
+            goto cleanup;
+        }
+        virQEMUCapsSet(qemuCaps, u32);
+    }
+
+    if (virQEMUCapsBinaryGetU32(&reader, &qemuCaps->version) < 0 ||
+        virQEMUCapsBinaryGetU32(&reader, &qemuCaps->kvmVersion) < 0 ||
+        virQEMUCapsBinaryGetString(&reader, &qemuCaps->package) < 0 ||
+        virQEMUCapsBinaryGetU32(&reader, &u32) < 0)
+        goto cleanup;
+
+    if (u32 == VIR_ARCH_NONE || u32 >= VIR_ARCH_LAST) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unknown arch %u in QEMU capabilities cache"), u32);
+        goto cleanup;
+    }
+    qemuCaps->arch = u32;
+
+    if (virQEMUCapsBinaryGetCount(&reader, &n) < 0)
+        goto cleanup;
+    if (n > 0) {
+        if (VIR_ALLOC_N(qemuCaps->cpuDefinitions, n) < 0)
+            goto cleanup;
+        qemuCaps->ncpuDefinitions = n;
+
+        for (i = 0; i < n; i++) {
+            if (virQEMUCapsBinaryGetString(&reader,
+                                           &qemuCaps->cpuDefinitions[i]) < 0)
+                goto cleanup;
+            if (!qemuCaps->cpuDefinitions[i]) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("missing cpu name in QEMU capabilities cache"));
+                goto cleanup;
+            }
+        }
+    }
+
+    if (virQEMUCapsBinaryGetCount(&reader, &n) < 0)
+        goto cleanup;
+    if (n > 0) {
+        if (VIR_ALLOC_N(qemuCaps->machineTypes, n) < 0 ||
+            VIR_ALLOC_N(qemuCaps->machineAliases, n) < 0 ||
+            VIR_ALLOC_N(qemuCaps->machineMaxCpus, n) < 0)
+            goto cleanup;
+        qemuCaps->nmachineTypes = n;
+
+        for (i = 0; i < n; i++) {
+            if (virQEMUCapsBinaryGetString(&reader,
+                                           &qemuCaps->machineTypes[i]) < 0 ||
+                virQEMUCapsBinaryGetString(&reader,
+                                           &qemuCaps->machineAliases[i]) < 0 ||
+                virQEMUCapsBinaryGetU32(&reader,
+                                        &qemuCaps->machineMaxCpus[i]) < 0)
+                goto cleanup;
+            if (!qemuCaps->machineTypes[i]) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("missing machine name in QEMU capabilities cache"));
+                goto cleanup;
+            }
+        }
+    }
+
+    if (virQEMUCapsBinaryGetCount(&reader, &n) < 0)
+        goto cleanup;
+    if (n > 0) {
+        if (VIR_ALLOC_N(qemuCaps->gicCapabilities, n) < 0)
+            goto cleanup;
+        qemuCaps->ngicCapabilities = n;
+
+        for (i = 0; i < n; i++) {
+            virGICCapabilityPtr cap = &qemuCaps->gicCapabilities[i];
+
+            if (virQEMUCapsBinaryGetU32(&reader, &u32) < 0)
+                goto cleanup;
+            cap->version = u32;
+            if (virQEMUCapsBinaryGetU32(&reader, &u32) < 0)
+                goto cleanup;
+            cap->implementation = u32;
+        }
+    }
+
+    if (reader.pos != reader.len) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("trailing data in QEMU capabilities cache '%s'"),
+                       filename);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(data);
+    return ret;
+}
+
+
+struct virQEMUCapsBinaryData {
+    const char *data;
+    size_t len;
+};
+
+
+static int
+virQEMUCapsRewriteBinaryCache(int fd, void *opaque)
+{
+    struct virQEMUCapsBinaryData *bin = opaque;
+
+    if (safewrite(fd, bin->data, bin->len) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+virQEMUCapsSaveBinaryCache(virQEMUCapsPtr qemuCaps, const char *filename)
+{
+    struct virQEMUCapsBinaryData bin;
+    char *data = NULL;
+    int ret = -1;
+
+    if (!(data = virQEMUCapsFormatBinaryCache(qemuCaps,
+                                              virGetSelfLastChanged(),
+                                              LIBVIR_VERSION_NUMBER,
+                                              &bin.len)))
+        goto cleanup;
+    bin.data = data;
+
+    if (virFileRewrite(filename, S_IRUSR | S_IWUSR,
+                       virQEMUCapsRewriteBinaryCache, &bin) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Saved binary caps '%s' for '%s'", filename, qemuCaps->binary);
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(data);
+    return ret;
+}
+
+
 static int
 virQEMUCapsRememberCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
 {
     char *capsdir = NULL;
     char *capsfile = NULL;
+    char *binfile = NULL;
     int ret = -1;
     char *binaryhash = NULL;
 
@@ -3147,7 +3769,8 @@ virQEMUCapsRememberCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
                             &binaryhash) < 0)
         goto cleanup;
 
-    if (virAsprintf(&capsfile, "%s/%s.xml", capsdir, binaryhash) < 0)
+    if (virAsprintf(&capsfile, "%s/%s.xml", capsdir, binaryhash) < 0 ||
+        virAsprintf(&binfile, "%s/%s.bin", capsdir, binaryhash) < 0)
         goto cleanup;
 
     if (virFileMakePath(capsdir) < 0) {
@@ -3160,9 +3783,18 @@ virQEMUCapsRememberCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
     if (virQEMUCapsSaveCache(qemuCaps, capsfile) < 0)
         goto cleanup;
 
+    /* The XML cache is enough on its own, failing to save the binary one
+     * only makes the next load slower */
+    if (virQEMUCapsSaveBinaryCache(qemuCaps, binfile) < 0) {
+        VIR_WARN("Failed to save binary caps '%s' for '%s': %s",
+                 binfile, qemuCaps->binary, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
     ret = 0;
  cleanup:
     VIR_FREE(binaryhash);
+    VIR_FREE(binfile);
     VIR_FREE(capsfile);
     VIR_FREE(capsdir);
     return ret;
@@ -3204,12 +3836,14 @@ virQEMUCapsInitCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
 {
     char *capsdir = NULL;
     char *capsfile = NULL;
+    char *binfile = NULL;
     int ret = -1;
     char *binaryhash = NULL;
     struct stat sb;
     time_t qemuctime;
     time_t selfctime;
     unsigned long selfvers;
+    bool haveBinary = false;
 
     if (virAsprintf(&capsdir, "%s/capabilities", cacheDir) < 0)
         goto cleanup;
@@ -3219,7 +3853,8 @@ virQEMUCapsInitCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
                             &binaryhash) < 0)
         goto cleanup;
 
-    if (virAsprintf(&capsfile, "%s/%s.xml", capsdir, binaryhash) < 0)
+    if (virAsprintf(&capsfile, "%s/%s.xml", capsdir, binaryhash) < 0 ||
+        virAsprintf(&binfile, "%s/%s.bin", capsdir, binaryhash) < 0)
         goto cleanup;
 
     if (virFileMakePath(capsdir) < 0) {
@@ -3229,27 +3864,42 @@ virQEMUCapsInitCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
         goto cleanup;
     }
 
-    if (stat(capsfile, &sb) < 0) {
-        if (errno == ENOENT) {
-            VIR_DEBUG("No cached capabilities '%s' for '%s'",
-                      capsfile, qemuCaps->binary);
-            ret = 0;
-            goto cleanup;
+    if (virFileExists(binfile)) {
+        if (virQEMUCapsLoadBinaryCache(qemuCaps, binfile, &qemuctime,
+                                       &selfctime, &selfvers) == 0) {
+            haveBinary = true;
+        } else {
+            VIR_DEBUG("Failed to load binary caps from '%s' for '%s': %s",
+                      binfile, qemuCaps->binary, virGetLastErrorMessage());
+            virResetLastError();
+            virQEMUCapsReset(qemuCaps);
+            ignore_value(unlink(binfile));
         }
-        virReportSystemError(errno,
-                             _("Unable to access cache '%s' for '%s'"),
-                             capsfile, qemuCaps->binary);
-        goto cleanup;
     }
 
-    if (virQEMUCapsLoadCache(qemuCaps, capsfile, &qemuctime, &selfctime,
-                             &selfvers) < 0) {
-        VIR_WARN("Failed to load cached caps from '%s' for '%s': %s",
-                 capsfile, qemuCaps->binary, virGetLastErrorMessage());
-        virResetLastError();
-        ret = 0;
-        virQEMUCapsReset(qemuCaps);
-        goto cleanup;
+    if (!haveBinary) {
+        if (stat(capsfile, &sb) < 0) {
+            if (errno == ENOENT) {
+                VIR_DEBUG("No cached capabilities '%s' for '%s'",
+                          capsfile, qemuCaps->binary);
+                ret = 0;
+                goto cleanup;
+            }
+            virReportSystemError(errno,
+                                 _("Unable to access cache '%s' for '%s'"),
+                                 capsfile, qemuCaps->binary);
+            goto cleanup;
+        }
+
+        if (virQEMUCapsLoadCache(qemuCaps, capsfile, &qemuctime, &selfctime,
+                                 &selfvers) < 0) {
+            VIR_WARN("Failed to load cached caps from '%s' for '%s': %s",
+                     capsfile, qemuCaps->binary, virGetLastErrorMessage());
+            virResetLastError();
+            ret = 0;
+            virQEMUCapsReset(qemuCaps);
+            goto cleanup;
+        }
     }
 
     /* Discard cache if QEMU binary or libvirtd changed */
@@ -3263,18 +3913,28 @@ virQEMUCapsInitCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
                   (long long)selfctime, (long long)virGetSelfLastChanged(),
                   selfvers, (unsigned long)LIBVIR_VERSION_NUMBER);
         ignore_value(unlink(capsfile));
+        ignore_value(unlink(binfile));
         virQEMUCapsReset(qemuCaps);
         ret = 0;
         goto cleanup;
     }
 
     VIR_DEBUG("Loaded '%s' for '%s' ctime %lld usedQMP=%d",
-              capsfile, qemuCaps->binary,
+              haveBinary ? binfile : capsfile, qemuCaps->binary,
               (long long)qemuCaps->ctime, qemuCaps->usedQMP);
 
+    /* Caches written before the binary format existed get it now */
+    if (!haveBinary &&
+        virQEMUCapsSaveBinaryCache(qemuCaps, binfile) < 0) {
+        VIR_DEBUG("Failed to save binary caps '%s' for '%s': %s",
+                  binfile, qemuCaps->binary, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
     ret = 1;
  cleanup:
     VIR_FREE(binaryhash);
+    VIR_FREE(binfile);
     VIR_FREE(capsfile);
     VIR_FREE(capsdir);
     return ret;
@@ -3587,8 +4247,11 @@ virQEMUCapsInitQMP(virQEMUCapsPtr qemuCaps,
 
     /* the ".sock" sufix is important to avoid a possible clash with a qemu
      * domain called "capabilities"
+     * Binaries may be probed by several threads at once, each of which
+     * needs its own monitor socket and pidfile
      */
-    if (virAsprintf(&monpath, "%s/%s", libDir, "capabilities.monitor.sock") < 0)
+    if (virAsprintf(&monpath, "%s/capabilities.%llu.monitor.sock",
+                    libDir, virThreadSelfID()) < 0)
         goto cleanup;
     if (virAsprintf(&monarg, "unix:%s,server,nowait", monpath) < 0)
         goto cleanup;
@@ -3599,7 +4262,8 @@ virQEMUCapsInitQMP(virQEMUCapsPtr qemuCaps,
      * -daemonize we need QEMU to be allowed to create them, rather
      * than libvirtd. So we're using libDir which QEMU can write to
      */
-    if (virAsprintf(&pidfile, "%s/%s", libDir, "capabilities.pidfile") < 0)
+    if (virAsprintf(&pidfile, "%s/capabilities.%llu.pidfile",
+                    libDir, virThreadSelfID()) < 0)
         goto cleanup;
 
     memset(&config, 0, sizeof(config));
@@ -3880,8 +4544,18 @@ virQEMUCapsCacheNew(const char *libDir,
         return NULL;
     }
 
+    if (virCondInit(&cache->probed) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to initialize condition"));
+        virMutexDestroy(&cache->lock);
+        VIR_FREE(cache);
+        return NULL;
+    }
+
     if (!(cache->binaries = virHashCreate(10, virObjectFreeHashData)))
         goto error;
+    if (!(cache->probing = virHashCreate(10, NULL)))
+        goto error;
     if (VIR_STRDUP(cache->libDir, libDir) < 0)
         goto error;
     if (VIR_STRDUP(cache->cacheDir, cacheDir) < 0)
@@ -3909,6 +4583,7 @@ virQEMUCapsCacheLookup(virQEMUCapsCachePtr cache, const char *binary)
         binary = qemuTestCapsName;
 
     virMutexLock(&cache->lock);
+ retry:
     ret = virHashLookup(cache->binaries, binary);
     if (ret &&
         !virQEMUCapsIsValid(ret)) {
@@ -3918,11 +4593,33 @@ virQEMUCapsCacheLookup(virQEMUCapsCachePtr cache, const char *binary)
         ret = NULL;
     }
     if (!ret) {
+        /* The cache is not locked while probing, so that different
+         * binaries can be probed at once; the same binary is only
+         * probed by one thread, the others wait for its result */
+        if (virHashLookup(cache->probing, binary)) {
+            VIR_DEBUG("Waiting for capabilities of %s", binary);
+            if (virCondWait(&cache->probed, &cache->lock) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("failed to wait for QEMU probe"));
+                goto cleanup;
+            }
+            goto retry;
+        }
+
+        if (virHashAddEntry(cache->probing, binary, (void *) 1) < 0)
+            goto cleanup;
+        virMutexUnlock(&cache->lock);
+
         VIR_DEBUG("Creating capabilities for %s",
                   binary);
         ret = virQEMUCapsNewForBinary(binary, cache->libDir,
                                       cache->cacheDir,
                                       cache->runUid, cache->runGid);
+
+        virMutexLock(&cache->lock);
+        virHashRemoveEntry(cache->probing, binary);
+        virCondBroadcast(&cache->probed);
+
         if (ret) {
             VIR_DEBUG("Caching capabilities %p for %s",
                       ret, binary);
@@ -3934,6 +4631,7 @@ virQEMUCapsCacheLookup(virQEMUCapsCachePtr cache, const char *binary)
     }
     VIR_DEBUG("Returning caps %p for %s", ret, binary);
     virObjectRef(ret);
+ cleanup:
     virMutexUnlock(&cache->lock);
     return ret;
 }
@@ -4006,6 +4704,8 @@ virQEMUCapsCacheFree(virQEMUCapsCachePtr cache)
     VIR_FREE(cache->libDir);
     VIR_FREE(cache->cacheDir);
     virHashFree(cache->binaries);
+    virHashFree(cache->probing);
+    virCondDestroy(&cache->probed);
     virMutexDestroy(&cache->lock);
     VIR_FREE(cache);
 }
@@ -468,6 +468,7 @@ int virQEMUCapsParseHelpStr(const char *qemu,
 int virQEMUCapsParseDeviceStr(virQEMUCapsPtr qemuCaps, const char *str);
 
 VIR_ENUM_DECL(virQEMUCaps);
+int virQEMUCapsFlagFromString(const char *name);
 
 bool virQEMUCapsSupportsChardev(const virDomainDef *def,
                                 virQEMUCapsPtr qemuCaps,
@@ -31,6 +31,8 @@
 struct _virQEMUCapsCache {
     virMutex lock;
     virHashTablePtr binaries;
+    virHashTablePtr probing;    /* Binaries being probed right now */
+    virCond probed;             /* Signalled when a probe finishes */
     char *libDir;
     char *cacheDir;
     uid_t runUid;
@@ -54,4 +56,14 @@ char *virQEMUCapsFormatCache(virQEMUCapsPtr qemuCaps,
                              time_t selfCTime,
                              unsigned long selfVersion);
 
+int virQEMUCapsLoadBinaryCache(virQEMUCapsPtr qemuCaps,
+                               const char *filename,
+                               time_t *qemuctime,
+                               time_t *selfctime,
+                               unsigned long *selfvers);
+char *virQEMUCapsFormatBinaryCache(virQEMUCapsPtr qemuCaps,
+                                   time_t selfCTime,
+                                   unsigned long selfVersion,
+                                   size_t *len);
+
 #endif
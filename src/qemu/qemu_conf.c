@@ -278,6 +278,10 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged)
     cfg->securityDefaultConfined = true;
     cfg->securityRequireConfined = false;
 
+    cfg->statsWorkers = 4;
+    cfg->statsTimeout = 1000;
+    cfg->reconnectWorkers = 16;
+
     cfg->keepAliveInterval = 5;
     cfg->keepAliveCount = 5;
     cfg->seccompSandbox = -1;
@@ -736,6 +740,13 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
 
     GET_VALUE_ULONG("max_queued", cfg->maxQueuedJobs);
 
+    GET_VALUE_ULONG("stats_workers", cfg->statsWorkers);
+    GET_VALUE_ULONG("stats_timeout", cfg->statsTimeout);
+
+    GET_VALUE_BOOL("coalesce_events", cfg->coalesceEvents);
+
+    GET_VALUE_ULONG("reconnect_workers", cfg->reconnectWorkers);
+
     GET_VALUE_LONG("keepalive_interval", cfg->keepAliveInterval);
     GET_VALUE_ULONG("keepalive_count", cfg->keepAliveCount);
 
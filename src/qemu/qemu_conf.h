@@ -151,6 +151,13 @@ struct _virQEMUDriverConfig {
 
     int maxQueuedJobs;
 
+    unsigned int statsWorkers;
+    unsigned int statsTimeout;
+
+    bool coalesceEvents;
+
+    unsigned int reconnectWorkers;
+
     char **securityDriverNames;
     bool securityDefaultConfined;
     bool securityRequireConfined;
@@ -194,6 +201,14 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virThreadPoolPtr workerPool;
 
+    /* Immutable pointer, self-locking APIs */
+    virThreadPoolPtr statsPool;
+
+    /* Stats workers whose caller gave up on them and which
+     * no longer count against stats_workers */
+    virMutex statsLock;
+    size_t statsDetached; /* Require statsLock to access */
+
     /* Atomic increment only */
     int lastvmid;
 
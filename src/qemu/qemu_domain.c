@@ -1481,7 +1481,7 @@ qemuDomainObjPrivateXMLParse(xmlXPathContextPtr ctxt,
         for (i = 0; i < n; i++) {
             char *str = virXMLPropString(nodes[i], "name");
             if (str) {
-                int flag = virQEMUCapsTypeFromString(str);
+                int flag = virQEMUCapsFlagFromString(str);
                 if (flag < 0) {
                     virReportError(VIR_ERR_INTERNAL_ERROR,
                                    _("Unknown qemu capabilities flag %s"), str);
@@ -1622,6 +1622,306 @@ qemuDomainObjPrivateXMLParse(xmlXPathContextPtr ctxt,
 }
 
 
+/*
+ * Binary counterpart of the private XML for the status cache, holding
+ * the same data in the same order:
+ *
+ *   monitor path, monitor type, monitor JSON
+ *   nvcpupids, vcpupids...
+ *   nflags, qemuCaps flags...
+ *   lockstate
+ *   job, async job, phase, ndisks, migrating disks...
+ *   fakereboot
+ *   ndevices, device aliases...
+ *   numad nodeset, libDir, channelTargetDir
+ *
+ * Bump QEMU_DOMAIN_PRIVATE_BINARY_VERSION whenever this changes.
+ */
+#define QEMU_DOMAIN_PRIVATE_BINARY_VERSION 1
+
+static int
+qemuDomainObjPrivateBinaryFormat(virBufferPtr buf,
+                                 virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    const char *monitorpath = NULL;
+    char *nodeset = NULL;
+    qemuDomainJob job;
+    size_t n;
+    size_t i;
+
+    if (priv->monConfig) {
+        switch (priv->monConfig->type) {
+        case VIR_DOMAIN_CHR_TYPE_UNIX:
+            monitorpath = priv->monConfig->data.nix.path;
+            break;
+        default:
+        case VIR_DOMAIN_CHR_TYPE_PTY:
+            monitorpath = priv->monConfig->data.file.path;
+            break;
+        }
+    }
+    virDomainStatusCachePutString(buf, monitorpath);
+    virDomainStatusCachePutU32(buf, priv->monConfig ?
+                               priv->monConfig->type : VIR_DOMAIN_CHR_TYPE_PTY);
+    virDomainStatusCachePutU32(buf, priv->monJSON);
+
+    virDomainStatusCachePutU32(buf, priv->nvcpupids);
+    for (i = 0; i < priv->nvcpupids; i++)
+        virDomainStatusCachePutU32(buf, priv->vcpupids[i]);
+
+    n = 0;
+    for (i = 0; priv->qemuCaps && i < QEMU_CAPS_LAST; i++) {
+        if (virQEMUCapsGet(priv->qemuCaps, i))
+            n++;
+    }
+    virDomainStatusCachePutU32(buf, n);
+    for (i = 0; priv->qemuCaps && i < QEMU_CAPS_LAST; i++) {
+        if (virQEMUCapsGet(priv->qemuCaps, i))
+            virDomainStatusCachePutU32(buf, i);
+    }
+
+    virDomainStatusCachePutString(buf, priv->lockState);
+
+    job = priv->job.active;
+    if (!qemuDomainTrackJob(job))
+        job = QEMU_JOB_NONE;
+
+    virDomainStatusCachePutU32(buf, job);
+    virDomainStatusCachePutU32(buf, priv->job.asyncJob);
+    virDomainStatusCachePutU32(buf, priv->job.phase);
+
+    n = 0;
+    if (priv->job.asyncJob == QEMU_ASYNC_JOB_MIGRATION_OUT) {
+        for (i = 0; i < vm->def->ndisks; i++) {
+            if (QEMU_DOMAIN_DISK_PRIVATE(vm->def->disks[i])->migrating)
+                n++;
+        }
+    }
+    virDomainStatusCachePutU32(buf, n);
+    for (i = 0; n > 0 && i < vm->def->ndisks; i++) {
+        virDomainDiskDefPtr disk = vm->def->disks[i];
+
+        if (QEMU_DOMAIN_DISK_PRIVATE(disk)->migrating)
+            virDomainStatusCachePutString(buf, disk->dst);
+    }
+
+    virDomainStatusCachePutU32(buf, priv->fakeReboot);
+
+    n = priv->qemuDevices ?
+        virStringListLength((const char **) priv->qemuDevices) : 0;
+    virDomainStatusCachePutU32(buf, n);
+    for (i = 0; i < n; i++)
+        virDomainStatusCachePutString(buf, priv->qemuDevices[i]);
+
+    if (priv->autoNodeset &&
+        !(nodeset = virBitmapFormat(priv->autoNodeset)))
+        return -1;
+    virDomainStatusCachePutString(buf, nodeset);
+    VIR_FREE(nodeset);
+
+    virDomainStatusCachePutString(buf, priv->libDir);
+    virDomainStatusCachePutString(buf, priv->channelTargetDir);
+
+    return 0;
+}
+
+static int
+qemuDomainObjPrivateBinaryParse(virDomainStatusCacheReaderPtr reader,
+                                virDomainObjPtr vm,
+                                virDomainDefParserConfigPtr config)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverPtr driver = config->priv;
+    char *monitorpath = NULL;
+    char *tmp = NULL;
+    const char *phase;
+    uint32_t val;
+    size_t n;
+    size_t i;
+    virQEMUCapsPtr qemuCaps = NULL;
+    virCapsPtr caps = NULL;
+
+    if (VIR_ALLOC(priv->monConfig) < 0)
+        goto error;
+
+    if (virDomainStatusCacheGetString(reader, &monitorpath) < 0 ||
+        virDomainStatusCacheGetU32(reader, &val) < 0)
+        goto error;
+
+    if (!monitorpath) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "%s", _("no monitor path"));
+        goto error;
+    }
+
+    priv->monConfig->type = val;
+    switch (priv->monConfig->type) {
+    case VIR_DOMAIN_CHR_TYPE_PTY:
+        priv->monConfig->data.file.path = monitorpath;
+        break;
+    case VIR_DOMAIN_CHR_TYPE_UNIX:
+        priv->monConfig->data.nix.path = monitorpath;
+        break;
+    default:
+        VIR_FREE(monitorpath);
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unsupported monitor type %u"), val);
+        goto error;
+    }
+
+    if (virDomainStatusCacheGetU32(reader, &val) < 0)
+        goto error;
+    priv->monJSON = !!val;
+
+    if (virDomainStatusCacheGetCount(reader, &n) < 0)
+        goto error;
+    if (n > 0) {
+        if (VIR_REALLOC_N(priv->vcpupids, n) < 0)
+            goto error;
+        priv->nvcpupids = n;
+
+        for (i = 0; i < n; i++) {
+            if (virDomainStatusCacheGetU32(reader, &val) < 0)
+                goto error;
+            priv->vcpupids[i] = val;
+        }
+    }
+
+    if (virDomainStatusCacheGetCount(reader, &n) < 0)
+        goto error;
+    if (n > 0) {
+        if (!(qemuCaps = virQEMUCapsNew()))
+            goto error;
+
+        for (i = 0; i < n; i++) {
+            if (virDomainStatusCacheGetU32(reader, &val) < 0)
+                goto error;
+            if (val >= QEMU_CAPS_LAST) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("Unknown qemu capabilities flag %u"), val);
+                goto error;
+            }
+            virQEMUCapsSet(qemuCaps, val);
+        }
+
+        priv->qemuCaps = qemuCaps;
+        qemuCaps = NULL;
+    }
+
+    if (virDomainStatusCacheGetString(reader, &priv->lockState) < 0)
+        goto error;
+
+    if (virDomainStatusCacheGetU32(reader, &val) < 0)
+        goto error;
+    if (val >= QEMU_JOB_LAST) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unknown job type %u"), val);
+        goto error;
+    }
+    priv->job.active = val;
+
+    if (virDomainStatusCacheGetU32(reader, &val) < 0)
+        goto error;
+    if (val >= QEMU_ASYNC_JOB_LAST) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unknown async job type %u"), val);
+        goto error;
+    }
+    priv->job.asyncJob = val;
+
+    /* Go through the names to normalize the phase like the XML does */
+    if (virDomainStatusCacheGetU32(reader, &val) < 0)
+        goto error;
+    if (val &&
+        (!(phase = qemuDomainAsyncJobPhaseToString(priv->job.asyncJob, val)) ||
+         (priv->job.phase = qemuDomainAsyncJobPhaseFromString(priv->job.asyncJob,
+                                                              phase)) < 0)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unknown job phase %u"), val);
+        goto error;
+    }
+
+    if (virDomainStatusCacheGetCount(reader, &n) < 0)
+        goto error;
+    if (n > 0 && priv->job.asyncJob != QEMU_ASYNC_JOB_MIGRATION_OUT)
+        VIR_WARN("Found disks marked for migration but we were not "
+                 "migrating");
+    for (i = 0; i < n; i++) {
+        virDomainDiskDefPtr disk;
+
+        if (virDomainStatusCacheGetString(reader, &tmp) < 0)
+            goto error;
+
+        if (tmp &&
+            priv->job.asyncJob == QEMU_ASYNC_JOB_MIGRATION_OUT &&
+            (disk = virDomainDiskByName(vm->def, tmp, false)))
+            QEMU_DOMAIN_DISK_PRIVATE(disk)->migrating = true;
+        VIR_FREE(tmp);
+    }
+
+    if (virDomainStatusCacheGetU32(reader, &val) < 0)
+        goto error;
+    priv->fakeReboot = !!val;
+
+    if (virDomainStatusCacheGetCount(reader, &n) < 0)
+        goto error;
+    if (n > 0) {
+        /* NULL-terminated list */
+        if (VIR_ALLOC_N(priv->qemuDevices, n + 1) < 0)
+            goto error;
+
+        for (i = 0; i < n; i++) {
+            if (virDomainStatusCacheGetString(reader,
+                                              &priv->qemuDevices[i]) < 0)
+                goto error;
+            if (!priv->qemuDevices[i]) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("failed to parse qemu device list"));
+                goto error;
+            }
+        }
+    }
+
+    if (virDomainStatusCacheGetString(reader, &tmp) < 0)
+        goto error;
+    if (tmp) {
+        if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
+            goto error;
+
+        if (virBitmapParse(tmp, &priv->autoNodeset,
+                           caps->host.nnumaCell_max) < 0)
+            goto error;
+
+        if (!(priv->autoCpuset = virCapabilitiesGetCpusForNodemask(caps,
+                                                                   priv->autoNodeset)))
+            goto error;
+        VIR_FREE(tmp);
+    }
+    virObjectUnref(caps);
+    caps = NULL;
+
+    if (virDomainStatusCacheGetString(reader, &priv->libDir) < 0 ||
+        virDomainStatusCacheGetString(reader, &priv->channelTargetDir) < 0)
+        goto error;
+
+    if (qemuDomainSetPrivatePathsOld(driver, vm) < 0)
+        goto error;
+
+    return 0;
+
+ error:
+    virDomainChrSourceDefFree(priv->monConfig);
+    priv->monConfig = NULL;
+    VIR_FREE(tmp);
+    virStringFreeList(priv->qemuDevices);
+    priv->qemuDevices = NULL;
+    virObjectUnref(qemuCaps);
+    virObjectUnref(caps);
+    return -1;
+}
+
+
 virDomainXMLPrivateDataCallbacks virQEMUDriverPrivateDataCallbacks = {
     .alloc = qemuDomainObjPrivateAlloc,
     .free = qemuDomainObjPrivateFree,
@@ -1629,6 +1929,9 @@ virDomainXMLPrivateDataCallbacks virQEMUDriverPrivateDataCallbacks = {
     .hostdevNew = qemuDomainHostdevPrivateNew,
     .parse = qemuDomainObjPrivateXMLParse,
     .format = qemuDomainObjPrivateXMLFormat,
+    .binaryParse = qemuDomainObjPrivateBinaryParse,
+    .binaryFormat = qemuDomainObjPrivateBinaryFormat,
+    .binaryVersion = QEMU_DOMAIN_PRIVATE_BINARY_VERSION,
 };
 
 
@@ -2477,17 +2780,80 @@ virDomainDefParserConfig virQEMUDriverDomainDefParserConfig = {
 };
 
 
+/**
+ * qemuDomainFlushStatus:
+ * @driver: qemu driver data
+ * @obj: domain object
+ *
+ * Saves the status of @obj right away, together with any change whose
+ * save was deferred by qemuDomainSaveStatus. Use this where the status
+ * on disk must be current before going on, e.g. once a QEMU process
+ * was spawned.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuDomainFlushStatus(virQEMUDriverPtr driver,
+                      virDomainObjPtr obj)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    int ret;
+
+    priv->statusDirty = false;
+    ret = virDomainSaveStatus(driver->xmlopt, cfg->stateDir,
+                              obj, driver->caps);
+
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
+/**
+ * qemuDomainSaveStatus:
+ * @driver: qemu driver data
+ * @obj: domain object
+ *
+ * Saves the status of @obj. When called by the owner of the current
+ * job, the status is only marked dirty and written once when the job
+ * ends, so that an API changing the domain several times formats and
+ * syncs its status only once. Since the job itself is saved as soon as
+ * it starts, a crash within the job still leaves a consistent status
+ * behind which records the interrupted job.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuDomainSaveStatus(virQEMUDriverPtr driver,
+                     virDomainObjPtr obj)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    if (priv->job.active != QEMU_JOB_NONE &&
+        priv->job.owner == virThreadSelfID()) {
+        VIR_DEBUG("Deferring status save of %s until job %s ends",
+                  obj->def->name,
+                  qemuDomainJobTypeToString(priv->job.active));
+        priv->statusDirty = true;
+        return 0;
+    }
+
+    return qemuDomainFlushStatus(driver, obj);
+}
+
+
 static void
 qemuDomainObjSaveJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
 {
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainObjPrivatePtr priv = obj->privateData;
 
     if (virDomainObjIsActive(obj)) {
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, obj, driver->caps) < 0)
+        if (qemuDomainFlushStatus(driver, obj) < 0)
             VIR_WARN("Failed to save status on vm %s", obj->def->name);
+    } else {
+        /* Whatever was deferred went away along with the process */
+        priv->statusDirty = false;
     }
-
-    virObjectUnref(cfg);
 }
 
 void
@@ -2577,7 +2943,8 @@ static int ATTRIBUTE_NONNULL(1)
 qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
                               virDomainObjPtr obj,
                               qemuDomainJob job,
-                              qemuDomainAsyncJob asyncJob)
+                              qemuDomainAsyncJob asyncJob,
+                              unsigned long long timeout)
 {
     qemuDomainObjPrivatePtr priv = obj->privateData;
     unsigned long long now;
@@ -2601,13 +2968,25 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
               qemuDomainJobTypeToString(priv->job.active),
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob));
 
+    /* Reconnecting to a domain only waits for a free reconnect worker
+     * and the monitor, so it is not subject to the job timeout */
+    while (priv->reconnecting) {
+        VIR_DEBUG("Waiting for reconnect (vm=%p name=%s)", obj, obj->def->name);
+        if (virCondWait(&priv->job.cond, &obj->parent.lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("cannot wait for domain reconnect"));
+            virObjectUnref(cfg);
+            return -1;
+        }
+    }
+
     if (virTimeMillisNow(&now) < 0) {
         virObjectUnref(cfg);
         return -1;
     }
 
     priv->jobs_queued++;
-    then = now + QEMU_JOB_WAIT_TIME;
+    then = now + timeout;
 
  retry:
     if (cfg->maxQueuedJobs &&
@@ -2736,7 +3115,31 @@ int qemuDomainObjBeginJob(virQEMUDriverPtr driver,
                           qemuDomainJob job)
 {
     if (qemuDomainObjBeginJobInternal(driver, obj, job,
-                                      QEMU_ASYNC_JOB_NONE) < 0)
+                                      QEMU_ASYNC_JOB_NONE,
+                                      QEMU_JOB_WAIT_TIME) < 0)
+        return -1;
+    else
+        return 0;
+}
+
+/*
+ * obj must be locked before calling
+ *
+ * Just like qemuDomainObjBeginJob, but gives up waiting for the
+ * job after @timeout milliseconds instead of the usual 30 seconds.
+ * A @timeout of zero means the usual wait time.
+ *
+ * Successful calls must be followed by EndJob eventually
+ */
+int qemuDomainObjBeginJobWithTimeout(virQEMUDriverPtr driver,
+                                     virDomainObjPtr obj,
+                                     qemuDomainJob job,
+                                     unsigned long long timeout)
+{
+    if (qemuDomainObjBeginJobInternal(driver, obj, job,
+                                      QEMU_ASYNC_JOB_NONE,
+                                      timeout ? timeout :
+                                      QEMU_JOB_WAIT_TIME) < 0)
         return -1;
     else
         return 0;
@@ -2747,7 +3150,7 @@ int qemuDomainObjBeginAsyncJob(virQEMUDriverPtr driver,
                                qemuDomainAsyncJob asyncJob)
 {
     if (qemuDomainObjBeginJobInternal(driver, obj, QEMU_JOB_ASYNC,
-                                      asyncJob) < 0)
+                                      asyncJob, QEMU_JOB_WAIT_TIME) < 0)
         return -1;
     else
         return 0;
@@ -2773,7 +3176,8 @@ qemuDomainObjBeginNestedJob(virQEMUDriverPtr driver,
 
     return qemuDomainObjBeginJobInternal(driver, obj,
                                          QEMU_JOB_ASYNC_NESTED,
-                                         QEMU_ASYNC_JOB_NONE);
+                                         QEMU_ASYNC_JOB_NONE,
+                                         QEMU_JOB_WAIT_TIME);
 }
 
 
@@ -2797,7 +3201,7 @@ qemuDomainObjEndJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
               obj, obj->def->name);
 
     qemuDomainObjResetJob(priv);
-    if (qemuDomainTrackJob(job))
+    if (qemuDomainTrackJob(job) || priv->statusDirty)
         qemuDomainObjSaveJob(driver, obj);
     virCondSignal(&priv->job.cond);
 }
@@ -3965,18 +4369,16 @@ qemuDomainSetFakeReboot(virQEMUDriverPtr driver,
                         bool value)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     if (priv->fakeReboot == value)
         goto cleanup;
 
     priv->fakeReboot = value;
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         VIR_WARN("Failed to save status on vm %s", vm->def->name);
 
  cleanup:
-    virObjectUnref(cfg);
 }
 
 static void
@@ -197,6 +197,8 @@ struct _qemuDomainObjPrivate {
     bool fakeReboot;
 
     int jobs_queued;
+    bool reconnecting; /* waiting for qemuProcessReconnect, which jobs
+                          have to wait for before they start */
 
     unsigned long migMaxBandwidth;
     char *origname;
@@ -236,6 +238,9 @@ struct _qemuDomainObjPrivate {
     /* private XML) - need to restore at process reconnect */
     uint8_t *masterKey;
     size_t masterKeyLen;
+
+    bool statusDirty; /* status changed by the current job, to be saved
+                         when it ends */
 };
 
 /* Type of domain secret */
@@ -366,10 +371,22 @@ void qemuDomainEventQueue(virQEMUDriverPtr driver,
 void qemuDomainEventEmitJobCompleted(virQEMUDriverPtr driver,
                                      virDomainObjPtr vm);
 
+int qemuDomainSaveStatus(virQEMUDriverPtr driver,
+                         virDomainObjPtr obj)
+    ATTRIBUTE_RETURN_CHECK;
+int qemuDomainFlushStatus(virQEMUDriverPtr driver,
+                          virDomainObjPtr obj)
+    ATTRIBUTE_RETURN_CHECK;
+
 int qemuDomainObjBeginJob(virQEMUDriverPtr driver,
                           virDomainObjPtr obj,
                           qemuDomainJob job)
     ATTRIBUTE_RETURN_CHECK;
+int qemuDomainObjBeginJobWithTimeout(virQEMUDriverPtr driver,
+                                     virDomainObjPtr obj,
+                                     qemuDomainJob job,
+                                     unsigned long long timeout)
+    ATTRIBUTE_RETURN_CHECK;
 int qemuDomainObjBeginAsyncJob(virQEMUDriverPtr driver,
                                virDomainObjPtr obj,
                                qemuDomainAsyncJob asyncJob)
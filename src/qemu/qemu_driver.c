@@ -138,6 +138,8 @@ static void processGuestPanicEvent(virQEMUDriverPtr driver,
 
 static void qemuProcessEventHandler(void *data, void *opaque);
 
+static void qemuConnectGetAllDomainStatsWorker(void *jobdata, void *opaque);
+
 static int qemuStateCleanup(void);
 
 static int qemuDomainObjStart(virConnectPtr conn,
@@ -638,6 +640,14 @@ qemuStateInitialize(bool privileged,
         return -1;
     }
 
+    if (virMutexInit(&qemu_driver->statsLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        virMutexDestroy(&qemu_driver->lock);
+        VIR_FREE(qemu_driver);
+        return -1;
+    }
+
     qemu_driver->inhibitCallback = callback;
     qemu_driver->inhibitOpaque = opaque;
 
@@ -665,6 +675,9 @@ qemuStateInitialize(bool privileged,
         goto error;
     VIR_FREE(driverConf);
 
+    virObjectEventStateSetCoalesce(qemu_driver->domainEventState,
+                                   cfg->coalesceEvents);
+
     if (virFileMakePath(cfg->stateDir) < 0) {
         virReportSystemError(errno, _("Failed to create state dir %s"),
                              cfg->stateDir);
@@ -926,6 +939,12 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->workerPool)
         goto error;
 
+    if (cfg->statsWorkers > 1 &&
+        !(qemu_driver->statsPool = virThreadPoolNew(0, cfg->statsWorkers, 0,
+                                                    qemuConnectGetAllDomainStatsWorker,
+                                                    qemu_driver)))
+        goto error;
+
     virObjectUnref(conn);
 
     virNWFilterRegisterCallbackDriver(&qemuCallbackDriver);
@@ -1100,6 +1119,8 @@ qemuStateCleanup(void)
 
     virMutexDestroy(&qemu_driver->lock);
     virThreadPoolFree(qemu_driver->workerPool);
+    virThreadPoolFree(qemu_driver->statsPool);
+    virMutexDestroy(&qemu_driver->statsLock);
     VIR_FREE(qemu_driver);
 
     return 0;
@@ -1823,7 +1844,6 @@ static int qemuDomainSuspend(virDomainPtr dom)
     virDomainPausedReason reason;
     int eventDetail;
     int state;
-    virQEMUDriverConfigPtr cfg = NULL;
 
     if (!(vm = qemuDomObjFromDomain(dom)))
         return -1;
@@ -1831,7 +1851,6 @@ static int qemuDomainSuspend(virDomainPtr dom)
     if (virDomainSuspendEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    cfg = virQEMUDriverGetConfig(driver);
     priv = vm->privateData;
 
     if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_SUSPEND) < 0)
@@ -1869,7 +1888,7 @@ static int qemuDomainSuspend(virDomainPtr dom)
                                              eventDetail);
         }
     }
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         goto endjob;
     ret = 0;
 
@@ -1880,7 +1899,6 @@ static int qemuDomainSuspend(virDomainPtr dom)
     virDomainObjEndAPI(&vm);
 
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
     return ret;
 }
 
@@ -1893,13 +1911,10 @@ static int qemuDomainResume(virDomainPtr dom)
     virObjectEventPtr event = NULL;
     int state;
     int reason;
-    virQEMUDriverConfigPtr cfg = NULL;
 
     if (!(vm = qemuDomObjFromDomain(dom)))
         return -1;
 
-    cfg = virQEMUDriverGetConfig(driver);
-
     if (virDomainResumeEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
@@ -1932,7 +1947,7 @@ static int qemuDomainResume(virDomainPtr dom)
                                          VIR_DOMAIN_EVENT_RESUMED,
                                          VIR_DOMAIN_EVENT_RESUMED_UNPAUSED);
     }
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         goto endjob;
     ret = 0;
 
@@ -1942,7 +1957,6 @@ static int qemuDomainResume(virDomainPtr dom)
  cleanup:
     virDomainObjEndAPI(&vm);
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
     return ret;
 }
 
@@ -2465,7 +2479,7 @@ static int qemuDomainSetMemoryStatsPeriod(virDomainPtr dom, int period,
         }
 
         def->memballoon->period = period;
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             goto endjob;
     }
 
@@ -3958,7 +3972,6 @@ processGuestPanicEvent(virQEMUDriverPtr driver,
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
     virObjectEventPtr event = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     bool removeInactive = false;
 
     if (qemuDomainObjBeginAsyncJob(driver, vm, QEMU_ASYNC_JOB_DUMP) < 0)
@@ -3980,7 +3993,7 @@ processGuestPanicEvent(virQEMUDriverPtr driver,
 
     qemuDomainEventQueue(driver, event);
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+    if (qemuDomainSaveStatus(driver, vm) < 0) {
         VIR_WARN("Unable to save status on vm %s after state change",
                  vm->def->name);
     }
@@ -4030,7 +4043,6 @@ processGuestPanicEvent(virQEMUDriverPtr driver,
         qemuDomainRemoveInactive(driver, vm);
 
  cleanup:
-    virObjectUnref(cfg);
 }
 
 
@@ -4039,7 +4051,6 @@ processDeviceDeletedEvent(virQEMUDriverPtr driver,
                           virDomainObjPtr vm,
                           char *devAlias)
 {
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     virDomainDeviceDef dev;
 
     VIR_DEBUG("Removing device %s from domain %p %s",
@@ -4059,7 +4070,7 @@ processDeviceDeletedEvent(virQEMUDriverPtr driver,
     if (qemuDomainRemoveDevice(driver, vm, &dev) < 0)
         goto endjob;
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         VIR_WARN("unable to save domain status after removing device %s",
                  devAlias);
 
@@ -4068,7 +4079,6 @@ processDeviceDeletedEvent(virQEMUDriverPtr driver,
 
  cleanup:
     VIR_FREE(devAlias);
-    virObjectUnref(cfg);
 }
 
 
@@ -4375,7 +4385,6 @@ processSerialChangedEvent(virQEMUDriverPtr driver,
                           char *devAlias,
                           bool connected)
 {
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     virDomainChrDeviceState newstate;
     virObjectEventPtr event = NULL;
     virDomainDeviceDef dev;
@@ -4427,7 +4436,7 @@ processSerialChangedEvent(virQEMUDriverPtr driver,
 
     dev.data.chr->state = newstate;
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         VIR_WARN("unable to save status of domain %s after updating state of "
                  "channel %s", vm->def->name, devAlias);
 
@@ -4458,7 +4467,6 @@ processSerialChangedEvent(virQEMUDriverPtr driver,
 
  cleanup:
     VIR_FREE(devAlias);
-    virObjectUnref(cfg);
 
 }
 
@@ -4842,7 +4850,7 @@ qemuDomainSetVcpusFlags(virDomainPtr dom, unsigned int nvcpus,
             }
         }
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             goto endjob;
     }
 
@@ -4953,7 +4961,7 @@ qemuDomainPinVcpuLive(virDomainObjPtr vm,
     vcpuinfo->cpumask = tmpmap;
     tmpmap = NULL;
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         goto cleanup;
 
     if (snprintf(paramField, VIR_TYPED_PARAM_FIELD_LENGTH,
@@ -5170,7 +5178,7 @@ qemuDomainPinEmulator(virDomainPtr dom,
         if (!(def->cputune.emulatorpin = virBitmapNewCopy(pcpumap)))
             goto endjob;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             goto endjob;
 
         str = virBitmapFormat(pcpumap);
@@ -5640,7 +5648,7 @@ qemuDomainPinIOThread(virDomainPtr dom,
         if (virProcessSetAffinity(iothrid->thread_id, pcpumap) < 0)
             goto endjob;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             goto endjob;
 
         if (snprintf(paramField, VIR_TYPED_PARAM_FIELD_LENGTH,
@@ -5915,7 +5923,7 @@ qemuDomainChgIOThread(virQEMUDriverPtr driver,
                 goto endjob;
         }
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             goto endjob;
     }
 
@@ -6402,7 +6410,6 @@ qemuDomainSaveImageStartVM(virConnectPtr conn,
     int intermediatefd = -1;
     virCommandPtr cmd = NULL;
     char *errbuf = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     if ((header->version == 2) &&
         (header->compressed != QEMU_SAVE_FORMAT_RAW)) {
@@ -6478,7 +6485,7 @@ qemuDomainSaveImageStartVM(virConnectPtr conn,
                                "%s", _("failed to resume domain"));
             goto cleanup;
         }
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Failed to save status on vm %s", vm->def->name);
             goto cleanup;
         }
@@ -6499,7 +6506,6 @@ qemuDomainSaveImageStartVM(virConnectPtr conn,
     if (virSecurityManagerRestoreSavedStateLabel(driver->securityManager,
                                                  vm->def, path) < 0)
         VIR_WARN("failed to restore save state label on %s", path);
-    virObjectUnref(cfg);
     return ret;
 }
 
@@ -8157,7 +8163,7 @@ qemuDomainAttachDeviceFlags(virDomainPtr dom,
          * changed even if we failed to attach the device. For example,
          * a new controller may be created.
          */
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             ret = -1;
             goto endjob;
         }
@@ -8286,7 +8292,7 @@ static int qemuDomainUpdateDeviceFlags(virDomainPtr dom,
          * changed even if we failed to attach the device. For example,
          * a new controller may be created.
          */
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             ret = -1;
             goto endjob;
         }
@@ -8410,7 +8416,7 @@ qemuDomainDetachDeviceFlags(virDomainPtr dom,
          * changed even if we failed to attach the device. For example,
          * a new controller may be created.
          */
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             ret = -1;
             goto endjob;
         }
@@ -8941,7 +8947,7 @@ qemuDomainSetBlkioParameters(virDomainPtr dom,
             }
         }
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             goto endjob;
     }
     if (ret < 0)
@@ -9206,7 +9212,7 @@ qemuDomainSetMemoryParameters(virDomainPtr dom,
 #undef QEMU_SET_MEM_PARAMETER
 
     if (def &&
-        virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        qemuDomainSaveStatus(driver, vm) < 0)
         goto endjob;
 
     if (persistentDef &&
@@ -9474,7 +9480,7 @@ qemuDomainSetNumaParameters(virDomainPtr dom,
                                  -1, mode, nodeset) < 0)
             goto endjob;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             goto endjob;
     }
 
@@ -9646,7 +9652,7 @@ qemuDomainSetPerfEvents(virDomainPtr dom,
                 VIR_TRISTATE_BOOL_YES : VIR_TRISTATE_BOOL_NO;
         }
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             goto endjob;
     }
 
@@ -10047,7 +10053,7 @@ qemuDomainSetSchedulerParametersFlags(virDomainPtr dom,
         }
     }
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         goto endjob;
 
     if (eventNparams) {
@@ -10802,7 +10808,7 @@ qemuDomainSetInterfaceParameters(virDomainPtr dom,
                 goto endjob;
         }
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             goto endjob;
     }
 
@@ -14005,7 +14011,7 @@ qemuDomainSnapshotCreateDiskActive(virQEMUDriverPtr driver,
     }
 
     if (ret == 0 || !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_TRANSACTION)) {
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0 ||
+        if (qemuDomainSaveStatus(driver, vm) < 0 ||
             (persist && virDomainSaveConfig(cfg->configDir, driver->caps,
                                             vm->newDef) < 0))
             ret = -1;
@@ -15921,7 +15927,6 @@ qemuDomainBlockJobAbort(virDomainPtr dom,
     virQEMUDriverPtr driver = dom->conn->privateData;
     char *device = NULL;
     virDomainDiskDefPtr disk = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     bool save = false;
     bool modern;
     bool pivot = !!(flags & VIR_DOMAIN_BLOCK_JOB_ABORT_PIVOT);
@@ -15994,7 +15999,7 @@ qemuDomainBlockJobAbort(virDomainPtr dom,
      * effort to save it now.  But we can ignore failure, since there
      * will be further changes when the event marks completion.  */
     if (save)
-        ignore_value(virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps));
+        ignore_value(qemuDomainSaveStatus(driver, vm));
 
     /* With synchronous block cancel, we must synthesize an event, and
      * we silently ignore the ABORT_ASYNC flag.  With asynchronous
@@ -16031,7 +16036,6 @@ qemuDomainBlockJobAbort(virDomainPtr dom,
     qemuDomainObjEndJob(driver, vm);
 
  cleanup:
-    virObjectUnref(cfg);
     VIR_FREE(device);
     virDomainObjEndAPI(&vm);
     return ret;
@@ -16113,11 +16117,8 @@ qemuDomainGetBlockJobInfo(virDomainPtr dom,
     if (disk->mirror &&
         rawInfo.ready != 0 &&
         info->cur == info->end && !disk->mirrorState) {
-        virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
-
         disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_READY;
-        ignore_value(virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps));
-        virObjectUnref(cfg);
+        ignore_value(qemuDomainSaveStatus(driver, vm));
     }
  endjob:
     qemuDomainObjEndJob(driver, vm);
@@ -16375,7 +16376,7 @@ qemuDomainBlockCopyCommon(virDomainObjPtr vm,
     disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_COPY;
     QEMU_DOMAIN_DISK_PRIVATE(disk)->blockjob = true;
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         VIR_WARN("Unable to save status on vm %s after state change",
                  vm->def->name);
 
@@ -16769,13 +16770,10 @@ qemuDomainBlockCommit(virDomainPtr dom,
 
     if (mirror) {
         if (ret == 0) {
-            virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
-
             mirror = NULL;
-            if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+            if (qemuDomainSaveStatus(driver, vm) < 0)
                 VIR_WARN("Unable to save status on vm %s after block job",
                          vm->def->name);
-            virObjectUnref(cfg);
         } else {
             disk->mirror = NULL;
             disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_UNKNOWN;
@@ -17278,7 +17276,7 @@ qemuDomainSetBlockIoTune(virDomainPtr dom,
             goto endjob;
         disk->blkdeviotune = info;
 
-        ret = virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps);
+        ret = qemuDomainSaveStatus(driver, vm);
         if (ret < 0)
             goto endjob;
 
@@ -18453,6 +18451,8 @@ typedef enum {
                                             accessed */
     QEMU_DOMAIN_STATS_BACKING  = 1 << 1, /* include backing chain in
                                             block stats */
+    QEMU_DOMAIN_STATS_PARTIAL  = 1 << 2, /* job was needed but could not
+                                            be entered in time */
 } qemuDomainStatsFlags;
 
 
@@ -19086,6 +19086,14 @@ qemuDomainGetStats(virConnectPtr conn,
         }
     }
 
+    if (flags & QEMU_DOMAIN_STATS_PARTIAL &&
+        virTypedParamsAddBoolean(&tmp->params,
+                                 &tmp->nparams,
+                                 &maxparams,
+                                 "partial",
+                                 true) < 0)
+        goto cleanup;
+
     if (!(tmp->dom = virGetDomain(conn, dom->def->name, dom->def->uuid)))
         goto cleanup;
 
@@ -19103,6 +19111,372 @@ qemuDomainGetStats(virConnectPtr conn,
 }
 
 
+/* State shared by all domains of one virConnectGetAllDomainStats call.
+ * Workers which are still busy when the caller stops waiting keep it
+ * alive through their reference. */
+typedef struct _qemuConnectGetAllDomainStatsData qemuConnectGetAllDomainStatsData;
+typedef qemuConnectGetAllDomainStatsData *qemuConnectGetAllDomainStatsDataPtr;
+struct _qemuConnectGetAllDomainStatsData {
+    virConnectPtr conn;
+    unsigned int stats;
+    unsigned int privflags;
+    unsigned int flags;
+
+    virMutex lock;
+    virCond cond;
+    size_t refs;
+
+    /* Indexed just like the list of domains being queried */
+    virDomainStatsRecordPtr *records;
+    size_t nrecords;
+
+    /* The rest is only used when collecting in parallel */
+    size_t pending;
+    size_t running; /* jobs taken by a worker but not finished yet */
+    bool abandoned; /* the caller no longer waits for records */
+    virErrorPtr error;
+};
+
+typedef struct _qemuConnectGetAllDomainStatsJob qemuConnectGetAllDomainStatsJob;
+typedef qemuConnectGetAllDomainStatsJob *qemuConnectGetAllDomainStatsJobPtr;
+struct _qemuConnectGetAllDomainStatsJob {
+    qemuConnectGetAllDomainStatsDataPtr data;
+    virDomainObjPtr vm;
+    size_t idx;
+};
+
+
+static void
+qemuConnectGetAllDomainStatsRecordFree(virDomainStatsRecordPtr record)
+{
+    if (!record)
+        return;
+
+    virObjectUnref(record->dom);
+    virTypedParamsFree(record->params, record->nparams);
+    VIR_FREE(record);
+}
+
+
+static qemuConnectGetAllDomainStatsDataPtr
+qemuConnectGetAllDomainStatsDataNew(virConnectPtr conn,
+                                    size_t nrecords)
+{
+    qemuConnectGetAllDomainStatsDataPtr data;
+
+    if (VIR_ALLOC(data) < 0)
+        return NULL;
+
+    if (VIR_ALLOC_N(data->records, nrecords) < 0) {
+        VIR_FREE(data);
+        return NULL;
+    }
+
+    if (virMutexInit(&data->lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        VIR_FREE(data->records);
+        VIR_FREE(data);
+        return NULL;
+    }
+    if (virCondInit(&data->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virMutexDestroy(&data->lock);
+        VIR_FREE(data->records);
+        VIR_FREE(data);
+        return NULL;
+    }
+
+    data->conn = virObjectRef(conn);
+    data->nrecords = nrecords;
+    data->refs = 1;
+    return data;
+}
+
+
+static void
+qemuConnectGetAllDomainStatsDataUnref(qemuConnectGetAllDomainStatsDataPtr data)
+{
+    size_t i;
+    bool last;
+
+    if (!data)
+        return;
+
+    virMutexLock(&data->lock);
+    last = --data->refs == 0;
+    virMutexUnlock(&data->lock);
+
+    if (!last)
+        return;
+
+    for (i = 0; i < data->nrecords; i++)
+        qemuConnectGetAllDomainStatsRecordFree(data->records[i]);
+    VIR_FREE(data->records);
+    virFreeError(data->error);
+    virObjectUnref(data->conn);
+    virCondDestroy(&data->cond);
+    virMutexDestroy(&data->lock);
+    VIR_FREE(data);
+}
+
+
+/*
+ * Collect the stats of @vm, waiting at most @timeout milliseconds for
+ * its job, zero meaning as long as any other API does.
+ */
+static int
+qemuConnectGetAllDomainStatsOne(qemuConnectGetAllDomainStatsDataPtr data,
+                                virDomainObjPtr vm,
+                                unsigned long long timeout,
+                                virDomainStatsRecordPtr *record)
+{
+    virQEMUDriverPtr driver = data->conn->privateData;
+    unsigned int domflags = 0;
+    int ret;
+
+    virObjectLock(vm);
+
+    if (HAVE_JOB(data->privflags)) {
+        if (qemuDomainObjBeginJobWithTimeout(driver, vm, QEMU_JOB_QUERY,
+                                             timeout) == 0) {
+            domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+        } else {
+            /* without a job it's still possible to gather some data */
+            domflags |= QEMU_DOMAIN_STATS_PARTIAL;
+            virResetLastError();
+        }
+    }
+
+    if (data->flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
+        domflags |= QEMU_DOMAIN_STATS_BACKING;
+
+    ret = qemuDomainGetStats(data->conn, vm, data->stats, record, domflags);
+
+    if (HAVE_JOB(domflags))
+        qemuDomainObjEndJob(driver, vm);
+
+    virObjectUnlock(vm);
+    return ret;
+}
+
+
+/*
+ * Collect whatever stats of @vm don't need its monitor, for domains
+ * whose worker is stuck waiting for the job or the monitor.
+ */
+static int
+qemuConnectGetAllDomainStatsPartial(qemuConnectGetAllDomainStatsDataPtr data,
+                                    virDomainObjPtr vm,
+                                    virDomainStatsRecordPtr *record)
+{
+    unsigned int domflags = QEMU_DOMAIN_STATS_PARTIAL;
+    int ret;
+
+    if (data->flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
+        domflags |= QEMU_DOMAIN_STATS_BACKING;
+
+    virObjectLock(vm);
+    ret = qemuDomainGetStats(data->conn, vm, data->stats, record, domflags);
+    virObjectUnlock(vm);
+    return ret;
+}
+
+
+/*
+ * Workers whose caller gave up on them may stay stuck on a hung
+ * monitor for a long time. Grow driver->statsPool by @delta such
+ * workers, or shrink it back once they finish, so that they don't
+ * take the place of the stats_workers threads.
+ */
+static void
+qemuConnectGetAllDomainStatsDetach(virQEMUDriverPtr driver,
+                                   ssize_t delta)
+{
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+
+    virMutexLock(&driver->statsLock);
+    driver->statsDetached += delta;
+    if (virThreadPoolSetParameters(driver->statsPool, -1,
+                                   cfg->statsWorkers + driver->statsDetached,
+                                   -1) < 0) {
+        VIR_WARN("Unable to resize stats worker pool: %s",
+                 virGetLastErrorMessage());
+        virResetLastError();
+    }
+    virMutexUnlock(&driver->statsLock);
+
+    virObjectUnref(cfg);
+}
+
+
+static void
+qemuConnectGetAllDomainStatsWorker(void *jobdata,
+                                   void *opaque ATTRIBUTE_UNUSED)
+{
+    qemuConnectGetAllDomainStatsJobPtr job = jobdata;
+    qemuConnectGetAllDomainStatsDataPtr data = job->data;
+    virQEMUDriverPtr driver = data->conn->privateData;
+    virQEMUDriverConfigPtr cfg;
+    virDomainStatsRecordPtr record = NULL;
+    unsigned long long timeout;
+    bool detached = false;
+    int rc;
+
+    /* Nobody waits for domains whose job was still queued */
+    virMutexLock(&data->lock);
+    if (data->abandoned) {
+        data->pending--;
+        virMutexUnlock(&data->lock);
+        goto cleanup;
+    }
+    data->running++;
+    virMutexUnlock(&data->lock);
+
+    cfg = virQEMUDriverGetConfig(driver);
+    timeout = cfg->statsTimeout;
+    virObjectUnref(cfg);
+
+    rc = qemuConnectGetAllDomainStatsOne(data, job->vm, timeout, &record);
+
+    virMutexLock(&data->lock);
+    data->running--;
+    if (data->abandoned) {
+        VIR_DEBUG("Dropping late stats of domain %p", job->vm);
+        qemuConnectGetAllDomainStatsRecordFree(record);
+        /* We were counted as detached when the caller gave up */
+        detached = true;
+    } else {
+        if (rc < 0 && !data->error)
+            data->error = virSaveLastError();
+        data->records[job->idx] = record;
+    }
+    data->pending--;
+    virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+
+    if (detached)
+        qemuConnectGetAllDomainStatsDetach(driver, -1);
+
+ cleanup:
+    qemuConnectGetAllDomainStatsDataUnref(data);
+    virObjectUnref(job->vm);
+    VIR_FREE(job);
+}
+
+
+/*
+ * Spread collection of @vms over driver->statsPool and wait until
+ * all of them are done, so that one domain with a slow monitor delays
+ * only itself rather than all the rest. The wait gives up once no
+ * domain finished for twice the stats timeout, which covers waiting
+ * for the job of a domain and then talking to its monitor. Domains
+ * which are still being queried then only get the stats which don't
+ * need their monitor, marked as partial.
+ */
+static int
+qemuConnectGetAllDomainStatsParallel(virQEMUDriverPtr driver,
+                                     qemuConnectGetAllDomainStatsDataPtr data,
+                                     virDomainObjPtr *vms,
+                                     size_t nvms)
+{
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    unsigned long long timeout;
+    unsigned long long now;
+    unsigned long long deadline;
+    size_t pending;
+    size_t detached;
+    size_t i;
+    int ret = -1;
+
+    /* Zero makes the job wait as long as for any other API, 30s */
+    timeout = 2ull * (cfg->statsTimeout ? cfg->statsTimeout : 30 * 1000);
+    virObjectUnref(cfg);
+
+    virMutexLock(&data->lock);
+
+    for (i = 0; i < nvms; i++) {
+        qemuConnectGetAllDomainStatsJobPtr job;
+
+        if (VIR_ALLOC(job) < 0)
+            break;
+
+        job->data = data;
+        job->vm = virObjectRef(vms[i]);
+        job->idx = i;
+        data->refs++;
+
+        if (virThreadPoolSendJob(driver->statsPool, 0, job) < 0) {
+            data->refs--;
+            virObjectUnref(job->vm);
+            VIR_FREE(job);
+            break;
+        }
+        data->pending++;
+    }
+
+    if (virTimeMillisNow(&now) < 0)
+        goto abandon;
+    deadline = now + timeout;
+    pending = data->pending;
+
+    while (data->pending > 0) {
+        if (virCondWaitUntil(&data->cond, &data->lock, deadline) < 0) {
+            if (errno != ETIMEDOUT) {
+                virReportSystemError(errno, "%s",
+                                     _("Unable to wait for domain stats"));
+                goto abandon;
+            }
+            VIR_WARN("Giving up on stats of %zu domains which did not "
+                     "answer in time", data->pending);
+            break;
+        }
+
+        /* Every domain that finished gives the rest more time */
+        if (data->pending < pending) {
+            pending = data->pending;
+            if (virTimeMillisNow(&now) < 0)
+                break;
+            deadline = now + timeout;
+        }
+    }
+
+    if (i < nvms)
+        goto abandon;
+
+    if (data->error) {
+        virSetError(data->error);
+        goto abandon;
+    }
+
+    ret = 0;
+
+ abandon:
+    /* Workers still running must not hand their records
+     * over anymore, they are freed along with @data */
+    data->abandoned = true;
+    detached = data->running;
+    virMutexUnlock(&data->lock);
+
+    if (detached > 0)
+        qemuConnectGetAllDomainStatsDetach(driver, detached);
+
+    if (ret < 0)
+        return -1;
+
+    /* Only the domains which did not answer are left without a record */
+    for (i = 0; i < nvms; i++) {
+        if (data->records[i])
+            continue;
+        if (qemuConnectGetAllDomainStatsPartial(data, vms[i],
+                                                &data->records[i]) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 qemuConnectGetAllDomainStats(virConnectPtr conn,
                              virDomainPtr *doms,
@@ -19113,15 +19487,14 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
 {
     virQEMUDriverPtr driver = conn->privateData;
     virDomainObjPtr *vms = NULL;
-    virDomainObjPtr vm;
     size_t nvms;
+    qemuConnectGetAllDomainStatsDataPtr data = NULL;
     virDomainStatsRecordPtr *tmpstats = NULL;
     bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
     int nstats = 0;
     size_t i;
+    int rc = 0;
     int ret = -1;
-    unsigned int privflags = 0;
-    unsigned int domflags = 0;
     unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
                                    VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
                                    VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
@@ -19150,42 +19523,37 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
             return -1;
     }
 
-    if (VIR_ALLOC_N(tmpstats, nvms + 1) < 0)
-        return -1;
-
-    if (qemuDomainGetStatsNeedMonitor(stats))
-        privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
-
-    for (i = 0; i < nvms; i++) {
-        virDomainStatsRecordPtr tmp = NULL;
-        domflags = 0;
-        vm = vms[i];
+    if (VIR_ALLOC_N(tmpstats, nvms + 1) < 0 ||
+        !(data = qemuConnectGetAllDomainStatsDataNew(conn, nvms)))
+        goto cleanup;
 
-        virObjectLock(vm);
+    data->stats = stats;
+    data->flags = flags;
 
-        if (HAVE_JOB(privflags) &&
-            qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) == 0)
-            domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
-        /* else: without a job it's still possible to gather some data */
+    if (qemuDomainGetStatsNeedMonitor(stats))
+        data->privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
 
-        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
-            domflags |= QEMU_DOMAIN_STATS_BACKING;
-        if (qemuDomainGetStats(conn, vm, stats, &tmp, domflags) < 0) {
-            if (HAVE_JOB(domflags) && vm)
-                qemuDomainObjEndJob(driver, vm);
+    if (driver->statsPool && nvms > 1) {
+        rc = qemuConnectGetAllDomainStatsParallel(driver, data, vms, nvms);
+    } else {
+        for (i = 0; i < nvms && rc == 0; i++)
+            rc = qemuConnectGetAllDomainStatsOne(data, vms[i], 0,
+                                                 &data->records[i]);
+    }
 
-            virObjectUnlock(vm);
-            goto cleanup;
+    /* Keep the order of domains, but skip any without a record.
+     * Late workers no longer touch the records once abandoned. */
+    virMutexLock(&data->lock);
+    for (i = 0; i < nvms; i++) {
+        if (data->records[i]) {
+            tmpstats[nstats++] = data->records[i];
+            data->records[i] = NULL;
         }
-
-        if (tmp)
-            tmpstats[nstats++] = tmp;
-
-        if (HAVE_JOB(domflags))
-            qemuDomainObjEndJob(driver, vm);
-
-        virObjectUnlock(vm);
     }
+    virMutexUnlock(&data->lock);
+
+    if (rc < 0)
+        goto cleanup;
 
     *retStats = tmpstats;
     tmpstats = NULL;
@@ -19194,6 +19562,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
 
  cleanup:
     virDomainStatsRecordListFree(tmpstats);
+    qemuConnectGetAllDomainStatsDataUnref(data);
     virObjectListFreeCount(vms, nvms);
 
     return ret;
@@ -2118,7 +2118,6 @@ qemuMigrationDriveMirror(virQEMUDriverPtr driver,
     unsigned long long mirror_speed = speed;
     unsigned int mirror_flags = VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT;
     int rv;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     VIR_DEBUG("Starting drive mirrors for domain %s", vm->def->name);
 
@@ -2177,7 +2176,7 @@ qemuMigrationDriveMirror(virQEMUDriverPtr driver,
         }
         diskPriv->migrating = true;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Failed to save status on vm %s", vm->def->name);
             goto cleanup;
         }
@@ -2211,7 +2210,6 @@ qemuMigrationDriveMirror(virQEMUDriverPtr driver,
     ret = 0;
 
  cleanup:
-    virObjectUnref(cfg);
     VIR_FREE(diskAlias);
     VIR_FREE(nbd_dest);
     VIR_FREE(hoststr);
@@ -4173,7 +4171,6 @@ qemuMigrationConfirmPhase(virQEMUDriverPtr driver,
     qemuMigrationCookiePtr mig;
     virObjectEventPtr event;
     int rv = -1;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     qemuDomainObjPrivatePtr priv = vm->privateData;
     qemuDomainJobInfoPtr jobInfo = NULL;
 
@@ -4262,7 +4259,7 @@ qemuMigrationConfirmPhase(virQEMUDriverPtr driver,
             qemuDomainEventQueue(driver, event);
         }
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             VIR_WARN("Failed to save status on vm %s", vm->def->name);
     }
 
@@ -4271,7 +4268,6 @@ qemuMigrationConfirmPhase(virQEMUDriverPtr driver,
     rv = 0;
 
  cleanup:
-    virObjectUnref(cfg);
     return rv;
 }
 
@@ -4362,7 +4358,9 @@ struct _qemuMigrationSpec {
     } fwd;
 };
 
-#define TUNNEL_SEND_BUF_SIZE 65536
+/* The stream splits this into as many packets as the destination
+ * daemon is willing to take */
+#define TUNNEL_SEND_BUF_SIZE (1024 * 1024)
 
 typedef struct _qemuMigrationIOThread qemuMigrationIOThread;
 typedef qemuMigrationIOThread *qemuMigrationIOThreadPtr;
@@ -4437,11 +4435,17 @@ static void qemuMigrationIOFunc(void *arg)
 
         if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
             int nbytes;
+            int offset = 0;
 
             nbytes = saferead(data->sock, buffer, TUNNEL_SEND_BUF_SIZE);
             if (nbytes > 0) {
-                if (virStreamSend(data->st, buffer, nbytes) < 0)
-                    goto error;
+                while (offset < nbytes) {
+                    int done = virStreamSend(data->st, buffer + offset,
+                                             nbytes - offset);
+                    if (done < 0)
+                        goto error;
+                    offset += done;
+                }
             } else if (nbytes < 0) {
                 virReportSystemError(errno, "%s",
                         _("tunnelled migration failed to read from qemu"));
@@ -6161,7 +6165,6 @@ qemuMigrationFinish(virQEMUDriverPtr driver,
     virErrorPtr orig_err = NULL;
     int cookie_flags = 0;
     qemuDomainObjPrivatePtr priv = vm->privateData;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     unsigned short port;
     unsigned long long timeReceived = 0;
     virObjectEventPtr event;
@@ -6367,7 +6370,7 @@ qemuMigrationFinish(virQEMUDriverPtr driver,
     }
 
     if (virDomainObjIsActive(vm) &&
-        virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        qemuDomainSaveStatus(driver, vm) < 0)
         VIR_WARN("Failed to save status on vm %s", vm->def->name);
 
     /* Guest is successfully running, so cancel previous auto destroy */
@@ -6424,7 +6427,6 @@ qemuMigrationFinish(virQEMUDriverPtr driver,
         virSetError(orig_err);
         virFreeError(orig_err);
     }
-    virObjectUnref(cfg);
 
     /* Set a special error if Finish is expected to return NULL as a result of
      * successful call with retcode != 0
@@ -55,6 +55,12 @@ VIR_LOG_INIT("qemu.qemu_monitor");
 #define DEBUG_IO 0
 #define DEBUG_RAW_IO 0
 
+/* The read buffer starts at QEMU_MONITOR_BUFFER_MIN bytes and doubles
+ * whenever it runs out of room, but by no more than
+ * QEMU_MONITOR_BUFFER_GROW_MAX at a time to bound the slack */
+#define QEMU_MONITOR_BUFFER_MIN 1024
+#define QEMU_MONITOR_BUFFER_GROW_MAX (1024 * 1024)
+
 struct _qemuMonitor {
     virObjectLockable parent;
 
@@ -561,12 +567,17 @@ qemuMonitorIORead(qemuMonitorPtr mon)
     size_t avail = mon->bufferLength - mon->bufferOffset;
     int ret = 0;
 
-    if (avail < 1024) {
+    if (avail < QEMU_MONITOR_BUFFER_MIN) {
+        /* Grow geometrically, so that a reply of several megabytes
+         * does not cost a realloc and copy for every kilobyte */
+        size_t grow = MIN(MAX(mon->bufferLength, QEMU_MONITOR_BUFFER_MIN),
+                          QEMU_MONITOR_BUFFER_GROW_MAX);
+
         if (VIR_REALLOC_N(mon->buffer,
-                          mon->bufferLength + 1024) < 0)
+                          mon->bufferLength + grow) < 0)
             return -1;
-        mon->bufferLength += 1024;
-        avail += 1024;
+        mon->bufferLength += grow;
+        avail += grow;
     }
 
     /* Read as much as we can get into our buffer,
@@ -190,7 +190,9 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 
     VIR_DEBUG("Line [%s]", line);
 
-    if (!(obj = virJSONValueFromString(line)))
+    /* Replies are mostly read and thrown away as a whole, an arena
+     * saves the many small allocations of big ones like query-blockstats */
+    if (!(obj = virJSONValueFromStringArena(line)))
         goto cleanup;
 
     if (obj->type != VIR_JSON_TYPE_OBJECT) {
@@ -229,7 +231,7 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 }
 
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
-                             const char *data,
+                             char *data,
                              size_t len,
                              qemuMonitorMessagePtr msg)
 {
@@ -240,18 +242,14 @@ int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
         char *nl = strstr(data + used, LINE_ENDING);
 
         if (nl) {
-            int got = nl - (data + used);
-            char *line;
-            if (VIR_STRNDUP(line, data + used, got) < 0)
-                return -1;
-            used += got + strlen(LINE_ENDING);
-            line[got] = '\0'; /* kill \n */
-            if (qemuMonitorJSONIOProcessLine(mon, line, msg) < 0) {
-                VIR_FREE(line);
-                return -1;
-            }
+            char *line = data + used;
 
-            VIR_FREE(line);
+            /* Parse the line right where it is in the buffer, the
+             * caller discards the bytes we report as used anyway */
+            *nl = '\0';
+            used += nl - line + strlen(LINE_ENDING);
+            if (qemuMonitorJSONIOProcessLine(mon, line, msg) < 0)
+                return -1;
         } else {
             break;
         }
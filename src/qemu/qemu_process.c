@@ -104,6 +104,14 @@ qemuProcessRemoveDomainStatus(virQEMUDriverPtr driver,
                  vm->def->name, virStrerror(errno, ebuf, sizeof(ebuf)));
     VIR_FREE(file);
 
+    if (!(file = virDomainStatusCacheFile(cfg->stateDir, vm->def->name)))
+        goto cleanup;
+
+    if (unlink(file) < 0 && errno != ENOENT && errno != ENOTDIR)
+        VIR_WARN("Failed to remove status cache for %s: %s",
+                 vm->def->name, virStrerror(errno, ebuf, sizeof(ebuf)));
+    VIR_FREE(file);
+
     if (priv->pidfile &&
         unlink(priv->pidfile) < 0 &&
         errno != ENOENT)
@@ -491,7 +499,6 @@ qemuProcessHandleReset(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event;
     qemuDomainObjPrivatePtr priv;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
 
@@ -500,14 +507,13 @@ qemuProcessHandleReset(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     if (priv->agent)
         qemuAgentNotifyEvent(priv->agent, QEMU_AGENT_EVENT_RESET);
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         VIR_WARN("Failed to save status on vm %s", vm->def->name);
 
     virObjectUnlock(vm);
 
     qemuDomainEventQueue(driver, event);
 
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -527,7 +533,6 @@ qemuProcessFakeReboot(void *opaque)
     virDomainObjPtr vm = opaque;
     qemuDomainObjPrivatePtr priv = vm->privateData;
     virObjectEventPtr event = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     virDomainRunningReason reason = VIR_DOMAIN_RUNNING_BOOTED;
     int ret = -1, rc;
 
@@ -567,7 +572,7 @@ qemuProcessFakeReboot(void *opaque)
                                      VIR_DOMAIN_EVENT_RESUMED,
                                      VIR_DOMAIN_EVENT_RESUMED_UNPAUSED);
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+    if (qemuDomainSaveStatus(driver, vm) < 0) {
         VIR_WARN("Unable to save status on vm %s after state change",
                  vm->def->name);
     }
@@ -582,7 +587,6 @@ qemuProcessFakeReboot(void *opaque)
         ignore_value(qemuProcessKill(vm, VIR_QEMU_PROCESS_KILL_FORCE));
     virDomainObjEndAPI(&vm);
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
 }
 
 
@@ -644,7 +648,6 @@ qemuProcessHandleShutdown(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     qemuDomainObjPrivatePtr priv;
     virObjectEventPtr event = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     VIR_DEBUG("vm=%p", vm);
 
@@ -671,7 +674,7 @@ qemuProcessHandleShutdown(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                      VIR_DOMAIN_EVENT_SHUTDOWN,
                                      VIR_DOMAIN_EVENT_SHUTDOWN_FINISHED);
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+    if (qemuDomainSaveStatus(driver, vm) < 0) {
         VIR_WARN("Unable to save status on vm %s after state change",
                  vm->def->name);
     }
@@ -684,7 +687,6 @@ qemuProcessHandleShutdown(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
  unlock:
     virObjectUnlock(vm);
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
 
     return 0;
 }
@@ -699,7 +701,6 @@ qemuProcessHandleStop(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virObjectEventPtr event = NULL;
     virDomainPausedReason reason = VIR_DOMAIN_PAUSED_UNKNOWN;
     virDomainEventSuspendedDetailType detail = VIR_DOMAIN_EVENT_SUSPENDED_PAUSED;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     if (virDomainObjGetState(vm, NULL) == VIR_DOMAIN_RUNNING) {
@@ -740,7 +741,7 @@ qemuProcessHandleStop(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
             VIR_WARN("Unable to release lease on %s", vm->def->name);
         VIR_DEBUG("Preserving lock state '%s'", NULLSTR(priv->lockState));
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after state change",
                      vm->def->name);
         }
@@ -749,7 +750,6 @@ qemuProcessHandleStop(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
  unlock:
     virObjectUnlock(vm);
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
 
     return 0;
 }
@@ -793,7 +793,7 @@ qemuProcessHandleResume(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
         }
         VIR_FREE(priv->lockState);
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after state change",
                      vm->def->name);
         }
@@ -814,7 +814,6 @@ qemuProcessHandleRTCChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 {
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
 
@@ -837,7 +836,7 @@ qemuProcessHandleRTCChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
         offset += vm->def->clock.data.variable.adjustment0;
         vm->def->clock.data.variable.adjustment = offset;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
            VIR_WARN("unable to save domain status with RTC change");
     }
 
@@ -846,7 +845,6 @@ qemuProcessHandleRTCChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virObjectUnlock(vm);
 
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -860,7 +858,6 @@ qemuProcessHandleWatchdog(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr watchdogEvent = NULL;
     virObjectEventPtr lifecycleEvent = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     watchdogEvent = virDomainEventWatchdogNewFromObj(vm, action);
@@ -880,7 +877,7 @@ qemuProcessHandleWatchdog(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
             VIR_WARN("Unable to release lease on %s", vm->def->name);
         VIR_DEBUG("Preserving lock state '%s'", NULLSTR(priv->lockState));
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after watchdog event",
                      vm->def->name);
         }
@@ -909,7 +906,6 @@ qemuProcessHandleWatchdog(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     qemuDomainEventQueue(driver, watchdogEvent);
     qemuDomainEventQueue(driver, lifecycleEvent);
 
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -929,7 +925,6 @@ qemuProcessHandleIOError(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     const char *srcPath;
     const char *devAlias;
     virDomainDiskDefPtr disk;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     disk = qemuProcessFindDomainDiskByAlias(vm, diskAlias);
@@ -963,7 +958,7 @@ qemuProcessHandleIOError(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
             VIR_WARN("Unable to release lease on %s", vm->def->name);
         VIR_DEBUG("Preserving lock state '%s'", NULLSTR(priv->lockState));
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (qemuDomainSaveStatus(driver, vm) < 0)
             VIR_WARN("Unable to save status on vm %s after IO error", vm->def->name);
     }
     virObjectUnlock(vm);
@@ -971,7 +966,6 @@ qemuProcessHandleIOError(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     qemuDomainEventQueue(driver, ioErrorEvent);
     qemuDomainEventQueue(driver, ioErrorEvent2);
     qemuDomainEventQueue(driver, lifecycleEvent);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -1130,7 +1124,6 @@ qemuProcessHandleTrayChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
     virDomainDiskDefPtr disk;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     disk = qemuProcessFindDomainDiskByAlias(vm, devAlias);
@@ -1145,7 +1138,7 @@ qemuProcessHandleTrayChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
         else if (reason == VIR_DOMAIN_EVENT_TRAY_CHANGE_CLOSE)
             disk->tray_status = VIR_DOMAIN_DISK_TRAY_CLOSED;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after tray moved event",
                      vm->def->name);
         }
@@ -1155,7 +1148,6 @@ qemuProcessHandleTrayChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 
     virObjectUnlock(vm);
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -1167,7 +1159,6 @@ qemuProcessHandlePMWakeup(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
     virObjectEventPtr lifecycleEvent = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     event = virDomainEventPMWakeupNewFromObj(vm);
@@ -1185,7 +1176,7 @@ qemuProcessHandlePMWakeup(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                                   VIR_DOMAIN_EVENT_STARTED,
                                                   VIR_DOMAIN_EVENT_STARTED_WAKEUP);
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after wakeup event",
                      vm->def->name);
         }
@@ -1194,7 +1185,6 @@ qemuProcessHandlePMWakeup(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virObjectUnlock(vm);
     qemuDomainEventQueue(driver, event);
     qemuDomainEventQueue(driver, lifecycleEvent);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -1206,7 +1196,6 @@ qemuProcessHandlePMSuspend(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
     virObjectEventPtr lifecycleEvent = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     event = virDomainEventPMSuspendNewFromObj(vm);
@@ -1223,7 +1212,7 @@ qemuProcessHandlePMSuspend(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                      VIR_DOMAIN_EVENT_PMSUSPENDED,
                                      VIR_DOMAIN_EVENT_PMSUSPENDED_MEMORY);
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after suspend event",
                      vm->def->name);
         }
@@ -1236,7 +1225,6 @@ qemuProcessHandlePMSuspend(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 
     qemuDomainEventQueue(driver, event);
     qemuDomainEventQueue(driver, lifecycleEvent);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -1248,7 +1236,6 @@ qemuProcessHandleBalloonChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 {
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     event = virDomainEventBalloonChangeNewFromObj(vm, actual);
@@ -1257,13 +1244,12 @@ qemuProcessHandleBalloonChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
               vm->def->mem.cur_balloon, actual);
     vm->def->mem.cur_balloon = actual;
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, vm) < 0)
         VIR_WARN("unable to save domain status with balloon change");
 
     virObjectUnlock(vm);
 
     qemuDomainEventQueue(driver, event);
-    virObjectUnref(cfg);
     return 0;
 }
 
@@ -1275,7 +1261,6 @@ qemuProcessHandlePMSuspendDisk(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virQEMUDriverPtr driver = opaque;
     virObjectEventPtr event = NULL;
     virObjectEventPtr lifecycleEvent = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     virObjectLock(vm);
     event = virDomainEventPMSuspendDiskNewFromObj(vm);
@@ -1292,7 +1277,7 @@ qemuProcessHandlePMSuspendDisk(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                      VIR_DOMAIN_EVENT_PMSUSPENDED,
                                      VIR_DOMAIN_EVENT_PMSUSPENDED_DISK);
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (qemuDomainSaveStatus(driver, vm) < 0) {
             VIR_WARN("Unable to save status on vm %s after suspend event",
                      vm->def->name);
         }
@@ -1305,7 +1290,6 @@ qemuProcessHandlePMSuspendDisk(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 
     qemuDomainEventQueue(driver, event);
     qemuDomainEventQueue(driver, lifecycleEvent);
-    virObjectUnref(cfg);
 
     return 0;
 }
@@ -2501,7 +2485,6 @@ qemuProcessUpdateVideoRamSize(virQEMUDriverPtr driver,
     ssize_t i;
     qemuDomainObjPrivatePtr priv = vm->privateData;
     virDomainVideoDefPtr video = NULL;
-    virQEMUDriverConfigPtr cfg = NULL;
 
     if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
         return -1;
@@ -2558,9 +2541,7 @@ qemuProcessUpdateVideoRamSize(virQEMUDriverPtr driver,
     if (qemuDomainObjExitMonitor(driver, vm) < 0)
         return -1;
 
-    cfg = virQEMUDriverGetConfig(driver);
-    ret = virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps);
-    virObjectUnref(cfg);
+    ret = qemuDomainSaveStatus(driver, vm);
 
     return ret;
 
@@ -3154,11 +3135,6 @@ qemuDomainPerfRestart(virDomainObjPtr vm)
     return 0;
 }
 
-struct qemuProcessReconnectData {
-    virConnectPtr conn;
-    virQEMUDriverPtr driver;
-    virDomainObjPtr obj;
-};
 /*
  * Open an existing VM's monitor, re-detect VCPU threads
  * and re-reserve the security labels in use
@@ -3167,10 +3143,13 @@ struct qemuProcessReconnectData {
  * this thread function has increased the reference counter to it
  * so that we now have to close it.
  *
- * This function also inherits a locked and ref'd domain object.
+ * This function also inherits a ref'd domain object, which was
+ * marked as reconnecting by qemuProcessReconnectHelper so that jobs
+ * wait for it to be reconnected, however long it has to wait for a
+ * free worker.
  *
  * This function needs to:
- * 1. Enter job
+ * 1. Lock the domain and enter job
  * 1. just before monitor reconnect do lightweight MonitorEnter
  *    (increase VM refcount and unlock VM)
  * 2. reconnect to monitor
@@ -3200,13 +3179,19 @@ qemuProcessReconnect(void *opaque)
 
     VIR_FREE(data);
 
-    qemuDomainObjRestoreJob(obj, &oldjob);
-    if (oldjob.asyncJob == QEMU_ASYNC_JOB_MIGRATION_IN)
-        stopFlags |= VIR_QEMU_PROCESS_STOP_MIGRATED;
+    virObjectLock(obj);
 
     cfg = virQEMUDriverGetConfig(driver);
     priv = obj->privateData;
 
+    /* Jobs waiting for the reconnect get woken up once we hold ours */
+    qemuDomainObjRestoreJob(obj, &oldjob);
+    priv->reconnecting = false;
+    virCondBroadcast(&priv->job.cond);
+
+    if (oldjob.asyncJob == QEMU_ASYNC_JOB_MIGRATION_IN)
+        stopFlags |= VIR_QEMU_PROCESS_STOP_MIGRATED;
+
     if (qemuDomainObjBeginJob(driver, obj, QEMU_JOB_MODIFY) < 0)
         goto error;
     jobStarted = true;
@@ -3342,7 +3327,7 @@ qemuProcessReconnect(void *opaque)
     }
 
     /* update domain state XML with possibly updated state in virDomainObj */
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, obj, driver->caps) < 0)
+    if (qemuDomainSaveStatus(driver, obj) < 0)
         goto error;
 
     /* Run an hook to allow admins to do some magic */
@@ -3401,12 +3386,63 @@ qemuProcessReconnect(void *opaque)
     goto cleanup;
 }
 
+static void
+qemuProcessReconnectThread(void *opaque)
+{
+    struct qemuProcessReconnectData *data = opaque;
+    qemuProcessReconnectAllDataPtr all = data->all;
+
+    all->func(data);
+
+    virMutexLock(&all->lock);
+    if (--all->pending == 0)
+        virCondSignal(&all->cond);
+    virMutexUnlock(&all->lock);
+}
+
+
+static void
+qemuProcessReconnectWorker(void *jobdata,
+                           void *opaque ATTRIBUTE_UNUSED)
+{
+    qemuProcessReconnectThread(jobdata);
+}
+
+
+/*
+ * Wait for the reconnects to finish and report how long it took
+ * until the driver got hold of all the domains again. Frees @opaque.
+ */
+void
+qemuProcessReconnectWait(void *opaque)
+{
+    qemuProcessReconnectAllDataPtr all = opaque;
+    unsigned long long now;
+
+    virMutexLock(&all->lock);
+    while (all->pending > 0) {
+        if (virCondWait(&all->cond, &all->lock) < 0)
+            VIR_WARN("Unable to wait on reconnect condition");
+    }
+    virMutexUnlock(&all->lock);
+
+    if (virTimeMillisNow(&now) == 0)
+        VIR_INFO("Reconnected to %zu domains in %llu ms",
+                 all->ndomains, now - all->start);
+
+    virThreadPoolFree(all->pool);
+    virCondDestroy(&all->cond);
+    virMutexDestroy(&all->lock);
+    VIR_FREE(all);
+}
+
+
 static int
 qemuProcessReconnectHelper(virDomainObjPtr obj,
                            void *opaque)
 {
-    virThread thread;
-    struct qemuProcessReconnectData *src = opaque;
+    qemuProcessReconnectAllDataPtr all = opaque;
+    qemuDomainObjPrivatePtr priv = obj->privateData;
     struct qemuProcessReconnectData *data;
 
     /* If the VM was inactive, we don't need to reconnect */
@@ -3416,53 +3452,167 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
     if (VIR_ALLOC(data) < 0)
         return -1;
 
-    memcpy(data, src, sizeof(*data));
-    data->obj = obj;
+    if (VIR_APPEND_ELEMENT_COPY(all->domains, all->ndomains, data) < 0) {
+        VIR_FREE(data);
+        return -1;
+    }
 
-    /* this lock and reference will be eventually transferred to the thread
-     * that handles the reconnect */
-    virObjectLock(obj);
-    virObjectRef(obj);
+    data->driver = all->driver;
+    data->obj = virObjectRef(obj);
+    data->all = all;
 
     /* Since we close the connection later on, we have to make sure that the
      * threads we start see a valid connection throughout their lifetime. We
      * simply increase the reference counter here.
      */
-    virObjectRef(data->conn);
+    data->conn = virObjectRef(all->conn);
 
-    if (virThreadCreate(&thread, false, qemuProcessReconnect, data) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Could not create thread. QEMU initialization "
-                         "might be incomplete"));
-        /* We can't spawn a thread and thus connect to monitor. Kill qemu.
-         * It's safe to call qemuProcessStop without a job here since there
-         * is no thread that could be doing anything else with the same domain
-         * object.
-         */
-        qemuProcessStop(src->driver, obj, VIR_DOMAIN_SHUTOFF_FAILED,
-                        QEMU_ASYNC_JOB_NONE, 0);
-        qemuDomainRemoveInactive(src->driver, obj);
+    virObjectLock(obj);
+
+    /* Reconnecting may have to wait for a free worker, jobs started
+     * meanwhile wait for it without counting against their timeout */
+    priv->reconnecting = true;
+
+    data->autostart = obj->autostart;
+    if (virProcessGetStartTime(obj->pid, &data->startTime) < 0)
+        virResetLastError();
+
+    virObjectUnlock(obj);
+
+    return 0;
+}
 
-        virDomainObjEndAPI(&obj);
-        virObjectUnref(data->conn);
-        VIR_FREE(data);
-        return -1;
-    }
 
+/* Autostarted domains first, then the most recently started ones */
+static int
+qemuProcessReconnectCompare(const void *a,
+                            const void *b)
+{
+    const struct qemuProcessReconnectData *da = *(void * const *) a;
+    const struct qemuProcessReconnectData *db = *(void * const *) b;
+
+    if (da->autostart != db->autostart)
+        return da->autostart ? -1 : 1;
+    if (da->startTime != db->startTime)
+        return da->startTime > db->startTime ? -1 : 1;
     return 0;
 }
 
+
+/*
+ * Set up the state for reconnecting to domains, each of which is
+ * handed to @func once it gets its turn.
+ */
+qemuProcessReconnectAllDataPtr
+qemuProcessReconnectAllNew(virConnectPtr conn,
+                           virQEMUDriverPtr driver,
+                           qemuProcessReconnectFunc func)
+{
+    qemuProcessReconnectAllDataPtr all;
+
+    if (VIR_ALLOC(all) < 0)
+        return NULL;
+
+    if (virMutexInit(&all->lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        VIR_FREE(all);
+        return NULL;
+    }
+    if (virCondInit(&all->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virMutexDestroy(&all->lock);
+        VIR_FREE(all);
+        return NULL;
+    }
+
+    all->conn = conn;
+    all->driver = driver;
+    all->func = func;
+    ignore_value(virTimeMillisNow(&all->start));
+
+    return all;
+}
+
+
+/*
+ * Hand the domains collected in @all over for reconnecting, in the
+ * order of qemuProcessReconnectCompare and at most @workers at the
+ * same time, zero for a thread per domain. Use
+ * qemuProcessReconnectWait to wait for them to finish.
+ */
+void
+qemuProcessReconnectStart(qemuProcessReconnectAllDataPtr all,
+                          size_t workers)
+{
+    virThread thread;
+    size_t i;
+
+    if (all->ndomains > 1)
+        qsort(all->domains, all->ndomains, sizeof(*all->domains),
+              qemuProcessReconnectCompare);
+
+    if (workers > 0 && all->ndomains > 0 &&
+        !(all->pool = virThreadPoolNew(0, MIN(workers, all->ndomains),
+                                       0, qemuProcessReconnectWorker,
+                                       NULL))) {
+        VIR_WARN("Cannot create reconnect workers, using a thread "
+                 "per domain");
+        virResetLastError();
+    }
+
+    all->pending = all->ndomains;
+    for (i = 0; i < all->ndomains; i++) {
+        struct qemuProcessReconnectData *data = all->domains[i];
+
+        if (all->pool) {
+            if (virThreadPoolSendJob(all->pool, 0, data) == 0)
+                continue;
+        } else {
+            if (virThreadCreate(&thread, false,
+                                qemuProcessReconnectThread, data) == 0)
+                continue;
+        }
+
+        /* Rather than giving up on the domain, which would mean killing
+         * it, reconnect it right here */
+        VIR_WARN("Could not hand a domain over for reconnecting, "
+                 "QEMU initialization may take longer");
+        virResetLastError();
+        qemuProcessReconnectThread(data);
+    }
+    VIR_FREE(all->domains);
+    all->conn = NULL;
+}
+
+
 /**
  * qemuProcessReconnectAll
  *
  * Try to re-open the resources for live VMs that we care
- * about.
+ * about. At most reconnect_workers domains are reconnected
+ * at the same time, in the order of qemuProcessReconnectCompare.
  */
 void
 qemuProcessReconnectAll(virConnectPtr conn, virQEMUDriverPtr driver)
 {
-    struct qemuProcessReconnectData data = {.conn = conn, .driver = driver};
-    virDomainObjListForEach(driver->domains, qemuProcessReconnectHelper, &data);
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    qemuProcessReconnectAllDataPtr all;
+    virThread thread;
+
+    if (!(all = qemuProcessReconnectAllNew(conn, driver,
+                                           qemuProcessReconnect)))
+        goto cleanup;
+
+    virDomainObjListForEach(driver->domains, qemuProcessReconnectHelper, all);
+
+    qemuProcessReconnectStart(all, cfg->reconnectWorkers);
+
+    if (virThreadCreate(&thread, false, qemuProcessReconnectWait, all) < 0)
+        qemuProcessReconnectWait(all);
+
+ cleanup:
+    virObjectUnref(cfg);
 }
 
 static int
@@ -5201,7 +5351,7 @@ qemuProcessLaunch(virConnectPtr conn,
     }
 
     VIR_DEBUG("Writing early domain status to disk");
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         goto cleanup;
 
     VIR_DEBUG("Waiting for handshake from child");
@@ -5406,7 +5556,7 @@ qemuProcessFinishStartup(virConnectPtr conn,
     }
 
     VIR_DEBUG("Writing domain status to disk");
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         goto cleanup;
 
     if (qemuProcessStartHook(driver, vm,
@@ -6132,7 +6282,7 @@ int qemuProcessAttach(virConnectPtr conn ATTRIBUTE_UNUSED,
     }
 
     VIR_DEBUG("Writing domain status to disk");
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (qemuDomainFlushStatus(driver, vm) < 0)
         goto error;
 
     /* Run an hook to allow admins to do some magic */
@@ -23,7 +23,9 @@
 # define __QEMU_PROCESSPRIV_H__
 
 # include "domain_conf.h"
+# include "qemu_conf.h"
 # include "qemu_monitor.h"
+# include "virthreadpool.h"
 
 /*
  * This header file should never be used outside unit tests.
@@ -34,4 +36,49 @@ int qemuProcessHandleDeviceDeleted(qemuMonitorPtr mon,
                                    const char *devAlias,
                                    void *opaque);
 
+typedef struct _qemuProcessReconnectAllData qemuProcessReconnectAllData;
+typedef qemuProcessReconnectAllData *qemuProcessReconnectAllDataPtr;
+
+/* Reconnects the domain of the struct qemuProcessReconnectData
+ * @opaque, which it frees */
+typedef void (*qemuProcessReconnectFunc)(void *opaque);
+
+struct qemuProcessReconnectData {
+    virConnectPtr conn;
+    virQEMUDriverPtr driver;
+    virDomainObjPtr obj;
+
+    /* Decide which domains are reconnected first */
+    bool autostart;
+    unsigned long long startTime;
+
+    qemuProcessReconnectAllDataPtr all;
+};
+
+/* State shared by the reconnects of one qemuProcessReconnectAll call */
+struct _qemuProcessReconnectAllData {
+    virConnectPtr conn;
+    virQEMUDriverPtr driver;
+    qemuProcessReconnectFunc func;
+
+    struct qemuProcessReconnectData **domains;
+    size_t ndomains;
+    unsigned long long start;
+
+    virThreadPoolPtr pool;
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+};
+
+qemuProcessReconnectAllDataPtr
+qemuProcessReconnectAllNew(virConnectPtr conn,
+                           virQEMUDriverPtr driver,
+                           qemuProcessReconnectFunc func);
+
+void qemuProcessReconnectStart(qemuProcessReconnectAllDataPtr all,
+                               size_t workers);
+
+void qemuProcessReconnectWait(void *opaque);
+
 #endif /* __QEMU_PROCESSPRIV_H__ */
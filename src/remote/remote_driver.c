@@ -96,6 +96,8 @@ struct private_data {
     bool serverKeepAlive;       /* Does server support keepalive protocol? */
     bool serverEventFilter;     /* Does server support modern event filtering */
     bool serverCloseCallback;   /* Does server support driver close callback */
+    bool serverLargeStreamChunks; /* Does server take big stream packets */
+    bool largeStreamChunksAsked; /* Was the server asked for them yet */
 
     virObjectEventStatePtr eventState;
     virConnectCloseCallbackDataPtr closeCallback;
@@ -371,6 +373,11 @@ remoteConnectNotifyEventConnectionClosed(virNetClientProgramPtr prog ATTRIBUTE_U
                                          virNetClientPtr client ATTRIBUTE_UNUSED,
                                          void *evdata, void *opaque);
 
+static void
+remoteConnectNotifyEventBatch(virNetClientProgramPtr prog,
+                              virNetClientPtr client,
+                              void *evdata, void *opaque);
+
 static virNetClientProgramEvent remoteEvents[] = {
     { REMOTE_PROC_DOMAIN_EVENT_LIFECYCLE,
       remoteDomainBuildEventLifecycle,
@@ -553,6 +560,10 @@ static virNetClientProgramEvent remoteEvents[] = {
       remoteStoragePoolBuildEventRefresh,
       sizeof(remote_storage_pool_event_refresh_msg),
       (xdrproc_t)xdr_remote_storage_pool_event_refresh_msg },
+    { REMOTE_PROC_CONNECT_EVENT_BATCH,
+      remoteConnectNotifyEventBatch,
+      sizeof(remote_connect_event_batch_msg),
+      (xdrproc_t)xdr_remote_connect_event_batch_msg },
 };
 
 static void
@@ -567,6 +578,51 @@ remoteConnectNotifyEventConnectionClosed(virNetClientProgramPtr prog ATTRIBUTE_U
     virConnectCloseCallbackDataCall(priv->closeCallback, msg->reason);
 }
 
+/* Unpack the events of a batch and handle each as if it came on its own */
+static void
+remoteConnectNotifyEventBatch(virNetClientProgramPtr prog,
+                              virNetClientPtr client,
+                              void *evdata, void *opaque)
+{
+    remote_connect_event_batch_msg *msg = evdata;
+    size_t i, j;
+
+    for (i = 0; i < msg->events.events_len; i++) {
+        remote_connect_event_batch_entry *entry = &msg->events.events_val[i];
+        virNetClientProgramEventPtr event = NULL;
+        char *data = NULL;
+        XDR xdr;
+
+        for (j = 0; j < ARRAY_CARDINALITY(remoteEvents); j++) {
+            if (remoteEvents[j].proc == entry->procedure) {
+                event = &remoteEvents[j];
+                break;
+            }
+        }
+
+        if (!event || event->proc == REMOTE_PROC_CONNECT_EVENT_BATCH) {
+            VIR_WARN("Unexpected event procedure %d in batch",
+                     entry->procedure);
+            continue;
+        }
+
+        if (VIR_ALLOC_N(data, event->msg_len) < 0)
+            return;
+
+        xdrmem_create(&xdr, entry->payload.payload_val,
+                      entry->payload.payload_len, XDR_DECODE);
+        if ((*event->msg_filter)(&xdr, data, 0)) {
+            event->func(prog, client, data, opaque);
+            xdr_free(event->msg_filter, data);
+        } else {
+            VIR_WARN("Unable to decode batched event procedure %d",
+                     entry->procedure);
+        }
+        xdr_destroy(&xdr);
+        VIR_FREE(data);
+    }
+}
+
 static void
 remoteDomainBuildQemuMonitorEvent(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
                                   virNetClientPtr client ATTRIBUTE_UNUSED,
@@ -611,6 +667,45 @@ remoteConnectSupportsFeatureUnlocked(virConnectPtr conn,
     return rc != -1 && ret.supported;
 }
 
+/* Ask the server to switch on a behaviour this client can cope with */
+static int
+remoteConnectEnableFeatureUnlocked(virConnectPtr conn,
+                                   struct private_data *priv,
+                                   int feature)
+{
+    remote_connect_enable_feature_args args = { feature, 0 };
+    remote_connect_enable_feature_ret ret = { 0 };
+    int rc;
+
+    rc = call(conn, priv, 0, REMOTE_PROC_CONNECT_ENABLE_FEATURE,
+              (xdrproc_t)xdr_remote_connect_enable_feature_args, (char *) &args,
+              (xdrproc_t)xdr_remote_connect_enable_feature_ret, (char *) &ret);
+
+    return rc != -1 && ret.enabled;
+}
+
+/* Large stream chunks are only negotiated once the first stream of
+ * the connection is opened, connections without streams don't pay the
+ * round trip. Servers which enable them take them as well, and those
+ * without the call fail it, so there is no need to probe first. */
+static void
+remoteConnectEnableLargeStreamChunksUnlocked(virConnectPtr conn,
+                                             struct private_data *priv)
+{
+    if (priv->largeStreamChunksAsked)
+        return;
+    priv->largeStreamChunksAsked = true;
+
+    priv->serverLargeStreamChunks =
+        remoteConnectEnableFeatureUnlocked(conn, priv,
+                                           VIR_DRV_FEATURE_REMOTE_LARGE_STREAM_CHUNKS);
+    if (!priv->serverLargeStreamChunks) {
+        VIR_INFO("Using legacy sized stream chunks since larger ones "
+                 "are not supported by the server");
+        virResetLastError();
+    }
+}
+
 /* helper macro to ease extraction of arguments from the URI */
 #define EXTRACT_URI_ARG_STR(ARG_NAME, ARG_VAR)          \
     if (STRCASEEQ(var->name, ARG_NAME)) {               \
@@ -1147,6 +1242,14 @@ doRemoteOpen(virConnectPtr conn,
                  "by the remote side.");
     }
 
+    /* Servers without the call fail it, no need to probe first */
+    if (!remoteConnectEnableFeatureUnlocked(conn, priv,
+                                            VIR_DRV_FEATURE_REMOTE_EVENT_BATCH)) {
+        VIR_INFO("Receiving events one at a time since batches "
+                 "are not supported by the server");
+        virResetLastError();
+    }
+
     /* Successful. */
     retcode = VIR_DRV_OPEN_SUCCESS;
 
@@ -5238,6 +5341,11 @@ remoteStreamSend(virStreamPtr st,
 
     remoteDriverLock(priv);
     priv->localUses++;
+    /* Callers deal with partial writes */
+    if (priv->serverLargeStreamChunks)
+        nbytes = MIN(nbytes, VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX);
+    else
+        nbytes = MIN(nbytes, VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX);
     remoteDriverUnlock(priv);
 
     rv = virNetClientStreamSendPacket(privst,
@@ -5770,6 +5878,8 @@ remoteDomainMigratePrepareTunnel3(virConnectPtr dconn,
     memset(&args, 0, sizeof(args));
     memset(&ret, 0, sizeof(ret));
 
+    remoteConnectEnableLargeStreamChunksUnlocked(dconn, priv);
+
     if (!(netst = virNetClientStreamNew(priv->remoteProgram,
                                         REMOTE_PROC_DOMAIN_MIGRATE_PREPARE_TUNNEL3,
                                         priv->counter)))
@@ -6694,6 +6804,8 @@ remoteDomainMigratePrepareTunnel3Params(virConnectPtr dconn,
         goto cleanup;
     }
 
+    remoteConnectEnableLargeStreamChunksUnlocked(dconn, priv);
+
     if (!(netst = virNetClientStreamNew(priv->remoteProgram,
                                         REMOTE_PROC_DOMAIN_MIGRATE_PREPARE_TUNNEL3_PARAMS,
                                         priv->counter)))
@@ -253,6 +253,12 @@ const REMOTE_DOMAIN_IP_ADDR_MAX = 2048;
 /* Upper limit on number of guest vcpu information entries */
 const REMOTE_DOMAIN_GUEST_VCPU_PARAMS_MAX = 64;
 
+/* Upper limit on number of events delivered in one batch */
+const REMOTE_CONNECT_EVENT_BATCH_MAX = 4096;
+
+/* Upper limit on the encoded size of a single batched event */
+const REMOTE_CONNECT_EVENT_BATCH_PAYLOAD_MAX = 262144;
+
 /* UUID.  VIR_UUID_BUFLEN definition comes from libvirt.h */
 typedef opaque remote_uuid[VIR_UUID_BUFLEN];
 
@@ -441,6 +447,18 @@ struct remote_connect_supports_feature_ret {
     int supported;
 };
 
+/* Opts the connection into a VIR_DRV_FEATURE_REMOTE_* behaviour of the
+ * daemon which clients must be able to cope with, such as larger
+ * stream chunks. Features without such behaviour are never enabled. */
+struct remote_connect_enable_feature_args {
+    int feature;
+    unsigned int flags;
+};
+
+struct remote_connect_enable_feature_ret {
+    int enabled;
+};
+
 struct remote_connect_get_type_ret {
     remote_nonnull_string type;
 };
@@ -3316,6 +3334,17 @@ struct remote_domain_set_guest_vcpus_args {
     unsigned int flags;
 };
 
+/* An event message of this program, encoded as it would be on its own */
+struct remote_connect_event_batch_entry {
+    int procedure;
+    opaque payload<REMOTE_CONNECT_EVENT_BATCH_PAYLOAD_MAX>;
+};
+
+/* Only sent to clients which enabled VIR_DRV_FEATURE_REMOTE_EVENT_BATCH */
+struct remote_connect_event_batch_msg {
+    remote_connect_event_batch_entry events<REMOTE_CONNECT_EVENT_BATCH_MAX>;
+};
+
 
 /*----- Protocol. -----*/
 
@@ -5882,5 +5911,18 @@ enum remote_procedure {
      * @generate: both
      * @acl: none
      */
-    REMOTE_PROC_STORAGE_POOL_EVENT_REFRESH = 373
+    REMOTE_PROC_STORAGE_POOL_EVENT_REFRESH = 373,
+
+    /**
+     * @generate: none
+     * @acl: none
+     */
+    REMOTE_PROC_CONNECT_EVENT_BATCH = 374,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:getattr
+     */
+    REMOTE_PROC_CONNECT_ENABLE_FEATURE = 375
 };
@@ -298,6 +298,26 @@ while (<PROTOCOL>) {
             $calls{$name}->{priority} = 0;
         }
 
+        # a call is read-only if all the permissions it checks only
+        # allow looking at objects. Calls setting up streams, or
+        # changing what the connection itself is subscribed to or
+        # how it behaves, are not, even though their permissions
+        # say otherwise
+        $calls{$name}->{readonly} = 0;
+        if (exists $opts{acl} &&
+            $calls{$name}->{streamflag} eq "none" &&
+            $ProcName !~ /^Connect(Open|Close|SupportsFeature|EnableFeature)$/ &&
+            $ProcName !~ /register/i) {
+            $calls{$name}->{readonly} = 1;
+            foreach (@{$opts{acl}}) {
+                my @bits = split /:/;
+                if (!defined $bits[1] ||
+                    $bits[1] !~ /^(read|read_secure|getattr|search_\w+)$/) {
+                    $calls{$name}->{readonly} = 0;
+                }
+            }
+        }
+
         $calls[$id] = $calls{$name};
 
         $collect_args_members = 0;
@@ -397,6 +417,7 @@ if ($mode eq "debug") {
         print "        name $calls{$_}->{name} ($calls{$_}->{ProcName})\n";
         print "        $calls{$_}->{args} -> $calls{$_}->{ret}\n";
         print "        priority -> $calls{$_}->{priority}\n";
+        print "        readonly -> $calls{$_}->{readonly}\n";
     }
 }
 
@@ -1190,7 +1211,7 @@ elsif ($mode eq "server") {
 
     print "virNetServerProgramProc ${structprefix}Procs[] = {\n";
     for ($id = 0 ; $id <= $#calls ; $id++) {
-        my ($comment, $name, $argtype, $arglen, $argfilter, $retlen, $retfilter, $priority);
+        my ($comment, $name, $argtype, $arglen, $argfilter, $retlen, $retfilter, $priority, $readonly);
 
         if (defined $calls[$id] && !$calls[$id]->{msg}) {
             $comment = "/* Method $calls[$id]->{ProcName} => $id */";
@@ -1214,8 +1235,9 @@ elsif ($mode eq "server") {
         }
 
     $priority = defined $calls[$id]->{priority} ? $calls[$id]->{priority} : 0;
+    $readonly = $calls[$id]->{readonly} ? "true" : "false";
 
-        print "{ $comment\n   ${name},\n   $arglen,\n   (xdrproc_t)$argfilter,\n   $retlen,\n   (xdrproc_t)$retfilter,\n   true,\n   $priority\n},\n";
+        print "{ $comment\n   ${name},\n   $arglen,\n   (xdrproc_t)$argfilter,\n   $retlen,\n   (xdrproc_t)$retfilter,\n   true,\n   $priority,\n   $readonly\n},\n";
     }
     print "};\n";
     print "size_t ${structprefix}NProcs = ARRAY_CARDINALITY(${structprefix}Procs);\n";
@@ -1737,6 +1759,8 @@ elsif ($mode eq "client") {
         }
 
         if ($call->{streamflag} ne "none") {
+            print "\n";
+            print "    remoteConnectEnableLargeStreamChunksUnlocked($priv_src, priv);\n";
             print "\n";
             print "    if (!(netst = virNetClientStreamNew(priv->remoteProgram, $call->{constname}, priv->counter)))\n";
             print "        goto done;\n";
@@ -987,7 +987,7 @@ virNetClientCallDispatchReply(virNetClientPtr client)
         return -1;
     }
 
-    if (VIR_REALLOC_N(thecall->msg->buffer, client->msg.bufferLength) < 0)
+    if (virNetMessageReserveBuffer(thecall->msg, client->msg.bufferLength) < 0)
         return -1;
 
     memcpy(thecall->msg->buffer, client->msg.buffer, client->msg.bufferLength);
@@ -1234,7 +1234,8 @@ virNetClientIOReadMessage(virNetClientPtr client)
     /* Start by reading length word */
     if (client->msg.bufferLength == 0) {
         client->msg.bufferLength = 4;
-        if (VIR_ALLOC_N(client->msg.buffer, client->msg.bufferLength) < 0)
+        if (virNetMessageReserveBuffer(&client->msg,
+                                       client->msg.bufferLength) < 0)
             return -ENOMEM;
     }
 
@@ -30,16 +30,261 @@
 #include "virfile.h"
 #include "virutil.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
 VIR_LOG_INIT("rpc.netmessage");
 
+/*
+ * Freed messages and their buffers are kept around for reuse, so
+ * that the steady stream of requests and replies does not turn into
+ * a steady stream of malloc and free calls. Buffers are sorted into
+ * size classes matching the sizes the encoder grows messages to, and
+ * only a limited number of each is cached.
+ */
+#define VIR_NET_MESSAGE_POOL_MSGS 128
+
+/* Headroom for the header on top of the payload */
+#define VIR_NET_MESSAGE_POOL_SLACK 1024
+
+/* Smaller buffers, such as the one receiving just the length word of
+ * an incoming packet, are allocated as requested. Idle clients would
+ * otherwise pin a large buffer each. */
+#define VIR_NET_MESSAGE_POOL_MIN 64
+
+static const struct {
+    size_t size;
+    size_t max;
+} virNetMessagePoolClasses[] = {
+    { VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX, 32 },
+    { VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX + VIR_NET_MESSAGE_POOL_SLACK, 8 },
+    { 1024 * 1024 + VIR_NET_MESSAGE_POOL_SLACK, 2 },
+};
+
+#define VIR_NET_MESSAGE_POOL_CLASSES ARRAY_CARDINALITY(virNetMessagePoolClasses)
+
+typedef struct _virNetMessagePool virNetMessagePool;
+struct _virNetMessagePool {
+    virMutex lock;
+
+    /* Linked through msg->next */
+    virNetMessagePtr msgs;
+    size_t nmsgs;
+
+    /* Linked through a pointer stored at the start of each buffer */
+    char *buffers[VIR_NET_MESSAGE_POOL_CLASSES];
+    size_t nbuffers[VIR_NET_MESSAGE_POOL_CLASSES];
+
+    unsigned long long hits;
+    unsigned long long misses;
+};
+
+static virNetMessagePool virNetMessagePoolData;
+
+
+static int
+virNetMessageOnceInit(void)
+{
+    if (virMutexInit(&virNetMessagePoolData.lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize message pool mutex"));
+        return -1;
+    }
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virNetMessage)
+
+
+/* Returns the smallest class that can hold @len bytes, or -1 */
+static int
+virNetMessagePoolClassFor(size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_NET_MESSAGE_POOL_CLASSES; i++) {
+        if (len <= virNetMessagePoolClasses[i].size)
+            return i;
+    }
+
+    return -1;
+}
+
+
+/* Returns the class a buffer of exactly @alloc bytes belongs to, or -1 */
+static int
+virNetMessagePoolClassOf(size_t alloc)
+{
+    int i = virNetMessagePoolClassFor(alloc);
+
+    if (i < 0 || virNetMessagePoolClasses[i].size != alloc)
+        return -1;
+
+    return i;
+}
+
+
+static char *
+virNetMessagePoolTakeBuffer(int class)
+{
+    virNetMessagePool *pool = &virNetMessagePoolData;
+    char *buffer;
+
+    virMutexLock(&pool->lock);
+    if ((buffer = pool->buffers[class])) {
+        memcpy(&pool->buffers[class], buffer, sizeof(buffer));
+        pool->nbuffers[class]--;
+        pool->hits++;
+    } else {
+        pool->misses++;
+    }
+    virMutexUnlock(&pool->lock);
+
+    return buffer;
+}
+
+
+static void
+virNetMessagePoolPutBuffer(char *buffer,
+                           size_t alloc)
+{
+    virNetMessagePool *pool = &virNetMessagePoolData;
+    int class;
+
+    if (!buffer)
+        return;
+
+    if ((class = virNetMessagePoolClassOf(alloc)) >= 0) {
+        virMutexLock(&pool->lock);
+        if (pool->nbuffers[class] < virNetMessagePoolClasses[class].max) {
+            memcpy(buffer, &pool->buffers[class], sizeof(buffer));
+            pool->buffers[class] = buffer;
+            pool->nbuffers[class]++;
+            buffer = NULL;
+        }
+        virMutexUnlock(&pool->lock);
+    }
+
+    VIR_FREE(buffer);
+}
+
+
+/**
+ * virNetMessageReserveBuffer:
+ * @msg: the message
+ * @len: number of bytes needed
+ *
+ * Makes sure the buffer of @msg can hold at least @len bytes,
+ * preserving its current contents. The buffer is taken from the
+ * message pool where possible. This does not change bufferLength.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetMessageReserveBuffer(virNetMessagePtr msg,
+                           size_t len)
+{
+    char *buffer = NULL;
+    size_t alloc = len;
+    int class;
+
+    if (msg->buffer && msg->bufferAlloc >= len)
+        return 0;
+
+    /* Allocated behind our back, we do not know how big it is */
+    if (msg->buffer && !msg->bufferAlloc) {
+        if (VIR_REALLOC_N(msg->buffer, len) < 0)
+            return -1;
+        msg->bufferAlloc = len;
+        return 0;
+    }
+
+    if (virNetMessageInitialize() < 0)
+        return -1;
+
+    if (len < VIR_NET_MESSAGE_POOL_MIN) {
+        /* Not worth pooling */
+    } else if ((class = virNetMessagePoolClassFor(len)) >= 0) {
+        alloc = virNetMessagePoolClasses[class].size;
+        buffer = virNetMessagePoolTakeBuffer(class);
+    } else {
+        virMutexLock(&virNetMessagePoolData.lock);
+        virNetMessagePoolData.misses++;
+        virMutexUnlock(&virNetMessagePoolData.lock);
+    }
+
+    if (!buffer && VIR_ALLOC_N(buffer, alloc) < 0)
+        return -1;
+
+    if (msg->buffer) {
+        memcpy(buffer, msg->buffer, msg->bufferAlloc);
+        virNetMessagePoolPutBuffer(msg->buffer, msg->bufferAlloc);
+    }
+
+    msg->buffer = buffer;
+    msg->bufferAlloc = alloc;
+    return 0;
+}
+
+
+/**
+ * virNetMessagePoolGetStats:
+ * @hits: number of buffers served from the pool
+ * @misses: number of buffers that had to be allocated
+ * @nmsgs: number of messages currently cached
+ * @nbuffers: number of buffers currently cached
+ * @nbytes: memory held by the cached buffers
+ *
+ * Report the statistics of the message pool shared by all
+ * servers and clients of the process.
+ */
+void
+virNetMessagePoolGetStats(unsigned long long *hits,
+                          unsigned long long *misses,
+                          size_t *nmsgs,
+                          size_t *nbuffers,
+                          unsigned long long *nbytes)
+{
+    virNetMessagePool *pool = &virNetMessagePoolData;
+    size_t i;
+
+    *hits = *misses = *nbytes = 0;
+    *nmsgs = *nbuffers = 0;
+
+    if (virNetMessageInitialize() < 0)
+        return;
+
+    virMutexLock(&pool->lock);
+    *hits = pool->hits;
+    *misses = pool->misses;
+    *nmsgs = pool->nmsgs;
+    for (i = 0; i < VIR_NET_MESSAGE_POOL_CLASSES; i++) {
+        *nbuffers += pool->nbuffers[i];
+        *nbytes += pool->nbuffers[i] * virNetMessagePoolClasses[i].size;
+    }
+    virMutexUnlock(&pool->lock);
+}
+
+
 virNetMessagePtr virNetMessageNew(bool tracked)
 {
+    virNetMessagePool *pool = &virNetMessagePoolData;
     virNetMessagePtr msg;
 
-    if (VIR_ALLOC(msg) < 0)
+    if (virNetMessageInitialize() < 0)
+        return NULL;
+
+    virMutexLock(&pool->lock);
+    if ((msg = pool->msgs)) {
+        pool->msgs = msg->next;
+        pool->nmsgs--;
+        msg->next = NULL;
+    }
+    virMutexUnlock(&pool->lock);
+
+    if (!msg && VIR_ALLOC(msg) < 0)
         return NULL;
 
     msg->tracked = tracked;
@@ -61,9 +306,16 @@ virNetMessageClearPayload(virNetMessagePtr msg)
     msg->nfds = 0;
     VIR_FREE(msg->fds);
 
+    if (msg->spliceLength) {
+        VIR_FORCE_CLOSE(msg->spliceFD);
+        msg->spliceLength = 0;
+    }
+
     msg->bufferOffset = 0;
     msg->bufferLength = 0;
-    VIR_FREE(msg->buffer);
+    virNetMessagePoolPutBuffer(msg->buffer, msg->bufferAlloc);
+    msg->buffer = NULL;
+    msg->bufferAlloc = 0;
 }
 
 
@@ -81,6 +333,8 @@ void virNetMessageClear(virNetMessagePtr msg)
 
 void virNetMessageFree(virNetMessagePtr msg)
 {
+    virNetMessagePool *pool = &virNetMessagePoolData;
+
     if (!msg)
         return;
 
@@ -90,6 +344,18 @@ void virNetMessageFree(virNetMessagePtr msg)
         msg->cb(msg, msg->opaque);
 
     virNetMessageClearPayload(msg);
+    memset(msg, 0, sizeof(*msg));
+
+    /* Messages can only exist once the pool is initialized */
+    virMutexLock(&pool->lock);
+    if (pool->nmsgs < VIR_NET_MESSAGE_POOL_MSGS) {
+        msg->next = pool->msgs;
+        pool->msgs = msg;
+        pool->nmsgs++;
+        msg = NULL;
+    }
+    virMutexUnlock(&pool->lock);
+
     VIR_FREE(msg);
 }
 
@@ -154,7 +420,7 @@ int virNetMessageDecodeLength(virNetMessagePtr msg)
     /* Extend our declared buffer length and carry
        on reading the header + payload */
     msg->bufferLength += len;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageReserveBuffer(msg, msg->bufferLength) < 0)
         goto cleanup;
 
     VIR_DEBUG("Got length, now need %zu total (%u more)",
@@ -231,7 +497,7 @@ int virNetMessageEncodeHeader(virNetMessagePtr msg)
     unsigned int len = 0;
 
     msg->bufferLength = VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageReserveBuffer(msg, msg->bufferLength) < 0)
         return ret;
     msg->bufferOffset = 0;
 
@@ -350,6 +616,31 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
     XDR xdr;
     unsigned int msglen;
 
+#ifdef HAVE_XDR_SIZEOF
+    unsigned long size;
+
+    /* Counting the bytes the payload needs is much cheaper than
+     * encoding it, so size the buffer up front instead of encoding
+     * large payloads again for every time the buffer grows. A zero
+     * size means the payload is empty or could not be sized, the
+     * loop below copes with both. */
+    if ((size = xdr_sizeof(filter, data)) > 0) {
+        if (size > VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX -
+            msg->bufferOffset) {
+            virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message payload"));
+            return -1;
+        }
+
+        if (msg->bufferOffset + size > msg->bufferLength) {
+            msg->bufferLength = msg->bufferOffset + size;
+            if (virNetMessageReserveBuffer(msg, msg->bufferLength) < 0)
+                return -1;
+
+            VIR_DEBUG("Sized message buffer length = %zu", msg->bufferLength);
+        }
+    }
+#endif /* HAVE_XDR_SIZEOF */
+
     /* Serialise payload of the message. This assumes that
      * virNetMessageEncodeHeader has already been run, so
      * just appends to that data */
@@ -369,7 +660,7 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
 
         msg->bufferLength = newlen + VIR_NET_MESSAGE_LEN_MAX;
 
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        if (virNetMessageReserveBuffer(msg, msg->bufferLength) < 0)
             goto error;
 
         xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
@@ -453,7 +744,7 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
 
         msg->bufferLength = msg->bufferOffset + len;
 
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        if (virNetMessageReserveBuffer(msg, msg->bufferLength) < 0)
             return -1;
 
         VIR_DEBUG("Increased message buffer length = %zu", msg->bufferLength);
@@ -507,6 +798,56 @@ int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
 }
 
 
+/*
+ * Like virNetMessageEncodePayloadRaw, except that the @len payload
+ * bytes are not copied into the message, but moved straight from the
+ * pipe @fd to the socket when the message is sent. The message takes
+ * over @fd, even on failure.
+ */
+int virNetMessageEncodePayloadSplice(virNetMessagePtr msg,
+                                     int fd,
+                                     size_t len)
+{
+    XDR xdr;
+    unsigned int msglen;
+
+    if ((msg->bufferOffset + len) >
+        (VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX)) {
+        virReportError(VIR_ERR_RPC,
+                       _("Stream data too long to send "
+                         "(%zu bytes needed, %zu bytes available)"),
+                       len,
+                       VIR_NET_MESSAGE_MAX +
+                       VIR_NET_MESSAGE_LEN_MAX -
+                       msg->bufferOffset);
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+
+    /* Re-encode the length word. */
+    VIR_DEBUG("Encode length as %zu", msg->bufferOffset + len);
+    xdrmem_create(&xdr, msg->buffer, VIR_NET_MESSAGE_HEADER_XDR_LEN, XDR_ENCODE);
+    msglen = msg->bufferOffset + len;
+    if (!xdr_u_int(&xdr, &msglen)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message length"));
+        xdr_destroy(&xdr);
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+    xdr_destroy(&xdr);
+
+    msg->bufferLength = msg->bufferOffset;
+    msg->bufferOffset = 0;
+    if (len) {
+        msg->spliceFD = fd;
+        msg->spliceLength = len;
+    } else {
+        VIR_FORCE_CLOSE(fd);
+    }
+    return 0;
+}
+
+
 void virNetMessageSaveError(virNetMessageErrorPtr rerr)
 {
     /* This func may be called several times & the first
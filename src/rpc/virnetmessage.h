@@ -38,6 +38,7 @@ struct _virNetMessage {
                   /* Maximum   VIR_NET_MESSAGE_MAX     + VIR_NET_MESSAGE_LEN_MAX */
     size_t bufferLength;
     size_t bufferOffset;
+    size_t bufferAlloc; /* Space allocated by virNetMessageReserveBuffer */
 
     virNetMessageHeader header;
 
@@ -48,6 +49,17 @@ struct _virNetMessage {
     int *fds;
     size_t donefds;
 
+    /* Payload bytes still to be moved from the pipe @spliceFD to the
+     * socket once @buffer is sent. The FD is owned by the message and
+     * only open while @spliceLength is non-zero */
+    int spliceFD;
+    size_t spliceLength;
+
+    /* Number of events carried by an event message, which may then
+     * be dropped for a client falling behind. Zero for everything
+     * which has to be sent, replies and keepalives included */
+    size_t nevents;
+
     virNetMessagePtr next;
 };
 
@@ -60,6 +72,16 @@ void virNetMessageClear(virNetMessagePtr);
 
 void virNetMessageFree(virNetMessagePtr msg);
 
+int virNetMessageReserveBuffer(virNetMessagePtr msg,
+                               size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+
+void virNetMessagePoolGetStats(unsigned long long *hits,
+                               unsigned long long *misses,
+                               size_t *nmsgs,
+                               size_t *nbuffers,
+                               unsigned long long *nbytes);
+
 virNetMessagePtr virNetMessageQueueServe(virNetMessagePtr *queue)
     ATTRIBUTE_NONNULL(1);
 void virNetMessageQueuePush(virNetMessagePtr *queue,
@@ -91,6 +113,10 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+int virNetMessageEncodePayloadSplice(virNetMessagePtr msg,
+                                     int fd,
+                                     size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 
 void virNetMessageSaveError(virNetMessageErrorPtr rerr)
     ATTRIBUTE_NONNULL(1);
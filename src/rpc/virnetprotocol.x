@@ -48,6 +48,12 @@ const VIR_NET_MESSAGE_HEADER_MAX = 24;
 /* Size of message payload */
 const VIR_NET_MESSAGE_PAYLOAD_MAX = 16777192;
 
+/* Payload of stream data messages, for peers which agreed on
+ * using it. Others still get at most VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX
+ * at a time.
+ */
+const VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX = 4194304;
+
 /* Size of message length field. Not counted in VIR_NET_MESSAGE_MAX
  * and VIR_NET_MESSAGE_INITIAL.
  */
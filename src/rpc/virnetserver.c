@@ -29,6 +29,8 @@
 #include "virerror.h"
 #include "virthread.h"
 #include "virthreadpool.h"
+#include "viratomic.h"
+#include "vireventpoll.h"
 #include "virnetservermdns.h"
 #include "virstring.h"
 
@@ -44,6 +46,18 @@ struct _virNetServerJob {
     virNetServerClientPtr client;
     virNetMessagePtr msg;
     virNetServerProgramPtr prog;
+    bool ordered;   /* Started by virNetServerClientBeginCallLocked */
+    bool readonly;
+};
+
+typedef struct _virNetServerIOThread virNetServerIOThread;
+typedef virNetServerIOThread *virNetServerIOThreadPtr;
+
+struct _virNetServerIOThread {
+    virThread thread;
+    virEventPollLoopPtr loop;
+    int quitTimer;  /* Armed to have the loop notice @quit */
+    int quit;
 };
 
 struct _virNetServer {
@@ -73,6 +87,16 @@ struct _virNetServer {
     int keepaliveInterval;
     unsigned int keepaliveCount;
 
+    size_t clientWriteBatch;            /* See virNetServerClientSetWriteBatch */
+    size_t clientTxMaxMessages;         /* See virNetServerClientSetTxLimits */
+    size_t clientTxMaxBytes;
+    virNetServerClientTxPolicy clientTxPolicy;
+    bool orderedCalls;                  /* See virNetServerSetOrderedCalls */
+
+    size_t nioThreads;                  /* See virNetServerSetIOThreads */
+    virNetServerIOThreadPtr ioThreads;
+    size_t nextIOThread;                /* Takes the next client */
+
 #ifdef WITH_GNUTLS
     virNetTLSContextPtr tls;
 #endif
@@ -158,6 +182,88 @@ static int virNetServerProcessMsg(virNetServerPtr srv,
     return ret;
 }
 
+static virNetServerProgramPtr
+virNetServerFindProgramLocked(virNetServerPtr srv,
+                              virNetMessagePtr msg)
+{
+    size_t i;
+
+    for (i = 0; i < srv->nprograms; i++) {
+        if (virNetServerProgramMatches(srv->programs[i], msg))
+            return srv->programs[i];
+    }
+
+    return NULL;
+}
+
+static int virNetServerSendJobLocked(virNetServerPtr srv,
+                                     virNetServerClientPtr client,
+                                     virNetServerProgramPtr prog,
+                                     virNetMessagePtr msg,
+                                     bool ordered,
+                                     bool readonly)
+{
+    virNetServerJobPtr job;
+    unsigned int priority = 0;
+    int ret;
+
+    if (VIR_ALLOC(job) < 0)
+        return -1;
+
+    job->client = client;
+    job->msg = msg;
+    job->ordered = ordered;
+    job->readonly = readonly;
+
+    if (prog) {
+        virObjectRef(prog);
+        job->prog = prog;
+        priority = virNetServerProgramGetPriority(prog, msg->header.proc);
+    }
+
+    ret = virThreadPoolSendJob(srv->workers, priority, job);
+
+    if (ret < 0) {
+        VIR_FREE(job);
+        virObjectUnref(prog);
+    }
+
+    return ret;
+}
+
+/*
+ * Hand the calls which waited for an ordered call of @client
+ * to finish over to the workers. Each of them holds its own
+ * reference on @client, taken when the call was read.
+ */
+static void virNetServerEndOrderedJob(virNetServerPtr srv,
+                                      virNetServerClientPtr client,
+                                      bool readonly)
+{
+    virNetMessagePtr ready = virNetServerClientEndCall(client, readonly);
+
+    while (ready) {
+        virNetMessagePtr msg = virNetMessageQueueServe(&ready);
+        virNetServerProgramPtr prog;
+        bool ro = false;
+        int rv;
+
+        virObjectLock(srv);
+        if ((prog = virNetServerFindProgramLocked(srv, msg)))
+            ro = virNetServerProgramIsReadOnly(prog, msg->header.proc);
+        rv = virNetServerSendJobLocked(srv, client, prog, msg, true, ro);
+        virObjectUnlock(srv);
+
+        if (rv < 0) {
+            virNetMessageFree(msg);
+            virNetServerClientClose(client);
+            /* Finish the call we failed to start */
+            virNetServerEndOrderedJob(srv, client, ro);
+            virObjectUnref(client);
+        }
+    }
+}
+
 static void virNetServerHandleJob(void *jobOpaque, void *opaque)
 {
     virNetServerPtr srv = opaque;
@@ -169,6 +275,9 @@ static void virNetServerHandleJob(void *jobOpaque, void *opaque)
     if (virNetServerProcessMsg(srv, job->client, job->prog, job->msg) < 0)
         goto error;
 
+    if (job->ordered)
+        virNetServerEndOrderedJob(srv, job->client, job->readonly);
+
     virObjectUnref(job->prog);
     virObjectUnref(job->client);
     VIR_FREE(job);
@@ -178,6 +287,8 @@ static void virNetServerHandleJob(void *jobOpaque, void *opaque)
     virObjectUnref(job->prog);
     virNetMessageFree(job->msg);
     virNetServerClientClose(job->client);
+    if (job->ordered)
+        virNetServerEndOrderedJob(srv, job->client, job->readonly);
     virObjectUnref(job->client);
     VIR_FREE(job);
 }
@@ -188,42 +299,28 @@ static int virNetServerDispatchNewMessage(virNetServerClientPtr client,
 {
     virNetServerPtr srv = opaque;
     virNetServerProgramPtr prog = NULL;
-    unsigned int priority = 0;
-    size_t i;
     int ret = -1;
 
     VIR_DEBUG("server=%p client=%p message=%p",
               srv, client, msg);
 
     virObjectLock(srv);
-    for (i = 0; i < srv->nprograms; i++) {
-        if (virNetServerProgramMatches(srv->programs[i], msg)) {
-            prog = srv->programs[i];
-            break;
-        }
-    }
+    prog = virNetServerFindProgramLocked(srv, msg);
 
     if (srv->workers) {
-        virNetServerJobPtr job;
-
-        if (VIR_ALLOC(job) < 0)
-            goto cleanup;
-
-        job->client = client;
-        job->msg = msg;
-
-        if (prog) {
-            virObjectRef(prog);
-            job->prog = prog;
-            priority = virNetServerProgramGetPriority(prog, msg->header.proc);
+        bool ordered = srv->orderedCalls && prog;
+        bool readonly = false;
+
+        /* The client is locked by our caller */
+        if (ordered) {
+            readonly = virNetServerProgramIsReadOnly(prog, msg->header.proc);
+            if ((ret = virNetServerClientBeginCallLocked(client, msg,
+                                                         readonly)) <= 0)
+                goto cleanup;
         }
 
-        ret = virThreadPoolSendJob(srv->workers, priority, job);
-
-        if (ret < 0) {
-            VIR_FREE(job);
-            virObjectUnref(prog);
-        }
+        ret = virNetServerSendJobLocked(srv, client, prog, msg,
+                                        ordered, readonly);
     } else {
         ret = virNetServerProcessMsg(srv, client, prog, msg);
     }
@@ -247,6 +344,18 @@ int virNetServerAddClient(virNetServerPtr srv,
         goto error;
     }
 
+    virNetServerClientSetWriteBatch(client, srv->clientWriteBatch);
+    virNetServerClientSetTxLimits(client, srv->clientTxMaxMessages,
+                                  srv->clientTxMaxBytes, srv->clientTxPolicy);
+
+    if (srv->nioThreads) {
+        virNetServerIOThreadPtr io;
+
+        io = &srv->ioThreads[srv->nextIOThread++ % srv->nioThreads];
+        if (virNetServerClientSetEventLoop(client, io->loop) < 0)
+            goto error;
+    }
+
     if (virNetServerClientInit(client) < 0)
         goto error;
 
@@ -356,6 +465,7 @@ virNetServerPtr virNetServerNew(const char *name,
     srv->nclients_unauth_max = max_anonymous_clients;
     srv->keepaliveInterval = keepaliveInterval;
     srv->keepaliveCount = keepaliveCount;
+    srv->clientWriteBatch = VIR_NET_SERVER_CLIENT_WRITE_BATCH;
     srv->clientPrivNew = clientPrivNew;
     srv->clientPrivPreExecRestart = clientPrivPreExecRestart;
     srv->clientPrivFree = clientPrivFree;
@@ -529,6 +639,7 @@ virNetServerPtr virNetServerNewPostExecRestart(virJSONValuePtr object,
             goto error;
 
         if (virNetServerAddClient(srv, client) < 0) {
+            virNetServerClientClose(client);
             virObjectUnref(client);
             goto error;
         }
@@ -766,6 +877,54 @@ virNetServerCheckLimits(virNetServerPtr srv)
     }
 }
 
+static void
+virNetServerIOThreadQuitTimer(int timer,
+                              void *opaque)
+{
+    virNetServerIOThreadPtr io = opaque;
+
+    virEventPollLoopUpdateTimeout(io->loop, timer, -1);
+}
+
+
+static void
+virNetServerIOThreadMain(void *opaque)
+{
+    virNetServerIOThreadPtr io = opaque;
+
+    while (!virAtomicIntGet(&io->quit)) {
+        if (virEventPollLoopRunOnce(io->loop) < 0) {
+            VIR_ERROR(_("I/O thread event loop failed, exiting"));
+            break;
+        }
+    }
+}
+
+
+/*
+ * The clients of the threads must have been closed already
+ */
+static void
+virNetServerStopIOThreads(virNetServerPtr srv)
+{
+    size_t i;
+
+    for (i = 0; i < srv->nioThreads; i++) {
+        virAtomicIntSet(&srv->ioThreads[i].quit, 1);
+        virEventPollLoopUpdateTimeout(srv->ioThreads[i].loop,
+                                      srv->ioThreads[i].quitTimer, 0);
+    }
+
+    for (i = 0; i < srv->nioThreads; i++) {
+        virThreadJoin(&srv->ioThreads[i].thread);
+        virEventPollLoopFree(srv->ioThreads[i].loop);
+    }
+
+    VIR_FREE(srv->ioThreads);
+    srv->nioThreads = 0;
+}
+
+
 void virNetServerDispose(void *obj)
 {
     virNetServerPtr srv = obj;
@@ -792,6 +951,8 @@ void virNetServerDispose(void *obj)
     }
     VIR_FREE(srv->clients);
 
+    virNetServerStopIOThreads(srv);
+
     VIR_FREE(srv->mdnsGroupName);
     virNetServerMDNSFree(srv->mdns);
 }
@@ -945,6 +1106,156 @@ virNetServerSetThreadPoolParameters(virNetServerPtr srv,
     return ret;
 }
 
+/*
+ * Set how many bytes of queued replies and events may be handed to
+ * the socket of a client at once, for clients added from now on.
+ * Zero writes one message at a time.
+ */
+void
+virNetServerSetClientWriteBatch(virNetServerPtr srv,
+                                size_t clientWriteBatch)
+{
+    virObjectLock(srv);
+    srv->clientWriteBatch = clientWriteBatch;
+    virObjectUnlock(srv);
+}
+
+/*
+ * Set the limits on the messages queued for sending to each
+ * client added from now on, zero meaning no limit, and what
+ * happens to events beyond them.
+ */
+void
+virNetServerSetClientTxLimits(virNetServerPtr srv,
+                              size_t maxMessages,
+                              size_t maxBytes,
+                              virNetServerClientTxPolicy policy)
+{
+    virObjectLock(srv);
+    srv->clientTxMaxMessages = maxMessages;
+    srv->clientTxMaxBytes = maxBytes;
+    srv->clientTxPolicy = policy;
+    virObjectUnlock(srv);
+}
+
+/*
+ * With @orderedCalls set, the calls of a client run in the order
+ * they were received, except that read-only calls following each
+ * other may run in parallel. Otherwise every call of a client is
+ * handed to the workers as soon as it is read.
+ */
+void
+virNetServerSetOrderedCalls(virNetServerPtr srv,
+                            bool orderedCalls)
+{
+    virObjectLock(srv);
+    srv->orderedCalls = orderedCalls;
+    virObjectUnlock(srv);
+}
+
+/*
+ * Start @nioThreads threads with an event loop each, which take
+ * over the sockets of clients added from now on in turn. Without
+ * them, all clients are dispatched by the default event loop.
+ * Can only be done once.
+ */
+int
+virNetServerSetIOThreads(virNetServerPtr srv,
+                         size_t nioThreads)
+{
+    int ret = -1;
+
+    virObjectLock(srv);
+
+    if (srv->ioThreads) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("I/O threads are already running"));
+        goto cleanup;
+    }
+
+    if (nioThreads == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(srv->ioThreads, nioThreads) < 0)
+        goto cleanup;
+
+    while (srv->nioThreads < nioThreads) {
+        virNetServerIOThreadPtr io = &srv->ioThreads[srv->nioThreads];
+
+        if (!(io->loop = virEventPollLoopNew()))
+            goto error;
+
+        if ((io->quitTimer =
+             virEventPollLoopAddTimeout(io->loop, -1,
+                                        virNetServerIOThreadQuitTimer,
+                                        io, NULL)) < 0) {
+            virEventPollLoopFree(io->loop);
+            goto error;
+        }
+
+        if (virThreadCreate(&io->thread, true,
+                            virNetServerIOThreadMain, io) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create I/O thread"));
+            virEventPollLoopFree(io->loop);
+            goto error;
+        }
+
+        srv->nioThreads++;
+    }
+
+    VIR_DEBUG("Started %zu I/O threads", srv->nioThreads);
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(srv);
+    return ret;
+
+ error:
+    virNetServerStopIOThreads(srv);
+    goto cleanup;
+}
+
+/*
+ * With @workerQueues set, calls waiting for a worker are spread over
+ * several queues rather than a single one, see
+ * VIR_THREAD_POOL_WORK_STEALING. The workers are started afresh, so
+ * this must be done before any call is received.
+ */
+int
+virNetServerSetWorkerQueues(virNetServerPtr srv,
+                            bool workerQueues)
+{
+    virThreadPoolPtr workers;
+    int ret = -1;
+
+    virObjectLock(srv);
+
+    if (!srv->workers) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!(workers = virThreadPoolNewFlags(virThreadPoolGetMinWorkers(srv->workers),
+                                          virThreadPoolGetMaxWorkers(srv->workers),
+                                          virThreadPoolGetPriorityWorkers(srv->workers),
+                                          virNetServerHandleJob,
+                                          srv,
+                                          workerQueues ?
+                                          VIR_THREAD_POOL_WORK_STEALING : 0)))
+        goto cleanup;
+
+    virThreadPoolFree(srv->workers);
+    srv->workers = workers;
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(srv);
+    return ret;
+}
+
 size_t
 virNetServerGetMaxClients(virNetServerPtr srv)
 {
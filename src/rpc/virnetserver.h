@@ -103,6 +103,22 @@ int virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                         long long int maxWorkers,
                                         long long int prioWorkers);
 
+void virNetServerSetClientWriteBatch(virNetServerPtr srv,
+                                     size_t clientWriteBatch);
+void virNetServerSetClientTxLimits(virNetServerPtr srv,
+                                   size_t maxMessages,
+                                   size_t maxBytes,
+                                   virNetServerClientTxPolicy policy);
+
+void virNetServerSetOrderedCalls(virNetServerPtr srv,
+                                 bool orderedCalls);
+
+int virNetServerSetIOThreads(virNetServerPtr srv,
+                             size_t nioThreads);
+
+int virNetServerSetWorkerQueues(virNetServerPtr srv,
+                                bool workerQueues);
+
 unsigned long long virNetServerNextClientID(virNetServerPtr srv);
 
 virNetServerClientPtr virNetServerGetClient(virNetServerPtr srv,
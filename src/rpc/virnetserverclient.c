@@ -35,6 +35,7 @@
 #include "virerror.h"
 #include "viralloc.h"
 #include "virthread.h"
+#include "virfile.h"
 #include "virkeepalive.h"
 #include "virprobe.h"
 #include "virstring.h"
@@ -44,6 +45,9 @@
 
 VIR_LOG_INIT("rpc.netserverclient");
 
+/* Most queued messages written with one syscall */
+#define VIR_NET_SERVER_CLIENT_WRITE_IOV 16
+
 /* Allow for filtering of incoming messages to a custom
  * dispatch processing queue, instead of the workers.
  * This allows for certain types of messages to be handled
@@ -61,6 +65,16 @@ struct _virNetServerClientFilter {
     virNetServerClientFilterPtr next;
 };
 
+typedef struct _virNetServerClientCall virNetServerClientCall;
+typedef virNetServerClientCall *virNetServerClientCallPtr;
+
+struct _virNetServerClientCall {
+    virNetMessagePtr msg;
+    bool readonly;
+
+    virNetServerClientCallPtr next;
+};
+
 
 struct _virNetServerClient
 {
@@ -82,6 +96,12 @@ struct _virNetServerClient
     int sockTimer; /* Timer to be fired upon cached data,
                     * so we jump out from poll() immediately */
 
+    /* Loop dispatching the socket and sockTimer, NULL for the
+     * default one. Closing clients is still left to the default
+     * loop, which closeTimer wakes up once wantClose is set */
+    virEventPollLoopPtr eventLoop;
+    int closeTimer;
+
 
     virIdentityPtr identity;
 
@@ -105,6 +125,33 @@ struct _virNetServerClient
     /* Zero or many messages waiting for transmit
      * back to client, including async events */
     virNetMessagePtr tx;
+    /* Most bytes of the 'tx' queue to hand to the
+     * socket at once, zero to write one message
+     * at a time */
+    size_t writeBatch;
+    /* Bytes from the start of 'tx' which an encoding session
+     * refused with EAGAIN. It has to be offered the same bytes
+     * again, so the messages holding them must stay queued */
+    size_t txPending;
+    /* Size of the 'tx' queue and the limits beyond which
+     * events get dropped or the client closed, zero for
+     * no limit */
+    size_t ntx;
+    size_t txBytes;
+    size_t txMaxMessages;
+    size_t txMaxBytes;
+    virNetServerClientTxPolicy txPolicy;
+    virNetServerClientCoalesceFunc coalesceFunc;
+    unsigned long long txOverflows;
+    unsigned long long txDropped;
+    unsigned long long txCoalesced;
+
+    /* Ordered calls handed to the workers, whether
+     * one of them must run on its own, and the calls
+     * waiting for them to finish */
+    size_t ncalls;
+    bool exclusiveCall;
+    virNetServerClientCallPtr pendingCalls;
 
     /* Filters to capture messages that would otherwise
      * end up on the 'dx' queue */
@@ -139,13 +186,47 @@ static int virNetServerClientOnceInit(void)
 
 VIR_ONCE_GLOBAL_INIT(virNetServerClient)
 
+VIR_ENUM_IMPL(virNetServerClientTxPolicy,
+              VIR_NET_SERVER_CLIENT_TX_POLICY_LAST,
+              "drop", "coalesce", "close")
+
 
 static void virNetServerClientDispatchEvent(virNetSocketPtr sock, int events, void *opaque);
+static void virNetServerClientUpdateSockTimer(virNetServerClientPtr client,
+                                              int frequency);
+static void virNetServerClientWakeClose(virNetServerClientPtr client);
 static void virNetServerClientUpdateEvent(virNetServerClientPtr client);
 static void virNetServerClientDispatchRead(virNetServerClientPtr client);
 static int virNetServerClientSendMessageLocked(virNetServerClientPtr client,
                                                virNetMessagePtr msg);
 
+/*
+ * The 'tx' queue is only ever changed through these, so that
+ * its size is known without walking it
+ */
+static void
+virNetServerClientTxPush(virNetServerClientPtr client,
+                         virNetMessagePtr msg)
+{
+    virNetMessageQueuePush(&client->tx, msg);
+    client->ntx++;
+    client->txBytes += msg->bufferLength;
+}
+
+
+static virNetMessagePtr
+virNetServerClientTxServe(virNetServerClientPtr client)
+{
+    virNetMessagePtr msg = virNetMessageQueueServe(&client->tx);
+
+    if (msg) {
+        client->ntx--;
+        client->txBytes -= msg->bufferLength;
+    }
+    return msg;
+}
+
+
 /*
  * @client: a locked client object
  */
@@ -242,7 +323,9 @@ static void virNetServerClientUpdateEvent(virNetServerClientPtr client)
     virNetSocketUpdateIOCallback(client->sock, mode);
 
     if (client->rx && virNetSocketHasCachedData(client->sock))
-        virEventUpdateTimeout(client->sockTimer, 0);
+        virNetServerClientUpdateSockTimer(client, 0);
+
+    virNetServerClientWakeClose(client);
 }
 
 
@@ -326,14 +409,14 @@ virNetServerClientCheckAccess(virNetServerClientPtr client)
      * (NB. The '\1' byte is sent in an encrypted record).
      */
     confirm->bufferLength = 1;
-    if (VIR_ALLOC_N(confirm->buffer, confirm->bufferLength) < 0) {
+    if (virNetMessageReserveBuffer(confirm, confirm->bufferLength) < 0) {
         virNetMessageFree(confirm);
         return -1;
     }
     confirm->bufferOffset = 0;
     confirm->buffer[0] = '\1';
 
-    client->tx = confirm;
+    virNetServerClientTxPush(client, confirm);
 
     return 0;
 }
@@ -345,15 +428,57 @@ static void virNetServerClientSockTimerFunc(int timer,
 {
     virNetServerClientPtr client = opaque;
     virObjectLock(client);
-    virEventUpdateTimeout(timer, -1);
+    if (client->eventLoop)
+        virEventPollLoopUpdateTimeout(client->eventLoop, timer, -1);
+    else
+        virEventUpdateTimeout(timer, -1);
     /* Although client->rx != NULL when this timer is enabled, it might have
      * changed since the client was unlocked in the meantime. */
     if (client->rx)
         virNetServerClientDispatchRead(client);
+    virNetServerClientWakeClose(client);
     virObjectUnlock(client);
 }
 
 
+static void virNetServerClientCloseTimerFunc(int timer,
+                                             void *opaque ATTRIBUTE_UNUSED)
+{
+    /* Waking up the loop is all that was needed */
+    virEventUpdateTimeout(timer, -1);
+}
+
+
+/*
+ * @client: a locked client object
+ */
+static void virNetServerClientUpdateSockTimer(virNetServerClientPtr client,
+                                              int frequency)
+{
+    if (client->sockTimer <= 0)
+        return;
+
+    if (client->eventLoop)
+        virEventPollLoopUpdateTimeout(client->eventLoop,
+                                      client->sockTimer, frequency);
+    else
+        virEventUpdateTimeout(client->sockTimer, frequency);
+}
+
+
+/*
+ * @client: a locked client object
+ *
+ * Clients dispatched by a loop of their own are closed by the
+ * default loop, which has to notice that the client wants that.
+ */
+static void virNetServerClientWakeClose(virNetServerClientPtr client)
+{
+    if (client->wantClose && client->closeTimer > 0)
+        virEventUpdateTimeout(client->closeTimer, 0);
+}
+
+
 static virNetServerClientPtr
 virNetServerClientNewInternal(unsigned long long id,
                               virNetSocketPtr sock,
@@ -381,18 +506,20 @@ virNetServerClientNewInternal(unsigned long long id,
     client->tlsCtxt = virObjectRef(tls);
 #endif
     client->nrequests_max = nrequests_max;
+    client->writeBatch = VIR_NET_SERVER_CLIENT_WRITE_BATCH;
     client->conn_time = timestamp;
 
     client->sockTimer = virEventAddTimeout(-1, virNetServerClientSockTimerFunc,
                                            client, NULL);
     if (client->sockTimer < 0)
         goto error;
+    client->closeTimer = -1;
 
     /* Prepare one for packet receive */
     if (!(client->rx = virNetMessageNew(true)))
         goto error;
     client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_ALLOC_N(client->rx->buffer, client->rx->bufferLength) < 0)
+    if (virNetMessageReserveBuffer(client->rx, client->rx->bufferLength) < 0)
         goto error;
     client->nrequests = 1;
 
@@ -701,6 +828,26 @@ bool virNetServerClientIsLocal(virNetServerClientPtr client)
 }
 
 
+/*
+ * Whether stream data may be sent to the client with
+ * virNetMessageEncodePayloadSplice
+ */
+bool virNetServerClientHasSplice(virNetServerClientPtr client)
+{
+    bool splice = false;
+    virObjectLock(client);
+    if (client->sock)
+        splice = virNetSocketHasSplice(client->sock);
+#if WITH_SASL
+    /* About to switch to a SASL SSF layer */
+    if (client->sasl)
+        splice = false;
+#endif
+    virObjectUnlock(client);
+    return splice;
+}
+
+
 int virNetServerClientGetUNIXIdentity(virNetServerClientPtr client,
                                       uid_t *uid, gid_t *gid, pid_t *pid,
                                       unsigned long long *timestamp)
@@ -932,6 +1079,14 @@ void virNetServerClientDispose(void *obj)
     PROBE(RPC_SERVER_CLIENT_DISPOSE,
           "client=%p", client);
 
+    while (client->pendingCalls) {
+        virNetServerClientCallPtr call = client->pendingCalls;
+
+        client->pendingCalls = call->next;
+        virNetMessageFree(call->msg);
+        VIR_FREE(call);
+    }
+
     if (client->privateData &&
         client->privateDataFreeFunc)
         client->privateDataFreeFunc(client->privateData);
@@ -941,8 +1096,10 @@ void virNetServerClientDispose(void *obj)
 #if WITH_SASL
     virObjectUnref(client->sasl);
 #endif
-    if (client->sockTimer > 0)
+    if (client->sockTimer > 0 && !client->eventLoop)
         virEventRemoveTimeout(client->sockTimer);
+    if (client->closeTimer > 0)
+        virEventRemoveTimeout(client->closeTimer);
 #if WITH_GNUTLS
     virObjectUnref(client->tls);
     virObjectUnref(client->tlsCtxt);
@@ -997,6 +1154,12 @@ void virNetServerClientClose(virNetServerClientPtr client)
     if (client->sock)
         virNetSocketRemoveIOCallback(client->sock);
 
+    /* The timer holds a reference on the client */
+    if (client->eventLoop && client->sockTimer > 0) {
+        virEventPollLoopRemoveTimeout(client->eventLoop, client->sockTimer);
+        client->sockTimer = -1;
+    }
+
 #if WITH_GNUTLS
     if (client->tls) {
         virObjectUnref(client->tls);
@@ -1012,7 +1175,7 @@ void virNetServerClientClose(virNetServerClientPtr client)
     }
     while (client->tx) {
         virNetMessagePtr msg
-            = virNetMessageQueueServe(&client->tx);
+            = virNetServerClientTxServe(client);
         virNetMessageFree(msg);
     }
 
@@ -1045,6 +1208,7 @@ void virNetServerClientImmediateClose(virNetServerClientPtr client)
 {
     virObjectLock(client);
     client->wantClose = true;
+    virNetServerClientWakeClose(client);
     virObjectUnlock(client);
 }
 
@@ -1279,8 +1443,8 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
                 client->wantClose = true;
             } else {
                 client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                if (VIR_ALLOC_N(client->rx->buffer,
-                                client->rx->bufferLength) < 0) {
+                if (virNetMessageReserveBuffer(client->rx,
+                                               client->rx->bufferLength) < 0) {
                     client->wantClose = true;
                 } else {
                     client->nrequests++;
@@ -1292,6 +1456,25 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
 }
 
 
+/*
+ * Whether the socket writes through a TLS or SASL session, which
+ * may have encoded bytes it refused to send yet
+ */
+static bool
+virNetServerClientHasSession(virNetServerClientPtr client ATTRIBUTE_UNUSED)
+{
+#if WITH_GNUTLS
+    if (client->tls)
+        return true;
+#endif
+#if WITH_SASL
+    if (client->sasl)
+        return true;
+#endif
+    return false;
+}
+
+
 /*
  * Send client->tx using no encoding
  *
@@ -1302,7 +1485,12 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
  */
 static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
 {
+    struct iovec iov[VIR_NET_SERVER_CLIENT_WRITE_IOV];
+    virNetMessagePtr msg;
+    size_t niov = 0;
+    size_t len = 0;
     ssize_t ret;
+    ssize_t left;
 
     if (client->tx->bufferLength < client->tx->bufferOffset) {
         virReportError(VIR_ERR_RPC,
@@ -1315,13 +1503,264 @@ static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
     if (client->tx->bufferLength == client->tx->bufferOffset)
         return 1;
 
-    ret = virNetSocketWrite(client->sock,
-                            client->tx->buffer + client->tx->bufferOffset,
-                            client->tx->bufferLength - client->tx->bufferOffset);
+    /* Gather the queued messages following the head one, as long as
+     * nothing but their buffer has to go out before the next one */
+    for (msg = client->tx; msg && niov < VIR_NET_SERVER_CLIENT_WRITE_IOV;
+         msg = msg->next) {
+        iov[niov].iov_base = msg->buffer + msg->bufferOffset;
+        iov[niov].iov_len = msg->bufferLength - msg->bufferOffset;
+        len += iov[niov++].iov_len;
+
+        if (len >= client->writeBatch ||
+            msg->nfds || msg->spliceLength)
+            break;
+#if WITH_SASL
+        /* The SSF layer starts right after this message */
+        if (client->sasl)
+            break;
+#endif
+    }
+
+    ret = virNetSocketWritev(client->sock, iov, niov);
+    if (ret < 0)
+        return ret;
+    if (virNetServerClientHasSession(client))
+        client->txPending = len - ret;
+    if (ret == 0)
+        return ret; /* 0 = egain */
+
+    /* Messages completed here are dequeued by the caller */
+    for (msg = client->tx, left = ret; left > 0; msg = msg->next) {
+        size_t n = MIN((size_t) left, msg->bufferLength - msg->bufferOffset);
+
+        msg->bufferOffset += n;
+        left -= n;
+    }
+
+    return ret;
+}
+
+
+static bool
+virNetServerClientCanStartCall(virNetServerClientPtr client,
+                               bool readonly)
+{
+    if (readonly)
+        return !client->exclusiveCall;
+    return client->ncalls == 0;
+}
+
+
+/**
+ * virNetServerClientBeginCallLocked:
+ * @client: the client, locked
+ * @msg: the call about to be dispatched
+ * @readonly: whether the call only looks at state
+ *
+ * Read-only calls of a client may run alongside each other, any
+ * other call runs on its own. Calls which cannot start yet are
+ * queued and handed back by virNetServerClientEndCall in the order
+ * they arrived.
+ *
+ * Returns 1 if @msg may be dispatched now, 0 if it was queued,
+ * -1 on error.
+ */
+int
+virNetServerClientBeginCallLocked(virNetServerClientPtr client,
+                                  virNetMessagePtr msg,
+                                  bool readonly)
+{
+    virNetServerClientCallPtr call;
+    virNetServerClientCallPtr *tail = &client->pendingCalls;
+
+    if (!client->pendingCalls &&
+        virNetServerClientCanStartCall(client, readonly)) {
+        client->ncalls++;
+        if (!readonly)
+            client->exclusiveCall = true;
+        return 1;
+    }
+
+    if (VIR_ALLOC(call) < 0)
+        return -1;
+
+    call->msg = msg;
+    call->readonly = readonly;
+
+    while (*tail)
+        tail = &(*tail)->next;
+    *tail = call;
+
+    VIR_DEBUG("client=%p queued call proc=%d behind %zu running",
+              client, msg->header.proc, client->ncalls);
+    return 0;
+}
+
+
+/**
+ * virNetServerClientEndCall:
+ * @client: the client
+ * @readonly: whether the finished call was read-only
+ *
+ * Marks a call started by virNetServerClientBeginCallLocked as
+ * finished.
+ *
+ * Returns the queued calls which may be dispatched now, linked
+ * through their next pointer, or NULL.
+ */
+virNetMessagePtr
+virNetServerClientEndCall(virNetServerClientPtr client,
+                          bool readonly)
+{
+    virNetMessagePtr ready = NULL;
+
+    virObjectLock(client);
+    client->ncalls--;
+    if (!readonly)
+        client->exclusiveCall = false;
+
+    while (client->pendingCalls &&
+           virNetServerClientCanStartCall(client,
+                                          client->pendingCalls->readonly)) {
+        virNetServerClientCallPtr call = client->pendingCalls;
+
+        client->pendingCalls = call->next;
+        client->ncalls++;
+        if (!call->readonly)
+            client->exclusiveCall = true;
+
+        virNetMessageQueuePush(&ready, call->msg);
+        VIR_FREE(call);
+    }
+    virObjectUnlock(client);
+
+    return ready;
+}
+
+
+void virNetServerClientSetWriteBatch(virNetServerClientPtr client,
+                                     size_t writeBatch)
+{
+    virObjectLock(client);
+    client->writeBatch = writeBatch;
+    virObjectUnlock(client);
+}
+
+
+/*
+ * Limit the 'tx' queue of @client to @maxMessages messages and
+ * @maxBytes bytes, zero meaning no limit. Events which would take
+ * the queue past either are dealt with according to @policy,
+ * replies and stream data are always queued.
+ */
+void virNetServerClientSetTxLimits(virNetServerClientPtr client,
+                                   size_t maxMessages,
+                                   size_t maxBytes,
+                                   virNetServerClientTxPolicy policy)
+{
+    virObjectLock(client);
+    client->txMaxMessages = maxMessages;
+    client->txMaxBytes = maxBytes;
+    client->txPolicy = policy;
+    virObjectUnlock(client);
+}
+
+
+/*
+ * Set how VIR_NET_SERVER_CLIENT_TX_POLICY_COALESCE finds the
+ * queued events a new one supersedes. Without it the policy
+ * behaves like VIR_NET_SERVER_CLIENT_TX_POLICY_DROP.
+ */
+void virNetServerClientSetCoalesceFunc(virNetServerClientPtr client,
+                                       virNetServerClientCoalesceFunc func)
+{
+    virObjectLock(client);
+    client->coalesceFunc = func;
+    virObjectUnlock(client);
+}
+
+
+void virNetServerClientGetTxStats(virNetServerClientPtr client,
+                                  virNetServerClientTxStatsPtr stats)
+{
+    virObjectLock(client);
+    stats->messages = client->ntx;
+    stats->bytes = client->txBytes;
+    stats->overflows = client->txOverflows;
+    stats->dropped = client->txDropped;
+    stats->coalesced = client->txCoalesced;
+    virObjectUnlock(client);
+}
+
+
+/*
+ * Have the socket of @client dispatched by @loop instead of the
+ * default event loop. Must be called before virNetServerClientInit
+ * and @loop must outlive the client being closed.
+ */
+int virNetServerClientSetEventLoop(virNetServerClientPtr client,
+                                   virEventPollLoopPtr loop)
+{
+    int sockTimer = -1;
+    int closeTimer = -1;
+    int ret = -1;
+
+    virObjectLock(client);
+
+    if (client->eventLoop) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("client event loop is already set"));
+        goto cleanup;
+    }
+
+    if ((closeTimer = virEventAddTimeout(-1, virNetServerClientCloseTimerFunc,
+                                         NULL, NULL)) < 0)
+        goto cleanup;
+
+    if ((sockTimer = virEventPollLoopAddTimeout(loop, -1,
+                                                virNetServerClientSockTimerFunc,
+                                                client,
+                                                virObjectFreeCallback)) < 0) {
+        virEventRemoveTimeout(closeTimer);
+        goto cleanup;
+    }
+    virObjectRef(client);
+
+    if (client->sockTimer > 0)
+        virEventRemoveTimeout(client->sockTimer);
+    client->sockTimer = sockTimer;
+    client->closeTimer = closeTimer;
+    client->eventLoop = loop;
+    virNetSocketSetEventLoop(client->sock, loop);
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(client);
+    return ret;
+}
+
+
+/*
+ * Move the spliced payload of client->tx onto the wire
+ *
+ * Returns:
+ *   -1 on error or EOF
+ *    0 on EAGAIN
+ *    n number of bytes
+ */
+static ssize_t virNetServerClientSplice(virNetServerClientPtr client)
+{
+    ssize_t ret;
+
+    ret = virNetSocketSplice(client->sock,
+                             client->tx->spliceFD,
+                             client->tx->spliceLength);
     if (ret <= 0)
         return ret; /* -1 error, 0 = egain */
 
-    client->tx->bufferOffset += ret;
+    client->tx->spliceLength -= ret;
+    if (!client->tx->spliceLength)
+        VIR_FORCE_CLOSE(client->tx->spliceFD);
     return ret;
 }
 
@@ -1345,6 +1784,19 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
                 return; /* Would block on write EAGAIN */
         }
 
+        if (client->tx->bufferOffset == client->tx->bufferLength &&
+            client->tx->spliceLength) {
+            ssize_t ret;
+            ret = virNetServerClientSplice(client);
+            if (ret < 0) {
+                client->wantClose = true;
+                return;
+            }
+            if (ret == 0)
+                return; /* Would block on write EAGAIN */
+            continue;
+        }
+
         if (client->tx->bufferOffset == client->tx->bufferLength) {
             virNetMessagePtr msg;
             size_t i;
@@ -1372,7 +1824,7 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
 #endif
 
             /* Get finished msg from head of tx queue */
-            msg = virNetMessageQueueServe(&client->tx);
+            msg = virNetServerClientTxServe(client);
 
             if (msg->tracked) {
                 client->nrequests--;
@@ -1382,7 +1834,7 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
                     /* Ready to recv more messages */
                     virNetMessageClear(msg);
                     msg->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                    if (VIR_ALLOC_N(msg->buffer, msg->bufferLength) < 0) {
+                    if (virNetMessageReserveBuffer(msg, msg->bufferLength) < 0) {
                         virNetMessageFree(msg);
                         return;
                     }
@@ -1466,10 +1918,118 @@ virNetServerClientDispatchEvent(virNetSocketPtr sock, int events, void *opaque)
                   VIR_EVENT_HANDLE_HANGUP))
         client->wantClose = true;
 
+    virNetServerClientWakeClose(client);
     virObjectUnlock(client);
 }
 
 
+static bool
+virNetServerClientTxIsFull(virNetServerClientPtr client,
+                           virNetMessagePtr msg)
+{
+    return (client->txMaxMessages &&
+            client->ntx + 1 > client->txMaxMessages) ||
+        (client->txMaxBytes &&
+         client->txBytes + msg->bufferLength > client->txMaxBytes);
+}
+
+
+/* Only events no part of which was written yet can go */
+static bool
+virNetServerClientTxCanDrop(virNetMessagePtr msg)
+{
+    return msg->nevents && msg->bufferOffset == 0 && !msg->nfds;
+}
+
+
+/*
+ * The first message of the 'tx' queue which is not part of
+ * the bytes an encoding session still has to send
+ */
+static virNetMessagePtr *
+virNetServerClientTxFirstUnsent(virNetServerClientPtr client)
+{
+    virNetMessagePtr *place = &client->tx;
+    size_t pending = client->txPending;
+
+    while (*place && pending) {
+        pending -= MIN(pending, (*place)->bufferLength - (*place)->bufferOffset);
+        place = &(*place)->next;
+    }
+
+    return place;
+}
+
+
+static void
+virNetServerClientTxDrop(virNetServerClientPtr client,
+                         virNetMessagePtr *place)
+{
+    virNetMessagePtr msg = *place;
+
+    *place = msg->next;
+    msg->next = NULL;
+    client->ntx--;
+    client->txBytes -= msg->bufferLength;
+    virNetMessageFree(msg);
+}
+
+
+/*
+ * Make room in the 'tx' queue of @client for the event @msg,
+ * following the policy of the client.
+ *
+ * Returns 1 if @msg can be queued, 0 if it has to be dropped
+ * and -1 if the client is to be closed.
+ */
+static int
+virNetServerClientTxMakeRoom(virNetServerClientPtr client,
+                             virNetMessagePtr msg)
+{
+    virNetMessagePtr *place;
+
+    client->txOverflows++;
+
+    if (client->txPolicy == VIR_NET_SERVER_CLIENT_TX_POLICY_CLOSE) {
+        VIR_WARN("Closing client %llu with %zu messages (%zu bytes) "
+                 "waiting to be sent",
+                 client->id, client->ntx, client->txBytes);
+        return -1;
+    }
+
+    if (client->txPolicy == VIR_NET_SERVER_CLIENT_TX_POLICY_COALESCE &&
+        client->coalesceFunc) {
+        place = virNetServerClientTxFirstUnsent(client);
+        while (*place) {
+            if (virNetServerClientTxCanDrop(*place) &&
+                client->coalesceFunc(*place, msg)) {
+                client->txCoalesced += (*place)->nevents;
+                virNetServerClientTxDrop(client, place);
+            } else {
+                place = &(*place)->next;
+            }
+        }
+    }
+
+    place = virNetServerClientTxFirstUnsent(client);
+    while (*place && virNetServerClientTxIsFull(client, msg)) {
+        if (virNetServerClientTxCanDrop(*place)) {
+            client->txDropped += (*place)->nevents;
+            virNetServerClientTxDrop(client, place);
+        } else {
+            place = &(*place)->next;
+        }
+    }
+
+    if (virNetServerClientTxIsFull(client, msg)) {
+        client->txDropped += msg->nevents;
+        return 0;
+    }
+
+    return 1;
+}
+
+
 static int
 virNetServerClientSendMessageLocked(virNetServerClientPtr client,
                                     virNetMessagePtr msg)
@@ -1481,12 +2041,32 @@ virNetServerClientSendMessageLocked(virNetServerClientPtr client,
 
     msg->donefds = 0;
     if (client->sock && !client->wantClose) {
+        /* Replies are bounded by nrequests_max already and
+         * keepalives by their interval, only events marked
+         * by their sender as such can pile up */
+        if (msg->nevents &&
+            virNetServerClientTxIsFull(client, msg)) {
+            int rv = virNetServerClientTxMakeRoom(client, msg);
+
+            if (rv < 0) {
+                client->wantClose = true;
+                virNetServerClientWakeClose(client);
+                return -1;
+            }
+            if (rv == 0) {
+                VIR_DEBUG("Dropping event proc=%d for client %llu",
+                          msg->header.proc, client->id);
+                virNetMessageFree(msg);
+                return 0;
+            }
+        }
+
         PROBE(RPC_SERVER_CLIENT_MSG_TX_QUEUE,
               "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
               client, msg->bufferLength,
               msg->header.prog, msg->header.vers, msg->header.proc,
               msg->header.type, msg->header.status, msg->header.serial);
-        virNetMessageQueuePush(&client->tx, msg);
+        virNetServerClientTxPush(client, msg);
 
         virNetServerClientUpdateEvent(client);
         ret = 0;
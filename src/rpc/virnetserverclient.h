@@ -29,10 +29,37 @@
 # include "virnetmessage.h"
 # include "virobject.h"
 # include "virjson.h"
+# include "virutil.h"
 
 typedef struct _virNetServerClient virNetServerClient;
 typedef virNetServerClient *virNetServerClientPtr;
 
+/* Default for virNetServerClientSetWriteBatch */
+# define VIR_NET_SERVER_CLIENT_WRITE_BATCH (256 * 1024)
+
+/* What to do with an event which would take the 'tx' queue of a
+ * client past its limits, see virNetServerClientSetTxLimits */
+typedef enum {
+    VIR_NET_SERVER_CLIENT_TX_POLICY_DROP = 0, /* drop the oldest events */
+    VIR_NET_SERVER_CLIENT_TX_POLICY_COALESCE, /* drop superseded events, then
+                                               * the oldest ones */
+    VIR_NET_SERVER_CLIENT_TX_POLICY_CLOSE,    /* disconnect the client */
+
+    VIR_NET_SERVER_CLIENT_TX_POLICY_LAST
+} virNetServerClientTxPolicy;
+
+VIR_ENUM_DECL(virNetServerClientTxPolicy)
+
+typedef struct _virNetServerClientTxStats virNetServerClientTxStats;
+typedef virNetServerClientTxStats *virNetServerClientTxStatsPtr;
+struct _virNetServerClientTxStats {
+    size_t messages;                /* Messages in the 'tx' queue */
+    size_t bytes;                   /* ... and their size */
+    unsigned long long overflows;   /* Events which hit the limits */
+    unsigned long long dropped;     /* Events dropped as a result */
+    unsigned long long coalesced;   /* Events dropped as superseded */
+};
+
 typedef int (*virNetServerClientDispatchFunc)(virNetServerClientPtr client,
                                               virNetMessagePtr msg,
                                               void *opaque);
@@ -41,6 +68,10 @@ typedef int (*virNetServerClientFilterFunc)(virNetServerClientPtr client,
                                             virNetMessagePtr msg,
                                             void *opaque);
 
+/* Whether the queued event @old is made redundant by @msg */
+typedef bool (*virNetServerClientCoalesceFunc)(virNetMessagePtr old,
+                                               virNetMessagePtr msg);
+
 typedef virJSONValuePtr (*virNetServerClientPrivPreExecRestart)(virNetServerClientPtr client,
                                                                 void *data);
 typedef void *(*virNetServerClientPrivNewPostExecRestart)(virNetServerClientPtr client,
@@ -80,6 +111,24 @@ void virNetServerClientRemoveFilter(virNetServerClientPtr client,
 
 int virNetServerClientGetAuth(virNetServerClientPtr client);
 void virNetServerClientSetAuth(virNetServerClientPtr client, int auth);
+void virNetServerClientSetWriteBatch(virNetServerClientPtr client,
+                                     size_t writeBatch);
+int virNetServerClientSetEventLoop(virNetServerClientPtr client,
+                                   virEventPollLoopPtr loop);
+void virNetServerClientSetTxLimits(virNetServerClientPtr client,
+                                   size_t maxMessages,
+                                   size_t maxBytes,
+                                   virNetServerClientTxPolicy policy);
+void virNetServerClientSetCoalesceFunc(virNetServerClientPtr client,
+                                       virNetServerClientCoalesceFunc func);
+void virNetServerClientGetTxStats(virNetServerClientPtr client,
+                                  virNetServerClientTxStatsPtr stats);
+
+int virNetServerClientBeginCallLocked(virNetServerClientPtr client,
+                                      virNetMessagePtr msg,
+                                      bool readonly);
+virNetMessagePtr virNetServerClientEndCall(virNetServerClientPtr client,
+                                           bool readonly);
 bool virNetServerClientGetReadonly(virNetServerClientPtr client);
 unsigned long long virNetServerClientGetID(virNetServerClientPtr client);
 long long virNetServerClientGetTimestamp(virNetServerClientPtr client);
@@ -103,6 +152,8 @@ bool virNetServerClientIsSecure(virNetServerClientPtr client);
 
 bool virNetServerClientIsLocal(virNetServerClientPtr client);
 
+bool virNetServerClientHasSplice(virNetServerClientPtr client);
+
 int virNetServerClientGetUNIXIdentity(virNetServerClientPtr client,
                                       uid_t *uid, gid_t *gid, pid_t *pid,
                                       unsigned long long *timestamp);
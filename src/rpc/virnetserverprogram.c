@@ -139,6 +139,18 @@ virNetServerProgramGetPriority(virNetServerProgramPtr prog,
     return proc->priority;
 }
 
+bool
+virNetServerProgramIsReadOnly(virNetServerProgramPtr prog,
+                              int procedure)
+{
+    virNetServerProgramProcPtr proc = virNetServerProgramGetProc(prog, procedure);
+
+    if (!proc)
+        return false;
+
+    return proc->readonly;
+}
+
 static int
 virNetServerProgramSendError(unsigned program,
                              unsigned version,
@@ -548,6 +560,40 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
 }
 
 
+/*
+ * Like virNetServerProgramSendStreamData, but the @len bytes of data
+ * are spliced from the pipe @fd, which is closed afterwards
+ */
+int virNetServerProgramSendStreamSplice(virNetServerProgramPtr prog,
+                                        virNetServerClientPtr client,
+                                        virNetMessagePtr msg,
+                                        int procedure,
+                                        unsigned int serial,
+                                        int fd,
+                                        size_t len)
+{
+    VIR_DEBUG("client=%p msg=%p fd=%d len=%zu", client, msg, fd, len);
+
+    msg->header.prog = prog->program;
+    msg->header.vers = prog->version;
+    msg->header.proc = procedure;
+    msg->header.type = VIR_NET_STREAM;
+    msg->header.serial = serial;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0) {
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+
+    if (virNetMessageEncodePayloadSplice(msg, fd, len) < 0)
+        return -1;
+    VIR_DEBUG("Total %zu", msg->bufferLength + msg->spliceLength);
+
+    return virNetServerClientSendMessage(client, msg);
+}
+
+
 void virNetServerProgramDispose(void *obj ATTRIBUTE_UNUSED)
 {
 }
@@ -58,6 +58,7 @@ struct _virNetServerProgramProc {
     xdrproc_t ret_filter;
     bool needAuth;
     unsigned int priority;
+    bool readonly; /* Only looks at state, see virNetServerSetOrderedCalls */
 };
 
 virNetServerProgramPtr virNetServerProgramNew(unsigned program,
@@ -71,6 +72,9 @@ int virNetServerProgramGetVersion(virNetServerProgramPtr prog);
 unsigned int virNetServerProgramGetPriority(virNetServerProgramPtr prog,
                                             int procedure);
 
+bool virNetServerProgramIsReadOnly(virNetServerProgramPtr prog,
+                                   int procedure);
+
 int virNetServerProgramMatches(virNetServerProgramPtr prog,
                                virNetMessagePtr msg);
 
@@ -104,4 +108,12 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
                                       const char *data,
                                       size_t len);
 
+int virNetServerProgramSendStreamSplice(virNetServerProgramPtr prog,
+                                        virNetServerClientPtr client,
+                                        virNetMessagePtr msg,
+                                        int procedure,
+                                        unsigned int serial,
+                                        int fd,
+                                        size_t len);
+
 #endif /* __VIR_NET_SERVER_PROGRAM_H__ */
@@ -74,6 +74,7 @@ struct _virNetSocket {
 
     int fd;
     int watch;
+    virEventPollLoopPtr eventLoop; /* NULL for the default loop */
     pid_t pid;
     int errfd;
     bool client;
@@ -106,8 +107,16 @@ struct _virNetSocket {
 #if WITH_SSH2
     virNetSSHSessionPtr sshSession;
 #endif
+
+    /* Gathers small buffers into a single TLS record */
+    char *coalesceBuffer;
+    /* Bytes of coalesceBuffer not yet accepted by the session */
+    size_t coalesceLength;
 };
 
+/* The largest TLS record */
+#define VIR_NET_SOCKET_COALESCE_MAX 16384
+
 
 static virClassPtr virNetSocketClass;
 static void virNetSocketDispose(void *obj);
@@ -1176,7 +1185,10 @@ void virNetSocketDispose(void *obj)
           "sock=%p", sock);
 
     if (sock->watch >= 0) {
-        virEventRemoveHandle(sock->watch);
+        if (sock->eventLoop)
+            virEventPollLoopRemoveHandle(sock->eventLoop, sock->watch);
+        else
+            virEventRemoveHandle(sock->watch);
         sock->watch = -1;
     }
 
@@ -1209,6 +1221,7 @@ void virNetSocketDispose(void *obj)
 
     VIR_FREE(sock->localAddrStrSASL);
     VIR_FREE(sock->remoteAddrStrSASL);
+    VIR_FREE(sock->coalesceBuffer);
     VIR_FREE(sock->remoteAddrStrURI);
 }
 
@@ -1262,6 +1275,39 @@ bool virNetSocketHasPassFD(virNetSocketPtr sock)
 }
 
 
+/*
+ * Data can only be spliced into the socket if it goes onto
+ * the wire as is, ie on plain UNIX and TCP connections
+ */
+bool virNetSocketHasSplice(virNetSocketPtr sock ATTRIBUTE_UNUSED)
+{
+    bool hasSplice = false;
+#ifdef HAVE_SPLICE
+    int family;
+
+    virObjectLock(sock);
+    family = sock->localAddr.data.sa.sa_family;
+    if ((family == AF_UNIX || family == AF_INET || family == AF_INET6) &&
+        sock->pid == 0)
+        hasSplice = true;
+# if WITH_GNUTLS
+    if (sock->tlsSession)
+        hasSplice = false;
+# endif
+# if WITH_SASL
+    if (sock->saslSession)
+        hasSplice = false;
+# endif
+# if WITH_SSH2
+    if (sock->sshSession)
+        hasSplice = false;
+# endif
+    virObjectUnlock(sock);
+#endif
+    return hasSplice;
+}
+
+
 int virNetSocketGetPort(virNetSocketPtr sock)
 {
     int port;
@@ -1797,6 +1843,138 @@ ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len)
 }
 
 
+#if WITH_GNUTLS
+/*
+ * Every write to a TLS session produces at least one record, so
+ * copy as many of the buffers as fit into a single record and
+ * write them together. A first buffer filling a record on its own
+ * is written as is.
+ *
+ * GNUTLS requires a write which failed with EAGAIN to be retried
+ * with the same data, so once a coalesced record was attempted it
+ * is kept and written again, ignoring @iov, until it went out in
+ * full. The caller passes the same leading bytes again anyway.
+ */
+static ssize_t virNetSocketWritevTLS(virNetSocketPtr sock,
+                                     const struct iovec *iov,
+                                     size_t niov)
+{
+    ssize_t ret;
+    size_t i;
+
+    if (sock->coalesceLength == 0) {
+        if (iov[0].iov_len >= VIR_NET_SOCKET_COALESCE_MAX)
+            return virNetSocketWriteWire(sock, iov[0].iov_base,
+                                         iov[0].iov_len);
+
+        if (!sock->coalesceBuffer &&
+            VIR_ALLOC_N(sock->coalesceBuffer, VIR_NET_SOCKET_COALESCE_MAX) < 0)
+            return -1;
+
+        for (i = 0;
+             i < niov && sock->coalesceLength < VIR_NET_SOCKET_COALESCE_MAX;
+             i++) {
+            size_t n = MIN(iov[i].iov_len,
+                           VIR_NET_SOCKET_COALESCE_MAX - sock->coalesceLength);
+
+            memcpy(sock->coalesceBuffer + sock->coalesceLength,
+                   iov[i].iov_base, n);
+            sock->coalesceLength += n;
+        }
+    }
+
+    ret = virNetSocketWriteWire(sock, sock->coalesceBuffer,
+                                sock->coalesceLength);
+    if (ret < 0) {
+        sock->coalesceLength = 0;
+    } else if (ret > 0) {
+        sock->coalesceLength -= ret;
+        memmove(sock->coalesceBuffer, sock->coalesceBuffer + ret,
+                sock->coalesceLength);
+    }
+
+    return ret;
+}
+#endif
+
+
+static ssize_t virNetSocketWritevWire(virNetSocketPtr sock,
+                                      const struct iovec *iov,
+                                      size_t niov)
+{
+    ssize_t ret;
+
+#if WITH_SSH2
+    if (sock->sshSession)
+        return virNetSocketWriteWire(sock, iov[0].iov_base, iov[0].iov_len);
+#endif
+#if WITH_GNUTLS
+    if (sock->tlsSession)
+        return virNetSocketWritevTLS(sock, iov, niov);
+#endif
+
+#ifdef HAVE_WRITEV
+# ifdef IOV_MAX
+    if (niov > IOV_MAX)
+        niov = IOV_MAX;
+# endif
+
+ rewrite:
+    ret = writev(sock->fd, iov, niov);
+    if (ret < 0) {
+        if (errno == EINTR)
+            goto rewrite;
+        if (errno == EAGAIN)
+            return 0;
+
+        virReportSystemError(errno, "%s",
+                             _("Cannot write data"));
+        return -1;
+    }
+    if (ret == 0) {
+        virReportSystemError(EIO, "%s",
+                             _("End of file while writing data"));
+        return -1;
+    }
+#else
+    ret = virNetSocketWriteWire(sock, iov[0].iov_base, iov[0].iov_len);
+#endif
+
+    return ret;
+}
+
+
+/*
+ * Write the buffers described by @iov in order, as far as the socket
+ * takes them. SASL and SSH connections only ever write the first
+ * buffer, TLS connections gather small buffers into one record.
+ *
+ * Returns number of bytes written, 0 if it would block, -1 on error
+ */
+ssize_t virNetSocketWritev(virNetSocketPtr sock,
+                           const struct iovec *iov,
+                           size_t niov)
+{
+    ssize_t ret;
+
+    if (niov == 0)
+        return 0;
+
+    virObjectLock(sock);
+#if WITH_SASL
+    if (sock->saslSession)
+        ret = virNetSocketWriteSASL(sock, iov[0].iov_base, iov[0].iov_len);
+    else
+#endif
+    if (niov == 1 && sock->coalesceLength == 0)
+        ret = virNetSocketWriteWire(sock, iov[0].iov_base, iov[0].iov_len);
+    else
+        ret = virNetSocketWritevWire(sock, iov, niov);
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
 /*
  * Returns 1 if an FD was sent, 0 if it would block, -1 on error
  */
@@ -1828,6 +2006,56 @@ int virNetSocketSendFD(virNetSocketPtr sock, int fd)
 }
 
 
+/*
+ * Moves up to @len bytes from the pipe @fd to the socket without
+ * copying them through userspace. The caller must make sure the
+ * data is available in the pipe and check virNetSocketHasSplice.
+ *
+ * Returns number of bytes moved, 0 if it would block, -1 on error
+ */
+#ifdef HAVE_SPLICE
+ssize_t virNetSocketSplice(virNetSocketPtr sock, int fd, size_t len)
+{
+    ssize_t ret;
+
+    virObjectLock(sock);
+ rewrite:
+    ret = splice(fd, NULL, sock->fd, NULL, len,
+                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+    if (ret < 0) {
+        if (errno == EINTR)
+            goto rewrite;
+        if (errno == EAGAIN) {
+            ret = 0;
+            goto cleanup;
+        }
+
+        virReportSystemError(errno, "%s",
+                             _("Cannot splice data"));
+        goto cleanup;
+    }
+    if (ret == 0) {
+        virReportSystemError(EIO, "%s",
+                             _("End of file while splicing data"));
+        ret = -1;
+    }
+
+ cleanup:
+    virObjectUnlock(sock);
+    return ret;
+}
+#else
+ssize_t virNetSocketSplice(virNetSocketPtr sock ATTRIBUTE_UNUSED,
+                           int fd ATTRIBUTE_UNUSED,
+                           size_t len ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("Splicing data is not supported on this platform"));
+    return -1;
+}
+#endif
+
+
 /*
  * Returns 1 if an FD was read, 0 if it would block, -1 on error
  */
@@ -1962,6 +2190,22 @@ static void virNetSocketEventFree(void *opaque)
     virObjectUnref(sock);
 }
 
+/*
+ * Have the IO callback of @sock dispatched by @loop rather than
+ * the default event loop. Must be called before the callback is
+ * added, and @loop must outlive the callback.
+ */
+void virNetSocketSetEventLoop(virNetSocketPtr sock,
+                              virEventPollLoopPtr loop)
+{
+    virObjectLock(sock);
+    if (sock->watch >= 0)
+        VIR_WARN("Watch already registered on socket %p", sock);
+    else
+        sock->eventLoop = loop;
+    virObjectUnlock(sock);
+}
+
 int virNetSocketAddIOCallback(virNetSocketPtr sock,
                               int events,
                               virNetSocketIOFunc func,
@@ -1977,11 +2221,20 @@ int virNetSocketAddIOCallback(virNetSocketPtr sock,
         goto cleanup;
     }
 
-    if ((sock->watch = virEventAddHandle(sock->fd,
-                                         events,
-                                         virNetSocketEventHandle,
-                                         sock,
-                                         virNetSocketEventFree)) < 0) {
+    if (sock->eventLoop)
+        sock->watch = virEventPollLoopAddHandle(sock->eventLoop,
+                                                sock->fd,
+                                                events,
+                                                virNetSocketEventHandle,
+                                                sock,
+                                                virNetSocketEventFree);
+    else
+        sock->watch = virEventAddHandle(sock->fd,
+                                        events,
+                                        virNetSocketEventHandle,
+                                        sock,
+                                        virNetSocketEventFree);
+    if (sock->watch < 0) {
         VIR_DEBUG("Failed to register watch on socket %p", sock);
         goto cleanup;
     }
@@ -2008,7 +2261,10 @@ void virNetSocketUpdateIOCallback(virNetSocketPtr sock,
         return;
     }
 
-    virEventUpdateHandle(sock->watch, events);
+    if (sock->eventLoop)
+        virEventPollLoopUpdateHandle(sock->eventLoop, sock->watch, events);
+    else
+        virEventUpdateHandle(sock->watch, events);
 
     virObjectUnlock(sock);
 }
@@ -2023,7 +2279,10 @@ void virNetSocketRemoveIOCallback(virNetSocketPtr sock)
         return;
     }
 
-    virEventRemoveHandle(sock->watch);
+    if (sock->eventLoop)
+        virEventPollLoopRemoveHandle(sock->eventLoop, sock->watch);
+    else
+        virEventRemoveHandle(sock->watch);
     /* Don't unref @sock, it's done via eventloop callback. */
     sock->watch = -1;
 
@@ -24,8 +24,11 @@
 #ifndef __VIR_NET_SOCKET_H__
 # define __VIR_NET_SOCKET_H__
 
+# include <sys/uio.h>
+
 # include "virsocketaddr.h"
 # include "vircommand.h"
+# include "vireventpoll.h"
 # ifdef WITH_GNUTLS
 #  include "virnettlscontext.h"
 # endif
@@ -116,6 +119,7 @@ int virNetSocketDupFD(virNetSocketPtr sock, bool cloexec);
 bool virNetSocketIsLocal(virNetSocketPtr sock);
 
 bool virNetSocketHasPassFD(virNetSocketPtr sock);
+bool virNetSocketHasSplice(virNetSocketPtr sock);
 
 int virNetSocketGetPort(virNetSocketPtr sock);
 
@@ -132,8 +136,12 @@ int virNetSocketSetBlocking(virNetSocketPtr sock,
 
 ssize_t virNetSocketRead(virNetSocketPtr sock, char *buf, size_t len);
 ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len);
+ssize_t virNetSocketWritev(virNetSocketPtr sock,
+                           const struct iovec *iov,
+                           size_t niov);
 
 int virNetSocketSendFD(virNetSocketPtr sock, int fd);
+ssize_t virNetSocketSplice(virNetSocketPtr sock, int fd, size_t len);
 int virNetSocketRecvFD(virNetSocketPtr sock, int *fd);
 
 # ifdef WITH_GNUTLS
@@ -156,6 +164,9 @@ int virNetSocketListen(virNetSocketPtr sock, int backlog);
 int virNetSocketAccept(virNetSocketPtr sock,
                        virNetSocketPtr *clientsock);
 
+void virNetSocketSetEventLoop(virNetSocketPtr sock,
+                              virEventPollLoopPtr loop);
+
 int virNetSocketAddIOCallback(virNetSocketPtr sock,
                               int events,
                               virNetSocketIOFunc func,
@@ -166,6 +166,11 @@ typedef virStorageBackend *virStorageBackendPtr;
 struct _virStorageBackend {
     int type;
 
+    /* refreshPool reconciles the volumes already known to the pool
+     * rather than expecting an empty list, and only probes what
+     * changed since the previous refresh */
+    bool incrementalRefresh;
+
     virStorageBackendFindPoolSources findPoolSources;
     virStorageBackendCheckPool checkPool;
     virStorageBackendStartPool startPool;
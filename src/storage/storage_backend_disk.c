@@ -48,6 +48,7 @@ virStorageBackendDiskMakeDataVol(virStoragePoolObjPtr pool,
                                  virStorageVolDefPtr vol)
 {
     char *tmp, *devpath, *partname;
+    virStorageVolDefPtr newvol = NULL;
 
     /* Prepended path will be same for all partitions, so we can
      * strip the path to form a reasonable pool-unique name
@@ -61,19 +62,16 @@ virStorageBackendDiskMakeDataVol(virStoragePoolObjPtr pool,
         /* This is typically a reload/restart/refresh path where
          * we're discovering the existing partitions for the pool
          */
-        if (VIR_ALLOC(vol) < 0)
+        if (VIR_ALLOC(newvol) < 0)
             return -1;
-        if (VIR_STRDUP(vol->name, partname) < 0 ||
-            VIR_APPEND_ELEMENT_COPY(pool->volumes.objs,
-                                    pool->volumes.count, vol) < 0) {
-            virStorageVolDefFree(vol);
-            return -1;
-        }
+        if (VIR_STRDUP(newvol->name, partname) < 0)
+            goto error;
+        vol = newvol;
     }
 
     if (vol->target.path == NULL) {
         if (VIR_STRDUP(devpath, groups[0]) < 0)
-            return -1;
+            goto error;
 
         /* Now figure out the stable path
          *
@@ -84,7 +82,7 @@ virStorageBackendDiskMakeDataVol(virStoragePoolObjPtr pool,
         vol->target.path = virStorageBackendStablePath(pool, devpath, true);
         VIR_FREE(devpath);
         if (vol->target.path == NULL)
-            return -1;
+            goto error;
     }
 
     /* Enforce provided vol->name is the same as what parted created.
@@ -95,13 +93,21 @@ virStorageBackendDiskMakeDataVol(virStoragePoolObjPtr pool,
         virReportError(VIR_ERR_INVALID_ARG,
                        _("invalid partition name '%s', expected '%s'"),
                        vol->name, partname);
-        return -1;
+        goto error;
     }
 
     if (vol->key == NULL) {
         /* XXX base off a unique key of the underlying disk */
         if (VIR_STRDUP(vol->key, vol->target.path) < 0)
-            return -1;
+            goto error;
+    }
+
+    /* The pool indexes volumes by key and path, so only add
+     * a newly discovered one once both are known */
+    if (newvol) {
+        if (virStoragePoolObjAddVol(pool, newvol) < 0)
+            goto error;
+        newvol = NULL;
     }
 
     if (vol->source.extents == NULL) {
@@ -186,6 +192,10 @@ virStorageBackendDiskMakeDataVol(virStoragePoolObjPtr pool,
         pool->def->capacity = vol->source.extents[0].end;
 
     return 0;
+
+ error:
+    virStorageVolDefFree(newvol);
+    return -1;
 }
 
 static int
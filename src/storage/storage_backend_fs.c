@@ -51,6 +51,8 @@
 #include "virfile.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "stat-time.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -883,28 +885,206 @@ virStorageBackendFileSystemBuild(virConnectPtr conn ATTRIBUTE_UNUSED,
 }
 
 
+static bool
+virStorageBackendFileSystemVolUnchanged(virStorageVolDefPtr vol,
+                                        const struct stat *sb)
+{
+    struct timespec mtime = get_stat_mtime(sb);
+    struct timespec ctime = get_stat_ctime(sb);
+
+    return vol->probed.valid &&
+        vol->probed.dev == sb->st_dev &&
+        vol->probed.ino == sb->st_ino &&
+        vol->probed.size == sb->st_size &&
+        vol->probed.mtime.tv_sec == mtime.tv_sec &&
+        vol->probed.mtime.tv_nsec == mtime.tv_nsec &&
+        vol->probed.ctime.tv_sec == ctime.tv_sec &&
+        vol->probed.ctime.tv_nsec == ctime.tv_nsec;
+}
+
+
+/* Reading image headers is mostly waiting for I/O, which on network
+ * filesystems adds up quickly, so do it for several files at once */
+#define VIR_STORAGE_BACKEND_FS_PROBE_WORKERS 8
+
+typedef struct _virStorageBackendFileSystemVolProbe virStorageBackendFileSystemVolProbe;
+typedef virStorageBackendFileSystemVolProbe *virStorageBackendFileSystemVolProbePtr;
+struct _virStorageBackendFileSystemVolProbe {
+    virStorageVolDefPtr vol;
+    struct stat sb;
+    bool havestat;
+
+    int err;            /* as returned by virStorageBackendProbeTarget */
+    virErrorPtr error;  /* reported by the worker if @err is fatal */
+};
+
+typedef struct _virStorageBackendFileSystemVolProbeData virStorageBackendFileSystemVolProbeData;
+typedef virStorageBackendFileSystemVolProbeData *virStorageBackendFileSystemVolProbeDataPtr;
+struct _virStorageBackendFileSystemVolProbeData {
+    virMutex lock;
+    virStorageBackendFileSystemVolProbePtr probes;
+    size_t nprobes;
+    size_t next;        /* first probe not yet picked up by a worker */
+};
+
+
+static void
+virStorageBackendFileSystemProbeVol(virStorageBackendFileSystemVolProbePtr probe)
+{
+    virStorageVolDefPtr vol = probe->vol;
+
+    if ((probe->err = virStorageBackendProbeTarget(&vol->target,
+                                                   &vol->target.encryption)) < 0) {
+        if (probe->err == -2) {
+            /* Silently ignore non-regular files,
+             * eg 'lost+found', dangling symbolic link */
+            return;
+        } else if (probe->err == -3) {
+            /* The backing file is currently unavailable, its format is not
+             * explicitly specified, the probe to auto detect the format
+             * failed: continue with faked RAW format, since AUTO will
+             * break virStorageVolTargetDefFormat() generating the line
+             * <format type='...'/>. */
+        } else {
+            probe->error = virSaveLastError();
+            return;
+        }
+    }
+
+    /* directory based volume */
+    if (vol->target.format == VIR_STORAGE_FILE_DIR)
+        vol->type = VIR_STORAGE_VOL_DIR;
+
+    if (vol->target.format == VIR_STORAGE_FILE_PLOOP)
+        vol->type = VIR_STORAGE_VOL_PLOOP;
+
+    if (vol->target.backingStore) {
+        ignore_value(virStorageBackendUpdateVolTargetInfo(vol->target.backingStore,
+                                                          false,
+                                                          VIR_STORAGE_VOL_OPEN_DEFAULT, 0));
+        /* If this failed, the backing file is currently unavailable,
+         * the capacity, allocation, owner, group and mode are unknown.
+         * An error message was raised, but we just continue. */
+    }
+
+    /* Remember what the file looked like before it was probed.
+     * Volumes with a missing backing file are probed again next
+     * time, as are ploop volumes whose images live in a directory
+     * whose stat() does not reflect changes to them. */
+    if (probe->havestat && probe->err == 0 &&
+        vol->type != VIR_STORAGE_VOL_PLOOP) {
+        vol->probed.valid = true;
+        vol->probed.dev = probe->sb.st_dev;
+        vol->probed.ino = probe->sb.st_ino;
+        vol->probed.size = probe->sb.st_size;
+        vol->probed.mtime = get_stat_mtime(&probe->sb);
+        vol->probed.ctime = get_stat_ctime(&probe->sb);
+    }
+}
+
+
+static void
+virStorageBackendFileSystemProbeWorker(void *opaque)
+{
+    virStorageBackendFileSystemVolProbeDataPtr data = opaque;
+
+    while (true) {
+        size_t i;
+
+        virMutexLock(&data->lock);
+        i = data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (i >= data->nprobes)
+            break;
+
+        virStorageBackendFileSystemProbeVol(&data->probes[i]);
+    }
+}
+
+
+/*
+ * Probe all of @probes, spread over a few threads. The calling
+ * thread takes part too, so that failing to spawn the others
+ * only makes things slower.
+ */
+static int
+virStorageBackendFileSystemProbeVols(virStorageBackendFileSystemVolProbePtr probes,
+                                     size_t nprobes)
+{
+    virStorageBackendFileSystemVolProbeData data = {
+        .probes = probes,
+        .nprobes = nprobes,
+    };
+    virThread workers[VIR_STORAGE_BACKEND_FS_PROBE_WORKERS - 1];
+    size_t nworkers = 0;
+    size_t i;
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        return -1;
+    }
+
+    while (nworkers < ARRAY_CARDINALITY(workers) &&
+           nworkers + 1 < nprobes) {
+        if (virThreadCreate(&workers[nworkers], true,
+                            virStorageBackendFileSystemProbeWorker,
+                            &data) < 0) {
+            VIR_WARN("Failed to create thread to probe volumes");
+            break;
+        }
+        nworkers++;
+    }
+
+    virStorageBackendFileSystemProbeWorker(&data);
+
+    for (i = 0; i < nworkers; i++)
+        virThreadJoin(&workers[i]);
+
+    virMutexDestroy(&data.lock);
+    return 0;
+}
+
+
 /**
  * Iterate over the pool's directory and enumerate all disk images
  * within it. This is non-recursive.
+ *
+ * Volumes the pool already knows about are kept as they are if the
+ * file they were probed from did not change since, so that refreshing
+ * a large pool only needs to read the headers of new or modified
+ * images. Those are probed in parallel and added to the pool in
+ * directory order once all of them are done.
  */
 static int
 virStorageBackendFileSystemRefresh(virConnectPtr conn ATTRIBUTE_UNUSED,
                                    virStoragePoolObjPtr pool)
 {
-    DIR *dir;
+    DIR *dir = NULL;
     struct dirent *ent;
     struct statvfs sb;
     struct stat statbuf;
+    virStorageVolDefList oldvols;
+    virHashTablePtr reused = NULL;
+    virStorageBackendFileSystemVolProbePtr probes = NULL;
+    size_t nprobes = 0;
     virStorageVolDefPtr vol = NULL;
     virStorageSourcePtr target = NULL;
+    char *path = NULL;
+    size_t i;
     int direrr;
     int fd = -1, ret = -1;
 
+    virStoragePoolObjTakeVols(pool, &oldvols);
+
+    if (!(reused = virHashCreate(oldvols.count, NULL)))
+        goto cleanup;
+
     if (virDirOpen(&dir, pool->def->target.path) < 0)
         goto cleanup;
 
     while ((direrr = virDirRead(dir, &ent, pool->def->target.path)) > 0) {
-        int err;
+        virStorageBackendFileSystemVolProbe probe = { 0 };
 
         if (virStringHasControlChars(ent->d_name)) {
             VIR_WARN("Ignoring file with control characters under '%s'",
@@ -912,6 +1092,27 @@ virStorageBackendFileSystemRefresh(virConnectPtr conn ATTRIBUTE_UNUSED,
             continue;
         }
 
+        if (virAsprintf(&path, "%s/%s",
+                        pool->def->target.path,
+                        ent->d_name) == -1)
+            goto cleanup;
+
+        probe.havestat = stat(path, &probe.sb) == 0;
+
+        if (probe.havestat &&
+            (vol = virHashLookup(oldvols.objsName, ent->d_name)) &&
+            virStorageBackendFileSystemVolUnchanged(vol, &probe.sb)) {
+            if (virHashAddEntry(reused, vol->name, vol) < 0)
+                goto cleanup;
+            if (virStoragePoolObjAddVol(pool, vol) < 0) {
+                ignore_value(virHashRemoveEntry(reused, vol->name));
+                goto cleanup;
+            }
+            VIR_FREE(path);
+            vol = NULL;
+            continue;
+        }
+
         if (VIR_ALLOC(vol) < 0)
             goto cleanup;
 
@@ -920,56 +1121,38 @@ virStorageBackendFileSystemRefresh(virConnectPtr conn ATTRIBUTE_UNUSED,
 
         vol->type = VIR_STORAGE_VOL_FILE;
         vol->target.format = VIR_STORAGE_FILE_RAW; /* Real value is filled in during probe */
-        if (virAsprintf(&vol->target.path, "%s/%s",
-                        pool->def->target.path,
-                        vol->name) == -1)
-            goto cleanup;
+        vol->target.path = path;
+        path = NULL;
 
         if (VIR_STRDUP(vol->key, vol->target.path) < 0)
             goto cleanup;
 
-        if ((err = virStorageBackendProbeTarget(&vol->target,
-                                                &vol->target.encryption)) < 0) {
-            if (err == -2) {
-                /* Silently ignore non-regular files,
-                 * eg 'lost+found', dangling symbolic link */
-                virStorageVolDefFree(vol);
-                vol = NULL;
-                continue;
-            } else if (err == -3) {
-                /* The backing file is currently unavailable, its format is not
-                 * explicitly specified, the probe to auto detect the format
-                 * failed: continue with faked RAW format, since AUTO will
-                 * break virStorageVolTargetDefFormat() generating the line
-                 * <format type='...'/>. */
-            } else {
-                goto cleanup;
-            }
-        }
+        probe.vol = vol;
+        if (VIR_APPEND_ELEMENT(probes, nprobes, probe) < 0)
+            goto cleanup;
+        vol = NULL;
+    }
+    if (direrr < 0)
+        goto cleanup;
+    VIR_DIR_CLOSE(dir);
 
-        /* directory based volume */
-        if (vol->target.format == VIR_STORAGE_FILE_DIR)
-            vol->type = VIR_STORAGE_VOL_DIR;
+    if (virStorageBackendFileSystemProbeVols(probes, nprobes) < 0)
+        goto cleanup;
 
-        if (vol->target.format == VIR_STORAGE_FILE_PLOOP)
-            vol->type = VIR_STORAGE_VOL_PLOOP;
+    for (i = 0; i < nprobes; i++) {
+        if (probes[i].err == -2)
+            continue;
 
-        if (vol->target.backingStore) {
-            ignore_value(virStorageBackendUpdateVolTargetInfo(vol->target.backingStore,
-                                                              false,
-                                                              VIR_STORAGE_VOL_OPEN_DEFAULT, 0));
-            /* If this failed, the backing file is currently unavailable,
-             * the capacity, allocation, owner, group and mode are unknown.
-             * An error message was raised, but we just continue. */
+        if (probes[i].err < 0 && probes[i].err != -3) {
+            if (probes[i].error)
+                virSetError(probes[i].error);
+            goto cleanup;
         }
 
-        if (VIR_APPEND_ELEMENT(pool->volumes.objs, pool->volumes.count, vol) < 0)
+        if (virStoragePoolObjAddVol(pool, probes[i].vol) < 0)
             goto cleanup;
+        probes[i].vol = NULL;
     }
-    if (direrr < 0)
-        goto cleanup;
-    VIR_DIR_CLOSE(dir);
-    vol = NULL;
 
     if (VIR_ALLOC(target))
         goto cleanup;
@@ -1018,6 +1201,19 @@ virStorageBackendFileSystemRefresh(virConnectPtr conn ATTRIBUTE_UNUSED,
     VIR_FORCE_CLOSE(fd);
     virStorageVolDefFree(vol);
     virStorageSourceFree(target);
+    VIR_FREE(path);
+    for (i = 0; i < nprobes; i++) {
+        virStorageVolDefFree(probes[i].vol);
+        virFreeError(probes[i].error);
+    }
+    VIR_FREE(probes);
+    /* Volumes carried over now belong to the pool */
+    for (i = 0; i < oldvols.count; i++) {
+        if (virHashLookup(reused, oldvols.objs[i]->name) == oldvols.objs[i])
+            oldvols.objs[i] = NULL;
+    }
+    virStorageVolDefListClear(&oldvols);
+    virHashFree(reused);
     if (ret < 0)
         virStoragePoolObjClearVols(pool);
     return ret;
@@ -1409,6 +1605,7 @@ virStorageBackend virStorageBackendDirectory = {
 
     .buildPool = virStorageBackendFileSystemBuild,
     .checkPool = virStorageBackendFileSystemCheck,
+    .incrementalRefresh = true,
     .refreshPool = virStorageBackendFileSystemRefresh,
     .deletePool = virStorageBackendFileSystemDelete,
     .buildVol = virStorageBackendFileSystemVolBuild,
@@ -1429,6 +1626,7 @@ virStorageBackend virStorageBackendFileSystem = {
     .buildPool = virStorageBackendFileSystemBuild,
     .checkPool = virStorageBackendFileSystemCheck,
     .startPool = virStorageBackendFileSystemStart,
+    .incrementalRefresh = true,
     .refreshPool = virStorageBackendFileSystemRefresh,
     .stopPool = virStorageBackendFileSystemStop,
     .deletePool = virStorageBackendFileSystemDelete,
@@ -1449,6 +1647,7 @@ virStorageBackend virStorageBackendNetFileSystem = {
     .checkPool = virStorageBackendFileSystemCheck,
     .startPool = virStorageBackendFileSystemStart,
     .findPoolSources = virStorageBackendFileSystemNetFindPoolSources,
+    .incrementalRefresh = true,
     .refreshPool = virStorageBackendFileSystemRefresh,
     .stopPool = virStorageBackendFileSystemStop,
     .deletePool = virStorageBackendFileSystemDelete,
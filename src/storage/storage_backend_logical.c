@@ -300,9 +300,11 @@ virStorageBackendLogicalMakeVol(char **const groups,
     if (virStorageBackendLogicalParseVolExtents(vol, groups) < 0)
         goto cleanup;
 
-    if (is_new_vol &&
-        VIR_APPEND_ELEMENT(pool->volumes.objs, pool->volumes.count, vol) < 0)
-        goto cleanup;
+    if (is_new_vol) {
+        if (virStoragePoolObjAddVol(pool, vol) < 0)
+            goto cleanup;
+        vol = NULL;
+    }
 
     ret = 0;
 
@@ -160,11 +160,11 @@ virStorageBackendZFSParseVol(virStoragePoolObjPtr pool,
     if (volume->target.allocation < volume->target.capacity)
         volume->target.sparse = true;
 
-    if (is_new_vol &&
-        VIR_APPEND_ELEMENT(pool->volumes.objs,
-                           pool->volumes.count,
-                           volume) < 0)
-        goto cleanup;
+    if (is_new_vol) {
+        if (virStoragePoolObjAddVol(pool, volume) < 0)
+            goto cleanup;
+        volume = NULL;
+    }
 
     ret = 0;
  cleanup:
@@ -33,6 +33,9 @@
 #if HAVE_PWD_H
 # include <pwd.h>
 #endif
+#if HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
 #include <errno.h>
 #include <string.h>
 
@@ -51,6 +54,8 @@
 #include "virstring.h"
 #include "viraccessapicheck.h"
 #include "dirname.h"
+#include "virevent.h"
+#include "virobject.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -76,6 +81,275 @@ static void storageDriverUnlock(void)
     virMutexUnlock(&driver->lock);
 }
 
+/*
+ * Refresh the volume list of an active pool. Backends which refresh
+ * incrementally get to see the volumes found last time, the others
+ * start from scratch.
+ */
+static int
+storagePoolRefreshImpl(virConnectPtr conn,
+                       virStorageBackendPtr backend,
+                       virStoragePoolObjPtr pool)
+{
+    if (!backend->incrementalRefresh)
+        virStoragePoolObjClearVols(pool);
+    return backend->refreshPool(conn, pool);
+}
+
+
+#if HAVE_SYS_INOTIFY_H
+/* Directories change in bursts, e.g. while an image is copied into
+ * place, so wait for things to settle down before refreshing */
+# define STORAGE_POOL_WATCH_DELAY 1000
+
+# define STORAGE_POOL_WATCH_EVENTS \
+    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+     IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR)
+
+typedef struct _virStoragePoolWatch virStoragePoolWatch;
+typedef virStoragePoolWatch *virStoragePoolWatchPtr;
+struct _virStoragePoolWatch {
+    virObject parent;
+
+    char *name;
+    int fd;     /* inotify instance */
+    int watch;  /* event loop handle of @fd */
+    int timer;  /* fires the deferred refresh */
+};
+
+static virClassPtr virStoragePoolWatchClass;
+
+static void virStoragePoolWatchDispose(void *obj);
+
+static int
+virStoragePoolWatchOnceInit(void)
+{
+    if (!(virStoragePoolWatchClass = virClassNew(virClassForObject(),
+                                                 "virStoragePoolWatch",
+                                                 sizeof(virStoragePoolWatch),
+                                                 virStoragePoolWatchDispose)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virStoragePoolWatch)
+
+static void
+virStoragePoolWatchDispose(void *obj)
+{
+    virStoragePoolWatchPtr watch = obj;
+
+    VIR_FORCE_CLOSE(watch->fd);
+    VIR_FREE(watch->name);
+}
+
+
+static void
+storagePoolWatchFree(void *payload,
+                     const void *name ATTRIBUTE_UNUSED)
+{
+    virStoragePoolWatchPtr watch = payload;
+
+    if (!watch)
+        return;
+
+    if (watch->watch >= 0)
+        virEventRemoveHandle(watch->watch);
+    if (watch->timer >= 0)
+        virEventRemoveTimeout(watch->timer);
+    virObjectUnref(watch);
+}
+
+
+static void
+storagePoolWatchRefreshThread(void *opaque)
+{
+    char *name = opaque;
+    virStoragePoolObjPtr pool = NULL;
+    virStorageBackendPtr backend;
+    virObjectEventPtr event = NULL;
+
+    storageDriverLock();
+    if (!(pool = virStoragePoolObjFindByName(&driver->pools, name)))
+        goto cleanup;
+
+    if (!virStoragePoolObjIsActive(pool) ||
+        !(backend = virStorageBackendForType(pool->def->type)))
+        goto cleanup;
+
+    if (pool->asyncjobs > 0) {
+        /* A volume is being built, look again once it is done */
+        virStoragePoolWatchPtr watch;
+
+        virMutexLock(&driver->watchLock);
+        if ((watch = virHashLookup(driver->poolWatches, name)))
+            virEventUpdateTimeout(watch->timer, STORAGE_POOL_WATCH_DELAY);
+        virMutexUnlock(&driver->watchLock);
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Directory of storage pool '%s' changed, refreshing", name);
+    if (storagePoolRefreshImpl(NULL, backend, pool) < 0) {
+        VIR_WARN("Failed to refresh storage pool '%s': %s",
+                 name, virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    event = virStoragePoolEventRefreshNew(pool->def->name,
+                                          pool->def->uuid);
+
+ cleanup:
+    if (event)
+        virObjectEventStateQueue(driver->storageEventState, event);
+    if (pool)
+        virStoragePoolObjUnlock(pool);
+    storageDriverUnlock();
+    VIR_FREE(name);
+}
+
+
+static void
+storagePoolWatchTimeout(int timer,
+                        void *opaque)
+{
+    virStoragePoolWatchPtr watch = opaque;
+    virThread thread;
+    char *name;
+
+    virEventUpdateTimeout(timer, -1);
+
+    /* The refresh needs the driver lock, which must not
+     * be waited for in the event loop */
+    if (VIR_STRDUP(name, watch->name) < 0)
+        return;
+
+    if (virThreadCreate(&thread, false, storagePoolWatchRefreshThread,
+                        name) < 0) {
+        VIR_ERROR(_("Failed to create thread to handle pool refresh"));
+        VIR_FREE(name);
+    }
+}
+
+
+static void
+storagePoolWatchEvent(int fd ATTRIBUTE_UNUSED,
+                      int wfd,
+                      int events ATTRIBUTE_UNUSED,
+                      void *opaque)
+{
+    virStoragePoolWatchPtr watch = opaque;
+    char buf[4096];
+
+    /* Which files changed does not matter, the refresh
+     * finds that out by itself */
+    while (read(wfd, buf, sizeof(buf)) > 0)
+        ;
+
+    virEventUpdateTimeout(watch->timer, STORAGE_POOL_WATCH_DELAY);
+}
+
+
+/*
+ * Refresh @pool whenever its target directory changes. Only done for
+ * backends which refresh incrementally, for the others a refresh is
+ * too expensive to be triggered by every change.
+ */
+static void
+storagePoolWatchStart(virStoragePoolObjPtr pool,
+                      virStorageBackendPtr backend)
+{
+    virStoragePoolWatchPtr watch = NULL;
+
+    if (!backend->incrementalRefresh || !driver->poolWatches)
+        return;
+
+    virMutexLock(&driver->watchLock);
+
+    if (virHashLookup(driver->poolWatches, pool->def->name))
+        goto cleanup;
+
+    if (virStoragePoolWatchInitialize() < 0 ||
+        !(watch = virObjectNew(virStoragePoolWatchClass)))
+        goto error;
+
+    watch->fd = -1;
+    watch->watch = -1;
+    watch->timer = -1;
+
+    if (VIR_STRDUP(watch->name, pool->def->name) < 0)
+        goto error;
+
+    if ((watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize inotify"));
+        goto error;
+    }
+
+    if (inotify_add_watch(watch->fd, pool->def->target.path,
+                          STORAGE_POOL_WATCH_EVENTS) < 0) {
+        virReportSystemError(errno, _("cannot watch directory '%s'"),
+                             pool->def->target.path);
+        goto error;
+    }
+
+    virObjectRef(watch);
+    if ((watch->timer = virEventAddTimeout(-1, storagePoolWatchTimeout,
+                                           watch,
+                                           virObjectFreeCallback)) < 0) {
+        virObjectUnref(watch);
+        goto error;
+    }
+
+    virObjectRef(watch);
+    if ((watch->watch = virEventAddHandle(watch->fd, VIR_EVENT_HANDLE_READABLE,
+                                          storagePoolWatchEvent,
+                                          watch,
+                                          virObjectFreeCallback)) < 0) {
+        virObjectUnref(watch);
+        goto error;
+    }
+
+    if (virHashAddEntry(driver->poolWatches, pool->def->name, watch) < 0)
+        goto error;
+
+ cleanup:
+    virMutexUnlock(&driver->watchLock);
+    return;
+
+ error:
+    VIR_WARN("Changes to storage pool '%s' will not be noticed: %s",
+             pool->def->name, virGetLastErrorMessage());
+    virResetLastError();
+    storagePoolWatchFree(watch, NULL);
+    goto cleanup;
+}
+
+
+static void
+storagePoolWatchStop(virStoragePoolObjPtr pool)
+{
+    if (!driver->poolWatches)
+        return;
+
+    virMutexLock(&driver->watchLock);
+    ignore_value(virHashRemoveEntry(driver->poolWatches, pool->def->name));
+    virMutexUnlock(&driver->watchLock);
+}
+#else /* !HAVE_SYS_INOTIFY_H */
+static void
+storagePoolWatchStart(virStoragePoolObjPtr pool ATTRIBUTE_UNUSED,
+                      virStorageBackendPtr backend ATTRIBUTE_UNUSED)
+{
+}
+
+
+static void
+storagePoolWatchStop(virStoragePoolObjPtr pool ATTRIBUTE_UNUSED)
+{
+}
+#endif /* !HAVE_SYS_INOTIFY_H */
+
 static void
 storagePoolUpdateState(virStoragePoolObjPtr pool)
 {
@@ -123,6 +397,8 @@ storagePoolUpdateState(virStoragePoolObjPtr pool)
     }
 
     pool->active = active;
+    if (active)
+        storagePoolWatchStart(pool, backend);
     ret = 0;
  error:
     if (ret < 0) {
@@ -203,6 +479,7 @@ storageDriverAutostart(void)
                                pool->def->name, virGetLastErrorMessage());
             } else {
                 pool->active = true;
+                storagePoolWatchStart(pool, backend);
             }
             VIR_FREE(stateFile);
         }
@@ -233,6 +510,11 @@ storageStateInitialize(bool privileged,
         VIR_FREE(driver);
         return ret;
     }
+    if (virMutexInit(&driver->watchLock) < 0) {
+        virMutexDestroy(&driver->lock);
+        VIR_FREE(driver);
+        return ret;
+    }
     storageDriverLock();
 
     if (privileged) {
@@ -266,6 +548,11 @@ storageStateInitialize(bool privileged,
         goto error;
     }
 
+#if HAVE_SYS_INOTIFY_H
+    if (!(driver->poolWatches = virHashCreate(16, storagePoolWatchFree)))
+        goto error;
+#endif
+
     if (virStoragePoolLoadAllState(&driver->pools,
                                    driver->stateDir) < 0)
         goto error;
@@ -349,6 +636,9 @@ storageStateCleanup(void)
 
     virObjectEventStateFree(driver->storageEventState);
 
+    /* stop watching active pools */
+    virHashFree(driver->poolWatches);
+
     /* free inactive pools */
     virStoragePoolObjListFree(&driver->pools);
 
@@ -356,6 +646,7 @@ storageStateCleanup(void)
     VIR_FREE(driver->autostartDir);
     VIR_FREE(driver->stateDir);
     storageDriverUnlock();
+    virMutexDestroy(&driver->watchLock);
     virMutexDestroy(&driver->lock);
     VIR_FREE(driver);
 
@@ -749,6 +1040,7 @@ storagePoolCreateXML(virConnectPtr conn,
 
     VIR_INFO("Creating storage pool '%s'", pool->def->name);
     pool->active = true;
+    storagePoolWatchStart(pool, backend);
 
     ret = virGetStoragePool(conn, pool->def->name, pool->def->uuid,
                             NULL, NULL);
@@ -963,6 +1255,7 @@ storagePoolCreate(virStoragePoolPtr obj,
                                             0);
 
     pool->active = true;
+    storagePoolWatchStart(pool, backend);
     ret = 0;
 
  cleanup:
@@ -1068,6 +1361,7 @@ storagePoolDestroy(virStoragePoolPtr obj)
                                             VIR_STORAGE_POOL_EVENT_STOPPED,
                                             0);
 
+    storagePoolWatchStop(pool);
     pool->active = false;
 
     if (pool->configFile == NULL) {
@@ -1188,8 +1482,7 @@ storagePoolRefresh(virStoragePoolPtr obj,
         goto cleanup;
     }
 
-    virStoragePoolObjClearVols(pool);
-    if (backend->refreshPool(obj->conn, pool) < 0) {
+    if (storagePoolRefreshImpl(obj->conn, backend, pool) < 0) {
         if (backend->stopPool)
             backend->stopPool(obj->conn, pool);
 
@@ -1197,6 +1490,7 @@ storagePoolRefresh(virStoragePoolPtr obj,
                                                 pool->def->uuid,
                                                 VIR_STORAGE_POOL_EVENT_STOPPED,
                                                 0);
+        storagePoolWatchStop(pool);
         pool->active = false;
 
         if (pool->configFile == NULL) {
@@ -1721,25 +2015,6 @@ storagePoolLookupByTargetPath(virConnectPtr conn,
 }
 
 
-static void
-storageVolRemoveFromPool(virStoragePoolObjPtr pool,
-                         virStorageVolDefPtr vol)
-{
-    size_t i;
-
-    for (i = 0; i < pool->volumes.count; i++) {
-        if (pool->volumes.objs[i] == vol) {
-            VIR_INFO("Deleting volume '%s' from storage pool '%s'",
-                     vol->name, pool->def->name);
-            virStorageVolDefFree(vol);
-
-            VIR_DELETE_ELEMENT(pool->volumes.objs, i, pool->volumes.count);
-            break;
-        }
-    }
-}
-
-
 static int
 storageVolDeleteInternal(virStorageVolPtr obj,
                          virStorageBackendPtr backend,
@@ -1771,7 +2046,7 @@ storageVolDeleteInternal(virStorageVolPtr obj,
         }
     }
 
-    storageVolRemoveFromPool(pool, vol);
+    virStoragePoolObjRemoveVol(pool, vol);
     ret = 0;
 
  cleanup:
@@ -1920,21 +2195,23 @@ storageVolCreateXML(virStoragePoolPtr obj,
         goto cleanup;
     }
 
-    if (VIR_REALLOC_N(pool->volumes.objs,
-                      pool->volumes.count+1) < 0)
-        goto cleanup;
-
     /* Wipe any key the user may have suggested, as volume creation
      * will generate the canonical key.  */
     VIR_FREE(voldef->key);
     if (backend->createVol(obj->conn, pool, voldef) < 0)
         goto cleanup;
 
-    pool->volumes.objs[pool->volumes.count++] = voldef;
+    if (virStoragePoolObjAddVol(pool, voldef) < 0) {
+        /* Don't leave behind the volume createVol made */
+        if (backend->deleteVol)
+            ignore_value(backend->deleteVol(obj->conn, pool, voldef, 0));
+        goto cleanup;
+    }
     volobj = virGetStorageVol(obj->conn, pool->def->name, voldef->name,
                               voldef->key, NULL, NULL);
     if (!volobj) {
-        pool->volumes.count--;
+        virStoragePoolObjRemoveVol(pool, voldef);
+        voldef = NULL;
         goto cleanup;
     }
 
@@ -1972,7 +2249,7 @@ storageVolCreateXML(virStoragePoolPtr obj,
 
         if (buildret < 0) {
             /* buildVol handles deleting volume on failure */
-            storageVolRemoveFromPool(pool, voldef);
+            virStoragePoolObjRemoveVol(pool, voldef);
             voldef = NULL;
             goto cleanup;
         }
@@ -2119,10 +2396,6 @@ storageVolCreateXMLFrom(virStoragePoolPtr obj,
         backend->refreshVol(obj->conn, pool, origvol) < 0)
         goto cleanup;
 
-    if (VIR_REALLOC_N(pool->volumes.objs,
-                      pool->volumes.count+1) < 0)
-        goto cleanup;
-
     /* 'Define' the new volume so we get async progress reporting.
      * Wipe any key the user may have suggested, as volume creation
      * will generate the canonical key.  */
@@ -2139,11 +2412,16 @@ storageVolCreateXMLFrom(virStoragePoolPtr obj,
 
     memcpy(shadowvol, newvol, sizeof(*newvol));
 
-    pool->volumes.objs[pool->volumes.count++] = newvol;
+    if (virStoragePoolObjAddVol(pool, newvol) < 0) {
+        if (backend->deleteVol)
+            ignore_value(backend->deleteVol(obj->conn, pool, newvol, 0));
+        goto cleanup;
+    }
     volobj = virGetStorageVol(obj->conn, pool->def->name, newvol->name,
                               newvol->key, NULL, NULL);
     if (!volobj) {
-        pool->volumes.count--;
+        virStoragePoolObjRemoveVol(pool, newvol);
+        newvol = NULL;
         goto cleanup;
     }
 
@@ -2336,8 +2614,7 @@ virStorageVolPoolRefreshThread(void *opaque)
     if (!(backend = virStorageBackendForType(pool->def->type)))
         goto cleanup;
 
-    virStoragePoolObjClearVols(pool);
-    if (backend->refreshPool(NULL, pool) < 0)
+    if (storagePoolRefreshImpl(NULL, backend, pool) < 0)
         VIR_DEBUG("Failed to refresh storage pool");
 
     event = virStoragePoolEventRefreshNew(pool->def->name,
@@ -1149,7 +1149,7 @@ testOpenVolumesForPool(const char *file,
 
         if (!def->key && VIR_STRDUP(def->key, def->target.path) < 0)
             goto error;
-        if (VIR_APPEND_ELEMENT_COPY(pool->volumes.objs, pool->volumes.count, def) < 0)
+        if (virStoragePoolObjAddVol(pool, def) < 0)
             goto error;
 
         pool->def->allocation += def->target.allocation;
@@ -4935,8 +4935,7 @@ testStorageVolCreateXML(virStoragePoolPtr pool,
         goto cleanup;
 
     if (VIR_STRDUP(privvol->key, privvol->target.path) < 0 ||
-        VIR_APPEND_ELEMENT_COPY(privpool->volumes.objs,
-                                privpool->volumes.count, privvol) < 0)
+        virStoragePoolObjAddVol(privpool, privvol) < 0)
         goto cleanup;
 
     privpool->def->allocation += privvol->target.allocation;
@@ -5019,8 +5018,7 @@ testStorageVolCreateXMLFrom(virStoragePoolPtr pool,
         goto cleanup;
 
     if (VIR_STRDUP(privvol->key, privvol->target.path) < 0 ||
-        VIR_APPEND_ELEMENT_COPY(privpool->volumes.objs,
-                                privpool->volumes.count, privvol) < 0)
+        virStoragePoolObjAddVol(privpool, privvol) < 0)
         goto cleanup;
 
     privpool->def->allocation += privvol->target.allocation;
@@ -5046,7 +5044,6 @@ testStorageVolDelete(virStorageVolPtr vol,
     testDriverPtr privconn = vol->conn->privateData;
     virStoragePoolObjPtr privpool;
     virStorageVolDefPtr privvol;
-    size_t i;
     int ret = -1;
 
     virCheckFlags(0, -1);
@@ -5082,14 +5079,7 @@ testStorageVolDelete(virStorageVolPtr vol,
     privpool->def->available = (privpool->def->capacity -
                                 privpool->def->allocation);
 
-    for (i = 0; i < privpool->volumes.count; i++) {
-        if (privpool->volumes.objs[i] == privvol) {
-            virStorageVolDefFree(privvol);
-
-            VIR_DELETE_ELEMENT(privpool->volumes.objs, i, privpool->volumes.count);
-            break;
-        }
-    }
+    virStoragePoolObjRemoveVol(privpool, privvol);
     ret = 0;
 
  cleanup:
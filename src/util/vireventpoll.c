@@ -30,6 +30,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
 
 #include "virthread.h"
 #include "virlog.h"
@@ -40,6 +43,9 @@
 #include "virerror.h"
 #include "virprobe.h"
 #include "virtime.h"
+#include "virhash.h"
+#include "virhashcode.h"
+#include "viratomic.h"
 
 #define EVENT_DEBUG(fmt, ...) VIR_DEBUG(fmt, __VA_ARGS__)
 
@@ -47,7 +53,7 @@
 
 VIR_LOG_INIT("util.eventpoll");
 
-static int virEventPollInterruptLocked(void);
+static int virEventPollInterruptLocked(struct virEventPollLoop *loop);
 
 /* State for a single file handle being monitored */
 struct virEventPollHandle {
@@ -58,6 +64,12 @@ struct virEventPollHandle {
     virFreeCallback ff;
     void *opaque;
     int deleted;
+    size_t index; /* Position in loop->handles */
+    struct virEventPollHandle *nextDeleted;
+#ifdef HAVE_SYS_EPOLL_H
+    int epollFD; /* FD registered with epoll, -1 if not registered */
+    bool alwaysReady; /* FD refused by epoll, dispatched on every run */
+#endif
 };
 
 /* State for a single timer being generated */
@@ -69,84 +81,366 @@ struct virEventPollTimeout {
     virFreeCallback ff;
     void *opaque;
     int deleted;
+    ssize_t heapIndex; /* Position in loop->timeouts, -1 if disarmed */
+    struct virEventPollTimeout *nextDeleted;
 };
 
 /* Allocate extra slots for virEventPollHandle/virEventPollTimeout
    records in this multiple */
 #define EVENT_ALLOC_EXTENT 10
 
-/* State for the main event loop */
+/* Maximum number of events collected by a single epoll_wait() call.
+ * Any further ready handles are picked up on the next iteration */
+#define EVENT_EPOLL_MAX_EVENTS 128
+
+/* State for an event loop */
 struct virEventPollLoop {
     virMutex lock;
     int running;
     virThread leader;
     int wakeupfd[2];
+    int epollfd; /* -1 when falling back to poll() */
+#ifdef HAVE_SYS_EPOLL_H
+    /* Handles whose own FD is registered with epoll, keyed by FD + 1 */
+    virHashTablePtr epollOwners;
+    /* Handles whose FD epoll refused, such as regular files */
+    size_t alwaysReadyCount;
+#endif
+
+    /* All registered handles, keyed by watch */
+    virHashTablePtr handlesByWatch;
     size_t handlesCount;
     size_t handlesAlloc;
-    struct virEventPollHandle *handles;
+    struct virEventPollHandle **handles;
+    struct virEventPollHandle *handlesDeleted;
+
+    /* All registered timers, keyed by timer */
+    virHashTablePtr timeoutsByTimer;
+    size_t timersCount;
+    /* Binary min-heap of the armed timers ordered by expiresAt */
     size_t timeoutsCount;
     size_t timeoutsAlloc;
-    struct virEventPollTimeout *timeouts;
+    struct virEventPollTimeout **timeouts;
+    struct virEventPollTimeout *timeoutsDeleted;
+    /* Scratch space used when dispatching timers, always sized
+     * to hold every registered timer */
+    size_t expiredAlloc;
+    struct virEventPollTimeout **expired;
 };
 
-/* Only have one event loop */
-static struct virEventPollLoop eventLoop;
+/* The default event loop */
+static struct virEventPollLoop eventLoop = { .epollfd = -1 };
+
+/* Last ID handed out to a FD watch, unique across all loops */
+static int nextWatch;
+
+/* Last ID handed out to a timer, unique across all loops */
+static int nextTimer;
+
+
+static uint32_t
+virEventPollIDCode(const void *name, uint32_t seed)
+{
+    int id = (intptr_t)name;
+    return virHashCodeGen(&id, sizeof(id), seed);
+}
+
+
+static bool
+virEventPollIDEqual(const void *namea, const void *nameb)
+{
+    return namea == nameb;
+}
+
+
+static void *
+virEventPollIDCopy(const void *name)
+{
+    return (void *)name;
+}
+
+
+static struct virEventPollHandle *
+virEventPollFindHandle(struct virEventPollLoop *loop,
+                       int watch)
+{
+    return virHashLookup(loop->handlesByWatch, (void *)(intptr_t)watch);
+}
+
+
+static struct virEventPollTimeout *
+virEventPollFindTimeout(struct virEventPollLoop *loop,
+                        int timer)
+{
+    return virHashLookup(loop->timeoutsByTimer, (void *)(intptr_t)timer);
+}
+
+
+#ifdef HAVE_SYS_EPOLL_H
+static int
+virEventPollToEpollEvents(int events)
+{
+    int ret = 0;
+    if (events & POLLIN)
+        ret |= EPOLLIN;
+    if (events & POLLOUT)
+        ret |= EPOLLOUT;
+    if (events & POLLERR)
+        ret |= EPOLLERR;
+    if (events & POLLHUP)
+        ret |= EPOLLHUP;
+    return ret;
+}
+
+
+static int
+virEventPollFromEpollEvents(int events)
+{
+    int ret = 0;
+    if (events & EPOLLIN)
+        ret |= VIR_EVENT_HANDLE_READABLE;
+    if (events & EPOLLOUT)
+        ret |= VIR_EVENT_HANDLE_WRITABLE;
+    if (events & EPOLLERR)
+        ret |= VIR_EVENT_HANDLE_ERROR;
+    if (events & EPOLLHUP)
+        ret |= VIR_EVENT_HANDLE_HANGUP;
+    return ret;
+}
+
+
+/*
+ * Record @handle as the one whose FD number is registered with
+ * epoll. Registering an FD number only succeeds once the kernel
+ * dropped any earlier registration of it, which happens when the
+ * FD is closed. A previous owner of the number therefore no longer
+ * has a registration and must not issue EPOLL_CTL_DEL for it later,
+ * as that would drop the registration of @handle instead.
+ */
+static int
+virEventPollEpollSetOwner(struct virEventPollLoop *loop,
+                          struct virEventPollHandle *handle)
+{
+    void *key = (void *)(intptr_t)(handle->fd + 1);
+    struct virEventPollHandle *stale;
+
+    if ((stale = virHashLookup(loop->epollOwners, key)) &&
+        stale != handle) {
+        EVENT_DEBUG("fd=%d of watch=%d was closed before its removal",
+                    stale->fd, stale->watch);
+        stale->epollFD = -1;
+    }
+
+    return virHashUpdateEntry(loop->epollOwners, key, handle);
+}
+
+
+/*
+ * Drop the epoll registration of @handle, if any. This is done as
+ * soon as the watch is removed, while the caller still owns the FD.
+ */
+static void
+virEventPollEpollUnregister(struct virEventPollLoop *loop,
+                            struct virEventPollHandle *handle)
+{
+    if (handle->alwaysReady) {
+        handle->alwaysReady = false;
+        loop->alwaysReadyCount--;
+    }
+
+    if (handle->epollFD < 0)
+        return;
+
+    /* The FD may legitimately be gone already if the caller
+     * closed it before removing the watch */
+    if (epoll_ctl(loop->epollfd, EPOLL_CTL_DEL, handle->epollFD, NULL) < 0 &&
+        errno != EBADF && errno != ENOENT)
+        VIR_WARN("Unable to unregister fd=%d from epoll: %d",
+                 handle->epollFD, errno);
+
+    if (handle->epollFD != handle->fd) {
+        VIR_FORCE_CLOSE(handle->epollFD);
+    } else {
+        void *key = (void *)(intptr_t)(handle->fd + 1);
+
+        if (virHashLookup(loop->epollOwners, key) == handle)
+            ignore_value(virHashRemoveEntry(loop->epollOwners, key));
+    }
+    handle->epollFD = -1;
+}
+
+
+/*
+ * Bring the epoll registration of @handle in sync with its
+ * requested events. Handles with no events are not registered
+ * at all, mirroring the way they are skipped by poll().
+ *
+ * epoll refuses FDs which can not block, such as regular files
+ * or /dev/null, which poll() reports as always ready instead.
+ * Such handles are kept out of the epoll set and dispatched on
+ * every run of the loop, see virEventPollDispatchAlwaysReady.
+ *
+ * Returns 0 on success, -1 on error
+ */
+static int
+virEventPollEpollSync(struct virEventPollLoop *loop,
+                      struct virEventPollHandle *handle)
+{
+    struct epoll_event ev;
+
+    if (loop->epollfd < 0)
+        return 0;
+
+    if (!handle->events || handle->deleted) {
+        virEventPollEpollUnregister(loop, handle);
+        return 0;
+    }
+
+    if (handle->alwaysReady)
+        return 0;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = virEventPollToEpollEvents(handle->events);
+    ev.data.u64 = handle->watch;
+
+    if (handle->epollFD >= 0) {
+        if (epoll_ctl(loop->epollfd, EPOLL_CTL_MOD,
+                      handle->epollFD, &ev) < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to update fd %d in epoll set"),
+                                 handle->fd);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, handle->fd, &ev) == 0) {
+        if (virEventPollEpollSetOwner(loop, handle) < 0) {
+            ignore_value(epoll_ctl(loop->epollfd, EPOLL_CTL_DEL,
+                                   handle->fd, NULL));
+            return -1;
+        }
+        handle->epollFD = handle->fd;
+        return 0;
+    }
+
+    if (errno == EPERM) {
+        EVENT_DEBUG("fd=%d of watch=%d can not be polled, always ready",
+                    handle->fd, handle->watch);
+        handle->alwaysReady = true;
+        loop->alwaysReadyCount++;
+        return 0;
+    }
+
+    if (errno != EEXIST) {
+        virReportSystemError(errno,
+                             _("Unable to add fd %d to epoll set"),
+                             handle->fd);
+        return -1;
+    }
+
+    /* Somebody else is already watching this FD. epoll only allows
+     * one registration per FD number, so register a private
+     * duplicate for this watch instead */
+    if ((handle->epollFD = fcntl(handle->fd, F_DUPFD_CLOEXEC, 0)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to duplicate fd %d"),
+                             handle->fd);
+        return -1;
+    }
+
+    if (epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, handle->epollFD, &ev) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to add fd %d to epoll set"),
+                             handle->fd);
+        VIR_FORCE_CLOSE(handle->epollFD);
+        return -1;
+    }
 
-/* Unique ID for the next FD watch to be registered */
-static int nextWatch = 1;
+    return 0;
+}
+#else /* !HAVE_SYS_EPOLL_H */
+static int
+virEventPollEpollSync(struct virEventPollLoop *loop ATTRIBUTE_UNUSED,
+                      struct virEventPollHandle *handle ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
+#endif /* !HAVE_SYS_EPOLL_H */
 
-/* Unique ID for the next timer to be registered */
-static int nextTimer = 1;
 
 /*
  * Register a callback for monitoring file handle events.
  * NB, it *must* be safe to call this from within a callback
  * For this reason we only ever append to existing list.
  */
-int virEventPollAddHandle(int fd, int events,
-                          virEventHandleCallback cb,
-                          void *opaque,
-                          virFreeCallback ff)
+int virEventPollLoopAddHandle(virEventPollLoopPtr loop,
+                              int fd, int events,
+                              virEventHandleCallback cb,
+                              void *opaque,
+                              virFreeCallback ff)
 {
+    struct virEventPollHandle *handle;
     int watch;
-    virMutexLock(&eventLoop.lock);
-    if (eventLoop.handlesCount == eventLoop.handlesAlloc) {
+
+    if (VIR_ALLOC(handle) < 0)
+        return -1;
+
+    virMutexLock(&loop->lock);
+    if (loop->handlesCount == loop->handlesAlloc) {
         EVENT_DEBUG("Used %zu handle slots, adding at least %d more",
-                    eventLoop.handlesAlloc, EVENT_ALLOC_EXTENT);
-        if (VIR_RESIZE_N(eventLoop.handles, eventLoop.handlesAlloc,
-                         eventLoop.handlesCount, EVENT_ALLOC_EXTENT) < 0) {
-            virMutexUnlock(&eventLoop.lock);
-            return -1;
-        }
+                    loop->handlesAlloc, EVENT_ALLOC_EXTENT);
+        if (VIR_RESIZE_N(loop->handles, loop->handlesAlloc,
+                         loop->handlesCount, EVENT_ALLOC_EXTENT) < 0)
+            goto error;
     }
 
-    watch = nextWatch++;
+    watch = virAtomicIntInc(&nextWatch);
+
+    handle->watch = watch;
+    handle->fd = fd;
+    handle->events = virEventPollToNativeEvents(events);
+    handle->cb = cb;
+    handle->ff = ff;
+    handle->opaque = opaque;
+    handle->deleted = 0;
+    handle->index = loop->handlesCount;
+#ifdef HAVE_SYS_EPOLL_H
+    handle->epollFD = -1;
+    handle->alwaysReady = false;
+#endif
+
+    if (virHashAddEntry(loop->handlesByWatch,
+                        (void *)(intptr_t)watch, handle) < 0)
+        goto error;
 
-    eventLoop.handles[eventLoop.handlesCount].watch = watch;
-    eventLoop.handles[eventLoop.handlesCount].fd = fd;
-    eventLoop.handles[eventLoop.handlesCount].events =
-                                         virEventPollToNativeEvents(events);
-    eventLoop.handles[eventLoop.handlesCount].cb = cb;
-    eventLoop.handles[eventLoop.handlesCount].ff = ff;
-    eventLoop.handles[eventLoop.handlesCount].opaque = opaque;
-    eventLoop.handles[eventLoop.handlesCount].deleted = 0;
+    if (virEventPollEpollSync(loop, handle) < 0) {
+        ignore_value(virHashRemoveEntry(loop->handlesByWatch,
+                                        (void *)(intptr_t)watch));
+        goto error;
+    }
 
-    eventLoop.handlesCount++;
+    loop->handles[loop->handlesCount++] = handle;
 
-    virEventPollInterruptLocked();
+    virEventPollInterruptLocked(loop);
 
     PROBE(EVENT_POLL_ADD_HANDLE,
           "watch=%d fd=%d events=%d cb=%p opaque=%p ff=%p",
           watch, fd, events, cb, opaque, ff);
-    virMutexUnlock(&eventLoop.lock);
+    virMutexUnlock(&loop->lock);
 
     return watch;
+
+ error:
+    virMutexUnlock(&loop->lock);
+    VIR_FREE(handle);
+    return -1;
 }
 
-void virEventPollUpdateHandle(int watch, int events)
+void virEventPollLoopUpdateHandle(virEventPollLoopPtr loop,
+                                  int watch, int events)
 {
-    size_t i;
-    bool found = false;
+    struct virEventPollHandle *handle;
     PROBE(EVENT_POLL_UPDATE_HANDLE,
           "watch=%d events=%d",
           watch, events);
@@ -156,19 +450,16 @@ void virEventPollUpdateHandle(int watch, int events)
         return;
     }
 
-    virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].watch == watch) {
-            eventLoop.handles[i].events =
-                    virEventPollToNativeEvents(events);
-            virEventPollInterruptLocked();
-            found = true;
-            break;
-        }
+    virMutexLock(&loop->lock);
+    if ((handle = virEventPollFindHandle(loop, watch))) {
+        handle->events = virEventPollToNativeEvents(events);
+        if (virEventPollEpollSync(loop, handle) < 0)
+            VIR_WARN("Unable to update events for watch %d", watch);
+        virEventPollInterruptLocked(loop);
     }
-    virMutexUnlock(&eventLoop.lock);
+    virMutexUnlock(&loop->lock);
 
-    if (!found)
+    if (!handle)
         VIR_WARN("Got update for non-existent handle watch %d", watch);
 }
 
@@ -178,9 +469,10 @@ void virEventPollUpdateHandle(int watch, int events)
  * For this reason we only ever set a flag in the existing list.
  * Actual deletion will be done out-of-band
  */
-int virEventPollRemoveHandle(int watch)
+int virEventPollLoopRemoveHandle(virEventPollLoopPtr loop,
+                                 int watch)
 {
-    size_t i;
+    struct virEventPollHandle *handle;
     PROBE(EVENT_POLL_REMOVE_HANDLE,
           "watch=%d",
           watch);
@@ -190,21 +482,124 @@ int virEventPollRemoveHandle(int watch)
         return -1;
     }
 
-    virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].deleted)
-            continue;
+    virMutexLock(&loop->lock);
+    handle = virEventPollFindHandle(loop, watch);
+    if (!handle || handle->deleted) {
+        virMutexUnlock(&loop->lock);
+        return -1;
+    }
 
-        if (eventLoop.handles[i].watch == watch) {
-            EVENT_DEBUG("mark delete %zu %d", i, eventLoop.handles[i].fd);
-            eventLoop.handles[i].deleted = 1;
-            virEventPollInterruptLocked();
-            virMutexUnlock(&eventLoop.lock);
-            return 0;
-        }
+    EVENT_DEBUG("mark delete %zu %d", handle->index, handle->fd);
+    handle->deleted = 1;
+    /* The epoll registration must be dropped right away, because
+     * the caller is free to close the FD as soon as we return */
+    ignore_value(virEventPollEpollSync(loop, handle));
+    handle->nextDeleted = loop->handlesDeleted;
+    loop->handlesDeleted = handle;
+    virEventPollInterruptLocked(loop);
+    virMutexUnlock(&loop->lock);
+    return 0;
+}
+
+
+/*
+ * Helpers maintaining the min-heap of armed timers. They must
+ * be called with the event loop lock held.
+ */
+static void
+virEventPollTimeoutHeapSet(struct virEventPollLoop *loop,
+                           size_t idx,
+                           struct virEventPollTimeout *t)
+{
+    loop->timeouts[idx] = t;
+    t->heapIndex = idx;
+}
+
+
+static void
+virEventPollTimeoutHeapUp(struct virEventPollLoop *loop,
+                          size_t idx)
+{
+    struct virEventPollTimeout *t = loop->timeouts[idx];
+
+    while (idx > 0) {
+        size_t parent = (idx - 1) / 2;
+        if (loop->timeouts[parent]->expiresAt <= t->expiresAt)
+            break;
+        virEventPollTimeoutHeapSet(loop, idx, loop->timeouts[parent]);
+        idx = parent;
+    }
+    virEventPollTimeoutHeapSet(loop, idx, t);
+}
+
+
+static void
+virEventPollTimeoutHeapDown(struct virEventPollLoop *loop,
+                            size_t idx)
+{
+    struct virEventPollTimeout *t = loop->timeouts[idx];
+
+    while (true) {
+        size_t child = idx * 2 + 1;
+        if (child >= loop->timeoutsCount)
+            break;
+        if (child + 1 < loop->timeoutsCount &&
+            loop->timeouts[child + 1]->expiresAt <
+            loop->timeouts[child]->expiresAt)
+            child++;
+        if (t->expiresAt <= loop->timeouts[child]->expiresAt)
+            break;
+        virEventPollTimeoutHeapSet(loop, idx, loop->timeouts[child]);
+        idx = child;
+    }
+    virEventPollTimeoutHeapSet(loop, idx, t);
+}
+
+
+static void
+virEventPollTimeoutHeapRemove(struct virEventPollLoop *loop,
+                              struct virEventPollTimeout *t)
+{
+    struct virEventPollTimeout *moved;
+    size_t idx;
+
+    if (t->heapIndex < 0)
+        return;
+
+    idx = t->heapIndex;
+    t->heapIndex = -1;
+    loop->timeoutsCount--;
+    if (idx == loop->timeoutsCount)
+        return;
+
+    moved = loop->timeouts[loop->timeoutsCount];
+    virEventPollTimeoutHeapSet(loop, idx, moved);
+    virEventPollTimeoutHeapUp(loop, idx);
+    virEventPollTimeoutHeapDown(loop, moved->heapIndex);
+}
+
+
+/*
+ * Put @t at the right place in the heap after its frequency or
+ * expiry time changed. The heap is always large enough to hold
+ * every registered timer, so this can not fail.
+ */
+static void
+virEventPollTimeoutHeapUpdate(struct virEventPollLoop *loop,
+                              struct virEventPollTimeout *t)
+{
+    if (t->deleted || t->frequency < 0) {
+        virEventPollTimeoutHeapRemove(loop, t);
+        return;
+    }
+
+    if (t->heapIndex < 0) {
+        virEventPollTimeoutHeapSet(loop, loop->timeoutsCount++, t);
+        virEventPollTimeoutHeapUp(loop, t->heapIndex);
+    } else {
+        virEventPollTimeoutHeapUp(loop, t->heapIndex);
+        virEventPollTimeoutHeapDown(loop, t->heapIndex);
     }
-    virMutexUnlock(&eventLoop.lock);
-    return -1;
 }
 
 
@@ -213,53 +608,71 @@ int virEventPollRemoveHandle(int watch)
  * NB, it *must* be safe to call this from within a callback
  * For this reason we only ever append to existing list.
  */
-int virEventPollAddTimeout(int frequency,
-                           virEventTimeoutCallback cb,
-                           void *opaque,
-                           virFreeCallback ff)
+int virEventPollLoopAddTimeout(virEventPollLoopPtr loop,
+                               int frequency,
+                               virEventTimeoutCallback cb,
+                               void *opaque,
+                               virFreeCallback ff)
 {
+    struct virEventPollTimeout *t;
     unsigned long long now;
     int ret;
 
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
-    virMutexLock(&eventLoop.lock);
-    if (eventLoop.timeoutsCount == eventLoop.timeoutsAlloc) {
+    if (VIR_ALLOC(t) < 0)
+        return -1;
+
+    virMutexLock(&loop->lock);
+    if (loop->timersCount == loop->timeoutsAlloc) {
         EVENT_DEBUG("Used %zu timeout slots, adding at least %d more",
-                    eventLoop.timeoutsAlloc, EVENT_ALLOC_EXTENT);
-        if (VIR_RESIZE_N(eventLoop.timeouts, eventLoop.timeoutsAlloc,
-                         eventLoop.timeoutsCount, EVENT_ALLOC_EXTENT) < 0) {
-            virMutexUnlock(&eventLoop.lock);
-            return -1;
-        }
+                    loop->timeoutsAlloc, EVENT_ALLOC_EXTENT);
+        if (VIR_RESIZE_N(loop->timeouts, loop->timeoutsAlloc,
+                         loop->timersCount, EVENT_ALLOC_EXTENT) < 0)
+            goto error;
     }
+    if (loop->timersCount == loop->expiredAlloc &&
+        VIR_RESIZE_N(loop->expired, loop->expiredAlloc,
+                     loop->timersCount, EVENT_ALLOC_EXTENT) < 0)
+        goto error;
 
-    eventLoop.timeouts[eventLoop.timeoutsCount].timer = nextTimer++;
-    eventLoop.timeouts[eventLoop.timeoutsCount].frequency = frequency;
-    eventLoop.timeouts[eventLoop.timeoutsCount].cb = cb;
-    eventLoop.timeouts[eventLoop.timeoutsCount].ff = ff;
-    eventLoop.timeouts[eventLoop.timeoutsCount].opaque = opaque;
-    eventLoop.timeouts[eventLoop.timeoutsCount].deleted = 0;
-    eventLoop.timeouts[eventLoop.timeoutsCount].expiresAt =
-        frequency >= 0 ? frequency + now : 0;
+    t->timer = virAtomicIntInc(&nextTimer);
+    t->frequency = frequency;
+    t->cb = cb;
+    t->ff = ff;
+    t->opaque = opaque;
+    t->deleted = 0;
+    t->heapIndex = -1;
+    t->expiresAt = frequency >= 0 ? frequency + now : 0;
+
+    if (virHashAddEntry(loop->timeoutsByTimer,
+                        (void *)(intptr_t)t->timer, t) < 0)
+        goto error;
 
-    eventLoop.timeoutsCount++;
-    ret = nextTimer-1;
-    virEventPollInterruptLocked();
+    loop->timersCount++;
+    virEventPollTimeoutHeapUpdate(loop, t);
+
+    ret = t->timer;
+    virEventPollInterruptLocked(loop);
 
     PROBE(EVENT_POLL_ADD_TIMEOUT,
           "timer=%d frequency=%d cb=%p opaque=%p ff=%p",
           ret, frequency, cb, opaque, ff);
-    virMutexUnlock(&eventLoop.lock);
+    virMutexUnlock(&loop->lock);
     return ret;
+
+ error:
+    virMutexUnlock(&loop->lock);
+    VIR_FREE(t);
+    return -1;
 }
 
-void virEventPollUpdateTimeout(int timer, int frequency)
+void virEventPollLoopUpdateTimeout(virEventPollLoopPtr loop,
+                                   int timer, int frequency)
 {
+    struct virEventPollTimeout *t;
     unsigned long long now;
-    size_t i;
-    bool found = false;
     PROBE(EVENT_POLL_UPDATE_TIMEOUT,
           "timer=%d frequency=%d",
           timer, frequency);
@@ -272,22 +685,18 @@ void virEventPollUpdateTimeout(int timer, int frequency)
     if (virTimeMillisNow(&now) < 0)
         return;
 
-    virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].timer == timer) {
-            eventLoop.timeouts[i].frequency = frequency;
-            eventLoop.timeouts[i].expiresAt =
-                frequency >= 0 ? frequency + now : 0;
-            VIR_DEBUG("Set timer freq=%d expires=%llu", frequency,
-                      eventLoop.timeouts[i].expiresAt);
-            virEventPollInterruptLocked();
-            found = true;
-            break;
-        }
+    virMutexLock(&loop->lock);
+    if ((t = virEventPollFindTimeout(loop, timer))) {
+        t->frequency = frequency;
+        t->expiresAt = frequency >= 0 ? frequency + now : 0;
+        virEventPollTimeoutHeapUpdate(loop, t);
+        VIR_DEBUG("Set timer freq=%d expires=%llu", frequency,
+                  t->expiresAt);
+        virEventPollInterruptLocked(loop);
     }
-    virMutexUnlock(&eventLoop.lock);
+    virMutexUnlock(&loop->lock);
 
-    if (!found)
+    if (!t)
         VIR_WARN("Got update for non-existent timer %d", timer);
 }
 
@@ -297,9 +706,10 @@ void virEventPollUpdateTimeout(int timer, int frequency)
  * For this reason we only ever set a flag in the existing list.
  * Actual deletion will be done out-of-band
  */
-int virEventPollRemoveTimeout(int timer)
+int virEventPollLoopRemoveTimeout(virEventPollLoopPtr loop,
+                                  int timer)
 {
-    size_t i;
+    struct virEventPollTimeout *t;
     PROBE(EVENT_POLL_REMOVE_TIMEOUT,
           "timer=%d",
           timer);
@@ -309,44 +719,37 @@ int virEventPollRemoveTimeout(int timer)
         return -1;
     }
 
-    virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].deleted)
-            continue;
-
-        if (eventLoop.timeouts[i].timer == timer) {
-            eventLoop.timeouts[i].deleted = 1;
-            virEventPollInterruptLocked();
-            virMutexUnlock(&eventLoop.lock);
-            return 0;
-        }
+    virMutexLock(&loop->lock);
+    t = virEventPollFindTimeout(loop, timer);
+    if (!t || t->deleted) {
+        virMutexUnlock(&loop->lock);
+        return -1;
     }
-    virMutexUnlock(&eventLoop.lock);
-    return -1;
+
+    t->deleted = 1;
+    virEventPollTimeoutHeapRemove(loop, t);
+    t->nextDeleted = loop->timeoutsDeleted;
+    loop->timeoutsDeleted = t;
+    virEventPollInterruptLocked(loop);
+    virMutexUnlock(&loop->lock);
+    return 0;
 }
 
-/* Iterates over all registered timeouts and determine which
- * will be the first to expire.
+/* Determine which of the registered timeouts will be the
+ * first to expire, which is always at the top of the heap.
  * @timeout: filled with expiry time of soonest timer, or -1 if
  *           no timeout is pending
  * returns: 0 on success, -1 on error
  */
-static int virEventPollCalculateTimeout(int *timeout)
+static int virEventPollCalculateTimeout(struct virEventPollLoop *loop,
+                                       int *timeout)
 {
     unsigned long long then = 0;
-    size_t i;
-    EVENT_DEBUG("Calculate expiry of %zu timers", eventLoop.timeoutsCount);
+    EVENT_DEBUG("Calculate expiry of %zu timers", loop->timeoutsCount);
     /* Figure out if we need a timeout */
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].deleted)
-            continue;
-        if (eventLoop.timeouts[i].frequency < 0)
-            continue;
-
-        EVENT_DEBUG("Got a timeout scheduled for %llu", eventLoop.timeouts[i].expiresAt);
-        if (then == 0 ||
-            eventLoop.timeouts[i].expiresAt < then)
-            then = eventLoop.timeouts[i].expiresAt;
+    if (loop->timeoutsCount > 0) {
+        then = loop->timeouts[0]->expiresAt;
+        EVENT_DEBUG("Got a timeout scheduled for %llu", then);
     }
 
     /* Calculate how long we should wait for a timeout if needed */
@@ -378,13 +781,14 @@ static int virEventPollCalculateTimeout(int *timeout)
  * file handles. The caller must free the returned data struct
  * returns: the pollfd array, or NULL on error
  */
-static struct pollfd *virEventPollMakePollFDs(int *nfds) {
+static struct pollfd *virEventPollMakePollFDs(struct virEventPollLoop *loop,
+                                             int *nfds) {
     struct pollfd *fds;
     size_t i;
 
     *nfds = 0;
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].events && !eventLoop.handles[i].deleted)
+    for (i = 0; i < loop->handlesCount; i++) {
+        if (loop->handles[i]->events && !loop->handles[i]->deleted)
             (*nfds)++;
     }
 
@@ -393,16 +797,16 @@ static struct pollfd *virEventPollMakePollFDs(int *nfds) {
         return NULL;
 
     *nfds = 0;
-    for (i = 0; i < eventLoop.handlesCount; i++) {
+    for (i = 0; i < loop->handlesCount; i++) {
         EVENT_DEBUG("Prepare n=%zu w=%d, f=%d e=%d d=%d", i,
-                    eventLoop.handles[i].watch,
-                    eventLoop.handles[i].fd,
-                    eventLoop.handles[i].events,
-                    eventLoop.handles[i].deleted);
-        if (!eventLoop.handles[i].events || eventLoop.handles[i].deleted)
+                    loop->handles[i]->watch,
+                    loop->handles[i]->fd,
+                    loop->handles[i]->events,
+                    loop->handles[i]->deleted);
+        if (!loop->handles[i]->events || loop->handles[i]->deleted)
             continue;
-        fds[*nfds].fd = eventLoop.handles[i].fd;
-        fds[*nfds].events = eventLoop.handles[i].events;
+        fds[*nfds].fd = loop->handles[i]->fd;
+        fds[*nfds].events = loop->handles[i]->events;
         fds[*nfds].revents = 0;
         (*nfds)++;
     }
@@ -412,51 +816,80 @@ static struct pollfd *virEventPollMakePollFDs(int *nfds) {
 
 
 /*
- * Iterate over all timers and determine if any have expired.
- * Invoke the user supplied callback for each timer whose
- * expiry time is met, and schedule the next timeout. Does
- * not try to 'catch up' on time if the actual expiry time
- * was later than the requested time.
+ * Collect all armed timers expiring no later than @deadline into
+ * loop->expired, pruning subtrees of the heap which can not
+ * contain any.
+ */
+static void
+virEventPollCollectExpired(struct virEventPollLoop *loop,
+                           size_t idx,
+                           unsigned long long deadline,
+                           size_t *nexpired)
+{
+    if (idx >= loop->timeoutsCount ||
+        loop->timeouts[idx]->expiresAt > deadline)
+        return;
+
+    loop->expired[(*nexpired)++] = loop->timeouts[idx];
+    virEventPollCollectExpired(loop, idx * 2 + 1, deadline, nexpired);
+    virEventPollCollectExpired(loop, idx * 2 + 2, deadline, nexpired);
+}
+
+
+/*
+ * Iterate over all expired timers. Invoke the user supplied
+ * callback for each timer whose expiry time is met, and
+ * schedule the next timeout. Does not try to 'catch up' on
+ * time if the actual expiry time was later than the requested
+ * time.
  *
  * This method must cope with new timers being registered
  * by a callback, and must skip any timers marked as deleted.
  *
  * Returns 0 upon success, -1 if an error occurred
  */
-static int virEventPollDispatchTimeouts(void)
+static int virEventPollDispatchTimeouts(struct virEventPollLoop *loop)
 {
     unsigned long long now;
     size_t i;
-    /* Save this now - it may be changed during dispatch */
-    int ntimeouts = eventLoop.timeoutsCount;
-    VIR_DEBUG("Dispatch %d", ntimeouts);
+    size_t nexpired = 0;
 
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
-    for (i = 0; i < ntimeouts; i++) {
-        if (eventLoop.timeouts[i].deleted || eventLoop.timeouts[i].frequency < 0)
+    /* Add 20ms fuzz so we don't pointlessly spin doing
+     * <10ms sleeps, particularly on kernels with low HZ
+     * it is fine that a timer expires 20ms earlier than
+     * requested
+     */
+    virEventPollCollectExpired(loop, 0, now + 20, &nexpired);
+    VIR_DEBUG("Dispatch %zu", nexpired);
+
+    /* NB, a callback may add timers, which can move the
+     * loop->expired array, so always index it afresh */
+    for (i = 0; i < nexpired; i++) {
+        struct virEventPollTimeout *t = loop->expired[i];
+        virEventTimeoutCallback cb;
+        void *opaque;
+        int timer;
+
+        /* An earlier callback may have removed or rescheduled it */
+        if (t->deleted || t->frequency < 0 ||
+            t->expiresAt > now + 20)
             continue;
 
-        /* Add 20ms fuzz so we don't pointlessly spin doing
-         * <10ms sleeps, particularly on kernels with low HZ
-         * it is fine that a timer expires 20ms earlier than
-         * requested
-         */
-        if (eventLoop.timeouts[i].expiresAt <= (now+20)) {
-            virEventTimeoutCallback cb = eventLoop.timeouts[i].cb;
-            int timer = eventLoop.timeouts[i].timer;
-            void *opaque = eventLoop.timeouts[i].opaque;
-            eventLoop.timeouts[i].expiresAt =
-                now + eventLoop.timeouts[i].frequency;
-
-            PROBE(EVENT_POLL_DISPATCH_TIMEOUT,
-                  "timer=%d",
-                  timer);
-            virMutexUnlock(&eventLoop.lock);
-            (cb)(timer, opaque);
-            virMutexLock(&eventLoop.lock);
-        }
+        cb = t->cb;
+        timer = t->timer;
+        opaque = t->opaque;
+        t->expiresAt = now + t->frequency;
+        virEventPollTimeoutHeapUpdate(loop, t);
+
+        PROBE(EVENT_POLL_DISPATCH_TIMEOUT,
+              "timer=%d",
+              timer);
+        virMutexUnlock(&loop->lock);
+        (cb)(timer, opaque);
+        virMutexLock(&loop->lock);
     }
     return 0;
 }
@@ -472,94 +905,184 @@ static int virEventPollDispatchTimeouts(void)
  *
  * Returns 0 upon success, -1 if an error occurred
  */
-static int virEventPollDispatchHandles(int nfds, struct pollfd *fds)
+static int virEventPollDispatchHandles(struct virEventPollLoop *loop,
+                                       int nfds, struct pollfd *fds)
 {
     size_t i, n;
     VIR_DEBUG("Dispatch %d", nfds);
 
-    /* NB, use nfds not eventLoop.handlesCount, because new
+    /* NB, use nfds not loop->handlesCount, because new
      * fds might be added on end of list, and they're not
      * in the fds array we've got */
-    for (i = 0, n = 0; n < nfds && i < eventLoop.handlesCount; n++) {
-        while (i < eventLoop.handlesCount &&
-               (eventLoop.handles[i].fd != fds[n].fd ||
-                eventLoop.handles[i].events == 0)) {
+    for (i = 0, n = 0; n < nfds && i < loop->handlesCount; n++) {
+        while (i < loop->handlesCount &&
+               (loop->handles[i]->fd != fds[n].fd ||
+                loop->handles[i]->events == 0)) {
             i++;
         }
-        if (i == eventLoop.handlesCount)
+        if (i == loop->handlesCount)
             break;
 
-        VIR_DEBUG("i=%zu w=%d", i, eventLoop.handles[i].watch);
-        if (eventLoop.handles[i].deleted) {
+        VIR_DEBUG("i=%zu w=%d", i, loop->handles[i]->watch);
+        if (loop->handles[i]->deleted) {
             EVENT_DEBUG("Skip deleted n=%zu w=%d f=%d", i,
-                        eventLoop.handles[i].watch, eventLoop.handles[i].fd);
+                        loop->handles[i]->watch, loop->handles[i]->fd);
             continue;
         }
 
         if (fds[n].revents) {
-            virEventHandleCallback cb = eventLoop.handles[i].cb;
-            int watch = eventLoop.handles[i].watch;
-            void *opaque = eventLoop.handles[i].opaque;
+            virEventHandleCallback cb = loop->handles[i]->cb;
+            int watch = loop->handles[i]->watch;
+            void *opaque = loop->handles[i]->opaque;
             int hEvents = virEventPollFromNativeEvents(fds[n].revents);
             PROBE(EVENT_POLL_DISPATCH_HANDLE,
                   "watch=%d events=%d",
                   watch, hEvents);
-            virMutexUnlock(&eventLoop.lock);
+            virMutexUnlock(&loop->lock);
             (cb)(watch, fds[n].fd, hEvents, opaque);
-            virMutexLock(&eventLoop.lock);
+            virMutexLock(&loop->lock);
+        }
+    }
+
+    return 0;
+}
+
+
+#ifdef HAVE_SYS_EPOLL_H
+/* Dispatch the handles reported ready by epoll_wait(). Only the
+ * ready handles are visited, so the cost does not depend on the
+ * total number of registered handles.
+ *
+ * This method must cope with handles being registered or
+ * removed by a callback, and must skip any handles marked as
+ * deleted.
+ *
+ * Returns 0 upon success, -1 if an error occurred
+ */
+static int virEventPollDispatchEpoll(struct virEventPollLoop *loop,
+                                     int nevents, struct epoll_event *events)
+{
+    size_t i;
+    VIR_DEBUG("Dispatch %d", nevents);
+
+    for (i = 0; i < nevents; i++) {
+        struct virEventPollHandle *handle;
+        virEventHandleCallback cb;
+        void *opaque;
+        int watch = events[i].data.u64;
+        int fd;
+        int hEvents;
+
+        /* NB, the handle is looked up by watch rather than
+         * carried in the event itself, so that a stale event
+         * for an already purged handle is harmless */
+        if (!(handle = virEventPollFindHandle(loop, watch)) ||
+            handle->deleted || !handle->events) {
+            EVENT_DEBUG("Skip deleted w=%d", watch);
+            continue;
         }
+
+        cb = handle->cb;
+        fd = handle->fd;
+        opaque = handle->opaque;
+        hEvents = virEventPollFromEpollEvents(events[i].events);
+        PROBE(EVENT_POLL_DISPATCH_HANDLE,
+              "watch=%d events=%d",
+              watch, hEvents);
+        virMutexUnlock(&loop->lock);
+        (cb)(watch, fd, hEvents, opaque);
+        virMutexLock(&loop->lock);
     }
 
     return 0;
 }
 
 
+/* Dispatch the handles epoll refused to watch. Like poll() does
+ * for their FDs, report them ready for whatever they asked for.
+ *
+ * This method must cope with handles being registered or
+ * removed by a callback, and must skip any handles marked as
+ * deleted.
+ */
+static void virEventPollDispatchAlwaysReady(struct virEventPollLoop *loop)
+{
+    size_t count = loop->handlesCount;
+    size_t i;
+
+    VIR_DEBUG("Dispatch %zu always ready", loop->alwaysReadyCount);
+
+    /* NB, new handles are appended and the array may be moved by
+     * a callback, so stop at the current end and index it afresh */
+    for (i = 0; i < count && loop->alwaysReadyCount; i++) {
+        struct virEventPollHandle *handle = loop->handles[i];
+        virEventHandleCallback cb;
+        void *opaque;
+        int watch;
+        int fd;
+        int hEvents;
+
+        if (!handle->alwaysReady || handle->deleted || !handle->events)
+            continue;
+
+        cb = handle->cb;
+        watch = handle->watch;
+        fd = handle->fd;
+        opaque = handle->opaque;
+        hEvents = virEventPollFromNativeEvents(handle->events &
+                                               (POLLIN | POLLOUT));
+        PROBE(EVENT_POLL_DISPATCH_HANDLE,
+              "watch=%d events=%d",
+              watch, hEvents);
+        virMutexUnlock(&loop->lock);
+        (cb)(watch, fd, hEvents, opaque);
+        virMutexLock(&loop->lock);
+    }
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+
 /* Used post dispatch to actually remove any timers that
  * were previously marked as deleted. This asynchronous
  * cleanup is needed to make dispatch re-entrant safe.
  */
-static void virEventPollCleanupTimeouts(void)
+static void virEventPollCleanupTimeouts(struct virEventPollLoop *loop)
 {
-    size_t i;
     size_t gap;
-    VIR_DEBUG("Cleanup %zu", eventLoop.timeoutsCount);
+    VIR_DEBUG("Cleanup %zu", loop->timersCount);
 
-    /* Remove deleted entries, shuffling down remaining
-     * entries as needed to form contiguous series
-     */
-    for (i = 0; i < eventLoop.timeoutsCount;) {
-        if (!eventLoop.timeouts[i].deleted) {
-            i++;
-            continue;
-        }
+    /* NB, the free callback may remove further timers
+     * while the lock is dropped, so pop one at a time */
+    while (loop->timeoutsDeleted) {
+        struct virEventPollTimeout *t = loop->timeoutsDeleted;
+        loop->timeoutsDeleted = t->nextDeleted;
 
         PROBE(EVENT_POLL_PURGE_TIMEOUT,
               "timer=%d",
-              eventLoop.timeouts[i].timer);
-        if (eventLoop.timeouts[i].ff) {
-            virFreeCallback ff = eventLoop.timeouts[i].ff;
-            void *opaque = eventLoop.timeouts[i].opaque;
-            virMutexUnlock(&eventLoop.lock);
+              t->timer);
+        ignore_value(virHashRemoveEntry(loop->timeoutsByTimer,
+                                        (void *)(intptr_t)t->timer));
+        loop->timersCount--;
+
+        if (t->ff) {
+            virFreeCallback ff = t->ff;
+            void *opaque = t->opaque;
+            virMutexUnlock(&loop->lock);
             ff(opaque);
-            virMutexLock(&eventLoop.lock);
-        }
-
-        if ((i+1) < eventLoop.timeoutsCount) {
-            memmove(eventLoop.timeouts+i,
-                    eventLoop.timeouts+i+1,
-                    sizeof(struct virEventPollTimeout)*(eventLoop.timeoutsCount
-                                                    -(i+1)));
+            virMutexLock(&loop->lock);
         }
-        eventLoop.timeoutsCount--;
+        VIR_FREE(t);
     }
 
     /* Release some memory if we've got a big chunk free */
-    gap = eventLoop.timeoutsAlloc - eventLoop.timeoutsCount;
-    if (eventLoop.timeoutsCount == 0 ||
-        (gap > eventLoop.timeoutsCount && gap > EVENT_ALLOC_EXTENT)) {
+    gap = loop->timeoutsAlloc - loop->timersCount;
+    if (loop->timersCount == 0 ||
+        (gap > loop->timersCount && gap > EVENT_ALLOC_EXTENT)) {
         EVENT_DEBUG("Found %zu out of %zu timeout slots used, releasing %zu",
-                    eventLoop.timeoutsCount, eventLoop.timeoutsAlloc, gap);
-        VIR_SHRINK_N(eventLoop.timeouts, eventLoop.timeoutsAlloc, gap);
+                    loop->timersCount, loop->timeoutsAlloc, gap);
+        VIR_SHRINK_N(loop->timeouts, loop->timeoutsAlloc, gap);
+        gap = loop->expiredAlloc - loop->timersCount;
+        VIR_SHRINK_N(loop->expired, loop->expiredAlloc, gap);
     }
 }
 
@@ -567,48 +1090,49 @@ static void virEventPollCleanupTimeouts(void)
  * were previously marked as deleted. This asynchronous
  * cleanup is needed to make dispatch re-entrant safe.
  */
-static void virEventPollCleanupHandles(void)
+static void virEventPollCleanupHandles(struct virEventPollLoop *loop)
 {
-    size_t i;
     size_t gap;
-    VIR_DEBUG("Cleanup %zu", eventLoop.handlesCount);
+    VIR_DEBUG("Cleanup %zu", loop->handlesCount);
 
-    /* Remove deleted entries, shuffling down remaining
-     * entries as needed to form contiguous series
-     */
-    for (i = 0; i < eventLoop.handlesCount;) {
-        if (!eventLoop.handles[i].deleted) {
-            i++;
-            continue;
-        }
+    /* NB, the free callback may remove further handles
+     * while the lock is dropped, so pop one at a time */
+    while (loop->handlesDeleted) {
+        struct virEventPollHandle *handle = loop->handlesDeleted;
+        size_t last = loop->handlesCount - 1;
+        loop->handlesDeleted = handle->nextDeleted;
 
         PROBE(EVENT_POLL_PURGE_HANDLE,
               "watch=%d",
-              eventLoop.handles[i].watch);
-        if (eventLoop.handles[i].ff) {
-            virFreeCallback ff = eventLoop.handles[i].ff;
-            void *opaque = eventLoop.handles[i].opaque;
-            virMutexUnlock(&eventLoop.lock);
-            ff(opaque);
-            virMutexLock(&eventLoop.lock);
+              handle->watch);
+        ignore_value(virHashRemoveEntry(loop->handlesByWatch,
+                                        (void *)(intptr_t)handle->watch));
+
+        /* Order of the list does not matter, so fill the
+         * hole with the last entry */
+        if (handle->index != last) {
+            loop->handles[handle->index] = loop->handles[last];
+            loop->handles[handle->index]->index = handle->index;
         }
+        loop->handlesCount--;
 
-        if ((i+1) < eventLoop.handlesCount) {
-            memmove(eventLoop.handles+i,
-                    eventLoop.handles+i+1,
-                    sizeof(struct virEventPollHandle)*(eventLoop.handlesCount
-                                                   -(i+1)));
+        if (handle->ff) {
+            virFreeCallback ff = handle->ff;
+            void *opaque = handle->opaque;
+            virMutexUnlock(&loop->lock);
+            ff(opaque);
+            virMutexLock(&loop->lock);
         }
-        eventLoop.handlesCount--;
+        VIR_FREE(handle);
     }
 
     /* Release some memory if we've got a big chunk free */
-    gap = eventLoop.handlesAlloc - eventLoop.handlesCount;
-    if (eventLoop.handlesCount == 0 ||
-        (gap > eventLoop.handlesCount && gap > EVENT_ALLOC_EXTENT)) {
+    gap = loop->handlesAlloc - loop->handlesCount;
+    if (loop->handlesCount == 0 ||
+        (gap > loop->handlesCount && gap > EVENT_ALLOC_EXTENT)) {
         EVENT_DEBUG("Found %zu out of %zu handles slots used, releasing %zu",
-                    eventLoop.handlesCount, eventLoop.handlesAlloc, gap);
-        VIR_SHRINK_N(eventLoop.handles, eventLoop.handlesAlloc, gap);
+                    loop->handlesCount, loop->handlesAlloc, gap);
+        VIR_SHRINK_N(loop->handles, loop->handlesAlloc, gap);
     }
 }
 
@@ -616,29 +1140,48 @@ static void virEventPollCleanupHandles(void)
  * Run a single iteration of the event loop, blocking until
  * at least one file handle has an event, or a timer expires
  */
-int virEventPollRunOnce(void)
+int virEventPollLoopRunOnce(virEventPollLoopPtr loop)
 {
     struct pollfd *fds = NULL;
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event events[EVENT_EPOLL_MAX_EVENTS];
+#endif
     int ret, timeout, nfds;
 
-    virMutexLock(&eventLoop.lock);
-    eventLoop.running = 1;
-    virThreadSelf(&eventLoop.leader);
+    virMutexLock(&loop->lock);
+    loop->running = 1;
+    virThreadSelf(&loop->leader);
 
-    virEventPollCleanupTimeouts();
-    virEventPollCleanupHandles();
+    virEventPollCleanupTimeouts(loop);
+    virEventPollCleanupHandles(loop);
 
-    if (!(fds = virEventPollMakePollFDs(&nfds)) ||
-        virEventPollCalculateTimeout(&timeout) < 0)
+    if (virEventPollCalculateTimeout(loop, &timeout) < 0)
         goto error;
 
-    virMutexUnlock(&eventLoop.lock);
+    if (loop->epollfd >= 0) {
+        nfds = loop->handlesCount;
+#ifdef HAVE_SYS_EPOLL_H
+        /* Don't block while some handles are always ready */
+        if (loop->alwaysReadyCount)
+            timeout = 0;
+#endif
+    } else if (!(fds = virEventPollMakePollFDs(loop, &nfds))) {
+        goto error;
+    }
+
+    virMutexUnlock(&loop->lock);
 
  retry:
     PROBE(EVENT_POLL_RUN,
           "nhandles=%d timeout=%d",
           nfds, timeout);
-    ret = poll(fds, nfds, timeout);
+#ifdef HAVE_SYS_EPOLL_H
+    if (loop->epollfd >= 0)
+        ret = epoll_wait(loop->epollfd, events,
+                         ARRAY_CARDINALITY(events), timeout);
+    else
+#endif
+        ret = poll(fds, nfds, timeout);
     if (ret < 0) {
         EVENT_DEBUG("Poll got error event %d", errno);
         if (errno == EINTR || errno == EAGAIN)
@@ -649,24 +1192,37 @@ int virEventPollRunOnce(void)
     }
     EVENT_DEBUG("Poll got %d event(s)", ret);
 
-    virMutexLock(&eventLoop.lock);
-    if (virEventPollDispatchTimeouts() < 0)
+    virMutexLock(&loop->lock);
+    if (virEventPollDispatchTimeouts(loop) < 0)
         goto error;
 
-    if (ret > 0 &&
-        virEventPollDispatchHandles(nfds, fds) < 0)
-        goto error;
+    if (ret > 0) {
+        int rc;
+#ifdef HAVE_SYS_EPOLL_H
+        if (loop->epollfd >= 0)
+            rc = virEventPollDispatchEpoll(loop, ret, events);
+        else
+#endif
+            rc = virEventPollDispatchHandles(loop, nfds, fds);
+        if (rc < 0)
+            goto error;
+    }
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (loop->epollfd >= 0 && loop->alwaysReadyCount)
+        virEventPollDispatchAlwaysReady(loop);
+#endif
 
-    virEventPollCleanupTimeouts();
-    virEventPollCleanupHandles();
+    virEventPollCleanupTimeouts(loop);
+    virEventPollCleanupHandles(loop);
 
-    eventLoop.running = 0;
-    virMutexUnlock(&eventLoop.lock);
+    loop->running = 0;
+    virMutexUnlock(&loop->lock);
     VIR_FREE(fds);
     return 0;
 
  error:
-    virMutexUnlock(&eventLoop.lock);
+    virMutexUnlock(&loop->lock);
  error_unlocked:
     VIR_FREE(fds);
     return -1;
@@ -676,68 +1232,239 @@ int virEventPollRunOnce(void)
 static void virEventPollHandleWakeup(int watch ATTRIBUTE_UNUSED,
                                      int fd,
                                      int events ATTRIBUTE_UNUSED,
-                                     void *opaque ATTRIBUTE_UNUSED)
+                                     void *opaque)
 {
+    struct virEventPollLoop *loop = opaque;
     char c;
-    virMutexLock(&eventLoop.lock);
+    virMutexLock(&loop->lock);
     ignore_value(saferead(fd, &c, sizeof(c)));
-    virMutexUnlock(&eventLoop.lock);
+    virMutexUnlock(&loop->lock);
 }
 
-int virEventPollInit(void)
+static int virEventPollLoopInit(struct virEventPollLoop *loop)
 {
-    if (virMutexInit(&eventLoop.lock) < 0) {
+    loop->epollfd = -1;
+    loop->wakeupfd[0] = loop->wakeupfd[1] = -1;
+
+    if (virMutexInit(&loop->lock) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to initialize mutex"));
         return -1;
     }
 
-    if (pipe2(eventLoop.wakeupfd, O_CLOEXEC | O_NONBLOCK) < 0) {
+    if (!(loop->handlesByWatch = virHashCreateFull(EVENT_ALLOC_EXTENT,
+                                                   NULL,
+                                                   virEventPollIDCode,
+                                                   virEventPollIDEqual,
+                                                   virEventPollIDCopy,
+                                                   NULL)) ||
+        !(loop->timeoutsByTimer = virHashCreateFull(EVENT_ALLOC_EXTENT,
+                                                    NULL,
+                                                    virEventPollIDCode,
+                                                    virEventPollIDEqual,
+                                                    virEventPollIDCopy,
+                                                    NULL)))
+        return -1;
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (!(loop->epollOwners = virHashCreateFull(EVENT_ALLOC_EXTENT,
+                                                NULL,
+                                                virEventPollIDCode,
+                                                virEventPollIDEqual,
+                                                virEventPollIDCopy,
+                                                NULL)))
+        return -1;
+
+    if ((loop->epollfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        if (errno != ENOSYS) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create epoll instance"));
+            return -1;
+        }
+        VIR_DEBUG("%s", "epoll is not available, falling back to poll");
+    }
+#endif
+
+    if (pipe2(loop->wakeupfd, O_CLOEXEC | O_NONBLOCK) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to setup wakeup pipe"));
         return -1;
     }
 
-    if (virEventPollAddHandle(eventLoop.wakeupfd[0],
-                              VIR_EVENT_HANDLE_READABLE,
-                              virEventPollHandleWakeup, NULL, NULL) < 0) {
+    if (virEventPollLoopAddHandle(loop, loop->wakeupfd[0],
+                                  VIR_EVENT_HANDLE_READABLE,
+                                  virEventPollHandleWakeup, loop, NULL) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Unable to add handle %d to event loop"),
-                       eventLoop.wakeupfd[0]);
-        VIR_FORCE_CLOSE(eventLoop.wakeupfd[0]);
-        VIR_FORCE_CLOSE(eventLoop.wakeupfd[1]);
+                       loop->wakeupfd[0]);
+        VIR_FORCE_CLOSE(loop->wakeupfd[0]);
+        VIR_FORCE_CLOSE(loop->wakeupfd[1]);
         return -1;
     }
 
     return 0;
 }
 
-static int virEventPollInterruptLocked(void)
+int virEventPollInit(void)
+{
+    return virEventPollLoopInit(&eventLoop);
+}
+
+virEventPollLoopPtr virEventPollLoopNew(void)
+{
+    virEventPollLoopPtr loop;
+
+    if (VIR_ALLOC(loop) < 0)
+        return NULL;
+
+    if (virEventPollLoopInit(loop) < 0) {
+        virEventPollLoopFree(loop);
+        return NULL;
+    }
+
+    return loop;
+}
+
+static int
+virEventPollMarkTimeoutDeleted(void *payload,
+                               const void *name ATTRIBUTE_UNUSED,
+                               void *opaque)
+{
+    struct virEventPollTimeout *t = payload;
+    struct virEventPollLoop *loop = opaque;
+
+    if (!t->deleted) {
+        t->deleted = 1;
+        virEventPollTimeoutHeapRemove(loop, t);
+        t->nextDeleted = loop->timeoutsDeleted;
+        loop->timeoutsDeleted = t;
+    }
+    return 0;
+}
+
+/*
+ * Free a loop created by virEventPollLoopNew. Nobody must be
+ * running it anymore. Handles and timers still registered are
+ * removed, so their free callbacks are invoked from here.
+ */
+void virEventPollLoopFree(virEventPollLoopPtr loop)
+{
+    size_t i;
+
+    if (!loop)
+        return;
+
+    if (loop->handlesByWatch && loop->timeoutsByTimer) {
+        virMutexLock(&loop->lock);
+        for (i = 0; i < loop->handlesCount; i++) {
+            struct virEventPollHandle *handle = loop->handles[i];
+
+            if (handle->deleted)
+                continue;
+            handle->deleted = 1;
+            ignore_value(virEventPollEpollSync(loop, handle));
+            handle->nextDeleted = loop->handlesDeleted;
+            loop->handlesDeleted = handle;
+        }
+        virHashForEach(loop->timeoutsByTimer,
+                       virEventPollMarkTimeoutDeleted, loop);
+
+        virEventPollCleanupTimeouts(loop);
+        virEventPollCleanupHandles(loop);
+        virMutexUnlock(&loop->lock);
+    }
+
+    VIR_FORCE_CLOSE(loop->wakeupfd[0]);
+    VIR_FORCE_CLOSE(loop->wakeupfd[1]);
+    VIR_FORCE_CLOSE(loop->epollfd);
+#ifdef HAVE_SYS_EPOLL_H
+    virHashFree(loop->epollOwners);
+#endif
+    virHashFree(loop->handlesByWatch);
+    virHashFree(loop->timeoutsByTimer);
+    VIR_FREE(loop->handles);
+    VIR_FREE(loop->timeouts);
+    VIR_FREE(loop->expired);
+    if (loop->handlesByWatch)
+        virMutexDestroy(&loop->lock);
+    VIR_FREE(loop);
+}
+
+static int virEventPollInterruptLocked(struct virEventPollLoop *loop)
 {
     char c = '\0';
 
-    if (!eventLoop.running ||
-        virThreadIsSelf(&eventLoop.leader)) {
-        VIR_DEBUG("Skip interrupt, %d %llu", eventLoop.running,
-                  virThreadID(&eventLoop.leader));
+    if (!loop->running ||
+        virThreadIsSelf(&loop->leader)) {
+        VIR_DEBUG("Skip interrupt, %d %llu", loop->running,
+                  virThreadID(&loop->leader));
         return 0;
     }
 
     VIR_DEBUG("Interrupting");
-    if (safewrite(eventLoop.wakeupfd[1], &c, sizeof(c)) != sizeof(c))
+    if (safewrite(loop->wakeupfd[1], &c, sizeof(c)) != sizeof(c))
         return -1;
     return 0;
 }
 
-int virEventPollInterrupt(void)
+int virEventPollLoopInterrupt(virEventPollLoopPtr loop)
 {
     int ret;
-    virMutexLock(&eventLoop.lock);
-    ret = virEventPollInterruptLocked();
-    virMutexUnlock(&eventLoop.lock);
+    virMutexLock(&loop->lock);
+    ret = virEventPollInterruptLocked(loop);
+    virMutexUnlock(&loop->lock);
     return ret;
 }
 
+
+/* The default loop, as registered by virEventRegisterDefaultImpl */
+
+int virEventPollAddHandle(int fd, int events,
+                          virEventHandleCallback cb,
+                          void *opaque,
+                          virFreeCallback ff)
+{
+    return virEventPollLoopAddHandle(&eventLoop, fd, events, cb, opaque, ff);
+}
+
+void virEventPollUpdateHandle(int watch, int events)
+{
+    virEventPollLoopUpdateHandle(&eventLoop, watch, events);
+}
+
+int virEventPollRemoveHandle(int watch)
+{
+    return virEventPollLoopRemoveHandle(&eventLoop, watch);
+}
+
+int virEventPollAddTimeout(int frequency,
+                           virEventTimeoutCallback cb,
+                           void *opaque,
+                           virFreeCallback ff)
+{
+    return virEventPollLoopAddTimeout(&eventLoop, frequency, cb, opaque, ff);
+}
+
+void virEventPollUpdateTimeout(int timer, int frequency)
+{
+    virEventPollLoopUpdateTimeout(&eventLoop, timer, frequency);
+}
+
+int virEventPollRemoveTimeout(int timer)
+{
+    return virEventPollLoopRemoveTimeout(&eventLoop, timer);
+}
+
+int virEventPollRunOnce(void)
+{
+    return virEventPollLoopRunOnce(&eventLoop);
+}
+
+int virEventPollInterrupt(void)
+{
+    return virEventPollLoopInterrupt(&eventLoop);
+}
+
 int
 virEventPollToNativeEvents(int events)
 {
@@ -129,4 +129,40 @@ int virEventPollToNativeEvents(int events);
 int virEventPollInterrupt(void);
 
 
+/*
+ * Besides the default loop used by the functions above, further
+ * loops can be created and run by threads of their own. Watch and
+ * timer IDs are unique across all loops, but must always be passed
+ * to the loop they were registered with.
+ */
+typedef struct virEventPollLoop virEventPollLoop;
+typedef virEventPollLoop *virEventPollLoopPtr;
+
+virEventPollLoopPtr virEventPollLoopNew(void);
+void virEventPollLoopFree(virEventPollLoopPtr loop);
+
+int virEventPollLoopAddHandle(virEventPollLoopPtr loop,
+                              int fd, int events,
+                              virEventHandleCallback cb,
+                              void *opaque,
+                              virFreeCallback ff);
+void virEventPollLoopUpdateHandle(virEventPollLoopPtr loop,
+                                  int watch, int events);
+int virEventPollLoopRemoveHandle(virEventPollLoopPtr loop,
+                                 int watch);
+
+int virEventPollLoopAddTimeout(virEventPollLoopPtr loop,
+                               int frequency,
+                               virEventTimeoutCallback cb,
+                               void *opaque,
+                               virFreeCallback ff);
+void virEventPollLoopUpdateTimeout(virEventPollLoopPtr loop,
+                                   int timer, int frequency);
+int virEventPollLoopRemoveTimeout(virEventPollLoopPtr loop,
+                                  int timer);
+
+int virEventPollLoopRunOnce(virEventPollLoopPtr loop);
+int virEventPollLoopInterrupt(virEventPollLoopPtr loop);
+
+
 #endif /* __VIRTD_EVENT_H__ */
@@ -620,6 +620,44 @@ virHashForEach(virHashTablePtr table, virHashIterator iter, void *data)
 }
 
 
+/**
+ * virHashForEachReadOnly
+ * @table: the hash table to process
+ * @iter: callback to process each element
+ * @data: opaque data to pass to the iterator
+ *
+ * Like virHashForEach, but the table is not marked as being iterated
+ * over, so several threads may walk it at the same time as long as
+ * none of them modifies it, e.g. while holding a shared lock. The
+ * 'iter' callback must not call any function modifying the table.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int
+virHashForEachReadOnly(const virHashTable *table,
+                       virHashIterator iter,
+                       void *data)
+{
+    size_t i;
+
+    if (table == NULL || iter == NULL)
+        return -1;
+
+    if (table->iterating)
+        virHashIterationError(-1);
+
+    for (i = 0; i < table->size; i++) {
+        virHashEntryPtr entry;
+        for (entry = table->table[i]; entry; entry = entry->next) {
+            if (iter(entry->payload, entry->name, data) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
 /**
  * virHashRemoveSet
  * @table: the hash table to process
@@ -25,6 +25,7 @@
 
 #include "virjson.h"
 #include "viralloc.h"
+#include "viratomic.h"
 #include "virerror.h"
 #include "virlog.h"
 #include "virstring.h"
@@ -65,9 +66,271 @@ struct _virJSONParser {
     virJSONParserStatePtr state;
     size_t nstate;
     int wrap;
+    virJSONArenaPtr arena;
 };
 
 
+/*
+ * Documents parsed by virJSONValueFromStringArena are allocated from
+ * a list of chunks instead of one malloc per value, key and string.
+ * Individual values are never freed, the whole arena goes away at
+ * once when the last value holding a reference to it is freed: the
+ * root of the tree and any value taken out of the tree since.
+ */
+#define VIR_JSON_ARENA_CHUNK_MIN 4096
+#define VIR_JSON_ARENA_CHUNK_MAX (64 * 1024)
+#define VIR_JSON_ARENA_ALIGN 8
+
+typedef struct _virJSONArenaChunk virJSONArenaChunk;
+typedef virJSONArenaChunk *virJSONArenaChunkPtr;
+struct _virJSONArenaChunk {
+    virJSONArenaChunkPtr next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct _virJSONArena {
+    virJSONArenaChunkPtr chunks; /* allocations are served by the first */
+    int refs;
+
+    /* Heap allocated values appended into the tree after parsing */
+    virJSONValuePtr *adopted;
+    size_t nadopted;
+};
+
+
+static void
+virJSONArenaFree(virJSONArenaPtr arena)
+{
+    size_t i;
+
+    if (!arena)
+        return;
+
+    for (i = 0; i < arena->nadopted; i++)
+        virJSONValueFree(arena->adopted[i]);
+    VIR_FREE(arena->adopted);
+
+    while (arena->chunks) {
+        virJSONArenaChunkPtr next = arena->chunks->next;
+        VIR_FREE(arena->chunks);
+        arena->chunks = next;
+    }
+
+    VIR_FREE(arena);
+}
+
+
+static void
+virJSONArenaUnref(virJSONArenaPtr arena)
+{
+    if (virAtomicIntDecAndTest(&arena->refs))
+        virJSONArenaFree(arena);
+}
+
+
+/* Returns zeroed memory which stays valid until the arena is freed */
+static void *
+virJSONArenaAlloc(virJSONArenaPtr arena,
+                  size_t size)
+{
+    virJSONArenaChunkPtr chunk = arena->chunks;
+    size_t chunksize;
+    void *ret;
+
+    size = VIR_ROUND_UP(size, VIR_JSON_ARENA_ALIGN);
+
+    if (chunk && chunk->size - chunk->used >= size) {
+        ret = chunk->data + chunk->used;
+        chunk->used += size;
+        return ret;
+    }
+
+    chunksize = chunk ? MIN(chunk->size * 2, VIR_JSON_ARENA_CHUNK_MAX) :
+                        VIR_JSON_ARENA_CHUNK_MIN;
+
+    if (size > chunksize) {
+        /* Big enough to get a chunk of its own, which is put behind
+         * the current one so that its free space is not wasted */
+        if (VIR_ALLOC_VAR(chunk, char, size) < 0)
+            return NULL;
+        chunk->size = chunk->used = size;
+        if (arena->chunks) {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        } else {
+            arena->chunks = chunk;
+        }
+        return chunk->data;
+    }
+
+    if (VIR_ALLOC_VAR(chunk, char, chunksize) < 0)
+        return NULL;
+    chunk->size = chunksize;
+    chunk->used = size;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    return chunk->data;
+}
+
+
+/* Takes ownership of a heap allocated @value placed into the arena's
+ * tree, or of the root of a different arena */
+static int
+virJSONArenaAdopt(virJSONArenaPtr arena,
+                  virJSONValuePtr value)
+{
+    return VIR_APPEND_ELEMENT_COPY(arena->adopted, arena->nadopted, value);
+}
+
+
+/* Checks @value can be placed into @container. Members of an arena
+ * tree have no life of their own, so they can only be moved within
+ * their tree. */
+static int
+virJSONValueCheckInsert(virJSONValuePtr container,
+                        virJSONValuePtr value)
+{
+    if (value->arena && !value->root && value->arena != container->arena) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot insert a member of a different JSON tree"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Hands the ownership of @value over to @container, which must have
+ * passed virJSONValueCheckInsert and have room for @value already */
+static int
+virJSONValueInsert(virJSONValuePtr container,
+                   virJSONValuePtr value)
+{
+    if (!container->arena)
+        return 0;
+
+    /* Back in its own tree, the root of that tree keeps it */
+    if (value->arena == container->arena) {
+        if (value->root) {
+            value->root = false;
+            virJSONArenaUnref(value->arena);
+        }
+        return 0;
+    }
+
+    return virJSONArenaAdopt(container->arena, value);
+}
+
+
+/* Turns @value taken out of @container into a value which can be
+ * freed on its own. Members of the arena keep using it, so they take
+ * a reference, heap values and other trees are no longer adopted. */
+static void
+virJSONValueDetach(virJSONValuePtr container,
+                   virJSONValuePtr value)
+{
+    virJSONArenaPtr arena = container->arena;
+    size_t i;
+
+    if (!arena || !value)
+        return;
+
+    if (value->arena == arena) {
+        virAtomicIntInc(&arena->refs);
+        value->root = true;
+        return;
+    }
+
+    for (i = 0; i < arena->nadopted; i++) {
+        if (arena->adopted[i] == value) {
+            VIR_DELETE_ELEMENT(arena->adopted, i, arena->nadopted);
+            return;
+        }
+    }
+}
+
+
+static virJSONValuePtr
+virJSONValueAlloc(virJSONArenaPtr arena,
+                  int type)
+{
+    virJSONValuePtr val;
+
+    if (arena) {
+        if (!(val = virJSONArenaAlloc(arena, sizeof(*val))))
+            return NULL;
+        val->arena = arena;
+    } else {
+        if (VIR_ALLOC(val) < 0)
+            return NULL;
+    }
+
+    val->type = type;
+    return val;
+}
+
+
+static char *
+virJSONValueStrndup(virJSONArenaPtr arena,
+                    const char *str,
+                    size_t len)
+{
+    char *ret;
+
+    if (!arena) {
+        ignore_value(VIR_STRNDUP(ret, str, len));
+        return ret;
+    }
+
+    if (!(ret = virJSONArenaAlloc(arena, len + 1)))
+        return NULL;
+    memcpy(ret, str, len);
+    return ret;
+}
+
+
+/* Makes room for @add more members of an object or array, growing it
+ * geometrically.  Arena backed containers never shrink or release the
+ * old storage, the arena does it in the end. */
+static int
+virJSONValueResize(virJSONArenaPtr arena,
+                   void *ptrptr,
+                   size_t size,
+                   size_t *alloc,
+                   size_t count,
+                   size_t add)
+{
+    void **ptr = ptrptr;
+    size_t newalloc;
+    void *tmp;
+
+    if (!arena)
+        return virResizeN(ptrptr, size, alloc, count, add, true,
+                          VIR_FROM_THIS, __FILE__, __FUNCTION__, __LINE__);
+
+    if (count + add <= *alloc)
+        return 0;
+
+    newalloc = MAX(*alloc * 2, count + add);
+    if (xalloc_oversized(newalloc, size)) {
+        virReportOOMError();
+        return -1;
+    }
+
+    if (!(tmp = virJSONArenaAlloc(arena, newalloc * size)))
+        return -1;
+    if (count)
+        memcpy(tmp, *ptr, count * size);
+
+    *ptr = tmp;
+    *alloc = newalloc;
+    return 0;
+}
+
+
 /**
  * virJSONValueObjectAddVArgs:
  * @obj: JSON object to add the values to
@@ -348,6 +611,13 @@ virJSONValueFree(virJSONValuePtr value)
     if (!value || value->protect)
         return;
 
+    /* Members of an arena go away with the arena only */
+    if (value->arena) {
+        if (value->root)
+            virJSONArenaUnref(value->arena);
+        return;
+    }
+
     switch ((virJSONType) value->type) {
     case VIR_JSON_TYPE_OBJECT:
         for (i = 0; i < value->data.object.npairs; i++) {
@@ -559,6 +829,36 @@ virJSONValueNewObject(void)
 }
 
 
+/* Like virJSONValueObjectAppend, but @key is taken over on success.
+ * It must come from the arena of @object, if there is one. */
+static int
+virJSONValueObjectAppendKey(virJSONValuePtr object,
+                            char *key,
+                            virJSONValuePtr value)
+{
+    if (virJSONValueObjectHasKey(object, key))
+        return -1;
+
+    if (virJSONValueCheckInsert(object, value) < 0)
+        return -1;
+
+    if (virJSONValueResize(object->arena, &object->data.object.pairs,
+                           sizeof(*object->data.object.pairs),
+                           &object->data.object.npairs_alloc,
+                           object->data.object.npairs, 1) < 0)
+        return -1;
+
+    if (virJSONValueInsert(object, value) < 0)
+        return -1;
+
+    object->data.object.pairs[object->data.object.npairs].key = key;
+    object->data.object.pairs[object->data.object.npairs].value = value;
+    object->data.object.npairs++;
+
+    return 0;
+}
+
+
 int
 virJSONValueObjectAppend(virJSONValuePtr object,
                          const char *key,
@@ -569,22 +869,15 @@ virJSONValueObjectAppend(virJSONValuePtr object,
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    if (virJSONValueObjectHasKey(object, key))
-        return -1;
-
-    if (VIR_STRDUP(newkey, key) < 0)
+    if (!(newkey = virJSONValueStrndup(object->arena, key, strlen(key))))
         return -1;
 
-    if (VIR_REALLOC_N(object->data.object.pairs,
-                      object->data.object.npairs + 1) < 0) {
-        VIR_FREE(newkey);
+    if (virJSONValueObjectAppendKey(object, newkey, value) < 0) {
+        if (!object->arena)
+            VIR_FREE(newkey);
         return -1;
     }
 
-    object->data.object.pairs[object->data.object.npairs].key = newkey;
-    object->data.object.pairs[object->data.object.npairs].value = value;
-    object->data.object.npairs++;
-
     return 0;
 }
 
@@ -723,8 +1016,16 @@ virJSONValueArrayAppend(virJSONValuePtr array,
     if (array->type != VIR_JSON_TYPE_ARRAY)
         return -1;
 
-    if (VIR_REALLOC_N(array->data.array.values,
-                      array->data.array.nvalues + 1) < 0)
+    if (virJSONValueCheckInsert(array, value) < 0)
+        return -1;
+
+    if (virJSONValueResize(array->arena, &array->data.array.values,
+                           sizeof(*array->data.array.values),
+                           &array->data.array.nvalues_alloc,
+                           array->data.array.nvalues, 1) < 0)
+        return -1;
+
+    if (virJSONValueInsert(array, value) < 0)
         return -1;
 
     array->data.array.values[array->data.array.nvalues] = value;
@@ -811,6 +1112,8 @@ virJSONValueObjectGetKey(virJSONValuePtr object,
 
 /* Remove the key-value pair tied to @key out of @object.  If @value is
  * not NULL, the dropped value object is returned instead of freed.
+ * Values taken out of an arena backed object keep the arena around
+ * until they are freed.
  * Returns 1 on success, 0 if no key was found, and -1 on error.  */
 int
 virJSONValueObjectRemoveKey(virJSONValuePtr object,
@@ -827,14 +1130,21 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object,
 
     for (i = 0; i < object->data.object.npairs; i++) {
         if (STREQ(object->data.object.pairs[i].key, key)) {
-            if (value) {
-                *value = object->data.object.pairs[i].value;
-                object->data.object.pairs[i].value = NULL;
+            if (object->arena) {
+                if (value) {
+                    *value = object->data.object.pairs[i].value;
+                    virJSONValueDetach(object, *value);
+                }
+            } else {
+                if (value) {
+                    *value = object->data.object.pairs[i].value;
+                    object->data.object.pairs[i].value = NULL;
+                }
+                VIR_FREE(object->data.object.pairs[i].key);
+                virJSONValueFree(object->data.object.pairs[i].value);
             }
-            VIR_FREE(object->data.object.pairs[i].key);
-            virJSONValueFree(object->data.object.pairs[i].value);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
+            VIR_DELETE_ELEMENT_INPLACE(object->data.object.pairs, i,
+                                       object->data.object.npairs);
             return 1;
         }
     }
@@ -901,10 +1211,11 @@ virJSONValueArraySteal(virJSONValuePtr array,
         return NULL;
 
     ret = array->data.array.values[element];
+    virJSONValueDetach(array, ret);
 
-    VIR_DELETE_ELEMENT(array->data.array.values,
-                       element,
-                       array->data.array.nvalues);
+    VIR_DELETE_ELEMENT_INPLACE(array->data.array.values,
+                               element,
+                               array->data.array.nvalues);
 
     return ret;
 }
@@ -1304,6 +1615,17 @@ virJSONValueCopy(virJSONValuePtr in)
 
 
 #if WITH_YAJL
+static void
+virJSONParserFreeKey(virJSONParserPtr parser,
+                     char **key)
+{
+    if (parser->arena)
+        *key = NULL;
+    else
+        VIR_FREE(*key);
+}
+
+
 static int
 virJSONParserInsertValue(virJSONParserPtr parser,
                          virJSONValuePtr value)
@@ -1326,12 +1648,12 @@ virJSONParserInsertValue(virJSONParserPtr parser,
                 return -1;
             }
 
-            if (virJSONValueObjectAppend(state->value,
-                                         state->key,
-                                         value) < 0)
+            if (virJSONValueObjectAppendKey(state->value,
+                                            state->key,
+                                            value) < 0)
                 return -1;
 
-            VIR_FREE(state->key);
+            state->key = NULL;
         }   break;
 
         case VIR_JSON_TYPE_ARRAY: {
@@ -1359,7 +1681,8 @@ static int
 virJSONParserHandleNull(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewNull();
+    virJSONValuePtr value = virJSONValueAlloc(parser->arena,
+                                              VIR_JSON_TYPE_NULL);
 
     VIR_DEBUG("parser=%p", parser);
 
@@ -1380,12 +1703,14 @@ virJSONParserHandleBoolean(void *ctx,
                            int boolean_)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewBoolean(boolean_);
+    virJSONValuePtr value = virJSONValueAlloc(parser->arena,
+                                              VIR_JSON_TYPE_BOOLEAN);
 
     VIR_DEBUG("parser=%p boolean=%d", parser, boolean_);
 
     if (!value)
         return 0;
+    value->data.boolean = boolean_;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
@@ -1402,18 +1727,17 @@ virJSONParserHandleNumber(void *ctx,
                           yajl_size_t l)
 {
     virJSONParserPtr parser = ctx;
-    char *str;
     virJSONValuePtr value;
 
-    if (VIR_STRNDUP(str, s, l) < 0)
-        return -1;
-    value = virJSONValueNewNumber(str);
-    VIR_FREE(str);
+    VIR_DEBUG("parser=%p str=%.*s", parser, (int)l, s);
 
-    VIR_DEBUG("parser=%p str=%s", parser, str);
+    if (!(value = virJSONValueAlloc(parser->arena, VIR_JSON_TYPE_NUMBER)))
+        return 0;
 
-    if (!value)
+    if (!(value->data.number = virJSONValueStrndup(parser->arena, s, l))) {
+        virJSONValueFree(value);
         return 0;
+    }
 
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
@@ -1430,14 +1754,20 @@ virJSONParserHandleString(void *ctx,
                           yajl_size_t stringLen)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewStringLen((const char *)stringVal,
-                                                     stringLen);
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p str=%p", parser, (const char *)stringVal);
 
-    if (!value)
+    if (!(value = virJSONValueAlloc(parser->arena, VIR_JSON_TYPE_STRING)))
         return 0;
 
+    if (!(value->data.string = virJSONValueStrndup(parser->arena,
+                                                   (const char *)stringVal,
+                                                   stringLen))) {
+        virJSONValueFree(value);
+        return 0;
+    }
+
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
         return 0;
@@ -1463,7 +1793,9 @@ virJSONParserHandleMapKey(void *ctx,
     state = &parser->state[parser->nstate-1];
     if (state->key)
         return 0;
-    if (VIR_STRNDUP(state->key, (const char *)stringVal, stringLen) < 0)
+    if (!(state->key = virJSONValueStrndup(parser->arena,
+                                           (const char *)stringVal,
+                                           stringLen)))
         return 0;
     return 1;
 }
@@ -1473,7 +1805,8 @@ static int
 virJSONParserHandleStartMap(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewObject();
+    virJSONValuePtr value = virJSONValueAlloc(parser->arena,
+                                              VIR_JSON_TYPE_OBJECT);
 
     VIR_DEBUG("parser=%p", parser);
 
@@ -1511,7 +1844,7 @@ virJSONParserHandleEndMap(void *ctx)
 
     state = &(parser->state[parser->nstate-1]);
     if (state->key) {
-        VIR_FREE(state->key);
+        virJSONParserFreeKey(parser, &state->key);
         return 0;
     }
 
@@ -1525,7 +1858,8 @@ static int
 virJSONParserHandleStartArray(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewArray();
+    virJSONValuePtr value = virJSONValueAlloc(parser->arena,
+                                              VIR_JSON_TYPE_ARRAY);
 
     VIR_DEBUG("parser=%p", parser);
 
@@ -1562,7 +1896,7 @@ virJSONParserHandleEndArray(void *ctx)
 
     state = &(parser->state[parser->nstate-1]);
     if (state->key) {
-        VIR_FREE(state->key);
+        virJSONParserFreeKey(parser, &state->key);
         return 0;
     }
 
@@ -1587,12 +1921,22 @@ static const yajl_callbacks parserCallbacks = {
 };
 
 
-/* XXX add an incremental streaming parser - yajl trivially supports it */
-virJSONValuePtr
-virJSONValueFromString(const char *jsonstring)
+static virJSONArenaPtr
+virJSONArenaNew(void)
 {
-    yajl_handle hand;
-    virJSONParser parser = { NULL, NULL, 0, 0 };
+    virJSONArenaPtr arena;
+
+    ignore_value(VIR_ALLOC(arena));
+    return arena;
+}
+
+
+static virJSONValuePtr
+virJSONValueFromStringInternal(const char *jsonstring,
+                               bool useArena)
+{
+    yajl_handle hand = NULL;
+    virJSONParser parser = { NULL, NULL, 0, 0, NULL };
     virJSONValuePtr ret = NULL;
     int rc;
     size_t len = strlen(jsonstring);
@@ -1603,6 +1947,9 @@ virJSONValueFromString(const char *jsonstring)
 
     VIR_DEBUG("string=%s", jsonstring);
 
+    if (useArena && !(parser.arena = virJSONArenaNew()))
+        return NULL;
+
 # ifdef WITH_YAJL2
     hand = yajl_alloc(&parserCallbacks, NULL, &parser);
 # else
@@ -1660,6 +2007,8 @@ virJSONValueFromString(const char *jsonstring)
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("cannot parse json %s: too many items present"),
                            jsonstring);
+        else if (parser.arena)
+            ret = virJSONValueArrayGet(tmp, 0);
         else
             ret = virJSONValueArraySteal(tmp, 0);
         virJSONValueFree(tmp);
@@ -1667,21 +2016,614 @@ virJSONValueFromString(const char *jsonstring)
     }
 
  cleanup:
-    yajl_free(hand);
+    if (hand)
+        yajl_free(hand);
 
     if (parser.nstate) {
         size_t i;
         for (i = 0; i < parser.nstate; i++)
-            VIR_FREE(parser.state[i].key);
+            virJSONParserFreeKey(&parser, &parser.state[i].key);
         VIR_FREE(parser.state);
     }
 
+    if (parser.arena) {
+        if (ret) {
+            parser.arena->refs = 1;
+            ret->root = true;
+        } else {
+            virJSONArenaFree(parser.arena);
+        }
+    }
+
     VIR_DEBUG("result=%p", ret);
 
     return ret;
 }
 
 
+virJSONValuePtr
+virJSONValueFromString(const char *jsonstring)
+{
+    return virJSONValueFromStringInternal(jsonstring, false);
+}
+
+
+/**
+ * virJSONValueFromStringArena:
+ * @jsonstring: the document to parse
+ *
+ * Like virJSONValueFromString, except that the whole tree is allocated
+ * from a single arena which is released at once by virJSONValueFree on
+ * the returned value.  Members of the tree can not be freed on their
+ * own and can not be inserted into a different tree.  Values handed out
+ * by virJSONValueObjectRemoveKey and virJSONValueArraySteal share the
+ * arena and keep it around until they are freed too, so they must not
+ * be modified by one thread while another one modifies the rest of the
+ * tree.  Suitable for short lived documents which are mostly read, such
+ * as monitor replies.
+ *
+ * Returns the parsed value or NULL on error.
+ */
+virJSONValuePtr
+virJSONValueFromStringArena(const char *jsonstring)
+{
+    return virJSONValueFromStringInternal(jsonstring, true);
+}
+
+
+/*
+ * Incremental parsing: the document is fed in arbitrary chunks and
+ * only the values at paths somebody subscribed to are built, each
+ * of them handed over as soon as it is complete.
+ */
+typedef struct _virJSONStreamParserSub virJSONStreamParserSub;
+typedef virJSONStreamParserSub *virJSONStreamParserSubPtr;
+struct _virJSONStreamParserSub {
+    char *path;
+    char **keys;    /* one per component of @path, NULL for "[*]" */
+    size_t nkeys;
+    virJSONStreamParserCallback cb;
+    void *opaque;
+};
+
+/* A container enclosing the current position */
+typedef struct _virJSONStreamParserFrame virJSONStreamParserFrame;
+typedef virJSONStreamParserFrame *virJSONStreamParserFramePtr;
+struct _virJSONStreamParserFrame {
+    bool array;
+    char *key;      /* of the value being parsed, objects only */
+};
+
+struct _virJSONStreamParser {
+    yajl_handle hand;
+
+    virJSONStreamParserSubPtr subs;
+    size_t nsubs;
+
+    /* Containers outside of any subscribed value */
+    virJSONStreamParserFramePtr frames;
+    size_t nframes;
+
+    /* Builds the value of @active while inside of it */
+    virJSONParser tree;
+    virJSONStreamParserSubPtr active;
+
+    bool failed;    /* a callback failed and reported an error */
+};
+
+
+static virJSONStreamParserSubPtr
+virJSONStreamParserMatch(virJSONStreamParserPtr parser)
+{
+    size_t i, j;
+
+    for (i = 0; i < parser->nsubs; i++) {
+        virJSONStreamParserSubPtr sub = &parser->subs[i];
+
+        if (sub->nkeys != parser->nframes)
+            continue;
+
+        for (j = 0; j < sub->nkeys; j++) {
+            virJSONStreamParserFramePtr frame = &parser->frames[j];
+
+            if (sub->keys[j]) {
+                if (frame->array || STRNEQ_NULLABLE(frame->key, sub->keys[j]))
+                    break;
+            } else if (!frame->array) {
+                break;
+            }
+        }
+
+        if (j == sub->nkeys)
+            return sub;
+    }
+
+    return NULL;
+}
+
+
+/* Done with a value in the innermost container */
+static int
+virJSONStreamParserNext(virJSONStreamParserPtr parser)
+{
+    if (parser->nframes)
+        VIR_FREE(parser->frames[parser->nframes - 1].key);
+    return 1;
+}
+
+
+static int
+virJSONStreamParserDeliver(virJSONStreamParserPtr parser,
+                           virJSONStreamParserSubPtr sub,
+                           virJSONValuePtr value)
+{
+    if (!value) {
+        /* Building the value normally reported OOM already */
+        if (!virGetLastError())
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("cannot build the value of '%s'"), sub->path);
+        parser->failed = true;
+        return 0;
+    }
+
+    if (sub->cb(sub->path, value, sub->opaque) < 0) {
+        parser->failed = true;
+        return 0;
+    }
+
+    return virJSONStreamParserNext(parser);
+}
+
+
+static int
+virJSONStreamParserPush(virJSONStreamParserPtr parser,
+                        bool array)
+{
+    virJSONStreamParserFrame frame = { .array = array };
+
+    if (VIR_APPEND_ELEMENT(parser->frames, parser->nframes, frame) < 0)
+        return 0;
+    return 1;
+}
+
+
+static int
+virJSONStreamParserPop(virJSONStreamParserPtr parser,
+                       bool array)
+{
+    virJSONStreamParserFramePtr frame;
+
+    if (!parser->nframes)
+        return 0;
+
+    frame = &parser->frames[parser->nframes - 1];
+    if (frame->array != array || frame->key)
+        return 0;
+
+    VIR_DELETE_ELEMENT(parser->frames, parser->nframes - 1, parser->nframes);
+    return virJSONStreamParserNext(parser);
+}
+
+
+static int
+virJSONStreamParserHandleNull(void *ctx)
+{
+    virJSONStreamParserPtr parser = ctx;
+    virJSONStreamParserSubPtr sub;
+
+    if (parser->tree.nstate)
+        return virJSONParserHandleNull(&parser->tree);
+
+    if (!(sub = virJSONStreamParserMatch(parser)))
+        return virJSONStreamParserNext(parser);
+
+    return virJSONStreamParserDeliver(parser, sub, virJSONValueNewNull());
+}
+
+
+static int
+virJSONStreamParserHandleBoolean(void *ctx,
+                                 int boolean_)
+{
+    virJSONStreamParserPtr parser = ctx;
+    virJSONStreamParserSubPtr sub;
+
+    if (parser->tree.nstate)
+        return virJSONParserHandleBoolean(&parser->tree, boolean_);
+
+    if (!(sub = virJSONStreamParserMatch(parser)))
+        return virJSONStreamParserNext(parser);
+
+    return virJSONStreamParserDeliver(parser, sub,
+                                      virJSONValueNewBoolean(boolean_));
+}
+
+
+static int
+virJSONStreamParserHandleNumber(void *ctx,
+                                const char *s,
+                                yajl_size_t l)
+{
+    virJSONStreamParserPtr parser = ctx;
+    virJSONStreamParserSubPtr sub;
+    virJSONValuePtr value;
+    char *str;
+
+    if (parser->tree.nstate)
+        return virJSONParserHandleNumber(&parser->tree, s, l);
+
+    if (!(sub = virJSONStreamParserMatch(parser)))
+        return virJSONStreamParserNext(parser);
+
+    if (VIR_STRNDUP(str, s, l) < 0) {
+        parser->failed = true;
+        return 0;
+    }
+    value = virJSONValueNewNumber(str);
+    VIR_FREE(str);
+
+    return virJSONStreamParserDeliver(parser, sub, value);
+}
+
+
+static int
+virJSONStreamParserHandleString(void *ctx,
+                                const unsigned char *stringVal,
+                                yajl_size_t stringLen)
+{
+    virJSONStreamParserPtr parser = ctx;
+    virJSONStreamParserSubPtr sub;
+
+    if (parser->tree.nstate)
+        return virJSONParserHandleString(&parser->tree, stringVal, stringLen);
+
+    if (!(sub = virJSONStreamParserMatch(parser)))
+        return virJSONStreamParserNext(parser);
+
+    return virJSONStreamParserDeliver(parser, sub,
+                                      virJSONValueNewStringLen((const char *)stringVal,
+                                                               stringLen));
+}
+
+
+static int
+virJSONStreamParserHandleMapKey(void *ctx,
+                                const unsigned char *stringVal,
+                                yajl_size_t stringLen)
+{
+    virJSONStreamParserPtr parser = ctx;
+    virJSONStreamParserFramePtr frame;
+
+    if (parser->tree.nstate)
+        return virJSONParserHandleMapKey(&parser->tree, stringVal, stringLen);
+
+    if (!parser->nframes)
+        return 0;
+
+    frame = &parser->frames[parser->nframes - 1];
+    if (frame->array || frame->key)
+        return 0;
+    if (VIR_STRNDUP(frame->key, (const char *)stringVal, stringLen) < 0)
+        return 0;
+    return 1;
+}
+
+
+static int
+virJSONStreamParserHandleStartMap(void *ctx)
+{
+    virJSONStreamParserPtr parser = ctx;
+    virJSONStreamParserSubPtr sub;
+
+    if (parser->tree.nstate)
+        return virJSONParserHandleStartMap(&parser->tree);
+
+    if (!(sub = virJSONStreamParserMatch(parser)))
+        return virJSONStreamParserPush(parser, false);
+
+    parser->active = sub;
+    return virJSONParserHandleStartMap(&parser->tree);
+}
+
+
+/* Hand over the value built in @parser->tree once it is complete */
+static int
+virJSONStreamParserEndTree(virJSONStreamParserPtr parser)
+{
+    virJSONValuePtr value;
+
+    if (parser->tree.nstate)
+        return 1;
+
+    value = parser->tree.head;
+    parser->tree.head = NULL;
+    return virJSONStreamParserDeliver(parser, parser->active, value);
+}
+
+
+static int
+virJSONStreamParserHandleEndMap(void *ctx)
+{
+    virJSONStreamParserPtr parser = ctx;
+
+    if (parser->tree.nstate) {
+        if (!virJSONParserHandleEndMap(&parser->tree))
+            return 0;
+        return virJSONStreamParserEndTree(parser);
+    }
+
+    return virJSONStreamParserPop(parser, false);
+}
+
+
+static int
+virJSONStreamParserHandleStartArray(void *ctx)
+{
+    virJSONStreamParserPtr parser = ctx;
+    virJSONStreamParserSubPtr sub;
+
+    if (parser->tree.nstate)
+        return virJSONParserHandleStartArray(&parser->tree);
+
+    if (!(sub = virJSONStreamParserMatch(parser)))
+        return virJSONStreamParserPush(parser, true);
+
+    parser->active = sub;
+    return virJSONParserHandleStartArray(&parser->tree);
+}
+
+
+static int
+virJSONStreamParserHandleEndArray(void *ctx)
+{
+    virJSONStreamParserPtr parser = ctx;
+
+    if (parser->tree.nstate) {
+        if (!virJSONParserHandleEndArray(&parser->tree))
+            return 0;
+        return virJSONStreamParserEndTree(parser);
+    }
+
+    return virJSONStreamParserPop(parser, true);
+}
+
+
+static const yajl_callbacks streamParserCallbacks = {
+    virJSONStreamParserHandleNull,
+    virJSONStreamParserHandleBoolean,
+    NULL,
+    NULL,
+    virJSONStreamParserHandleNumber,
+    virJSONStreamParserHandleString,
+    virJSONStreamParserHandleStartMap,
+    virJSONStreamParserHandleMapKey,
+    virJSONStreamParserHandleEndMap,
+    virJSONStreamParserHandleStartArray,
+    virJSONStreamParserHandleEndArray
+};
+
+
+/**
+ * virJSONStreamParserNew:
+ *
+ * Create a parser which is fed a JSON document piecewise with
+ * virJSONStreamParserFeed. Nothing is built from the document
+ * except for values at the paths registered with
+ * virJSONStreamParserSubscribe.
+ *
+ * Returns the parser or NULL on error.
+ */
+virJSONStreamParserPtr
+virJSONStreamParserNew(void)
+{
+    virJSONStreamParserPtr parser;
+# ifndef WITH_YAJL2
+    yajl_parser_config cfg = { 0, 1 }; /* Match yajl 2 default behavior */
+# endif
+
+    if (VIR_ALLOC(parser) < 0)
+        return NULL;
+
+# ifdef WITH_YAJL2
+    parser->hand = yajl_alloc(&streamParserCallbacks, NULL, parser);
+# else
+    parser->hand = yajl_alloc(&streamParserCallbacks, &cfg, NULL, parser);
+# endif
+    if (!parser->hand) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to create JSON parser"));
+        VIR_FREE(parser);
+        return NULL;
+    }
+
+    return parser;
+}
+
+
+void
+virJSONStreamParserFree(virJSONStreamParserPtr parser)
+{
+    size_t i, j;
+
+    if (!parser)
+        return;
+
+    yajl_free(parser->hand);
+
+    for (i = 0; i < parser->nsubs; i++) {
+        VIR_FREE(parser->subs[i].path);
+        for (j = 0; j < parser->subs[i].nkeys; j++)
+            VIR_FREE(parser->subs[i].keys[j]);
+        VIR_FREE(parser->subs[i].keys);
+    }
+    VIR_FREE(parser->subs);
+
+    for (i = 0; i < parser->nframes; i++)
+        VIR_FREE(parser->frames[i].key);
+    VIR_FREE(parser->frames);
+
+    virJSONValueFree(parser->tree.head);
+    for (i = 0; i < parser->tree.nstate; i++)
+        VIR_FREE(parser->tree.state[i].key);
+    VIR_FREE(parser->tree.state);
+
+    VIR_FREE(parser);
+}
+
+
+/**
+ * virJSONStreamParserSubscribe:
+ * @parser: the parser
+ * @path: which values to report
+ * @cb: function to report them to
+ * @opaque: data for @cb
+ *
+ * Make @parser build every value found at @path and pass it to @cb
+ * as soon as it is complete. @path is a list of object keys separated
+ * by dots, where any element of an array is selected by "[*]", e.g.
+ * "return[*].inserted.file". An empty @path selects the whole
+ * document. Values below a subscribed value are not reported
+ * separately. @cb takes ownership of the value, and if it returns -1
+ * parsing stops with the error @cb reported.
+ *
+ * Subscriptions must be made before feeding the document.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virJSONStreamParserSubscribe(virJSONStreamParserPtr parser,
+                             const char *path,
+                             virJSONStreamParserCallback cb,
+                             void *opaque)
+{
+    virJSONStreamParserSub sub = { .cb = cb, .opaque = opaque };
+    const char *cur = path;
+    size_t i;
+
+    if (VIR_STRDUP(sub.path, path) < 0)
+        goto error;
+
+    while (*cur) {
+        char *key = NULL;
+
+        if (STRPREFIX(cur, "[*]")) {
+            cur += 3;
+        } else {
+            size_t len = strcspn(cur, ".[");
+
+            if (len == 0)
+                goto invalid;
+            if (VIR_STRNDUP(key, cur, len) < 0)
+                goto error;
+            cur += len;
+        }
+
+        if (VIR_APPEND_ELEMENT(sub.keys, sub.nkeys, key) < 0) {
+            VIR_FREE(key);
+            goto error;
+        }
+
+        if (*cur == '.') {
+            cur++;
+            if (!*cur || *cur == '.' || *cur == '[')
+                goto invalid;
+        } else if (*cur && *cur != '[') {
+            goto invalid;
+        }
+    }
+
+    if (VIR_APPEND_ELEMENT(parser->subs, parser->nsubs, sub) < 0)
+        goto error;
+
+    return 0;
+
+ invalid:
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("invalid JSON path '%s'"), path);
+ error:
+    VIR_FREE(sub.path);
+    for (i = 0; i < sub.nkeys; i++)
+        VIR_FREE(sub.keys[i]);
+    VIR_FREE(sub.keys);
+    return -1;
+}
+
+
+static int
+virJSONStreamParserCheck(virJSONStreamParserPtr parser,
+                         int rc)
+{
+    unsigned char *errstr;
+
+    if (VIR_YAJL_STATUS_OK(rc))
+        return 0;
+
+    /* The callback already said what went wrong */
+    if (parser->failed)
+        return -1;
+
+    errstr = yajl_get_error(parser->hand, 0, NULL, 0);
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("cannot parse json: %s"), (const char *) errstr);
+    yajl_free_error(parser->hand, errstr);
+    return -1;
+}
+
+
+/**
+ * virJSONStreamParserFeed:
+ * @parser: the parser
+ * @data: next chunk of the document
+ * @len: length of @data
+ *
+ * Parse @len bytes of @data, which may end anywhere in the document,
+ * and report any subscribed values completed by them.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virJSONStreamParserFeed(virJSONStreamParserPtr parser,
+                        const char *data,
+                        size_t len)
+{
+    if (parser->failed)
+        return -1;
+
+    return virJSONStreamParserCheck(parser,
+                                    yajl_parse(parser->hand,
+                                               (const unsigned char *)data,
+                                               len));
+}
+
+
+/**
+ * virJSONStreamParserFinish:
+ * @parser: the parser
+ *
+ * Tell @parser that the whole document was fed.
+ *
+ * Returns 0 if the document was complete and valid, -1 otherwise.
+ */
+int
+virJSONStreamParserFinish(virJSONStreamParserPtr parser)
+{
+    if (parser->failed)
+        return -1;
+
+    if (virJSONStreamParserCheck(parser,
+                                 yajl_complete_parse(parser->hand)) < 0)
+        return -1;
+
+    if (parser->nframes || parser->tree.nstate) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot parse json: unterminated string/map/array"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virJSONValueToStringOne(virJSONValuePtr object,
                         yajl_gen g)
@@ -1808,6 +2750,62 @@ virJSONValueFromString(const char *jsonstring ATTRIBUTE_UNUSED)
 }
 
 
+virJSONValuePtr
+virJSONValueFromStringArena(const char *jsonstring ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return NULL;
+}
+
+
+virJSONStreamParserPtr
+virJSONStreamParserNew(void)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return NULL;
+}
+
+
+void
+virJSONStreamParserFree(virJSONStreamParserPtr parser ATTRIBUTE_UNUSED)
+{
+}
+
+
+int
+virJSONStreamParserSubscribe(virJSONStreamParserPtr parser ATTRIBUTE_UNUSED,
+                             const char *path ATTRIBUTE_UNUSED,
+                             virJSONStreamParserCallback cb ATTRIBUTE_UNUSED,
+                             void *opaque ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return -1;
+}
+
+
+int
+virJSONStreamParserFeed(virJSONStreamParserPtr parser ATTRIBUTE_UNUSED,
+                        const char *data ATTRIBUTE_UNUSED,
+                        size_t len ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return -1;
+}
+
+
+int
+virJSONStreamParserFinish(virJSONStreamParserPtr parser ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return -1;
+}
+
+
 char *
 virJSONValueToString(virJSONValuePtr object ATTRIBUTE_UNUSED,
                      bool pretty ATTRIBUTE_UNUSED)
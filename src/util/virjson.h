@@ -51,6 +51,9 @@ typedef virJSONObjectPair *virJSONObjectPairPtr;
 typedef struct _virJSONArray virJSONArray;
 typedef virJSONArray *virJSONArrayPtr;
 
+typedef struct _virJSONArena virJSONArena;
+typedef virJSONArena *virJSONArenaPtr;
+
 
 struct _virJSONObjectPair {
     char *key;
@@ -59,17 +62,21 @@ struct _virJSONObjectPair {
 
 struct _virJSONObject {
     size_t npairs;
+    size_t npairs_alloc;
     virJSONObjectPairPtr pairs;
 };
 
 struct _virJSONArray {
     size_t nvalues;
+    size_t nvalues_alloc;
     virJSONValuePtr *values;
 };
 
 struct _virJSONValue {
     int type; /* enum virJSONType */
     bool protect; /* prevents deletion when embedded in another object */
+    virJSONArenaPtr arena; /* the value is part of a tree parsed in one go */
+    bool root; /* holds a reference to @arena, freeing it drops that */
 
     union {
         virJSONObject object;
@@ -160,9 +167,31 @@ int virJSONValueObjectRemoveKey(virJSONValuePtr object, const char *key,
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
 virJSONValuePtr virJSONValueFromString(const char *jsonstring);
+virJSONValuePtr virJSONValueFromStringArena(const char *jsonstring);
 char *virJSONValueToString(virJSONValuePtr object,
                            bool pretty);
 
+typedef struct _virJSONStreamParser virJSONStreamParser;
+typedef virJSONStreamParser *virJSONStreamParserPtr;
+
+typedef int (*virJSONStreamParserCallback)(const char *path,
+                                           virJSONValuePtr value,
+                                           void *opaque);
+
+virJSONStreamParserPtr virJSONStreamParserNew(void);
+void virJSONStreamParserFree(virJSONStreamParserPtr parser);
+int virJSONStreamParserSubscribe(virJSONStreamParserPtr parser,
+                                 const char *path,
+                                 virJSONStreamParserCallback cb,
+                                 void *opaque)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+int virJSONStreamParserFeed(virJSONStreamParserPtr parser,
+                            const char *data,
+                            size_t len)
+    ATTRIBUTE_NONNULL(1);
+int virJSONStreamParserFinish(virJSONStreamParserPtr parser)
+    ATTRIBUTE_NONNULL(1);
+
 typedef int (*virJSONValueObjectIteratorFunc)(const char *key,
                                               const virJSONValue *value,
                                               void *opaque);
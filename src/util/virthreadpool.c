@@ -28,11 +28,16 @@
 
 #include "virthreadpool.h"
 #include "viralloc.h"
+#include "viratomic.h"
 #include "virthread.h"
 #include "virerror.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+/* Jobs without a priority are spread over this many queues
+ * with VIR_THREAD_POOL_WORK_STEALING */
+#define VIR_THREAD_POOL_QUEUES 16
+
 typedef struct _virThreadPoolJob virThreadPoolJob;
 typedef virThreadPoolJob *virThreadPoolJobPtr;
 
@@ -53,9 +58,24 @@ struct _virThreadPoolJobList {
     virThreadPoolJobPtr firstPrio;
 };
 
+/* With VIR_THREAD_POOL_WORK_STEALING, jobs without a priority
+ * are spread round robin over these. Workers go round the queues
+ * the same way, taking the oldest job of the next one or of the
+ * ones after it if it is empty, so no job waits behind a worker
+ * which is busy and the pool mutex is only taken by workers about
+ * to sleep. */
+typedef struct _virThreadPoolQueue virThreadPoolQueue;
+typedef virThreadPoolQueue *virThreadPoolQueuePtr;
+
+struct _virThreadPoolQueue {
+    virMutex lock;
+    virThreadPoolJobList jobList;
+};
+
 
 struct _virThreadPool {
     bool quit;
+    unsigned int flags;
 
     virThreadPoolJobFunc jobFunc;
     const char *jobFuncName;
@@ -77,6 +97,17 @@ struct _virThreadPool {
     size_t nPrioWorkers;
     virThreadPtr prioWorkers;
     virCond prioCond;
+
+    size_t nqueues;
+    virThreadPoolQueuePtr queues;
+
+    /* Read without the mutex by the work stealing code */
+    int quitting;       /* Same as @quit */
+    int spareWorkers;   /* @maxWorkers - @nWorkers */
+    int sleepingWorkers;
+    int queuedJobs;     /* Jobs in @queues */
+    int nextJobQueue;
+    int nextTakeQueue;
 };
 
 struct virThreadPoolWorkerData {
@@ -93,6 +124,53 @@ static inline bool virThreadPoolWorkerQuitHelper(size_t count, size_t limit)
     return count > limit;
 }
 
+static void
+virThreadPoolUpdateSpareLocked(virThreadPoolPtr pool)
+{
+    virAtomicIntSet(&pool->spareWorkers,
+                    (int) pool->maxWorkers - (int) pool->nWorkers);
+}
+
+static void
+virThreadPoolJobListRemove(virThreadPoolJobListPtr jobList,
+                           virThreadPoolJobPtr job)
+{
+    if (job == jobList->firstPrio) {
+        virThreadPoolJobPtr tmp = job->next;
+        while (tmp) {
+            if (tmp->priority)
+                break;
+            tmp = tmp->next;
+        }
+        jobList->firstPrio = tmp;
+    }
+
+    if (job->prev)
+        job->prev->next = job->next;
+    else
+        jobList->head = job->next;
+    if (job->next)
+        job->next->prev = job->prev;
+    else
+        jobList->tail = job->prev;
+}
+
+static void
+virThreadPoolJobListAppend(virThreadPoolJobListPtr jobList,
+                           virThreadPoolJobPtr job)
+{
+    job->prev = jobList->tail;
+    if (jobList->tail)
+        jobList->tail->next = job;
+    jobList->tail = job;
+
+    if (!jobList->head)
+        jobList->head = job;
+
+    if (job->priority && !jobList->firstPrio)
+        jobList->firstPrio = job;
+}
+
 static void virThreadPoolWorker(void *opaque)
 {
     struct virThreadPoolWorkerData *data = opaque;
@@ -142,25 +220,7 @@ static void virThreadPoolWorker(void *opaque)
             job = pool->jobList.head;
         }
 
-        if (job == pool->jobList.firstPrio) {
-            virThreadPoolJobPtr tmp = job->next;
-            while (tmp) {
-                if (tmp->priority)
-                    break;
-                tmp = tmp->next;
-            }
-            pool->jobList.firstPrio = tmp;
-        }
-
-        if (job->prev)
-            job->prev->next = job->next;
-        else
-            pool->jobList.head = job->next;
-        if (job->next)
-            job->next->prev = job->prev;
-        else
-            pool->jobList.tail = job->prev;
-
+        virThreadPoolJobListRemove(&pool->jobList, job);
         pool->jobQueueDepth--;
 
         virMutexUnlock(&pool->mutex);
@@ -174,6 +234,101 @@ static void virThreadPoolWorker(void *opaque)
         pool->nPrioWorkers--;
     else
         pool->nWorkers--;
+    virThreadPoolUpdateSpareLocked(pool);
+    if (pool->nWorkers == 0 && pool->nPrioWorkers == 0)
+        virCondSignal(&pool->quit_cond);
+    virMutexUnlock(&pool->mutex);
+}
+
+/*
+ * Take the oldest job of the next queue in turn, or of the first
+ * one after it which is not empty.
+ */
+static virThreadPoolJobPtr
+virThreadPoolTakeQueuedJob(virThreadPoolPtr pool)
+{
+    unsigned int first;
+    size_t i;
+
+    if (virAtomicIntGet(&pool->queuedJobs) <= 0)
+        return NULL;
+
+    first = virAtomicIntInc(&pool->nextTakeQueue);
+
+    for (i = 0; i < pool->nqueues; i++) {
+        virThreadPoolQueuePtr queue = &pool->queues[(first + i) % pool->nqueues];
+        virThreadPoolJobPtr job;
+
+        virMutexLock(&queue->lock);
+        if ((job = queue->jobList.head))
+            virThreadPoolJobListRemove(&queue->jobList, job);
+        virMutexUnlock(&queue->lock);
+
+        if (job) {
+            virAtomicIntAdd(&pool->queuedJobs, -1);
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+static void virThreadPoolStealingWorker(void *opaque)
+{
+    struct virThreadPoolWorkerData *data = opaque;
+    virThreadPoolPtr pool = data->pool;
+    virThreadPoolJobPtr job;
+
+    VIR_FREE(data);
+
+    while (1) {
+        /* Only go for the mutex if there is nothing queued or
+         * the pool has to shrink */
+        if (!virAtomicIntGet(&pool->quitting) &&
+            virAtomicIntGet(&pool->spareWorkers) >= 0 &&
+            (job = virThreadPoolTakeQueuedJob(pool))) {
+            (pool->jobFunc)(job->data, pool->jobOpaque);
+            VIR_FREE(job);
+            continue;
+        }
+
+        virMutexLock(&pool->mutex);
+
+        if (pool->quit ||
+            virThreadPoolWorkerQuitHelper(pool->nWorkers, pool->maxWorkers))
+            goto out;
+
+        /* Jobs with a priority are kept in the shared list */
+        if ((job = pool->jobList.head)) {
+            virThreadPoolJobListRemove(&pool->jobList, job);
+            pool->jobQueueDepth--;
+
+            virMutexUnlock(&pool->mutex);
+            (pool->jobFunc)(job->data, pool->jobOpaque);
+            VIR_FREE(job);
+            continue;
+        }
+
+        /* Senders look at the number of sleeping workers after
+         * queueing, so we must look at the queues after announcing
+         * that we sleep, or a job could be left behind */
+        pool->freeWorkers++;
+        virAtomicIntInc(&pool->sleepingWorkers);
+        if (virAtomicIntGet(&pool->queuedJobs) <= 0 &&
+            virCondWait(&pool->cond, &pool->mutex) < 0) {
+            virAtomicIntAdd(&pool->sleepingWorkers, -1);
+            pool->freeWorkers--;
+            goto out;
+        }
+        virAtomicIntAdd(&pool->sleepingWorkers, -1);
+        pool->freeWorkers--;
+
+        virMutexUnlock(&pool->mutex);
+    }
+
+ out:
+    pool->nWorkers--;
+    virThreadPoolUpdateSpareLocked(pool);
     if (pool->nWorkers == 0 && pool->nPrioWorkers == 0)
         virCondSignal(&pool->quit_cond);
     virMutexUnlock(&pool->mutex);
@@ -200,6 +355,8 @@ virThreadPoolExpand(virThreadPoolPtr pool, size_t gain, bool priority)
 
         if (virThreadCreateFull(&(*workers)[i],
                                 false,
+                                pool->nqueues && !priority ?
+                                virThreadPoolStealingWorker :
                                 virThreadPoolWorker,
                                 pool->jobFuncName,
                                 true,
@@ -210,10 +367,12 @@ virThreadPoolExpand(virThreadPoolPtr pool, size_t gain, bool priority)
         }
     }
 
+    virThreadPoolUpdateSpareLocked(pool);
     return 0;
 
  error:
     *curWorkers -= gain - i;
+    virThreadPoolUpdateSpareLocked(pool);
     return -1;
 }
 
@@ -223,10 +382,13 @@ virThreadPoolNewFull(size_t minWorkers,
                      size_t prioWorkers,
                      virThreadPoolJobFunc func,
                      const char *funcName,
-                     void *opaque)
+                     void *opaque,
+                     unsigned int flags)
 {
     virThreadPoolPtr pool;
 
+    virCheckFlags(VIR_THREAD_POOL_WORK_STEALING, NULL);
+
     if (minWorkers > maxWorkers)
         minWorkers = maxWorkers;
 
@@ -238,6 +400,7 @@ virThreadPoolNewFull(size_t minWorkers,
     pool->jobFunc = func;
     pool->jobFuncName = funcName;
     pool->jobOpaque = opaque;
+    pool->flags = flags;
 
     if (virMutexInit(&pool->mutex) < 0)
         goto error;
@@ -246,6 +409,21 @@ virThreadPoolNewFull(size_t minWorkers,
     if (virCondInit(&pool->quit_cond) < 0)
         goto error;
 
+    /* The queues are not tied to workers, so the worker limits
+     * can change freely later on */
+    if (flags & VIR_THREAD_POOL_WORK_STEALING) {
+        if (VIR_ALLOC_N(pool->queues, VIR_THREAD_POOL_QUEUES) < 0)
+            goto error;
+
+        for (; pool->nqueues < VIR_THREAD_POOL_QUEUES; pool->nqueues++) {
+            if (virMutexInit(&pool->queues[pool->nqueues].lock) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("Unable to initialize mutex"));
+                goto error;
+            }
+        }
+    }
+
     pool->minWorkers = minWorkers;
     pool->maxWorkers = maxWorkers;
     pool->maxPrioWorkers = prioWorkers;
@@ -273,12 +451,14 @@ void virThreadPoolFree(virThreadPoolPtr pool)
 {
     virThreadPoolJobPtr job;
     bool priority = false;
+    size_t i;
 
     if (!pool)
         return;
 
     virMutexLock(&pool->mutex);
     pool->quit = true;
+    virAtomicIntSet(&pool->quitting, 1);
     if (pool->nWorkers > 0)
         virCondBroadcast(&pool->cond);
     if (pool->nPrioWorkers > 0) {
@@ -294,6 +474,15 @@ void virThreadPoolFree(virThreadPoolPtr pool)
         VIR_FREE(job);
     }
 
+    for (i = 0; i < pool->nqueues; i++) {
+        while ((job = pool->queues[i].jobList.head)) {
+            pool->queues[i].jobList.head = job->next;
+            VIR_FREE(job);
+        }
+        virMutexDestroy(&pool->queues[i].lock);
+    }
+    VIR_FREE(pool->queues);
+
     VIR_FREE(pool->workers);
     virMutexUnlock(&pool->mutex);
     virMutexDestroy(&pool->mutex);
@@ -365,14 +554,73 @@ size_t virThreadPoolGetFreeWorkers(virThreadPoolPtr pool)
 size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool)
 {
     size_t ret;
+    int queued = virAtomicIntGet(&pool->queuedJobs);
 
     virMutexLock(&pool->mutex);
     ret = pool->jobQueueDepth;
     virMutexUnlock(&pool->mutex);
 
+    if (queued > 0)
+        ret += queued;
+
     return ret;
 }
 
+/*
+ * Queue a job without a priority on a work stealing pool. The pool
+ * mutex is only needed if the pool may have to grow or a worker has
+ * to be woken up.
+ */
+static int
+virThreadPoolSendQueuedJob(virThreadPoolPtr pool,
+                           void *jobData)
+{
+    virThreadPoolJobPtr job;
+    virThreadPoolQueuePtr queue;
+    unsigned int n;
+
+    if (virAtomicIntGet(&pool->quitting))
+        return -1;
+
+    if (virAtomicIntGet(&pool->spareWorkers) > 0 &&
+        virAtomicIntGet(&pool->sleepingWorkers) <=
+        virAtomicIntGet(&pool->queuedJobs)) {
+        int ret = 0;
+
+        virMutexLock(&pool->mutex);
+        if ((int) pool->freeWorkers <= virAtomicIntGet(&pool->queuedJobs) &&
+            pool->nWorkers < pool->maxWorkers &&
+            virThreadPoolExpand(pool, 1, false) < 0)
+            ret = -1;
+        virMutexUnlock(&pool->mutex);
+
+        if (ret < 0)
+            return -1;
+    }
+
+    if (VIR_ALLOC(job) < 0)
+        return -1;
+
+    job->data = jobData;
+
+    n = virAtomicIntInc(&pool->nextJobQueue);
+    queue = &pool->queues[n % pool->nqueues];
+
+    virMutexLock(&queue->lock);
+    virThreadPoolJobListAppend(&queue->jobList, job);
+    virMutexUnlock(&queue->lock);
+
+    /* Pairs with the check in virThreadPoolStealingWorker */
+    virAtomicIntInc(&pool->queuedJobs);
+    if (virAtomicIntGet(&pool->sleepingWorkers) > 0) {
+        virMutexLock(&pool->mutex);
+        virCondSignal(&pool->cond);
+        virMutexUnlock(&pool->mutex);
+    }
+
+    return 0;
+}
+
 /*
  * @priority - job priority
  * Return: 0 on success, -1 otherwise
@@ -383,6 +631,9 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
 {
     virThreadPoolJobPtr job;
 
+    if (pool->nqueues && !priority)
+        return virThreadPoolSendQueuedJob(pool, jobData);
+
     virMutexLock(&pool->mutex);
     if (pool->quit)
         goto error;
@@ -398,17 +649,7 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
     job->data = jobData;
     job->priority = priority;
 
-    job->prev = pool->jobList.tail;
-    if (pool->jobList.tail)
-        pool->jobList.tail->next = job;
-    pool->jobList.tail = job;
-
-    if (!pool->jobList.head)
-        pool->jobList.head = job;
-
-    if (priority && !pool->jobList.firstPrio)
-        pool->jobList.firstPrio = job;
-
+    virThreadPoolJobListAppend(&pool->jobList, job);
     pool->jobQueueDepth++;
 
     virCondSignal(&pool->cond);
@@ -452,6 +693,7 @@ virThreadPoolSetParameters(virThreadPoolPtr pool,
 
     if (maxWorkers >= 0) {
         pool->maxWorkers = maxWorkers;
+        virThreadPoolUpdateSpareLocked(pool);
         virCondBroadcast(&pool->cond);
     }
 
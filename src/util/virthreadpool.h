@@ -33,15 +33,26 @@ typedef virThreadPool *virThreadPoolPtr;
 
 typedef void (*virThreadPoolJobFunc)(void *jobdata, void *opaque);
 
+typedef enum {
+    /* Spread jobs without a priority over several queues
+     * instead of a single list. Jobs start roughly, but no
+     * longer exactly, in the order they were sent. */
+    VIR_THREAD_POOL_WORK_STEALING = (1 << 0),
+} virThreadPoolFlags;
+
 # define virThreadPoolNew(min, max, prio, func, opaque) \
-    virThreadPoolNewFull(min, max, prio, func, #func, opaque)
+    virThreadPoolNewFull(min, max, prio, func, #func, opaque, 0)
+
+# define virThreadPoolNewFlags(min, max, prio, func, opaque, flags) \
+    virThreadPoolNewFull(min, max, prio, func, #func, opaque, flags)
 
 virThreadPoolPtr virThreadPoolNewFull(size_t minWorkers,
                                       size_t maxWorkers,
                                       size_t prioWorkers,
                                       virThreadPoolJobFunc func,
                                       const char *funcName,
-                                      void *opaque) ATTRIBUTE_NONNULL(4);
+                                      void *opaque,
+                                      unsigned int flags) ATTRIBUTE_NONNULL(4);
 
 size_t virThreadPoolGetMinWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetMaxWorkers(virThreadPoolPtr pool);
@@ -22,22 +22,29 @@
 
 #include <config.h>
 
+#include <fcntl.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <time.h>
+#include <sys/resource.h>
 
 #include "testutils.h"
 #include "internal.h"
+#include "viralloc.h"
 #include "virfile.h"
 #include "virthread.h"
 #include "virlog.h"
 #include "virutil.h"
 #include "vireventpoll.h"
 
+#define VIR_FROM_THIS VIR_FROM_NONE
+
 VIR_LOG_INIT("tests.eventtest");
 
 #define NUM_FDS 31
 #define NUM_TIME 31
+#define NUM_IDLE_FDS 10000
+#define NUM_IDLE_ITERATIONS 1000
 
 static struct handleInfo {
     int pipeFD[2];
@@ -149,6 +156,389 @@ testTimer(int timer, void *data)
         virEventPollRemoveTimeout(info->delete);
 }
 
+static void
+testIdleReader(int watch ATTRIBUTE_UNUSED,
+               int fd ATTRIBUTE_UNUSED,
+               int events ATTRIBUTE_UNUSED,
+               void *data)
+{
+    int *fired = data;
+    (*fired)++;
+}
+
+
+static void
+testCountingReader(int watch ATTRIBUTE_UNUSED,
+                   int fd,
+                   int events ATTRIBUTE_UNUSED,
+                   void *data)
+{
+    int *count = data;
+    char one;
+
+    if (read(fd, &one, 1) == 1)
+        (*count)++;
+}
+
+
+/*
+ * Measure the latency of dispatching a single active handle
+ * while a large number of idle handles is registered too.
+ * Must be called while the event thread is parked.
+ */
+static int
+testDispatchIdle(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct rlimit rlim;
+    int idlePipe[2] = { -1, -1 };
+    int activePipe[2] = { -1, -1 };
+    int *idleFDs = NULL;
+    int *idleWatches = NULL;
+    int activeWatch = -1;
+    int idleFired = 0;
+    int count = 0;
+    char one = '1';
+    struct timespec start, end;
+    unsigned long long elapsed;
+    size_t nidle = 0;
+    size_t i;
+    int ret = -1;
+
+    if (getrlimit(RLIMIT_NOFILE, &rlim) < 0)
+        return EXIT_AM_SKIP;
+    if (rlim.rlim_cur < NUM_IDLE_FDS + 100) {
+        if (rlim.rlim_max != RLIM_INFINITY &&
+            rlim.rlim_max < NUM_IDLE_FDS + 100)
+            return EXIT_AM_SKIP;
+        rlim.rlim_cur = NUM_IDLE_FDS + 100;
+        if (setrlimit(RLIMIT_NOFILE, &rlim) < 0)
+            return EXIT_AM_SKIP;
+    }
+
+    if (VIR_ALLOC_N(idleFDs, NUM_IDLE_FDS) < 0 ||
+        VIR_ALLOC_N(idleWatches, NUM_IDLE_FDS) < 0)
+        goto cleanup;
+
+    if (pipe(idlePipe) < 0 || pipe(activePipe) < 0)
+        goto cleanup;
+
+    /* Nothing is ever written to the idle pipe, so all the
+     * duplicates of its read end stay quiet */
+    for (nidle = 0; nidle < NUM_IDLE_FDS; nidle++) {
+        if ((idleFDs[nidle] = dup(idlePipe[0])) < 0)
+            goto cleanup;
+        if ((idleWatches[nidle] =
+             virEventPollAddHandle(idleFDs[nidle],
+                                   VIR_EVENT_HANDLE_READABLE,
+                                   testIdleReader,
+                                   &idleFired, NULL)) < 0) {
+            VIR_FORCE_CLOSE(idleFDs[nidle]);
+            goto cleanup;
+        }
+    }
+
+    if ((activeWatch = virEventPollAddHandle(activePipe[0],
+                                             VIR_EVENT_HANDLE_READABLE,
+                                             testCountingReader,
+                                             &count, NULL)) < 0)
+        goto cleanup;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < NUM_IDLE_ITERATIONS; i++) {
+        if (safewrite(activePipe[1], &one, 1) != 1 ||
+            virEventPollRunOnce() < 0)
+            goto cleanup;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (idleFired || count != NUM_IDLE_ITERATIONS) {
+        fprintf(stderr, "Expected %d active and no idle events, "
+                "got %d and %d\n", NUM_IDLE_ITERATIONS, count, idleFired);
+        goto cleanup;
+    }
+
+    elapsed = (end.tv_sec - start.tv_sec) * 1000000000ull +
+        end.tv_nsec - start.tv_nsec;
+    VIR_TEST_VERBOSE("\n%d iterations with %d idle handles: "
+                     "%llu ns per dispatch\n",
+                     NUM_IDLE_ITERATIONS, NUM_IDLE_FDS,
+                     elapsed / NUM_IDLE_ITERATIONS);
+
+    ret = 0;
+
+ cleanup:
+    if (activeWatch > 0)
+        virEventPollRemoveHandle(activeWatch);
+    for (i = 0; i < nidle; i++) {
+        virEventPollRemoveHandle(idleWatches[i]);
+        VIR_FORCE_CLOSE(idleFDs[i]);
+    }
+    VIR_FORCE_CLOSE(idlePipe[0]);
+    VIR_FORCE_CLOSE(idlePipe[1]);
+    VIR_FORCE_CLOSE(activePipe[0]);
+    VIR_FORCE_CLOSE(activePipe[1]);
+    VIR_FREE(idleFDs);
+    VIR_FREE(idleWatches);
+    return ret;
+}
+
+
+struct testLoopData {
+    virEventPollLoopPtr loop;
+    virMutex lock;
+    virCond cond;
+    bool quit;
+    unsigned long long thread;
+    int fired;
+    int freed;
+};
+
+
+static void
+testLoopThread(void *opaque)
+{
+    struct testLoopData *data = opaque;
+
+    virMutexLock(&data->lock);
+    while (!data->quit) {
+        virMutexUnlock(&data->lock);
+        ignore_value(virEventPollLoopRunOnce(data->loop));
+        virMutexLock(&data->lock);
+    }
+    virMutexUnlock(&data->lock);
+}
+
+
+static void
+testLoopReader(int watch ATTRIBUTE_UNUSED,
+               int fd,
+               int events ATTRIBUTE_UNUSED,
+               void *opaque)
+{
+    struct testLoopData *data = opaque;
+    char one;
+
+    ignore_value(saferead(fd, &one, 1));
+
+    virMutexLock(&data->lock);
+    data->fired++;
+    data->thread = virThreadSelfID();
+    virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+static void
+testLoopQuit(int timer ATTRIBUTE_UNUSED,
+             void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+
+static void
+testLoopFree(void *opaque)
+{
+    struct testLoopData *data = opaque;
+
+    data->freed++;
+}
+
+
+/*
+ * A loop of its own must dispatch its handles in the thread
+ * running it, no matter which thread registered them, and
+ * free whatever is left registered when it goes away.
+ */
+static int
+testSeparateLoop(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testLoopData data;
+    virThread thread;
+    bool running = false;
+    int fds[2] = { -1, -1 };
+    char one = '1';
+    int timer = -1;
+    int ret = -1;
+
+    memset(&data, 0, sizeof(data));
+    if (virMutexInit(&data.lock) < 0)
+        return -1;
+    if (virCondInit(&data.cond) < 0) {
+        virMutexDestroy(&data.lock);
+        return -1;
+    }
+
+    /* Arming the timer makes sure the thread notices it has
+     * to quit, even if it is not waiting in the loop yet */
+    if (pipe(fds) < 0 ||
+        !(data.loop = virEventPollLoopNew()) ||
+        (timer = virEventPollLoopAddTimeout(data.loop, -1, testLoopQuit,
+                                            NULL, NULL)) < 0)
+        goto cleanup;
+
+    if (virThreadCreate(&thread, true, testLoopThread, &data) < 0)
+        goto cleanup;
+    running = true;
+
+    if (virEventPollLoopAddHandle(data.loop, fds[0],
+                                  VIR_EVENT_HANDLE_READABLE,
+                                  testLoopReader, &data,
+                                  testLoopFree) < 0 ||
+        safewrite(fds[1], &one, 1) != 1)
+        goto cleanup;
+
+    virMutexLock(&data.lock);
+    while (!data.fired) {
+        if (virCondWait(&data.cond, &data.lock) < 0) {
+            virMutexUnlock(&data.lock);
+            goto cleanup;
+        }
+    }
+    virMutexUnlock(&data.lock);
+
+    if (data.thread != virThreadID(&thread)) {
+        fprintf(stderr, "Handle was dispatched by the wrong thread\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (running) {
+        virMutexLock(&data.lock);
+        data.quit = true;
+        virEventPollLoopUpdateTimeout(data.loop, timer, 0);
+        virMutexUnlock(&data.lock);
+        virThreadJoin(&thread);
+    }
+    virEventPollLoopFree(data.loop);
+    if (ret == 0 && data.freed != 1) {
+        fprintf(stderr, "Free callback ran %d times\n", data.freed);
+        ret = -1;
+    }
+    VIR_FORCE_CLOSE(fds[0]);
+    VIR_FORCE_CLOSE(fds[1]);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+/*
+ * Callers may close an FD before removing its watch. Once the FD
+ * number is reused by a new watch, removing the old watch must not
+ * drop the registration of the new one.
+ */
+static int
+testReusedFD(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virEventPollLoopPtr loop = NULL;
+    int oldPipe[2] = { -1, -1 };
+    int newPipe[2] = { -1, -1 };
+    int reused = -1;
+    int oldWatch = -1;
+    int oldCount = 0;
+    int newCount = 0;
+    char one = '1';
+    size_t i;
+    int ret = -1;
+
+    /* The timer keeps every iteration from blocking */
+    if (pipe(oldPipe) < 0 || pipe(newPipe) < 0 ||
+        !(loop = virEventPollLoopNew()) ||
+        virEventPollLoopAddTimeout(loop, 0, testLoopQuit, NULL, NULL) < 0)
+        goto cleanup;
+
+    if ((oldWatch = virEventPollLoopAddHandle(loop, oldPipe[0],
+                                              VIR_EVENT_HANDLE_READABLE,
+                                              testCountingReader,
+                                              &oldCount, NULL)) < 0)
+        goto cleanup;
+
+    reused = oldPipe[0];
+    if (dup2(newPipe[0], reused) < 0) {
+        reused = -1;
+        goto cleanup;
+    }
+    oldPipe[0] = -1;
+
+    if (virEventPollLoopAddHandle(loop, reused,
+                                  VIR_EVENT_HANDLE_READABLE,
+                                  testCountingReader,
+                                  &newCount, NULL) < 0)
+        goto cleanup;
+
+    if (virEventPollLoopRemoveHandle(loop, oldWatch) < 0 ||
+        safewrite(newPipe[1], &one, 1) != 1)
+        goto cleanup;
+
+    for (i = 0; i < 3 && !newCount; i++) {
+        if (virEventPollLoopRunOnce(loop) < 0)
+            goto cleanup;
+    }
+
+    if (oldCount || newCount != 1) {
+        fprintf(stderr, "Expected 0 old and 1 new events, got %d and %d\n",
+                oldCount, newCount);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virEventPollLoopFree(loop);
+    VIR_FORCE_CLOSE(reused);
+    VIR_FORCE_CLOSE(oldPipe[0]);
+    VIR_FORCE_CLOSE(oldPipe[1]);
+    VIR_FORCE_CLOSE(newPipe[0]);
+    VIR_FORCE_CLOSE(newPipe[1]);
+    return ret;
+}
+
+
+/*
+ * epoll refuses regular files, which poll() reports as always
+ * ready. Watching one must work all the same and report it ready
+ * on every run of the loop.
+ */
+static int
+testRegularFile(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virEventPollLoopPtr loop = NULL;
+    int fd = -1;
+    int count = 0;
+    size_t i;
+    int ret = -1;
+
+    if ((fd = open(abs_srcdir "/eventtest.c", O_RDONLY)) < 0 ||
+        !(loop = virEventPollLoopNew()))
+        goto cleanup;
+
+    if (virEventPollLoopAddHandle(loop, fd, VIR_EVENT_HANDLE_READABLE,
+                                  testCountingReader, &count, NULL) < 0) {
+        fprintf(stderr, "Unable to watch a regular file\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (virEventPollLoopRunOnce(loop) < 0)
+            goto cleanup;
+    }
+
+    if (count != 3) {
+        fprintf(stderr, "Expected 3 events, got %d\n", count);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virEventPollLoopFree(loop);
+    VIR_FORCE_CLOSE(fd);
+    return ret;
+}
+
+
 static pthread_mutex_t eventThreadMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t eventThreadRunCond = PTHREAD_COND_INITIALIZER;
 static int eventThreadRunOnce;
@@ -506,6 +896,21 @@ mymain(void)
     if (finishJob("Write duplicate", 1, -1) != EXIT_SUCCESS)
         return EXIT_FAILURE;
 
+    /* The event thread is parked until the next startJob(),
+     * so we can drive the loop directly from here */
+    if (virTestRun("Dispatch with idle handles",
+                   testDispatchIdle, NULL) < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("Separate loop", testSeparateLoop, NULL) < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("Reused FD", testReusedFD, NULL) < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("Regular file", testRegularFile, NULL) < 0)
+        return EXIT_FAILURE;
+
     //pthread_kill(eventThread, SIGTERM);
 
     return EXIT_SUCCESS;
@@ -6,9 +6,13 @@
 #include <time.h>
 
 #include "internal.h"
+#include "virbuffer.h"
 #include "virjson.h"
+#include "virstring.h"
 #include "testutils.h"
 
+#define VIR_FROM_THIS VIR_FROM_NONE
+
 struct testInfo {
     const char *doc;
     const char *expect;
@@ -311,6 +315,367 @@ testJSONCopy(const void *data)
 }
 
 
+struct testStreamInfo {
+    const char *doc;
+    const char *path;
+    const char *expect;
+    bool pass;
+};
+
+
+static int
+testJSONStreamCallback(const char *path ATTRIBUTE_UNUSED,
+                       virJSONValuePtr value,
+                       void *opaque)
+{
+    virBufferPtr buf = opaque;
+    char *str;
+
+    str = virJSONValueToString(value, false);
+    virJSONValueFree(value);
+    if (!str)
+        return -1;
+
+    virBufferAsprintf(buf, "%s;", str);
+    VIR_FREE(str);
+    return 0;
+}
+
+
+/*
+ * Feed @doc in chunks of @chunk bytes and collect the values
+ * reported for @path, separated by semicolons.
+ */
+static char *
+testJSONStreamParseChunked(const struct testStreamInfo *info,
+                           size_t chunk)
+{
+    virJSONStreamParserPtr parser;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t len = strlen(info->doc);
+    size_t off;
+    char *ret = NULL;
+
+    if (!(parser = virJSONStreamParserNew()) ||
+        virJSONStreamParserSubscribe(parser, info->path,
+                                     testJSONStreamCallback, &buf) < 0)
+        goto cleanup;
+
+    for (off = 0; off < len; off += chunk) {
+        if (virJSONStreamParserFeed(parser, info->doc + off,
+                                    MIN(chunk, len - off)) < 0)
+            goto cleanup;
+    }
+
+    if (virJSONStreamParserFinish(parser) < 0)
+        goto cleanup;
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+
+    /* Nothing matching leaves the buffer unallocated */
+    if (!(ret = virBufferContentAndReset(&buf)))
+        ignore_value(VIR_STRDUP(ret, ""));
+
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    virJSONStreamParserFree(parser);
+    return ret;
+}
+
+
+static int
+testJSONStreamParse(const void *data)
+{
+    const struct testStreamInfo *info = data;
+    size_t chunks[] = { 1, 7, strlen(info->doc) };
+    size_t i;
+    char *result = NULL;
+
+    for (i = 0; i < ARRAY_CARDINALITY(chunks); i++) {
+        result = testJSONStreamParseChunked(info, chunks[i]);
+
+        if (!info->pass) {
+            if (result) {
+                VIR_TEST_VERBOSE("Should not have parsed %s\n", info->doc);
+                VIR_FREE(result);
+                return -1;
+            }
+            continue;
+        }
+
+        if (!result) {
+            VIR_TEST_VERBOSE("Fail to parse %s in chunks of %zu\n",
+                             info->doc, chunks[i]);
+            return -1;
+        }
+
+        if (STRNEQ(info->expect, result)) {
+            virTestDifference(stderr, info->expect, result);
+            VIR_FREE(result);
+            return -1;
+        }
+        VIR_FREE(result);
+    }
+
+    return 0;
+}
+
+
+/* Apply the same changes to a tree, whichever way it was allocated */
+static int
+testJSONArenaModify(virJSONValuePtr json,
+                    virJSONValuePtr *removed)
+{
+    const char *key;
+    char *name = NULL;
+    int ret = -1;
+
+    if (virJSONValueIsArray(json)) {
+        if (!(*removed = virJSONValueArraySteal(json, 0)) ||
+            virJSONValueArrayAppend(json, virJSONValueNewString("foo")) < 0)
+            return -1;
+        return 0;
+    }
+
+    if (!(key = virJSONValueObjectGetKey(json, 0)) ||
+        VIR_STRDUP(name, key) < 0)
+        return -1;
+
+    if (virJSONValueObjectRemoveKey(json, name, removed) != 1 ||
+        virJSONValueObjectAppendString(json, "newname", "foo") < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(name);
+    return ret;
+}
+
+
+static int
+testJSONArena(const void *data)
+{
+    const struct testInfo *info = data;
+    virJSONValuePtr json = NULL;
+    virJSONValuePtr arena = NULL;
+    virJSONValuePtr removed = NULL;
+    virJSONValuePtr arenaRemoved = NULL;
+    char *result = NULL;
+    char *arenaResult = NULL;
+    int ret = -1;
+
+    if (!(json = virJSONValueFromString(info->doc)) ||
+        !(arena = virJSONValueFromStringArena(info->doc))) {
+        VIR_TEST_VERBOSE("Fail to parse %s\n", info->doc);
+        goto cleanup;
+    }
+
+    if (!(result = virJSONValueToString(json, false)) ||
+        !(arenaResult = virJSONValueToString(arena, false)))
+        goto cleanup;
+
+    if (STRNEQ(result, arenaResult)) {
+        virTestDifference(stderr, result, arenaResult);
+        goto cleanup;
+    }
+
+    VIR_FREE(result);
+    VIR_FREE(arenaResult);
+
+    if (testJSONArenaModify(json, &removed) < 0 ||
+        testJSONArenaModify(arena, &arenaRemoved) < 0) {
+        VIR_TEST_VERBOSE("Fail to modify %s\n", info->doc);
+        goto cleanup;
+    }
+
+    if (!(result = virJSONValueToString(json, false)) ||
+        !(arenaResult = virJSONValueToString(arena, false)))
+        goto cleanup;
+
+    if (STRNEQ(result, arenaResult)) {
+        virTestDifference(stderr, result, arenaResult);
+        goto cleanup;
+    }
+
+    VIR_FREE(result);
+    VIR_FREE(arenaResult);
+
+    /* Values taken out of the tree must outlive the arena */
+    virJSONValueFree(arena);
+    arena = NULL;
+
+    if (!(result = virJSONValueToString(removed, false)) ||
+        !(arenaResult = virJSONValueToString(arenaRemoved, false)))
+        goto cleanup;
+
+    if (STRNEQ(result, arenaResult)) {
+        virTestDifference(stderr, result, arenaResult);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(result);
+    VIR_FREE(arenaResult);
+    virJSONValueFree(json);
+    virJSONValueFree(arena);
+    virJSONValueFree(removed);
+    virJSONValueFree(arenaRemoved);
+    return ret;
+}
+
+
+/*
+ * Values taken out of an arena tree are handed out as they are and
+ * can be moved into other trees, members still in a tree can not.
+ */
+static int
+testJSONArenaShare(const void *data ATTRIBUTE_UNUSED)
+{
+    virJSONValuePtr src = NULL;
+    virJSONValuePtr dst = NULL;
+    virJSONValuePtr heap = NULL;
+    virJSONValuePtr member;
+    virJSONValuePtr taken = NULL;
+    char *result = NULL;
+    int ret = -1;
+
+    if (!(src = virJSONValueFromStringArena("{\"a\": [1, 2], "
+                                            "\"b\": {\"c\": 3}}")) ||
+        !(dst = virJSONValueFromStringArena("{\"d\": []}")) ||
+        !(heap = virJSONValueNewObject()))
+        goto cleanup;
+
+    if (!(member = virJSONValueObjectGet(src, "a")))
+        goto cleanup;
+
+    if (virJSONValueObjectAppend(dst, "a", member) == 0 ||
+        virJSONValueObjectAppend(heap, "a", member) == 0) {
+        VIR_TEST_VERBOSE("member of a different tree was inserted\n");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    if (virJSONValueObjectRemoveKey(src, "a", &taken) != 1)
+        goto cleanup;
+    if (taken != member) {
+        VIR_TEST_VERBOSE("removed value was copied\n");
+        goto cleanup;
+    }
+    if (virJSONValueObjectAppend(dst, "a", taken) < 0)
+        goto cleanup;
+    taken = NULL;
+
+    if (virJSONValueObjectRemoveKey(src, "b", &taken) != 1 ||
+        virJSONValueObjectAppend(heap, "b", taken) < 0)
+        goto cleanup;
+    taken = NULL;
+
+    /* Both trees now refer to the arena of @src */
+    virJSONValueFree(src);
+    src = NULL;
+
+    if (!(result = virJSONValueToString(dst, false)))
+        goto cleanup;
+    if (STRNEQ(result, "{\"d\":[],\"a\":[1,2]}")) {
+        virTestDifference(stderr, "{\"d\":[],\"a\":[1,2]}", result);
+        goto cleanup;
+    }
+    VIR_FREE(result);
+
+    virJSONValueFree(dst);
+    dst = NULL;
+
+    if (!(result = virJSONValueToString(heap, false)))
+        goto cleanup;
+    if (STRNEQ(result, "{\"b\":{\"c\":3}}")) {
+        virTestDifference(stderr, "{\"b\":{\"c\":3}}", result);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(result);
+    virJSONValueFree(src);
+    virJSONValueFree(dst);
+    virJSONValueFree(heap);
+    virJSONValueFree(taken);
+    return ret;
+}
+
+
+#define NUM_BENCH_DEVICES 200
+#define NUM_BENCH_PARSES 500
+
+/*
+ * Parse a query-blockstats like reply over and over, once into
+ * individually allocated values and once into an arena, and report
+ * the cost of both including freeing the result.
+ */
+static int
+testJSONArenaBench(const void *data ATTRIBUTE_UNUSED)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    struct timespec start, end;
+    unsigned long long elapsed[2];
+    char *doc = NULL;
+    size_t pass;
+    size_t i;
+    int ret = -1;
+
+    virBufferAddLit(&buf, "{\"return\": [");
+    for (i = 0; i < NUM_BENCH_DEVICES; i++) {
+        virBufferAsprintf(&buf,
+                          "%s{\"device\": \"drive-virtio-disk%zu\", "
+                          "\"stats\": {\"rd_bytes\": %zu, \"wr_bytes\": %zu, "
+                          "\"rd_operations\": %zu, \"wr_operations\": %zu, "
+                          "\"flush_operations\": 0, \"wr_highest_offset\": %zu, "
+                          "\"rd_total_time_ns\": 0, \"wr_total_time_ns\": 0, "
+                          "\"flush_total_time_ns\": 0}, "
+                          "\"parent\": {\"stats\": {\"wr_highest_offset\": 0}}}",
+                          i ? ", " : "", i, i * 4096, i * 512, i, i * 2, i);
+    }
+    virBufferAddLit(&buf, "], \"id\": \"libvirt-42\"}");
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+    doc = virBufferContentAndReset(&buf);
+
+    for (pass = 0; pass < 2; pass++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < NUM_BENCH_PARSES; i++) {
+            virJSONValuePtr json;
+
+            if (pass == 0)
+                json = virJSONValueFromString(doc);
+            else
+                json = virJSONValueFromStringArena(doc);
+
+            if (!json)
+                goto cleanup;
+            virJSONValueFree(json);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        elapsed[pass] = (end.tv_sec - start.tv_sec) * 1000000000ull +
+            end.tv_nsec - start.tv_nsec;
+    }
+
+    VIR_TEST_VERBOSE("parsing %zu bytes: %llu ns with heap values, "
+                     "%llu ns with an arena\n",
+                     strlen(doc),
+                     elapsed[0] / NUM_BENCH_PARSES,
+                     elapsed[1] / NUM_BENCH_PARSES);
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(doc);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -329,6 +694,19 @@ mymain(void)
 #define DO_TEST_PARSE_FAIL(name, doc)           \
     DO_TEST_FULL(name, FromString, doc, NULL, false)
 
+#define DO_TEST_STREAM_FULL(name, doc, path, expect, pass)          \
+    do {                                                            \
+        struct testStreamInfo info = { doc, path, expect, pass };   \
+        if (virTestRun(name, testJSONStreamParse, &info) < 0)       \
+            ret = -1;                                               \
+    } while (0)
+
+#define DO_TEST_STREAM(name, doc, path, expect)         \
+    DO_TEST_STREAM_FULL(name, doc, path, expect, true)
+
+#define DO_TEST_STREAM_FAIL(name, doc, path)            \
+    DO_TEST_STREAM_FULL(name, doc, path, NULL, false)
+
 
     DO_TEST_PARSE("Simple", "{\"return\": {}, \"id\": \"libvirt-1\"}");
     DO_TEST_PARSE("NotSoSimple", "{\"QMP\": {\"version\": {\"qemu\":"
@@ -448,6 +826,55 @@ mymain(void)
                  "{ \"a\": {}, \"b\": 1, \"c\": \"str\", \"d\": [] }",
                  NULL, true);
 
+    DO_TEST_FULL("arena object", Arena,
+                 "{\"return\": [{\"filename\": "
+                 "\"unix:/home/berrange/.libvirt/qemu/lib/tck.monitor,server\","
+                 "\"label\": \"charmonitor\"}, {\"filename\": \"pty:/dev/pts/158\","
+                 "\"label\": \"charserial0\"}], \"id\": \"libvirt-3\"}",
+                 NULL, true);
+    DO_TEST_FULL("arena array", Arena,
+                 "[ {\"a\": 1.5, \"b\": [true, false, null]}, \"str\", 42 ]",
+                 NULL, true);
+    DO_TEST_FULL("arena nested", Arena,
+                 "{ \"a\": { \"b\": { \"c\": [ [], {}, \"\" ] } }, \"d\": 1 }",
+                 NULL, true);
+
+    if (virTestRun("arena sharing", testJSONArenaShare, NULL) < 0)
+        ret = -1;
+    if (virTestRun("arena benchmark", testJSONArenaBench, NULL) < 0)
+        ret = -1;
+
+    DO_TEST_STREAM("stream whole document",
+                   "{ \"a\": [ 1, 2 ] }", "",
+                   "{\"a\":[1,2]};");
+    DO_TEST_STREAM("stream scalar",
+                   "{ \"a\": { \"b\": \"str\", \"c\": 1 }, \"b\": 2 }",
+                   "a.b", "\"str\";");
+    DO_TEST_STREAM("stream array elements",
+                   "{\"return\": [{\"device\": \"ide0\", \"inserted\": "
+                   "{\"file\": \"/a.qcow2\", \"backing\": {\"file\": \"x\"}}},"
+                   "{\"device\": \"ide1\"}, "
+                   "{\"device\": \"ide2\", \"inserted\": "
+                   "{\"file\": \"/b.raw\"}}], \"id\": \"libvirt-7\"}",
+                   "return[*].inserted.file",
+                   "\"/a.qcow2\";\"/b.raw\";");
+    DO_TEST_STREAM("stream containers",
+                   "{\"return\": [[1, {\"x\": []}], [], [null]]}",
+                   "return[*]",
+                   "[1,{\"x\":[]}];[];[null];");
+    DO_TEST_STREAM("stream nested arrays",
+                   "[[1, 2], [3], true]", "[*][*]", "1;2;3;");
+    DO_TEST_STREAM("stream no match",
+                   "{\"return\": {}}", "return.missing", "");
+    DO_TEST_STREAM_FAIL("stream unterminated",
+                        "{\"return\": [1, 2", "return[*]");
+    DO_TEST_STREAM_FAIL("stream trailing garbage",
+                        "{\"return\": 1} x", "return");
+    DO_TEST_STREAM_FAIL("stream invalid path",
+                        "{\"return\": 1}", "return..x");
+    DO_TEST_STREAM_FAIL("stream invalid index",
+                        "[1]", "[0]");
+
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -23,6 +23,7 @@
 
 #include "testutils.h"
 
+#include "domain_event.h"
 #include "virerror.h"
 #include "virxml.h"
 
@@ -79,6 +80,11 @@ lifecycleEventCounter_reset(lifecycleEventCounter *counter)
     counter->unexpectedEvents = 0;
 }
 
+typedef struct {
+    int events;
+    unsigned long long actual;
+} balloonEventCounter;
+
 typedef struct {
     virConnectPtr conn;
     virNetworkPtr net;
@@ -115,6 +121,18 @@ domainLifecycleCb(virConnectPtr conn ATTRIBUTE_UNUSED,
     return 0;
 }
 
+static void
+domainBalloonChangeCb(virConnectPtr conn ATTRIBUTE_UNUSED,
+                      virDomainPtr dom ATTRIBUTE_UNUSED,
+                      unsigned long long actual,
+                      void *opaque)
+{
+    balloonEventCounter *counter = opaque;
+
+    counter->events++;
+    counter->actual = actual;
+}
+
 static void
 networkLifecycleCb(virConnectPtr conn ATTRIBUTE_UNUSED,
                    virNetworkPtr net ATTRIBUTE_UNUSED,
@@ -691,6 +709,86 @@ testStoragePoolStartStopEvent(const void *data)
     return ret;
 }
 
+static int
+testDomainEventCoalesce(const void *data)
+{
+    const objecteventTest *test = data;
+    virObjectEventStatePtr state = NULL;
+    virObjectEventPtr event;
+    virDomainPtr dom = NULL;
+    lifecycleEventCounter counter;
+    balloonEventCounter balloon = { 0, 0 };
+    int id1 = -1, id2 = -1;
+    size_t i;
+    int ret = -1;
+
+    lifecycleEventCounter_reset(&counter);
+
+    if (!(state = virObjectEventStateNew()))
+        return -1;
+    virObjectEventStateSetCoalesce(state, true);
+
+    if (!(dom = virDomainLookupByName(test->conn, "test")))
+        goto cleanup;
+
+    if (virDomainEventStateRegisterID(test->conn, state, NULL,
+                      VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                      VIR_DOMAIN_EVENT_CALLBACK(&domainLifecycleCb),
+                      &counter, NULL, &id1) < 0 ||
+        virDomainEventStateRegisterID(test->conn, state, NULL,
+                      VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE,
+                      VIR_DOMAIN_EVENT_CALLBACK(&domainBalloonChangeCb),
+                      &balloon, NULL, &id2) < 0)
+        goto cleanup;
+
+    /* Only the last balloon change survives, while every
+     * lifecycle event in between is still delivered */
+    for (i = 1; i <= 5; i++) {
+        if (!(event = virDomainEventBalloonChangeNewFromDom(dom, i * 1024)))
+            goto cleanup;
+        virObjectEventStateQueue(state, event);
+
+        if (!(event = virDomainEventLifecycleNewFromDom(dom,
+                                                        VIR_DOMAIN_EVENT_STARTED,
+                                                        VIR_DOMAIN_EVENT_STARTED_BOOTED)))
+            goto cleanup;
+        virObjectEventStateQueue(state, event);
+    }
+
+    if (virEventRunDefaultImpl() < 0)
+        goto cleanup;
+
+    if (balloon.events != 1 || balloon.actual != 5 * 1024 ||
+        counter.startEvents != 5 || counter.unexpectedEvents > 0)
+        goto cleanup;
+
+    /* Without coalescing every balloon change is delivered */
+    virObjectEventStateSetCoalesce(state, false);
+    for (i = 1; i <= 3; i++) {
+        if (!(event = virDomainEventBalloonChangeNewFromDom(dom, i * 1024)))
+            goto cleanup;
+        virObjectEventStateQueue(state, event);
+    }
+
+    if (virEventRunDefaultImpl() < 0)
+        goto cleanup;
+
+    if (balloon.events != 4 || balloon.actual != 3 * 1024)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (id1 >= 0)
+        virObjectEventStateDeregisterID(test->conn, state, id1);
+    if (id2 >= 0)
+        virObjectEventStateDeregisterID(test->conn, state, id2);
+    virObjectEventStateFree(state);
+    if (dom)
+        virDomainFree(dom);
+    return ret;
+}
+
 static void
 timeout(int id ATTRIBUTE_UNUSED, void *opaque ATTRIBUTE_UNUSED)
 {
@@ -730,6 +828,8 @@ mymain(void)
         ret = EXIT_FAILURE;
     if (virTestRun("Domain start stop events", testDomainStartStopEvent, &test) < 0)
         ret = EXIT_FAILURE;
+    if (virTestRun("Domain event coalescing", testDomainEventCoalesce, &test) < 0)
+        ret = EXIT_FAILURE;
 
     /* Network event tests */
     /* Tests requiring the test network not to be set up*/
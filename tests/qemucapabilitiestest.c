@@ -19,14 +19,26 @@
 
 #include <config.h>
 
+#include <fcntl.h>
+#include <time.h>
+
 #include "testutils.h"
 #include "testutilsqemu.h"
 #include "qemumonitortestutils.h"
 #define __QEMU_CAPSRIV_H_ALLOW__
 #include "qemu/qemu_capspriv.h"
+#define __VIR_COMMAND_PRIV_H_ALLOW__
+#include "vircommandpriv.h"
+#include "virfile.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+#define NUM_LOADS 50
+#define NUM_FLAG_LOOKUPS 100000
+
 typedef struct _testQemuData testQemuData;
 typedef testQemuData *testQemuDataPtr;
 struct _testQemuData {
@@ -77,6 +89,364 @@ testQemuCaps(const void *opaque)
     return ret;
 }
 
+
+/*
+ * Load @path @nloads times with @load, check that it formats back to
+ * @expected and add the time spent loading to @elapsed.
+ */
+static int
+testQemuCapsCacheLoadTimed(int (*load)(virQEMUCapsPtr, const char *,
+                                       time_t *, time_t *, unsigned long *),
+                           const char *path,
+                           const char *expected,
+                           unsigned long long *elapsed)
+{
+    virQEMUCapsPtr qemuCaps = NULL;
+    struct timespec start, end;
+    char *actual = NULL;
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < NUM_LOADS; i++) {
+        time_t qemuctime;
+        time_t selfctime;
+        unsigned long selfvers;
+
+        if (!(qemuCaps = virQEMUCapsNew()))
+            goto cleanup;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (load(qemuCaps, path, &qemuctime, &selfctime, &selfvers) < 0)
+            goto cleanup;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        *elapsed += (end.tv_sec - start.tv_sec) * 1000000000ull +
+            end.tv_nsec - start.tv_nsec;
+
+        if (i == 0) {
+            if (!(actual = virQEMUCapsFormatCache(qemuCaps, 0, 0)))
+                goto cleanup;
+            if (STRNEQ(expected, actual)) {
+                VIR_TEST_DEBUG("%s did not survive a reload", path);
+                virTestDifference(stderr, expected, actual);
+                goto cleanup;
+            }
+            VIR_FREE(actual);
+        }
+
+        virObjectUnref(qemuCaps);
+        qemuCaps = NULL;
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(qemuCaps);
+    VIR_FREE(actual);
+    return ret;
+}
+
+
+/*
+ * Load every cache file in qemucapabilitiesdata the way daemon startup
+ * does, both from XML and from the binary format written next to it.
+ * Check that each one formats back to the very same XML and report the
+ * cost of a load in either format.
+ */
+static int
+testQemuCapsCacheLoadBench(const void *opaque ATTRIBUTE_UNUSED)
+{
+    char *dirPath = NULL;
+    char *path = NULL;
+    char *binPath = NULL;
+    char *expected = NULL;
+    char *bin = NULL;
+    size_t binLen;
+    virQEMUCapsPtr qemuCaps = NULL;
+    DIR *dir = NULL;
+    struct dirent *ent;
+    unsigned long long xmlElapsed = 0;
+    unsigned long long binElapsed = 0;
+    size_t nfiles = 0;
+    int fd = -1;
+    int rc;
+    int ret = -1;
+
+    if (virAsprintf(&dirPath, "%s/qemucapabilitiesdata", abs_srcdir) < 0 ||
+        virAsprintf(&binPath, "%s/qemucapabilitiestest.bin", abs_builddir) < 0 ||
+        virDirOpen(&dir, dirPath) < 0)
+        goto cleanup;
+
+    while ((rc = virDirRead(dir, &ent, dirPath)) > 0) {
+        time_t qemuctime;
+        time_t selfctime;
+        unsigned long selfvers;
+
+        if (!virFileHasSuffix(ent->d_name, ".xml"))
+            continue;
+
+        if (virAsprintf(&path, "%s/%s", dirPath, ent->d_name) < 0 ||
+            virTestLoadFile(path, &expected) < 0)
+            goto cleanup;
+
+        if (testQemuCapsCacheLoadTimed(virQEMUCapsLoadCache, path,
+                                       expected, &xmlElapsed) < 0)
+            goto cleanup;
+
+        if (!(qemuCaps = virQEMUCapsNew()) ||
+            virQEMUCapsLoadCache(qemuCaps, path, &qemuctime,
+                                 &selfctime, &selfvers) < 0 ||
+            !(bin = virQEMUCapsFormatBinaryCache(qemuCaps, selfctime,
+                                                 selfvers, &binLen)))
+            goto cleanup;
+
+        if ((fd = open(binPath, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 ||
+            safewrite(fd, bin, binLen) < 0 ||
+            VIR_CLOSE(fd) < 0) {
+            VIR_TEST_DEBUG("cannot write %s", binPath);
+            goto cleanup;
+        }
+
+        if (testQemuCapsCacheLoadTimed(virQEMUCapsLoadBinaryCache, binPath,
+                                       expected, &binElapsed) < 0)
+            goto cleanup;
+
+        nfiles++;
+        virObjectUnref(qemuCaps);
+        qemuCaps = NULL;
+        VIR_FREE(bin);
+        VIR_FREE(path);
+        VIR_FREE(expected);
+    }
+    if (rc < 0)
+        goto cleanup;
+
+    if (nfiles == 0) {
+        VIR_TEST_DEBUG("no cache files found in %s", dirPath);
+        goto cleanup;
+    }
+
+    VIR_TEST_VERBOSE("%zu cache files: %llu us per XML load, "
+                     "%llu us per binary load\n", nfiles,
+                     xmlElapsed / 1000 / (nfiles * NUM_LOADS),
+                     binElapsed / 1000 / (nfiles * NUM_LOADS));
+
+    ret = 0;
+ cleanup:
+    VIR_DIR_CLOSE(dir);
+    VIR_FORCE_CLOSE(fd);
+    virObjectUnref(qemuCaps);
+    if (binPath)
+        unlink(binPath);
+    VIR_FREE(binPath);
+    VIR_FREE(dirPath);
+    VIR_FREE(path);
+    VIR_FREE(expected);
+    VIR_FREE(bin);
+    return ret;
+}
+
+
+/*
+ * Every flag name must resolve to the same flag through the hash
+ * table as through the enum, report what either lookup costs.
+ */
+static int
+testQemuCapsFlagLookup(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct timespec start, end;
+    unsigned long long elapsed[2];
+    size_t pass;
+    size_t i;
+
+    for (i = 0; i < QEMU_CAPS_LAST; i++) {
+        const char *name = virQEMUCapsTypeToString(i);
+        int flag = virQEMUCapsFlagFromString(name);
+
+        if (flag != (int) i) {
+            VIR_TEST_DEBUG("flag '%s' resolves to %d instead of %zu",
+                           name, flag, i);
+            return -1;
+        }
+    }
+
+    if (virQEMUCapsFlagFromString("no-such-flag") != -1) {
+        VIR_TEST_DEBUG("unknown flag was resolved");
+        return -1;
+    }
+
+    for (pass = 0; pass < 2; pass++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < NUM_FLAG_LOOKUPS; i++) {
+            const char *name = virQEMUCapsTypeToString(i % QEMU_CAPS_LAST);
+            int flag;
+
+            if (pass == 0)
+                flag = virQEMUCapsFlagFromString(name);
+            else
+                flag = virQEMUCapsTypeFromString(name);
+
+            if (flag < 0)
+                return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        elapsed[pass] = (end.tv_sec - start.tv_sec) * 1000000000ull +
+            end.tv_nsec - start.tv_nsec;
+    }
+
+    VIR_TEST_VERBOSE("flag lookup among %d flags: %llu ns hashed, "
+                     "%llu ns scanning\n",
+                     QEMU_CAPS_LAST,
+                     elapsed[0] / NUM_FLAG_LOOKUPS,
+                     elapsed[1] / NUM_FLAG_LOOKUPS);
+
+    return 0;
+}
+
+struct testQemuCapsProbeData {
+    virMutex lock;
+    virCond cond;
+    size_t nprobes;
+    bool overlapped;
+    char *monitors[2];
+    char *pidfiles[2];
+};
+
+
+/*
+ * Stands in for QEMU started by virQEMUCapsInitQMP, failing the probe
+ * once both probes started theirs.
+ */
+static void
+testQemuCapsProbeCommand(const char *const*args,
+                         const char *const*env ATTRIBUTE_UNUSED,
+                         const char *input ATTRIBUTE_UNUSED,
+                         char **output ATTRIBUTE_UNUSED,
+                         char **error ATTRIBUTE_UNUSED,
+                         int *status,
+                         void *opaque)
+{
+    struct testQemuCapsProbeData *data = opaque;
+    const char *monitor = NULL;
+    const char *pidfile = NULL;
+    unsigned long long deadline;
+    size_t i;
+
+    *status = 1;
+
+    for (i = 0; args[i] && args[i + 1]; i++) {
+        if (STREQ(args[i], "-qmp"))
+            monitor = args[i + 1];
+        else if (STREQ(args[i], "-pidfile"))
+            pidfile = args[i + 1];
+    }
+
+    /* Falling back to -help */
+    if (!monitor || !pidfile)
+        return;
+
+    if (virTimeMillisNow(&deadline) < 0)
+        return;
+    deadline += 10 * 1000;
+
+    virMutexLock(&data->lock);
+    if (data->nprobes < ARRAY_CARDINALITY(data->monitors)) {
+        ignore_value(VIR_STRDUP(data->monitors[data->nprobes], monitor));
+        ignore_value(VIR_STRDUP(data->pidfiles[data->nprobes], pidfile));
+    }
+    if (++data->nprobes == ARRAY_CARDINALITY(data->monitors)) {
+        data->overlapped = true;
+        virCondBroadcast(&data->cond);
+    }
+    while (!data->overlapped) {
+        if (virCondWaitUntil(&data->cond, &data->lock, deadline) < 0)
+            break;
+    }
+    virMutexUnlock(&data->lock);
+}
+
+
+static void
+testQemuCapsProbeThread(void *opaque)
+{
+    virQEMUCapsPtr qemuCaps;
+
+    if (!(qemuCaps = virQEMUCapsNewForBinaryInternal(opaque,
+                                                     abs_builddir,
+                                                     NULL, -1, -1, true)))
+        virResetLastError();
+    virObjectUnref(qemuCaps);
+}
+
+
+/*
+ * Two binaries probed at the same time must not share the monitor
+ * socket or pidfile of the QEMU processes started for them.
+ */
+static int
+testQemuCapsConcurrentProbe(const void *opaque ATTRIBUTE_UNUSED)
+{
+    const char *binaries[] = { "/bin/true", "/bin/false" };
+    struct testQemuCapsProbeData data;
+    virThread threads[ARRAY_CARDINALITY(binaries)];
+    size_t nthreads = 0;
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < ARRAY_CARDINALITY(binaries); i++) {
+        if (!virFileIsExecutable(binaries[i]))
+            return EXIT_AM_SKIP;
+    }
+
+    memset(&data, 0, sizeof(data));
+    if (virMutexInit(&data.lock) < 0)
+        return -1;
+    if (virCondInit(&data.cond) < 0) {
+        virMutexDestroy(&data.lock);
+        return -1;
+    }
+
+    virCommandSetDryRun(NULL, testQemuCapsProbeCommand, &data);
+
+    for (i = 0; i < ARRAY_CARDINALITY(binaries); i++) {
+        if (virThreadCreate(&threads[i], true, testQemuCapsProbeThread,
+                            (void *) binaries[i]) < 0)
+            break;
+        nthreads++;
+    }
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    virCommandSetDryRun(NULL, NULL, NULL);
+
+    if (nthreads != ARRAY_CARDINALITY(binaries) || !data.overlapped) {
+        VIR_TEST_DEBUG("probes did not run at the same time");
+        goto cleanup;
+    }
+
+    if (!data.monitors[0] || !data.monitors[1] ||
+        !data.pidfiles[0] || !data.pidfiles[1])
+        goto cleanup;
+
+    if (STREQ(data.monitors[0], data.monitors[1]) ||
+        STREQ(data.pidfiles[0], data.pidfiles[1])) {
+        VIR_TEST_DEBUG("probes share %s and %s",
+                       data.monitors[0], data.pidfiles[0]);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < ARRAY_CARDINALITY(data.monitors); i++) {
+        VIR_FREE(data.monitors[i]);
+        VIR_FREE(data.pidfiles[i]);
+    }
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
 static int
 mymain(void)
 {
@@ -119,6 +489,15 @@ mymain(void)
     DO_TEST("aarch64", "caps_2.6.0-gicv3");
     DO_TEST("ppc64le", "caps_2.6.0");
 
+    if (virTestRun("Flag lookup", testQemuCapsFlagLookup, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Cache load benchmark",
+                   testQemuCapsCacheLoadBench, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Concurrent probes",
+                   testQemuCapsConcurrentProbe, NULL) < 0)
+        ret = -1;
+
     /*
      * Run "tests/qemucapsprobe /path/to/qemu/binary >foo.replies"
      * to generate updated or new *.replies data files.
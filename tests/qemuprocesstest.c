@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2016 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <unistd.h>
+
+#include "testutils.h"
+#include "viralloc.h"
+#include "virthread.h"
+#include "qemu/qemu_processpriv.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define NUM_DOMAINS 20
+
+/* What the fake reconnects saw, domains are told apart by startTime */
+static virMutex testLock = VIR_MUTEX_INITIALIZER;
+static size_t testRunning;
+static size_t testMaxRunning;
+static unsigned long long testOrder[NUM_DOMAINS];
+static size_t testNOrder;
+
+
+static void
+testReconnect(void *opaque)
+{
+    struct qemuProcessReconnectData *data = opaque;
+
+    virMutexLock(&testLock);
+    if (++testRunning > testMaxRunning)
+        testMaxRunning = testRunning;
+    if (testNOrder < NUM_DOMAINS)
+        testOrder[testNOrder++] = data->startTime;
+    virMutexUnlock(&testLock);
+
+    /* Give the other workers a chance to overlap with us */
+    usleep(10 * 1000);
+
+    virMutexLock(&testLock);
+    testRunning--;
+    virMutexUnlock(&testLock);
+
+    VIR_FREE(data);
+}
+
+
+static int
+testReconnectAdd(qemuProcessReconnectAllDataPtr all,
+                 bool autostart,
+                 unsigned long long startTime)
+{
+    struct qemuProcessReconnectData *data;
+
+    if (VIR_ALLOC(data) < 0)
+        return -1;
+
+    data->autostart = autostart;
+    data->startTime = startTime;
+    data->all = all;
+
+    if (VIR_APPEND_ELEMENT(all->domains, all->ndomains, data) < 0) {
+        VIR_FREE(data);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static qemuProcessReconnectAllDataPtr
+testReconnectNew(void)
+{
+    testRunning = testMaxRunning = testNOrder = 0;
+    return qemuProcessReconnectAllNew(NULL, NULL, testReconnect);
+}
+
+
+/*
+ * A single worker reconnects the autostarted domains first, then
+ * the others, most recently started first.
+ */
+static int
+testReconnectOrder(const void *opaque ATTRIBUTE_UNUSED)
+{
+    qemuProcessReconnectAllDataPtr all;
+    const unsigned long long expect[] = { 7, 1, 9, 5 };
+    size_t i;
+    int ret = 0;
+
+    if (!(all = testReconnectNew()))
+        return -1;
+
+    if (testReconnectAdd(all, false, 5) < 0 ||
+        testReconnectAdd(all, true, 1) < 0 ||
+        testReconnectAdd(all, false, 9) < 0 ||
+        testReconnectAdd(all, true, 7) < 0)
+        ret = -1;
+
+    qemuProcessReconnectStart(all, 1);
+    qemuProcessReconnectWait(all);
+
+    if (ret < 0)
+        return -1;
+
+    if (testNOrder != ARRAY_CARDINALITY(expect)) {
+        VIR_TEST_DEBUG("reconnected %zu domains, expected %zu",
+                       testNOrder, ARRAY_CARDINALITY(expect));
+        return -1;
+    }
+
+    for (i = 0; i < testNOrder; i++) {
+        if (testOrder[i] != expect[i]) {
+            VIR_TEST_DEBUG("domain %llu reconnected as %zu, expected %llu",
+                           testOrder[i], i, expect[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * No more than @opaque domains are reconnected at the same time,
+ * zero meaning a thread for each of them.
+ */
+static int
+testReconnectBound(const void *opaque)
+{
+    size_t workers = *(const size_t *) opaque;
+    qemuProcessReconnectAllDataPtr all;
+    size_t i;
+    int ret = 0;
+
+    if (!(all = testReconnectNew()))
+        return -1;
+
+    for (i = 0; i < NUM_DOMAINS; i++) {
+        if (testReconnectAdd(all, false, i) < 0)
+            ret = -1;
+    }
+
+    qemuProcessReconnectStart(all, workers);
+    qemuProcessReconnectWait(all);
+
+    if (ret < 0)
+        return -1;
+
+    if (testNOrder != NUM_DOMAINS) {
+        VIR_TEST_DEBUG("reconnected %zu domains, expected %d",
+                       testNOrder, NUM_DOMAINS);
+        return -1;
+    }
+
+    if (workers && testMaxRunning > workers) {
+        VIR_TEST_DEBUG("%zu reconnects ran at once, limit is %zu",
+                       testMaxRunning, workers);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    size_t bounded = 4;
+    size_t unbounded = 0;
+    int ret = 0;
+
+    if (virTestRun("Reconnect order",
+                   testReconnectOrder, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Reconnect workers bound",
+                   testReconnectBound, &bounded) < 0)
+        ret = -1;
+    if (virTestRun("Reconnect thread per domain",
+                   testReconnectBound, &unbounded) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
@@ -20,7 +20,10 @@
 
 # define VIR_FROM_THIS VIR_FROM_NONE
 
+# define STATUSDIRTEMPLATE abs_builddir "/qemuxml2xmlstatus-XXXXXX"
+
 static virQEMUDriver driver;
+static char statusDir[] = STATUSDIRTEMPLATE;
 
 enum {
     WHEN_INACTIVE = 1,
@@ -99,9 +102,13 @@ static int
 testCompareStatusXMLToXMLFiles(const void *opaque)
 {
     const struct testInfo *data = opaque;
+    unsigned int parseFlags = VIR_DOMAIN_DEF_PARSE_STATUS |
+                              VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
+                              VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES;
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     xmlDocPtr xml = NULL;
     virDomainObjPtr obj = NULL;
+    virDomainObjPtr cached = NULL;
     char *expect = NULL;
     char *actual = NULL;
     char *source = NULL;
@@ -142,9 +149,7 @@ testCompareStatusXMLToXMLFiles(const void *opaque)
     if (!(xml = virXMLParseString(source, "(domain_status_test_XML)")) ||
         !(obj = virDomainObjParseNode(xml, xmlDocGetRootElement(xml),
                                       driver.caps, driver.xmlopt,
-                                      VIR_DOMAIN_DEF_PARSE_STATUS |
-                                      VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
-                                      VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES))) {
+                                      parseFlags))) {
         VIR_TEST_DEBUG("Failed to parse domain status XML:\n%s", source);
         goto cleanup;
     }
@@ -165,12 +170,36 @@ testCompareStatusXMLToXMLFiles(const void *opaque)
         goto cleanup;
     }
 
+    /* the status cache must load the very same status */
+    if (virDomainSaveStatus(driver.xmlopt, statusDir, obj, driver.caps) < 0 ||
+        virDomainObjParseStatusCache(statusDir, obj->def->name,
+                                     driver.caps, driver.xmlopt,
+                                     parseFlags, &cached) != 1) {
+        VIR_TEST_DEBUG("Failed to load domain status cache");
+        goto cleanup;
+    }
+
+    VIR_FREE(actual);
+    if (!(actual = virDomainObjFormat(driver.xmlopt, cached, NULL,
+                                      VIR_DOMAIN_DEF_FORMAT_SECURE))) {
+        VIR_TEST_DEBUG("Failed to format domain status cache");
+        goto cleanup;
+    }
+
+    if (STRNEQ(actual, expect)) {
+        virTestDifferenceFullNoRegenerate(stderr,
+                                          expect, data->outActiveName,
+                                          actual, data->inName);
+        goto cleanup;
+    }
+
     ret = 0;
 
  cleanup:
     xmlKeepBlanksDefault(keepBlanksDefault);
     xmlFreeDoc(xml);
     virObjectUnref(obj);
+    virObjectUnref(cached);
     VIR_FREE(expect);
     VIR_FREE(actual);
     VIR_FREE(source);
@@ -264,6 +293,11 @@ mymain(void)
     if (qemuTestDriverInit(&driver) < 0)
         return EXIT_FAILURE;
 
+    if (!mkdtemp(statusDir)) {
+        virFilePrintf(stderr, "Cannot create qemuxml2xmlstatus");
+        abort();
+    }
+
     cfg = virQEMUDriverGetConfig(&driver);
 
     /* TODO: test with format probing disabled too */
@@ -831,6 +865,9 @@ mymain(void)
 
     qemuTestDriverFree(&driver);
 
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(statusDir);
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2016 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "storage/storage_backend_fs.h"
+#include "viralloc.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.storagebackendfstest");
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/storagebackendfsdata-XXXXXX"
+
+#define NUM_FILES 200
+
+static virStoragePoolObjList pools;
+
+
+static int
+testWriteFile(const char *dir,
+              const char *name,
+              const char *content)
+{
+    char *path = NULL;
+    int ret;
+
+    if (virAsprintf(&path, "%s/%s", dir, name) < 0)
+        return -1;
+
+    ret = virFileWriteStr(path, content, 0600);
+    VIR_FREE(path);
+    return ret;
+}
+
+
+static int
+testRemoveFile(const char *dir,
+               const char *name)
+{
+    char *path = NULL;
+    int ret;
+
+    if (virAsprintf(&path, "%s/%s", dir, name) < 0)
+        return -1;
+
+    ret = unlink(path);
+    VIR_FREE(path);
+    return ret;
+}
+
+
+static virStoragePoolObjPtr
+testPoolNew(const char *name,
+            const char *dir)
+{
+    virStoragePoolDefPtr def = NULL;
+    virStoragePoolObjPtr pool;
+    char *xml = NULL;
+
+    if (virAsprintf(&xml,
+                    "<pool type='dir'>"
+                    "  <name>%s</name>"
+                    "  <target><path>%s</path></target>"
+                    "</pool>", name, dir) < 0)
+        return NULL;
+
+    def = virStoragePoolDefParseString(xml);
+    VIR_FREE(xml);
+    if (!def)
+        return NULL;
+
+    if (!(pool = virStoragePoolObjAssignDef(&pools, def))) {
+        virStoragePoolDefFree(def);
+        return NULL;
+    }
+
+    return pool;
+}
+
+
+/*
+ * A second refresh must keep the volumes of files which did not
+ * change, probe the ones which did and drop the ones which are gone.
+ */
+static int
+testRefreshIncremental(const void *opaque)
+{
+    const char *dir = opaque;
+    virStoragePoolObjPtr pool = NULL;
+    virStorageVolDefPtr vol;
+    int ret = -1;
+
+    if (testWriteFile(dir, "a.img", "aaaa") < 0 ||
+        testWriteFile(dir, "b.img", "bbbb") < 0 ||
+        testWriteFile(dir, "c.img", "cccc") < 0)
+        goto cleanup;
+
+    if (!(pool = testPoolNew("fs", dir)))
+        goto cleanup;
+
+    if (virStorageBackendDirectory.refreshPool(NULL, pool) < 0)
+        goto cleanup;
+
+    if (pool->volumes.count != 3) {
+        VIR_TEST_DEBUG("expected 3 volumes, found %zu",
+                       pool->volumes.count);
+        goto cleanup;
+    }
+
+    /* Probing never sets the use count, so it only
+     * survives if the volume is carried over */
+    if (!(vol = virStorageVolDefFindByName(pool, "a.img")))
+        goto cleanup;
+    vol->in_use = 1;
+
+    if (testWriteFile(dir, "b.img", "bbbbbbbb") < 0 ||
+        testRemoveFile(dir, "c.img") < 0 ||
+        testWriteFile(dir, "d.img", "dddd") < 0)
+        goto cleanup;
+
+    if (virStorageBackendDirectory.refreshPool(NULL, pool) < 0)
+        goto cleanup;
+
+    if (pool->volumes.count != 3) {
+        VIR_TEST_DEBUG("expected 3 volumes, found %zu",
+                       pool->volumes.count);
+        goto cleanup;
+    }
+
+    if (!(vol = virStorageVolDefFindByName(pool, "a.img")) ||
+        vol->in_use != 1) {
+        VIR_TEST_DEBUG("unchanged volume was not kept");
+        goto cleanup;
+    }
+
+    if (!(vol = virStorageVolDefFindByName(pool, "b.img")) ||
+        vol->target.capacity != 8) {
+        VIR_TEST_DEBUG("modified volume was not probed again");
+        goto cleanup;
+    }
+
+    if (virStorageVolDefFindByName(pool, "c.img")) {
+        VIR_TEST_DEBUG("removed volume is still listed");
+        goto cleanup;
+    }
+
+    if (!virStorageVolDefFindByName(pool, "d.img")) {
+        VIR_TEST_DEBUG("new volume was not found");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (pool)
+        virStoragePoolObjUnlock(pool);
+    return ret;
+}
+
+
+/*
+ * Files are probed by several threads at once, every volume
+ * must still end up with the details of its own file.
+ */
+static int
+testRefreshParallel(const void *opaque)
+{
+    const char *basedir = opaque;
+    virStoragePoolObjPtr pool = NULL;
+    char *dir = NULL;
+    char *name = NULL;
+    char *content = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (virAsprintf(&dir, "%s/parallel", basedir) < 0 ||
+        virFileMakePath(dir) < 0)
+        goto cleanup;
+
+    for (i = 0; i < NUM_FILES; i++) {
+        if (virAsprintf(&name, "vol%zu.img", i) < 0 ||
+            VIR_ALLOC_N(content, i + 2) < 0)
+            goto cleanup;
+        memset(content, 'x', i + 1);
+
+        if (testWriteFile(dir, name, content) < 0)
+            goto cleanup;
+
+        VIR_FREE(name);
+        VIR_FREE(content);
+    }
+
+    if (!(pool = testPoolNew("parallel", dir)))
+        goto cleanup;
+
+    if (virStorageBackendDirectory.refreshPool(NULL, pool) < 0)
+        goto cleanup;
+
+    if (pool->volumes.count != NUM_FILES) {
+        VIR_TEST_DEBUG("expected %d volumes, found %zu",
+                       NUM_FILES, pool->volumes.count);
+        goto cleanup;
+    }
+
+    for (i = 0; i < NUM_FILES; i++) {
+        virStorageVolDefPtr vol;
+
+        if (virAsprintf(&name, "vol%zu.img", i) < 0)
+            goto cleanup;
+
+        if (!(vol = virStorageVolDefFindByName(pool, name)) ||
+            vol->target.capacity != i + 1) {
+            VIR_TEST_DEBUG("volume '%s' has wrong details", name);
+            goto cleanup;
+        }
+
+        VIR_FREE(name);
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (pool)
+        virStoragePoolObjUnlock(pool);
+    VIR_FREE(dir);
+    VIR_FREE(name);
+    VIR_FREE(content);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create storagebackendfsdata");
+        abort();
+    }
+
+    if (virTestRun("Incremental refresh", testRefreshIncremental,
+                   scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("Parallel refresh", testRefreshParallel,
+                   scratchdir) < 0)
+        ret = -1;
+
+    virStoragePoolObjListFree(&pools);
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
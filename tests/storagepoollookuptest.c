@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2016 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "storage_conf.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "viruuid.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.storagepoollookuptest");
+
+#define NUM_POOLS 20
+#define NUM_VOLS 1000
+#define NUM_LOOKUPS 2000
+
+static virStoragePoolObjList pools;
+
+
+static int
+testPoolAddVols(virStoragePoolObjPtr pool,
+                size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < NUM_VOLS; i++) {
+        virStorageVolDefPtr vol;
+
+        if (VIR_ALLOC(vol) < 0)
+            return -1;
+
+        if (virAsprintf(&vol->name, "vol%zu", i) < 0 ||
+            virAsprintf(&vol->target.path, "/pool/pool%zu/vol%zu",
+                        n, i) < 0 ||
+            VIR_STRDUP(vol->key, vol->target.path) < 0 ||
+            virStoragePoolObjAddVol(pool, vol) < 0) {
+            virStorageVolDefFree(vol);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testPoolPopulate(void)
+{
+    size_t i;
+
+    for (i = 0; i < NUM_POOLS; i++) {
+        virStoragePoolDefPtr def = NULL;
+        virStoragePoolObjPtr pool;
+        char *xml = NULL;
+
+        if (virAsprintf(&xml,
+                        "<pool type='dir'>"
+                        "  <name>pool%zu</name>"
+                        "  <uuid>c7a5fdb2-cdaf-9455-926a-d65c16db%04zx</uuid>"
+                        "  <target><path>/pool/pool%zu</path></target>"
+                        "</pool>", i, i, i) < 0)
+            return -1;
+
+        def = virStoragePoolDefParseString(xml);
+        VIR_FREE(xml);
+        if (!def)
+            return -1;
+
+        if (!(pool = virStoragePoolObjAssignDef(&pools, def))) {
+            virStoragePoolDefFree(def);
+            return -1;
+        }
+
+        if (testPoolAddVols(pool, i) < 0) {
+            virStoragePoolObjUnlock(pool);
+            return -1;
+        }
+
+        virStoragePoolObjUnlock(pool);
+    }
+
+    return 0;
+}
+
+
+static int
+testPoolFind(const void *opaque ATTRIBUTE_UNUSED)
+{
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    virStoragePoolObjPtr pool;
+    virStoragePoolObjPtr byname;
+
+    if (virUUIDParse("c7a5fdb2-cdaf-9455-926a-d65c16db0007", uuid) < 0)
+        return -1;
+
+    if (!(pool = virStoragePoolObjFindByUUID(&pools, uuid)))
+        return -1;
+    virStoragePoolObjUnlock(pool);
+
+    if (!(byname = virStoragePoolObjFindByName(&pools, "pool7")))
+        return -1;
+    virStoragePoolObjUnlock(byname);
+
+    if (pool != byname) {
+        VIR_TEST_DEBUG("lookup by UUID and name found different pools");
+        return -1;
+    }
+
+    if (virStoragePoolObjFindByName(&pools, "nosuchpool")) {
+        VIR_TEST_DEBUG("found a pool which does not exist");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testVolFind(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virStoragePoolObjPtr pool;
+    virStorageVolDefPtr vol;
+    virStorageVolDefPtr dup = NULL;
+    int ret = -1;
+
+    if (!(pool = virStoragePoolObjFindByName(&pools, "pool3")))
+        return -1;
+
+    if (!(vol = virStorageVolDefFindByName(pool, "vol42")) ||
+        virStorageVolDefFindByKey(pool, "/pool/pool3/vol42") != vol ||
+        virStorageVolDefFindByPath(pool, "/pool/pool3/vol42") != vol) {
+        VIR_TEST_DEBUG("volume lookups disagree");
+        goto cleanup;
+    }
+
+    if (virStorageVolDefFindByPath(pool, "/pool/pool4/vol42")) {
+        VIR_TEST_DEBUG("found a volume of a different pool");
+        goto cleanup;
+    }
+
+    /* A second volume sharing the key must take over the
+     * key once the first one is gone */
+    if (VIR_ALLOC(dup) < 0 ||
+        VIR_STRDUP(dup->name, "dup") < 0 ||
+        VIR_STRDUP(dup->key, vol->key) < 0 ||
+        virStoragePoolObjAddVol(pool, dup) < 0)
+        goto cleanup;
+
+    if (virStorageVolDefFindByKey(pool, dup->key) != vol) {
+        VIR_TEST_DEBUG("key of the first volume was taken over");
+        dup = NULL;
+        goto cleanup;
+    }
+
+    virStoragePoolObjRemoveVol(pool, vol);
+    if (virStorageVolDefFindByName(pool, "vol42") ||
+        virStorageVolDefFindByPath(pool, "/pool/pool3/vol42")) {
+        VIR_TEST_DEBUG("removed volume is still found");
+        dup = NULL;
+        goto cleanup;
+    }
+
+    if (virStorageVolDefFindByKey(pool, "/pool/pool3/vol42") != dup) {
+        VIR_TEST_DEBUG("key was not handed over to the remaining volume");
+        dup = NULL;
+        goto cleanup;
+    }
+
+    virStoragePoolObjRemoveVol(pool, dup);
+    dup = NULL;
+    if (virStorageVolDefFindByKey(pool, "/pool/pool3/vol42")) {
+        VIR_TEST_DEBUG("key still resolves after removing all volumes");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStorageVolDefFree(dup);
+    virStoragePoolObjUnlock(pool);
+    return ret;
+}
+
+
+/* The lookup storage drivers used to do: scan every volume */
+static virStorageVolDefPtr
+testVolFindByPathLinear(virStoragePoolObjPtr pool,
+                        const char *path)
+{
+    size_t i;
+
+    for (i = 0; i < pool->volumes.count; i++) {
+        if (STREQ_NULLABLE(pool->volumes.objs[i]->target.path, path))
+            return pool->volumes.objs[i];
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Resolve volume paths the way storageVolLookupByPath does, by
+ * asking every pool in turn, once with the hash index and once
+ * with a linear scan, and report the cost of both.
+ */
+static int
+testVolLookupByPathBench(const void *opaque ATTRIBUTE_UNUSED)
+{
+    char *paths[NUM_LOOKUPS] = { NULL };
+    struct timespec start, end;
+    unsigned long long elapsed[2];
+    size_t pass;
+    size_t i, j;
+    int ret = -1;
+
+    for (i = 0; i < NUM_LOOKUPS; i++) {
+        if (virAsprintf(&paths[i], "/pool/pool%zu/vol%zu",
+                        (i * 7) % NUM_POOLS, (i * 13) % NUM_VOLS) < 0)
+            goto cleanup;
+    }
+
+    for (pass = 0; pass < 2; pass++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < NUM_LOOKUPS; i++) {
+            virStorageVolDefPtr vol = NULL;
+
+            for (j = 0; j < pools.count && !vol; j++) {
+                virStoragePoolObjPtr pool = pools.objs[j];
+
+                virStoragePoolObjLock(pool);
+                if (pass == 0)
+                    vol = virStorageVolDefFindByPath(pool, paths[i]);
+                else
+                    vol = testVolFindByPathLinear(pool, paths[i]);
+                virStoragePoolObjUnlock(pool);
+            }
+
+            /* Only vol42 of pool3 was removed */
+            if (!vol && STRNEQ(paths[i], "/pool/pool3/vol42")) {
+                VIR_TEST_DEBUG("path '%s' not found", paths[i]);
+                goto cleanup;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        elapsed[pass] = (end.tv_sec - start.tv_sec) * 1000000000ull +
+            end.tv_nsec - start.tv_nsec;
+    }
+
+    VIR_TEST_VERBOSE("lookup by path among %d volumes: %llu ns indexed, "
+                     "%llu ns scanning\n",
+                     NUM_POOLS * NUM_VOLS,
+                     elapsed[0] / NUM_LOOKUPS,
+                     elapsed[1] / NUM_LOOKUPS);
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < NUM_LOOKUPS; i++)
+        VIR_FREE(paths[i]);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (testPoolPopulate() < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virTestRun("Pool lookup", testPoolFind, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Volume lookup", testVolFind, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Volume lookup by path benchmark",
+                   testVolLookupByPathBench, NULL) < 0)
+        ret = -1;
+
+ cleanup:
+    virStoragePoolObjListFree(&pools);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
@@ -0,0 +1,667 @@
+/*
+ * Copyright (C) 2016 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "viralloc.h"
+#include "virdomainobjlist.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.virdomainobjlisttest");
+
+#define NUM_DOMAINS 5000
+#define NUM_LOOKUPS 100000
+#define NUM_THREADS 8
+#define NUM_CONFIGS 500
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/virdomainobjlistdata-XXXXXX"
+
+static virDomainXMLOptionPtr xmlopt;
+static virDomainObjListPtr doms;
+static virDomainObjPtr vms[NUM_DOMAINS];
+
+
+/* Every other domain is running, with ID i + 1 */
+static int
+testDomainID(size_t i)
+{
+    return i % 2 ? -1 : i + 1;
+}
+
+
+static int
+testDomainListPopulate(void)
+{
+    size_t i;
+
+    for (i = 0; i < NUM_DOMAINS; i++) {
+        virDomainDefPtr def;
+
+        if (!(def = virDomainDefNew()))
+            return -1;
+
+        def->virtType = VIR_DOMAIN_VIRT_QEMU;
+        def->id = testDomainID(i);
+        def->uuid[0] = i & 0xff;
+        def->uuid[1] = (i >> 8) & 0xff;
+        if (virAsprintf(&def->name, "test%zu", i) < 0 ||
+            !(vms[i] = virDomainObjListAdd(doms, def, xmlopt,
+                                           VIR_DOMAIN_OBJ_LIST_ADD_LIVE,
+                                           NULL))) {
+            virDomainDefFree(def);
+            return -1;
+        }
+        virObjectUnlock(vms[i]);
+    }
+
+    return 0;
+}
+
+
+static int
+testDomainListCheckID(int id,
+                      virDomainObjPtr expect)
+{
+    virDomainObjPtr vm = virDomainObjListFindByID(doms, id);
+
+    if (vm)
+        virObjectUnlock(vm);
+
+    if (vm != expect) {
+        VIR_TEST_DEBUG("lookup of ID %d returned %s, expected %s",
+                       id,
+                       vm ? vm->def->name : "nothing",
+                       expect ? expect->def->name : "nothing");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testDomainListFindByID(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainObjPtr unindexed = vms[1];
+    int id = NUM_DOMAINS + 2;
+    size_t i;
+
+    /* Running domains are indexed as they are added */
+    for (i = 0; i < NUM_DOMAINS; i++) {
+        if (testDomainID(i) < 0)
+            continue;
+        if (testDomainListCheckID(testDomainID(i), vms[i]) < 0)
+            return -1;
+    }
+
+    /* A domain started behind the back of the list has no index
+     * entry, so it can only be found by scanning. The first lookup
+     * indexes it, the second one must then find it in the index. */
+    unindexed->def->id = id;
+    if (testDomainListCheckID(id, unindexed) < 0 ||
+        testDomainListCheckID(id, unindexed) < 0)
+        return -1;
+    unindexed->def->id = -1;
+    if (testDomainListCheckID(id, NULL) < 0)
+        return -1;
+
+    for (i = 0; i < NUM_DOMAINS; i++) {
+        if (testDomainID(i) < 0 &&
+            testDomainListCheckID(i + 1, NULL) < 0)
+            return -1;
+    }
+
+    if (testDomainListCheckID(-1, NULL) < 0 ||
+        testDomainListCheckID(0, NULL) < 0 ||
+        testDomainListCheckID(NUM_DOMAINS + 1, NULL) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/* Drivers assign IDs directly, so the list must cope with
+ * domains being stopped and started behind its back */
+static int
+testDomainListFindByIDStale(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainObjPtr first = vms[0];
+    virDomainObjPtr second = vms[2];
+    int firstID = first->def->id;
+    int secondID = second->def->id;
+
+    /* Make sure both are indexed */
+    if (testDomainListCheckID(firstID, first) < 0 ||
+        testDomainListCheckID(secondID, second) < 0)
+        return -1;
+
+    first->def->id = -1;
+    if (testDomainListCheckID(firstID, NULL) < 0)
+        return -1;
+
+    /* Hand the ID of the stopped domain to a different one */
+    second->def->id = firstID;
+    if (testDomainListCheckID(secondID, NULL) < 0 ||
+        testDomainListCheckID(firstID, second) < 0)
+        return -1;
+
+    first->def->id = secondID;
+    if (testDomainListCheckID(secondID, first) < 0)
+        return -1;
+
+    first->def->id = firstID;
+    second->def->id = secondID;
+    if (testDomainListCheckID(firstID, first) < 0 ||
+        testDomainListCheckID(secondID, second) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testDomainListFindByIDRemove(const void *opaque ATTRIBUTE_UNUSED)
+{
+    size_t n = NUM_DOMAINS - 2;
+    int id = testDomainID(n);
+
+    if (testDomainListCheckID(id, vms[n]) < 0)
+        return -1;
+
+    virObjectLock(vms[n]);
+    virDomainObjListRemove(doms, vms[n]);
+    vms[n] = NULL;
+
+    return testDomainListCheckID(id, NULL);
+}
+
+
+/*
+ * Report the average cost of looking up a running domain by ID.
+ * This is what virDomainLookupByID and friends boil down to.
+ */
+static int
+testDomainListFindByIDBench(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct timespec start, end;
+    unsigned long long elapsed;
+    size_t i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < NUM_LOOKUPS; i++) {
+        size_t n = (i * 2) % NUM_DOMAINS;
+        virDomainObjPtr vm;
+
+        if (!vms[n])
+            continue;
+
+        if (!(vm = virDomainObjListFindByID(doms, testDomainID(n))))
+            return -1;
+        virObjectUnlock(vm);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    elapsed = (end.tv_sec - start.tv_sec) * 1000000000ull +
+        end.tv_nsec - start.tv_nsec;
+    VIR_TEST_VERBOSE("%llu ns per lookup among %d domains\n",
+                     elapsed / NUM_LOOKUPS, NUM_DOMAINS);
+
+    return 0;
+}
+
+
+struct testDomainListLookupData {
+    size_t offset;
+    int failed;
+};
+
+
+static void
+testDomainListLookupThread(void *opaque)
+{
+    struct testDomainListLookupData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < NUM_LOOKUPS / NUM_THREADS; i++) {
+        size_t n = (data->offset + i * 7) % NUM_DOMAINS;
+        virDomainObjPtr vm;
+
+        if (!vms[n])
+            continue;
+
+        if (i % 2)
+            vm = virDomainObjListFindByName(doms, vms[n]->def->name);
+        else
+            vm = virDomainObjListFindByUUIDRef(doms, vms[n]->def->uuid);
+
+        if (vm != vms[n])
+            data->failed++;
+        if (vm) {
+            virObjectUnlock(vm);
+            virObjectUnref(vm);
+        }
+    }
+}
+
+
+/*
+ * Lookups by UUID and name only take the list lock shared,
+ * so concurrent callers must not serialize on each other.
+ */
+static int
+testDomainListLookupParallel(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virThread threads[NUM_THREADS];
+    struct testDomainListLookupData data[NUM_THREADS];
+    struct timespec start, end;
+    unsigned long long elapsed;
+    size_t nthreads;
+    size_t i;
+    int ret = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (nthreads = 0; nthreads < NUM_THREADS; nthreads++) {
+        data[nthreads].offset = nthreads * (NUM_DOMAINS / NUM_THREADS);
+        data[nthreads].failed = 0;
+        if (virThreadCreate(&threads[nthreads], true,
+                            testDomainListLookupThread,
+                            &data[nthreads]) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        virThreadJoin(&threads[i]);
+        if (data[i].failed) {
+            VIR_TEST_DEBUG("thread %zu had %d failed lookups",
+                           i, data[i].failed);
+            ret = -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    elapsed = (end.tv_sec - start.tv_sec) * 1000000000ull +
+        end.tv_nsec - start.tv_nsec;
+    VIR_TEST_VERBOSE("%llu ns per lookup with %zu threads\n",
+                     elapsed / (NUM_LOOKUPS / NUM_THREADS * NUM_THREADS),
+                     nthreads);
+
+    return ret;
+}
+
+
+/* Every third config is marked for autostart */
+static int
+testDomainConfigWrite(const char *configDir,
+                      const char *autostartDir,
+                      size_t i)
+{
+    char *path = NULL;
+    char *link = NULL;
+    char *xml = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&path, "%s/config%zu.xml", configDir, i) < 0 ||
+        virAsprintf(&xml,
+                    "<domain type='test'>"
+                    "  <name>config%zu</name>"
+                    "  <uuid>6f1e0f3c-57c4-4a4b-9d3e-8b2a1c%06zx</uuid>"
+                    "  <memory>%zu</memory>"
+                    "  <vcpu>1</vcpu>"
+                    "  <os><type>hvm</type></os>"
+                    "</domain>", i, i, 1024 * (i + 1)) < 0)
+        goto cleanup;
+
+    if (virFileWriteStr(path, xml, 0600) < 0)
+        goto cleanup;
+
+    if (i % 3 == 0) {
+        if (virAsprintf(&link, "%s/config%zu.xml", autostartDir, i) < 0)
+            goto cleanup;
+        if (symlink(path, link) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(path);
+    VIR_FREE(link);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
+/*
+ * Load NUM_CONFIGS persistent domains the way drivers do at
+ * startup, check that every one of them came out of its own
+ * file and report how long it took.
+ */
+static int
+testDomainListLoadConfigsBench(const void *opaque)
+{
+    const char *basedir = opaque;
+    virCapsPtr caps = NULL;
+    virDomainXMLOptionPtr genericxmlopt = NULL;
+    virDomainObjListPtr loaded = NULL;
+    char *configDir = NULL;
+    char *autostartDir = NULL;
+    char *name = NULL;
+    struct timespec start, end;
+    unsigned long long elapsed;
+    size_t i;
+    int ret = -1;
+
+    if (virAsprintf(&configDir, "%s/qemu", basedir) < 0 ||
+        virAsprintf(&autostartDir, "%s/qemu/autostart", basedir) < 0 ||
+        virFileMakePath(autostartDir) < 0)
+        goto cleanup;
+
+    for (i = 0; i < NUM_CONFIGS; i++) {
+        if (testDomainConfigWrite(configDir, autostartDir, i) < 0)
+            goto cleanup;
+    }
+
+    if (!(caps = virTestGenericCapsInit()) ||
+        !(genericxmlopt = virTestGenericDomainXMLConfInit()) ||
+        !(loaded = virDomainObjListNew()))
+        goto cleanup;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (virDomainObjListLoadAllConfigs(loaded, configDir, autostartDir, 0,
+                                       caps, genericxmlopt, NULL, NULL) < 0)
+        goto cleanup;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (virDomainObjListNumOfDomains(loaded, false, NULL, NULL) !=
+        NUM_CONFIGS) {
+        VIR_TEST_DEBUG("expected %d inactive domains, found %d",
+                       NUM_CONFIGS,
+                       virDomainObjListNumOfDomains(loaded, false,
+                                                   NULL, NULL));
+        goto cleanup;
+    }
+
+    for (i = 0; i < NUM_CONFIGS; i++) {
+        virDomainObjPtr vm;
+        bool match;
+
+        if (virAsprintf(&name, "config%zu", i) < 0)
+            goto cleanup;
+
+        if (!(vm = virDomainObjListFindByName(loaded, name))) {
+            VIR_TEST_DEBUG("domain '%s' was not loaded", name);
+            goto cleanup;
+        }
+
+        match = vm->persistent &&
+            vm->autostart == (i % 3 == 0) &&
+            virDomainDefGetMemoryTotal(vm->def) == 1024 * (i + 1);
+        virDomainObjEndAPI(&vm);
+
+        if (!match) {
+            VIR_TEST_DEBUG("domain '%s' has wrong details", name);
+            goto cleanup;
+        }
+
+        VIR_FREE(name);
+    }
+
+    elapsed = (end.tv_sec - start.tv_sec) * 1000000000ull +
+        end.tv_nsec - start.tv_nsec;
+    VIR_TEST_VERBOSE("loaded %d configs in %llu ms, %llu us per domain\n",
+                     NUM_CONFIGS, elapsed / 1000000,
+                     elapsed / 1000 / NUM_CONFIGS);
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(loaded);
+    virObjectUnref(genericxmlopt);
+    virObjectUnref(caps);
+    VIR_FREE(configDir);
+    VIR_FREE(autostartDir);
+    VIR_FREE(name);
+    return ret;
+}
+
+
+#define NUM_STATUS 3
+
+/* PID of the domain as written into its status */
+static pid_t
+testDomainStatusPid(size_t i,
+                    bool stale)
+{
+    return 1000 + i + (stale ? 500 : 0);
+}
+
+
+/*
+ * Status saved by virDomainSaveStatus must be loaded back from the
+ * status cache while it matches the status XML, and from the XML once
+ * the cache is stale or damaged.
+ */
+static int
+testDomainListStatusCache(const void *opaque)
+{
+    const char *basedir = opaque;
+    unsigned int flags = VIR_DOMAIN_DEF_PARSE_STATUS |
+                         VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
+                         VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES;
+    virCapsPtr caps = NULL;
+    virDomainXMLOptionPtr genericxmlopt = NULL;
+    virDomainObjListPtr saved = NULL;
+    virDomainObjListPtr loaded = NULL;
+    virDomainObjPtr vms_status[NUM_STATUS] = { NULL };
+    virDomainObjPtr cached = NULL;
+    char *statusDir = NULL;
+    char *xml = NULL;
+    char *cacheFile = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (virAsprintf(&statusDir, "%s/status", basedir) < 0 ||
+        virFileMakePath(statusDir) < 0)
+        goto cleanup;
+
+    if (!(caps = virTestGenericCapsInit()) ||
+        !(genericxmlopt = virTestGenericDomainXMLConfInit()) ||
+        !(saved = virDomainObjListNew()) ||
+        !(loaded = virDomainObjListNew()))
+        goto cleanup;
+
+    for (i = 0; i < NUM_STATUS; i++) {
+        virDomainDefPtr def;
+
+        if (virAsprintf(&xml,
+                        "<domain type='test'>"
+                        "  <name>status%zu</name>"
+                        "  <uuid>0c2b5d6e-1f8a-4c3e-b7a9-5e4d3c2b1a%02zx</uuid>"
+                        "  <memory>1024</memory>"
+                        "  <vcpu>1</vcpu>"
+                        "  <os><type>hvm</type></os>"
+                        "</domain>", i, i) < 0)
+            goto cleanup;
+
+        def = virDomainDefParseString(xml, caps, genericxmlopt,
+                                      VIR_DOMAIN_DEF_PARSE_INACTIVE);
+        VIR_FREE(xml);
+        if (!def)
+            goto cleanup;
+
+        if (!(vms_status[i] = virDomainObjListAdd(saved, def, genericxmlopt,
+                                                  VIR_DOMAIN_OBJ_LIST_ADD_LIVE,
+                                                  NULL))) {
+            virDomainDefFree(def);
+            goto cleanup;
+        }
+        virObjectUnlock(vms_status[i]);
+
+        vms_status[i]->def->id = i + 1;
+        virDomainObjSetState(vms_status[i], VIR_DOMAIN_PAUSED,
+                             VIR_DOMAIN_PAUSED_USER);
+        vms_status[i]->pid = testDomainStatusPid(i, false);
+        virDomainObjTaint(vms_status[i], VIR_DOMAIN_TAINT_CUSTOM_ARGV);
+
+        if (virDomainSaveStatus(genericxmlopt, statusDir,
+                                vms_status[i], caps) < 0)
+            goto cleanup;
+    }
+
+    /* Only the status XML of the first domain changes */
+    vms_status[0]->pid = testDomainStatusPid(0, true);
+    if (!(xml = virDomainObjFormat(genericxmlopt, vms_status[0], caps,
+                                   VIR_DOMAIN_DEF_FORMAT_STATUS)) ||
+        virDomainSaveXML(statusDir, vms_status[0]->def, xml) < 0)
+        goto cleanup;
+
+    /* And the cache of the second one is damaged */
+    if (!(cacheFile = virDomainStatusCacheFile(statusDir,
+                                               vms_status[1]->def->name)) ||
+        virFileWriteStr(cacheFile, "garbage", 0600) < 0)
+        goto cleanup;
+
+    if (virDomainObjParseStatusCache(statusDir, vms_status[0]->def->name,
+                                     caps, genericxmlopt, flags,
+                                     &cached) != 0) {
+        VIR_TEST_DEBUG("stale status cache was not ignored");
+        goto cleanup;
+    }
+
+    if (virDomainObjParseStatusCache(statusDir, vms_status[1]->def->name,
+                                     caps, genericxmlopt, flags,
+                                     &cached) != -1) {
+        VIR_TEST_DEBUG("damaged status cache was not rejected");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    if (virDomainObjParseStatusCache(statusDir, vms_status[2]->def->name,
+                                     caps, genericxmlopt, flags,
+                                     &cached) != 1) {
+        VIR_TEST_DEBUG("status cache was not loaded");
+        goto cleanup;
+    }
+    virObjectUnref(cached);
+    cached = NULL;
+
+    if (virDomainObjListLoadAllConfigs(loaded, statusDir, NULL, 1,
+                                       caps, genericxmlopt, NULL, NULL) < 0)
+        goto cleanup;
+
+    for (i = 0; i < NUM_STATUS; i++) {
+        virDomainObjPtr vm;
+        int reason;
+        bool match;
+
+        if (!(vm = virDomainObjListFindByName(loaded,
+                                              vms_status[i]->def->name))) {
+            VIR_TEST_DEBUG("status of '%s' was not loaded",
+                           vms_status[i]->def->name);
+            goto cleanup;
+        }
+
+        match = virDomainObjGetState(vm, &reason) == VIR_DOMAIN_PAUSED &&
+            reason == VIR_DOMAIN_PAUSED_USER &&
+            vm->pid == testDomainStatusPid(i, i == 0) &&
+            vm->taint == vms_status[i]->taint &&
+            vm->def->id == vms_status[i]->def->id;
+        virDomainObjEndAPI(&vm);
+
+        if (!match) {
+            VIR_TEST_DEBUG("status of '%s' was not restored",
+                           vms_status[i]->def->name);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(cached);
+    virObjectUnref(loaded);
+    virObjectUnref(saved);
+    virObjectUnref(genericxmlopt);
+    virObjectUnref(caps);
+    VIR_FREE(statusDir);
+    VIR_FREE(xml);
+    VIR_FREE(cacheFile);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create virdomainobjlistdata");
+        abort();
+    }
+
+    if (!(xmlopt = virDomainXMLOptionNew(NULL, NULL, NULL)) ||
+        !(doms = virDomainObjListNew()) ||
+        testDomainListPopulate() < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virTestRun("Find by ID", testDomainListFindByID, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Find by ID after restart",
+                   testDomainListFindByIDStale, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Find by ID after remove",
+                   testDomainListFindByIDRemove, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Find by ID benchmark",
+                   testDomainListFindByIDBench, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Parallel lookups",
+                   testDomainListLookupParallel, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Load configs benchmark",
+                   testDomainListLoadConfigsBench, scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("Status cache",
+                   testDomainListStatusCache, scratchdir) < 0)
+        ret = -1;
+
+ cleanup:
+    virObjectUnref(doms);
+    virObjectUnref(xmlopt);
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
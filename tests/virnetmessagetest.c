@@ -22,13 +22,19 @@
 
 #include <stdlib.h>
 #include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
 
 #include "testutils.h"
 #include "virerror.h"
 #include "viralloc.h"
 #include "virlog.h"
+#include "virfile.h"
 #include "virstring.h"
+#include "virthread.h"
+#include "viruuid.h"
 #include "rpc/virnetmessage.h"
+#include "rpc/virnetsocket.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -521,6 +527,520 @@ static int testMessagePayloadStreamEncode(const void *args ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static int testMessagePayloadStreamSplice(const void *args ATTRIBUTE_UNUSED)
+{
+    virNetMessagePtr msg = virNetMessageNew(true);
+    static const char expect[] = {
+        0x00, 0x00, 0x00, 0x47,  /* Length, including 43 spliced bytes */
+        0x11, 0x22, 0x33, 0x44,  /* Program */
+        0x00, 0x00, 0x00, 0x01,  /* Version */
+        0x00, 0x00, 0x06, 0x66,  /* Procedure */
+        0x00, 0x00, 0x00, 0x03,  /* Type */
+        0x00, 0x00, 0x00, 0x99,  /* Serial */
+        0x00, 0x00, 0x00, 0x02,  /* Status */
+    };
+    int pipefd[2] = { -1, -1 };
+    int ret = -1;
+
+    if (!msg)
+        return -1;
+
+    if (pipe(pipefd) < 0)
+        goto cleanup;
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_STREAM;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (virNetMessageEncodePayloadSplice(msg, pipefd[0], 43) < 0) {
+        pipefd[0] = -1;
+        goto cleanup;
+    }
+
+    if (ARRAY_CARDINALITY(expect) != msg->bufferLength) {
+        VIR_DEBUG("Expect message length %zu got %zu",
+                  sizeof(expect), msg->bufferLength);
+        goto cleanup;
+    }
+
+    if (msg->spliceFD != pipefd[0] || msg->spliceLength != 43) {
+        VIR_DEBUG("Expect to splice 43 bytes from %d, got %zu from %d",
+                  pipefd[0], msg->spliceLength, msg->spliceFD);
+        goto cleanup;
+    }
+    pipefd[0] = -1;
+
+    if (memcmp(expect, msg->buffer, sizeof(expect)) != 0) {
+        virTestDifferenceBin(stderr, expect, msg->buffer, sizeof(expect));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    VIR_FORCE_CLOSE(pipefd[0]);
+    VIR_FORCE_CLOSE(pipefd[1]);
+    return ret;
+}
+
+
+static int testMessagePool(const void *args ATTRIBUTE_UNUSED)
+{
+    virNetMessagePtr msg = NULL;
+    unsigned long long hits, misses, nbytes;
+    unsigned long long oldHits, oldMisses;
+    size_t nmsgs, nbuffers;
+    char *buffer;
+    int ret = -1;
+
+    /* Make sure the pool holds at least one default sized buffer */
+    if (!(msg = virNetMessageNew(false)) ||
+        virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+    virNetMessageFree(msg);
+    msg = NULL;
+
+    virNetMessagePoolGetStats(&oldHits, &oldMisses, &nmsgs,
+                              &nbuffers, &nbytes);
+    if (nmsgs == 0 || nbuffers == 0 || nbytes == 0) {
+        VIR_DEBUG("Expect a cached message and buffer, got %zu and %zu",
+                  nmsgs, nbuffers);
+        goto cleanup;
+    }
+
+    if (!(msg = virNetMessageNew(false)) ||
+        virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    virNetMessagePoolGetStats(&hits, &misses, &nmsgs, &nbuffers, &nbytes);
+    if (hits != oldHits + 1 || misses != oldMisses) {
+        VIR_DEBUG("Expect the buffer to come from the pool");
+        goto cleanup;
+    }
+
+    /* Growing the buffer must keep what was written so far */
+    memset(msg->buffer, 'x', msg->bufferAlloc);
+    buffer = msg->buffer;
+    if (virNetMessageReserveBuffer(msg, msg->bufferAlloc + 1) < 0)
+        goto cleanup;
+
+    if (msg->buffer == buffer ||
+        msg->bufferAlloc < VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX + 1 ||
+        msg->buffer[0] != 'x' ||
+        msg->buffer[VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX - 1] != 'x') {
+        VIR_DEBUG("Expect the buffer to grow with its contents");
+        goto cleanup;
+    }
+
+    /* Reserving less than what is there is a no-op */
+    buffer = msg->buffer;
+    if (virNetMessageReserveBuffer(msg, 1) < 0 ||
+        msg->buffer != buffer) {
+        VIR_DEBUG("Expect the buffer to be kept");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
+/* Mimics remote_connect_get_all_domain_stats_ret */
+#define BENCH_STATS_RECORDS 5000
+#define BENCH_STATS_PARAMS 20
+#define BENCH_STATS_LOOPS 10
+
+struct testStatsParam {
+    char *field;
+    int type;
+    u_quad_t value;
+};
+
+struct testStatsRecord {
+    char *name;
+    char uuid[VIR_UUID_BUFLEN];
+    u_int nparams;
+    struct testStatsParam *params;
+};
+
+struct testStatsReply {
+    u_int nrecords;
+    struct testStatsRecord *records;
+};
+
+
+static bool_t
+testStatsParamXDR(XDR *xdrs, struct testStatsParam *param)
+{
+    return xdr_string(xdrs, &param->field, VIR_TYPED_PARAM_FIELD_LENGTH) &&
+        xdr_int(xdrs, &param->type) &&
+        xdr_u_hyper(xdrs, &param->value);
+}
+
+
+static bool_t
+testStatsRecordXDR(XDR *xdrs, struct testStatsRecord *record)
+{
+    char *params = (char *) record->params;
+
+    return xdr_string(xdrs, &record->name, 256) &&
+        xdr_opaque(xdrs, record->uuid, VIR_UUID_BUFLEN) &&
+        xdr_array(xdrs, &params, &record->nparams, BENCH_STATS_PARAMS,
+                  sizeof(*record->params), (xdrproc_t) testStatsParamXDR);
+}
+
+
+static bool_t
+testStatsReplyXDR(XDR *xdrs, struct testStatsReply *reply)
+{
+    char *records = (char *) reply->records;
+
+    return xdr_array(xdrs, &records, &reply->nrecords, BENCH_STATS_RECORDS,
+                     sizeof(*reply->records), (xdrproc_t) testStatsRecordXDR);
+}
+
+
+/* How payloads used to be encoded: retry in a buffer four times as
+ * big until the payload fits */
+static int
+testStatsEncodeGrowing(virNetMessagePtr msg,
+                       struct testStatsReply *reply)
+{
+    XDR xdr;
+
+    xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
+                  msg->bufferLength - msg->bufferOffset, XDR_ENCODE);
+
+    while (!testStatsReplyXDR(&xdr, reply)) {
+        xdr_destroy(&xdr);
+
+        msg->bufferLength = (msg->bufferLength - VIR_NET_MESSAGE_LEN_MAX) * 4 +
+            VIR_NET_MESSAGE_LEN_MAX;
+        if (msg->bufferLength > VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX ||
+            virNetMessageReserveBuffer(msg, msg->bufferLength) < 0)
+            return -1;
+
+        xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
+                      msg->bufferLength - msg->bufferOffset, XDR_ENCODE);
+    }
+
+    msg->bufferOffset += xdr_getpos(&xdr);
+    xdr_destroy(&xdr);
+    return 0;
+}
+
+
+/*
+ * Encode a reply the size of a bulk stats reply for a few thousand
+ * domains, once sized up front and once growing the buffer, and
+ * report the cost of both. Both must produce the same payload.
+ */
+static int
+testMessageStatsEncodeBench(const void *args ATTRIBUTE_UNUSED)
+{
+    struct testStatsReply reply = { 0, NULL };
+    virNetMessagePtr msg = NULL;
+    char *sized = NULL;
+    size_t sizedLen = 0;
+    struct timespec start, end;
+    unsigned long long elapsed[2];
+    size_t pass;
+    size_t i, j;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(reply.records, BENCH_STATS_RECORDS) < 0)
+        goto cleanup;
+    reply.nrecords = BENCH_STATS_RECORDS;
+
+    for (i = 0; i < BENCH_STATS_RECORDS; i++) {
+        struct testStatsRecord *record = &reply.records[i];
+
+        if (virAsprintf(&record->name, "domain%zu", i) < 0 ||
+            VIR_ALLOC_N(record->params, BENCH_STATS_PARAMS) < 0)
+            goto cleanup;
+        memset(record->uuid, i & 0xff, VIR_UUID_BUFLEN);
+        record->nparams = BENCH_STATS_PARAMS;
+
+        for (j = 0; j < BENCH_STATS_PARAMS; j++) {
+            if (virAsprintf(&record->params[j].field, "block.%zu.rd.bytes", j) < 0)
+                goto cleanup;
+            record->params[j].type = VIR_TYPED_PARAM_ULLONG;
+            record->params[j].value = i * j;
+        }
+    }
+
+    for (pass = 0; pass < 2; pass++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < BENCH_STATS_LOOPS; i++) {
+            int rc;
+
+            if (!(msg = virNetMessageNew(false)) ||
+                virNetMessageEncodeHeader(msg) < 0)
+                goto cleanup;
+
+            if (pass == 0)
+                rc = virNetMessageEncodePayload(msg,
+                                                (xdrproc_t) testStatsReplyXDR,
+                                                &reply);
+            else
+                rc = testStatsEncodeGrowing(msg, &reply);
+            if (rc < 0)
+                goto cleanup;
+
+            if (pass == 0 && !sized) {
+                sizedLen = msg->bufferLength;
+                if (VIR_ALLOC_N(sized, sizedLen) < 0)
+                    goto cleanup;
+                memcpy(sized, msg->buffer, sizedLen);
+            } else if (pass == 1 && i == 0 &&
+                       (msg->bufferOffset != sizedLen ||
+                        memcmp(sized + VIR_NET_MESSAGE_LEN_MAX,
+                               msg->buffer + VIR_NET_MESSAGE_LEN_MAX,
+                               sizedLen - VIR_NET_MESSAGE_LEN_MAX) != 0)) {
+                VIR_TEST_DEBUG("payloads encoded differently");
+                goto cleanup;
+            }
+
+            virNetMessageFree(msg);
+            msg = NULL;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        elapsed[pass] = (end.tv_sec - start.tv_sec) * 1000000000ull +
+            end.tv_nsec - start.tv_nsec;
+    }
+
+    VIR_TEST_VERBOSE("%d record stats reply of %zu bytes: %llu ns sized, "
+                     "%llu ns growing\n",
+                     BENCH_STATS_RECORDS, sizedLen,
+                     elapsed[0] / BENCH_STATS_LOOPS,
+                     elapsed[1] / BENCH_STATS_LOOPS);
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    VIR_FREE(sized);
+    for (i = 0; i < reply.nrecords; i++) {
+        VIR_FREE(reply.records[i].name);
+        for (j = 0; reply.records[i].params && j < BENCH_STATS_PARAMS; j++)
+            VIR_FREE(reply.records[i].params[j].field);
+        VIR_FREE(reply.records[i].params);
+    }
+    VIR_FREE(reply.records);
+    return ret;
+}
+
+
+#ifndef WIN32
+# define BENCH_STREAM_TOTAL (64 * 1024 * 1024)
+
+struct testStreamBenchData {
+    virNetSocketPtr sock;
+    const char *data;
+    size_t chunk;
+    int ret;
+};
+
+
+static int
+testStreamBenchWrite(virNetSocketPtr sock,
+                     const char *buf,
+                     size_t len)
+{
+    while (len) {
+        ssize_t rv = virNetSocketWrite(sock, buf, len);
+        if (rv < 0)
+            return -1;
+        buf += rv;
+        len -= rv;
+    }
+    return 0;
+}
+
+
+static int
+testStreamBenchRead(virNetSocketPtr sock,
+                    char *buf,
+                    size_t len)
+{
+    while (len) {
+        ssize_t rv = virNetSocketRead(sock, buf, len);
+        if (rv <= 0)
+            return -1;
+        buf += rv;
+        len -= rv;
+    }
+    return 0;
+}
+
+
+/* Frame the data the way the daemon frames stream data */
+static void
+testStreamBenchSender(void *opaque)
+{
+    struct testStreamBenchData *data = opaque;
+    size_t sent = 0;
+
+    data->ret = -1;
+
+    while (sent < BENCH_STREAM_TOTAL) {
+        virNetMessagePtr msg;
+        int rv;
+
+        if (!(msg = virNetMessageNew(false)))
+            return;
+
+        msg->header.prog = 0x11223344;
+        msg->header.vers = 0x01;
+        msg->header.proc = 0x666;
+        msg->header.type = VIR_NET_STREAM;
+        msg->header.serial = 0x99;
+        msg->header.status = VIR_NET_CONTINUE;
+
+        rv = -1;
+        if (virNetMessageEncodeHeader(msg) == 0 &&
+            virNetMessageEncodePayloadRaw(msg, data->data, data->chunk) == 0)
+            rv = testStreamBenchWrite(data->sock, msg->buffer,
+                                      msg->bufferLength);
+        virNetMessageFree(msg);
+        if (rv < 0)
+            return;
+
+        sent += data->chunk;
+    }
+
+    data->ret = 0;
+}
+
+
+/* And unpack it again the way the client does */
+static int
+testStreamBenchReceive(virNetSocketPtr sock)
+{
+    size_t received = 0;
+
+    while (received < BENCH_STREAM_TOTAL) {
+        virNetMessagePtr msg;
+        int rv = -1;
+
+        if (!(msg = virNetMessageNew(false)))
+            return -1;
+
+        msg->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
+        if (VIR_ALLOC_N(msg->buffer, msg->bufferLength) == 0 &&
+            testStreamBenchRead(sock, msg->buffer, msg->bufferLength) == 0 &&
+            virNetMessageDecodeLength(msg) == 0 &&
+            testStreamBenchRead(sock, msg->buffer + msg->bufferOffset,
+                                msg->bufferLength - msg->bufferOffset) == 0 &&
+            virNetMessageDecodeHeader(msg) == 0 &&
+            msg->header.type == VIR_NET_STREAM) {
+            received += msg->bufferLength - msg->bufferOffset;
+            rv = 0;
+        }
+        virNetMessageFree(msg);
+        if (rv < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Push stream data through a UNIX socket, once in chunks of the
+ * legacy payload size and once in the large chunks peers can agree
+ * on, and report the throughput of both. Moving that much data
+ * takes a while, so it only runs with VIR_TEST_EXPENSIVE=1.
+ */
+static int
+testMessageStreamChunkBench(const void *args ATTRIBUTE_UNUSED)
+{
+    const size_t chunks[] = { VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX,
+                              VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX };
+    unsigned long long elapsed[ARRAY_CARDINALITY(chunks)];
+    char *buf = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (virTestGetExpensive() == 0)
+        return EXIT_AM_SKIP;
+
+    if (VIR_ALLOC_N(buf, VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX) < 0)
+        return -1;
+    memset(buf, 'x', VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX);
+
+    for (i = 0; i < ARRAY_CARDINALITY(chunks); i++) {
+        struct testStreamBenchData data = { NULL, buf, chunks[i], -1 };
+        virNetSocketPtr rsock = NULL;
+        struct timespec start, end;
+        virThread thread;
+        int sv[2];
+        int rv;
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+            goto cleanup;
+
+        if (virNetSocketNewConnectSockFD(sv[0], &data.sock) < 0) {
+            VIR_FORCE_CLOSE(sv[0]);
+            VIR_FORCE_CLOSE(sv[1]);
+            goto cleanup;
+        }
+        if (virNetSocketNewConnectSockFD(sv[1], &rsock) < 0) {
+            VIR_FORCE_CLOSE(sv[1]);
+            virObjectUnref(data.sock);
+            goto cleanup;
+        }
+
+        if (virNetSocketSetBlocking(data.sock, true) < 0 ||
+            virNetSocketSetBlocking(rsock, true) < 0)
+            goto error;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (virThreadCreate(&thread, true, testStreamBenchSender, &data) < 0)
+            goto error;
+        rv = testStreamBenchReceive(rsock);
+        if (rv < 0)
+            virNetSocketClose(rsock);
+        virThreadJoin(&thread);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (rv < 0 || data.ret < 0)
+            goto error;
+
+        elapsed[i] = (end.tv_sec - start.tv_sec) * 1000000000ull +
+            end.tv_nsec - start.tv_nsec;
+
+        virObjectUnref(data.sock);
+        virObjectUnref(rsock);
+        continue;
+
+     error:
+        virObjectUnref(data.sock);
+        virObjectUnref(rsock);
+        goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(chunks); i++) {
+        VIR_TEST_VERBOSE("%zu byte chunks: %llu MiB/s\n", chunks[i],
+                         BENCH_STREAM_TOTAL * 1000000000ull /
+                         (1024 * 1024) / MAX(elapsed[i], 1));
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(buf);
+    return ret;
+}
+#endif /* !WIN32 */
+
 
 static int
 mymain(void)
@@ -544,6 +1064,20 @@ mymain(void)
     if (virTestRun("Message Payload Stream Encode", testMessagePayloadStreamEncode, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Message Payload Stream Splice", testMessagePayloadStreamSplice, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Message Pool", testMessagePool, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Message Stats Encode Benchmark", testMessageStatsEncodeBench, NULL) < 0)
+        ret = -1;
+
+#ifndef WIN32
+    if (virTestRun("Message Stream Chunk Benchmark", testMessageStreamChunkBench, NULL) < 0)
+        ret = -1;
+#endif
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -137,15 +137,315 @@ static int testIdentity(const void *opaque ATTRIBUTE_UNUSED)
 }
 
 
+static int
+testBeginCall(virNetServerClientPtr client,
+              virNetMessagePtr msg,
+              bool readonly,
+              int expect)
+{
+    int rv;
+
+    virObjectLock(client);
+    rv = virNetServerClientBeginCallLocked(client, msg, readonly);
+    virObjectUnlock(client);
+
+    if (rv != expect) {
+        fprintf(stderr, "Call %d: want %d got %d\n",
+                msg->header.serial, expect, rv);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Ends a call which must not let any queued call start */
+static int
+testEndCall(virNetServerClientPtr client,
+            bool readonly)
+{
+    virNetMessagePtr ready = virNetServerClientEndCall(client, readonly);
+
+    if (!ready)
+        return 0;
+
+    fprintf(stderr, "Call %d started too early\n", ready->header.serial);
+    while (ready)
+        virNetMessageFree(virNetMessageQueueServe(&ready));
+    return -1;
+}
+
+
+/*
+ * Read-only calls may run in parallel, others must wait for
+ * everything before them and hold back everything after them.
+ */
+static int testOrderedCalls(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int sv[2];
+    int ret = -1;
+    virNetSocketPtr sock = NULL;
+    virNetServerClientPtr client = NULL;
+    virNetMessagePtr msgs[5] = { NULL };
+    size_t i;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        virReportSystemError(errno, "%s",
+                             "Cannot create socket pair");
+        return -1;
+    }
+
+    if (virNetSocketNewConnectSockFD(sv[0], &sock) < 0) {
+        virDispatchError(NULL);
+        goto cleanup;
+    }
+    sv[0] = -1;
+
+    if (!(client = virNetServerClientNew(1, sock, 0, false, 1,
+# ifdef WITH_GNUTLS
+                                         NULL,
+# endif
+                                         NULL, NULL, NULL, NULL))) {
+        virDispatchError(NULL);
+        goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(msgs); i++) {
+        if (!(msgs[i] = virNetMessageNew(true)))
+            goto cleanup;
+        msgs[i]->header.serial = i;
+    }
+
+    /* Two read-only calls run at once, the writer queues and
+     * the read-only call behind it must not overtake it */
+    if (testBeginCall(client, msgs[0], true, 1) < 0 ||
+        testBeginCall(client, msgs[1], true, 1) < 0)
+        goto cleanup;
+
+    /* Queued messages belong to the client until handed back */
+    for (i = 2; i < ARRAY_CARDINALITY(msgs); i++) {
+        virNetMessagePtr msg = msgs[i];
+
+        msgs[i] = NULL;
+        if (testBeginCall(client, msg, i == 3, 0) < 0) {
+            virNetMessageFree(msg);
+            goto cleanup;
+        }
+    }
+
+    if (testEndCall(client, true) < 0)
+        goto cleanup;
+
+    if (!(msgs[2] = virNetServerClientEndCall(client, true)) ||
+        msgs[2]->header.serial != 2 || msgs[2]->next) {
+        fprintf(stderr, "Writer did not start once readers finished\n");
+        goto cleanup;
+    }
+
+    if (!(msgs[3] = virNetServerClientEndCall(client, false)) ||
+        msgs[3]->header.serial != 3 || msgs[3]->next) {
+        fprintf(stderr, "Reader did not start once writer finished\n");
+        goto cleanup;
+    }
+
+    if (!(msgs[4] = virNetServerClientEndCall(client, true)) ||
+        msgs[4]->header.serial != 4 || msgs[4]->next) {
+        fprintf(stderr, "Second writer did not start\n");
+        goto cleanup;
+    }
+
+    if (testEndCall(client, false) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < ARRAY_CARDINALITY(msgs); i++)
+        virNetMessageFree(msgs[i]);
+    virObjectUnref(sock);
+    virObjectUnref(client);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    return ret;
+}
+
+
+static int
+testTxSend(virNetServerClientPtr client,
+           int proc,
+           virNetMessageType type,
+           size_t nevents,
+           int expect)
+{
+    virNetMessagePtr msg;
+    int rv;
+
+    if (!(msg = virNetMessageNew(false)))
+        return -1;
+    msg->header.proc = proc;
+    msg->header.type = type;
+    msg->nevents = nevents;
+
+    if ((rv = virNetServerClientSendMessage(client, msg)) < 0)
+        virNetMessageFree(msg);
+
+    if (rv != expect) {
+        fprintf(stderr, "Message %d: want %d got %d\n", proc, expect, rv);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testTxCheckStats(virNetServerClientPtr client,
+                 size_t messages,
+                 unsigned long long dropped,
+                 unsigned long long coalesced)
+{
+    virNetServerClientTxStats stats;
+
+    virNetServerClientGetTxStats(client, &stats);
+    if (stats.messages != messages ||
+        stats.dropped != dropped ||
+        stats.coalesced != coalesced) {
+        fprintf(stderr, "Want %zu queued, %llu dropped, %llu coalesced, "
+                "got %zu, %llu, %llu\n",
+                messages, dropped, coalesced,
+                stats.messages, stats.dropped, stats.coalesced);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static bool
+testTxCoalesce(virNetMessagePtr old,
+               virNetMessagePtr msg)
+{
+    return old->header.proc == msg->header.proc;
+}
+
+
+/*
+ * Events beyond the limits of the 'tx' queue are dropped or
+ * coalesced, or get the client closed, replies are always queued.
+ */
+static int testTxLimits(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int sv[2];
+    int ret = -1;
+    virNetSocketPtr sock = NULL;
+    virNetServerClientPtr client = NULL;
+    size_t i;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        virReportSystemError(errno, "%s",
+                             "Cannot create socket pair");
+        return -1;
+    }
+
+    if (virNetSocketNewConnectSockFD(sv[0], &sock) < 0) {
+        virDispatchError(NULL);
+        goto cleanup;
+    }
+    sv[0] = -1;
+
+    if (!(client = virNetServerClientNew(1, sock, 0, false, 1,
+# ifdef WITH_GNUTLS
+                                         NULL,
+# endif
+                                         NULL, NULL, NULL, NULL))) {
+        virDispatchError(NULL);
+        goto cleanup;
+    }
+
+    /* The socket is never watched, so nothing leaves the queue */
+    virNetServerClientSetTxLimits(client, 3, 0,
+                                  VIR_NET_SERVER_CLIENT_TX_POLICY_DROP);
+    for (i = 0; i < 5; i++) {
+        if (testTxSend(client, i, VIR_NET_MESSAGE, 1, 0) < 0)
+            goto cleanup;
+    }
+    if (testTxCheckStats(client, 3, 2, 0) < 0)
+        goto cleanup;
+
+    /* Neither replies nor messages not marked as events,
+     * like keepalives, are ever dropped */
+    if (testTxSend(client, 5, VIR_NET_REPLY, 0, 0) < 0 ||
+        testTxSend(client, 100, VIR_NET_MESSAGE, 0, 0) < 0 ||
+        testTxCheckStats(client, 5, 2, 0) < 0)
+        goto cleanup;
+
+    /* Each event of a dropped batch counts */
+    virNetServerClientSetTxLimits(client, 5, 0,
+                                  VIR_NET_SERVER_CLIENT_TX_POLICY_DROP);
+    if (testTxSend(client, 20, VIR_NET_MESSAGE, 10, 0) < 0)
+        goto cleanup;
+    for (i = 21; i < 24; i++) {
+        if (testTxSend(client, i, VIR_NET_MESSAGE, 1, 0) < 0)
+            goto cleanup;
+    }
+    if (testTxCheckStats(client, 5, 15, 0) < 0)
+        goto cleanup;
+
+    /* Proc 22 supersedes the queued one, proc 24 has to
+     * push out the oldest event instead */
+    virNetServerClientSetCoalesceFunc(client, testTxCoalesce);
+    virNetServerClientSetTxLimits(client, 5, 0,
+                                  VIR_NET_SERVER_CLIENT_TX_POLICY_COALESCE);
+    if (testTxSend(client, 22, VIR_NET_MESSAGE, 1, 0) < 0 ||
+        testTxCheckStats(client, 5, 15, 1) < 0 ||
+        testTxSend(client, 24, VIR_NET_MESSAGE, 1, 0) < 0 ||
+        testTxCheckStats(client, 5, 16, 1) < 0)
+        goto cleanup;
+
+    virNetServerClientSetTxLimits(client, 5, 0,
+                                  VIR_NET_SERVER_CLIENT_TX_POLICY_CLOSE);
+    if (testTxSend(client, 101, VIR_NET_MESSAGE, 0, 0) < 0)
+        goto cleanup;
+    if (virNetServerClientWantClose(client)) {
+        fprintf(stderr, "Client was closed for a keepalive\n");
+        goto cleanup;
+    }
+    if (testTxSend(client, 25, VIR_NET_MESSAGE, 1, -1) < 0)
+        goto cleanup;
+    if (!virNetServerClientWantClose(client)) {
+        fprintf(stderr, "Client was not closed\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (client)
+        virNetServerClientClose(client);
+    virObjectUnref(sock);
+    virObjectUnref(client);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
     int ret = 0;
 
+    /* Clients need an event loop for their timers */
+    if (virEventRegisterDefaultImpl() < 0)
+        return EXIT_FAILURE;
 
     if (virTestRun("Identity",
                    testIdentity, NULL) < 0)
         ret = -1;
+    if (virTestRun("Ordered calls",
+                   testOrderedCalls, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Tx queue limits",
+                   testTxLimits, NULL) < 0)
+        ret = -1;
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -438,6 +438,123 @@ static int testSocketSSH(const void *opaque)
 #endif
 
 
+#ifdef HAVE_SPLICE
+static int testSocketSplice(const void *data ATTRIBUTE_UNUSED)
+{
+    virNetSocketPtr sock = NULL;
+    int sv[2] = { -1, -1 };
+    int pipefd[2] = { -1, -1 };
+    const char *msg = "The quick brown fox jumps over the lazy dog";
+    size_t len = strlen(msg);
+    char buf[100];
+    size_t done = 0;
+    int ret = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0 ||
+        pipe(pipefd) < 0)
+        goto cleanup;
+
+    if (safewrite(pipefd[1], msg, len) < 0)
+        goto cleanup;
+
+    if (virNetSocketNewConnectSockFD(sv[0], &sock) < 0)
+        goto cleanup;
+    sv[0] = -1;
+
+    if (!virNetSocketHasSplice(sock)) {
+        VIR_DEBUG("Splicing is not possible on a UNIX socket");
+        goto cleanup;
+    }
+
+    while (done < len) {
+        ssize_t rv = virNetSocketSplice(sock, pipefd[0], len - done);
+        if (rv < 0)
+            goto cleanup;
+        done += rv;
+    }
+
+    if (saferead(sv[1], buf, len) != (ssize_t) len ||
+        memcmp(buf, msg, len) != 0) {
+        VIR_DEBUG("Spliced data did not arrive intact");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(sock);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    VIR_FORCE_CLOSE(pipefd[0]);
+    VIR_FORCE_CLOSE(pipefd[1]);
+    return ret;
+}
+#endif
+
+
+#ifndef WIN32
+static int testSocketWritev(const void *data ATTRIBUTE_UNUSED)
+{
+    virNetSocketPtr sock = NULL;
+    int sv[2] = { -1, -1 };
+    const char *msg = "The quick brown fox jumps over the lazy dog";
+    size_t len = strlen(msg);
+    struct iovec iov[3];
+    size_t niov = ARRAY_CARDINALITY(iov);
+    size_t i = 0;
+    char buf[100];
+    size_t done = 0;
+    int ret = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        goto cleanup;
+
+    if (virNetSocketNewConnectSockFD(sv[0], &sock) < 0)
+        goto cleanup;
+    sv[0] = -1;
+
+    /* Three pieces, the last one empty */
+    iov[0].iov_base = (char *) msg;
+    iov[0].iov_len = 10;
+    iov[1].iov_base = (char *) msg + 10;
+    iov[1].iov_len = len - 10;
+    iov[2].iov_base = (char *) msg + len;
+    iov[2].iov_len = 0;
+
+    while (done < len) {
+        ssize_t rv;
+        size_t left;
+
+        if ((rv = virNetSocketWritev(sock, iov + i, niov - i)) < 0)
+            goto cleanup;
+        done += rv;
+
+        /* Skip over what was written */
+        for (left = rv; i < niov && left >= iov[i].iov_len; i++)
+            left -= iov[i].iov_len;
+        if (i < niov) {
+            iov[i].iov_base = (char *) iov[i].iov_base + left;
+            iov[i].iov_len -= left;
+        }
+    }
+
+    if (saferead(sv[1], buf, len) != (ssize_t) len ||
+        memcmp(buf, msg, len) != 0) {
+        VIR_DEBUG("Gathered data did not arrive intact");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(sock);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    return ret;
+}
+#endif
+
+
 static int
 mymain(void)
 {
@@ -594,6 +711,16 @@ mymain(void)
 
 #endif
 
+#ifdef HAVE_SPLICE
+    if (virTestRun("Socket splice", testSocketSplice, NULL) < 0)
+        ret = -1;
+#endif
+
+#ifndef WIN32
+    if (virTestRun("Socket writev", testSocketWritev, NULL) < 0)
+        ret = -1;
+#endif
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
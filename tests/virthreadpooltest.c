@@ -0,0 +1,421 @@
+/*
+ * Copyright (C) 2016 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "viralloc.h"
+#include "viratomic.h"
+#include "virlog.h"
+#include "virthread.h"
+#include "virthreadpool.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.virthreadpooltest");
+
+#define NUM_WORKERS 64
+#define NUM_SENDERS 8
+#define NUM_JOBS 200000
+
+
+struct testPoolData {
+    virMutex lock;
+    virCond done;
+    int pending;
+    int *runs;
+    int blocked;    /* Jobs without a priority wait for this to clear */
+};
+
+
+static void
+testPoolJob(void *jobdata,
+            void *opaque)
+{
+    struct testPoolData *data = opaque;
+    size_t n = (size_t) jobdata;
+
+    if (virAtomicIntGet(&data->blocked) && n > 0) {
+        virMutexLock(&data->lock);
+        while (virAtomicIntGet(&data->blocked))
+            ignore_value(virCondWait(&data->done, &data->lock));
+        virMutexUnlock(&data->lock);
+    }
+
+    virAtomicIntInc(&data->runs[n]);
+
+    if (virAtomicIntDecAndTest(&data->pending)) {
+        virMutexLock(&data->lock);
+        virCondBroadcast(&data->done);
+        virMutexUnlock(&data->lock);
+    }
+}
+
+
+static int
+testPoolDataInit(struct testPoolData *data,
+                 size_t njobs)
+{
+    memset(data, 0, sizeof(*data));
+
+    if (virMutexInit(&data->lock) < 0)
+        return -1;
+    if (virCondInit(&data->done) < 0) {
+        virMutexDestroy(&data->lock);
+        return -1;
+    }
+    if (VIR_ALLOC_N(data->runs, njobs) < 0) {
+        virCondDestroy(&data->done);
+        virMutexDestroy(&data->lock);
+        return -1;
+    }
+
+    data->pending = njobs;
+    return 0;
+}
+
+
+static void
+testPoolDataClear(struct testPoolData *data)
+{
+    VIR_FREE(data->runs);
+    virCondDestroy(&data->done);
+    virMutexDestroy(&data->lock);
+}
+
+
+static void
+testPoolWait(struct testPoolData *data)
+{
+    virMutexLock(&data->lock);
+    while (virAtomicIntGet(&data->pending) > 0)
+        ignore_value(virCondWait(&data->done, &data->lock));
+    virMutexUnlock(&data->lock);
+}
+
+
+struct testPoolSender {
+    virThreadPoolPtr pool;
+    size_t first;
+    size_t njobs;
+    int failed;
+};
+
+
+static void
+testPoolSenderThread(void *opaque)
+{
+    struct testPoolSender *sender = opaque;
+    size_t i;
+
+    for (i = 0; i < sender->njobs; i++) {
+        if (virThreadPoolSendJob(sender->pool, 0,
+                                 (void *) (sender->first + i)) < 0)
+            sender->failed++;
+    }
+}
+
+
+/*
+ * Send NUM_JOBS empty jobs from NUM_SENDERS threads at once
+ * and wait for all of them to run.
+ */
+static int
+testPoolRun(unsigned int flags,
+            unsigned long long *elapsed)
+{
+    virThreadPoolPtr pool = NULL;
+    struct testPoolData data;
+    struct testPoolSender senders[NUM_SENDERS];
+    virThread threads[NUM_SENDERS];
+    struct timespec start, end;
+    size_t nthreads;
+    size_t i;
+    int ret = -1;
+
+    if (testPoolDataInit(&data, NUM_JOBS) < 0)
+        return -1;
+
+    if (!(pool = virThreadPoolNewFlags(NUM_WORKERS, NUM_WORKERS, 0,
+                                       testPoolJob, &data, flags)))
+        goto cleanup;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (nthreads = 0; nthreads < NUM_SENDERS; nthreads++) {
+        senders[nthreads].pool = pool;
+        senders[nthreads].first = nthreads * (NUM_JOBS / NUM_SENDERS);
+        senders[nthreads].njobs = NUM_JOBS / NUM_SENDERS;
+        senders[nthreads].failed = 0;
+        if (virThreadCreate(&threads[nthreads], true,
+                            testPoolSenderThread,
+                            &senders[nthreads]) < 0)
+            break;
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        virThreadJoin(&threads[i]);
+        if (senders[i].failed) {
+            VIR_TEST_DEBUG("sender %zu failed to send %d jobs",
+                           i, senders[i].failed);
+            nthreads = 0;
+        }
+    }
+
+    /* Make up for the jobs which were never sent */
+    if (nthreads < NUM_SENDERS) {
+        virAtomicIntAdd(&data.pending,
+                        -(int) (NUM_SENDERS - nthreads) *
+                        (NUM_JOBS / NUM_SENDERS));
+        testPoolWait(&data);
+        goto cleanup;
+    }
+
+    testPoolWait(&data);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (i = 0; i < NUM_JOBS; i++) {
+        if (data.runs[i] != 1) {
+            VIR_TEST_DEBUG("job %zu ran %d times", i, data.runs[i]);
+            goto cleanup;
+        }
+    }
+
+    if (virThreadPoolGetJobQueueDepth(pool) != 0) {
+        VIR_TEST_DEBUG("%zu jobs still queued",
+                       virThreadPoolGetJobQueueDepth(pool));
+        goto cleanup;
+    }
+
+    *elapsed = (end.tv_sec - start.tv_sec) * 1000000000ull +
+        end.tv_nsec - start.tv_nsec;
+    ret = 0;
+
+ cleanup:
+    virThreadPoolFree(pool);
+    testPoolDataClear(&data);
+    return ret;
+}
+
+
+static int
+testPoolContentionBench(const void *opaque ATTRIBUTE_UNUSED)
+{
+    unsigned long long shared, stealing;
+
+    if (testPoolRun(0, &shared) < 0 ||
+        testPoolRun(VIR_THREAD_POOL_WORK_STEALING, &stealing) < 0)
+        return -1;
+
+    VIR_TEST_VERBOSE("%d jobs from %d threads on %d workers: "
+                     "%llu ns per job with a single list, "
+                     "%llu ns with work stealing\n",
+                     NUM_JOBS, NUM_SENDERS, NUM_WORKERS,
+                     shared / NUM_JOBS, stealing / NUM_JOBS);
+
+    return 0;
+}
+
+
+/*
+ * With every worker stuck on a job, a job with a priority
+ * must still be run by a priority worker.
+ */
+static int
+testPoolPriority(const void *opaque)
+{
+    unsigned int flags = *(const unsigned int *) opaque;
+    virThreadPoolPtr pool = NULL;
+    struct testPoolData data;
+    size_t i;
+    int ret = -1;
+
+    if (testPoolDataInit(&data, 5) < 0)
+        return -1;
+
+    data.blocked = 1;
+    data.pending = 1;
+
+    if (!(pool = virThreadPoolNewFlags(2, 2, 1, testPoolJob,
+                                       &data, flags)))
+        goto cleanup;
+
+    for (i = 1; i < 5; i++) {
+        if (virThreadPoolSendJob(pool, 0, (void *) i) < 0)
+            goto cleanup;
+    }
+
+    if (virThreadPoolSendJob(pool, 1, (void *) 0) < 0)
+        goto cleanup;
+
+    testPoolWait(&data);
+
+    if (data.runs[0] != 1) {
+        VIR_TEST_DEBUG("priority job did not run");
+        goto cleanup;
+    }
+
+    virAtomicIntSet(&data.pending, 4);
+    virMutexLock(&data.lock);
+    virAtomicIntSet(&data.blocked, 0);
+    virCondBroadcast(&data.done);
+    virMutexUnlock(&data.lock);
+    testPoolWait(&data);
+
+    for (i = 0; i < 5; i++) {
+        if (data.runs[i] != 1) {
+            VIR_TEST_DEBUG("job %zu ran %d times", i, data.runs[i]);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (ret < 0) {
+        virMutexLock(&data.lock);
+        virAtomicIntSet(&data.blocked, 0);
+        virCondBroadcast(&data.done);
+        virMutexUnlock(&data.lock);
+    }
+    virThreadPoolFree(pool);
+    testPoolDataClear(&data);
+    return ret;
+}
+
+
+/* Like testPoolJob, but only job 0 waits for @blocked to clear */
+static void
+testPoolBlockingJob(void *jobdata,
+                    void *opaque)
+{
+    struct testPoolData *data = opaque;
+    size_t n = (size_t) jobdata;
+
+    if (n == 0) {
+        virMutexLock(&data->lock);
+        while (virAtomicIntGet(&data->blocked))
+            ignore_value(virCondWait(&data->done, &data->lock));
+        virMutexUnlock(&data->lock);
+    }
+
+    virAtomicIntInc(&data->runs[n]);
+
+    if (virAtomicIntDecAndTest(&data->pending)) {
+        virMutexLock(&data->lock);
+        virCondBroadcast(&data->done);
+        virMutexUnlock(&data->lock);
+    }
+}
+
+
+/*
+ * A worker stuck in a job must not hold up the jobs queued after
+ * it, also when the second worker was only allowed once the pool
+ * was running already.
+ */
+static int
+testPoolBlockedWorker(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virThreadPoolPtr pool = NULL;
+    struct testPoolData data;
+    size_t i;
+    int ret = -1;
+
+    if (testPoolDataInit(&data, 50) < 0)
+        return -1;
+
+    data.blocked = 1;
+    data.pending = 49;
+
+    if (!(pool = virThreadPoolNewFlags(1, 1, 0, testPoolBlockingJob,
+                                       &data,
+                                       VIR_THREAD_POOL_WORK_STEALING)))
+        goto cleanup;
+
+    if (virThreadPoolSendJob(pool, 0, (void *) 0) < 0 ||
+        virThreadPoolSetParameters(pool, -1, 2, -1) < 0)
+        goto cleanup;
+
+    for (i = 1; i < 50; i++) {
+        if (virThreadPoolSendJob(pool, 0, (void *) i) < 0)
+            goto cleanup;
+    }
+
+    testPoolWait(&data);
+
+    if (data.runs[0] != 0) {
+        VIR_TEST_DEBUG("blocked job finished early");
+        goto cleanup;
+    }
+
+    virAtomicIntSet(&data.pending, 1);
+    virMutexLock(&data.lock);
+    virAtomicIntSet(&data.blocked, 0);
+    virCondBroadcast(&data.done);
+    virMutexUnlock(&data.lock);
+    testPoolWait(&data);
+
+    for (i = 0; i < 50; i++) {
+        if (data.runs[i] != 1) {
+            VIR_TEST_DEBUG("job %zu ran %d times", i, data.runs[i]);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (ret < 0) {
+        virMutexLock(&data.lock);
+        virAtomicIntSet(&data.blocked, 0);
+        virCondBroadcast(&data.done);
+        virMutexUnlock(&data.lock);
+    }
+    virThreadPoolFree(pool);
+    testPoolDataClear(&data);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    unsigned int shared = 0;
+    unsigned int stealing = VIR_THREAD_POOL_WORK_STEALING;
+    int ret = 0;
+
+    if (virTestRun("Priority job", testPoolPriority, &shared) < 0)
+        ret = -1;
+    if (virTestRun("Priority job with work stealing",
+                   testPoolPriority, &stealing) < 0)
+        ret = -1;
+    if (virTestRun("Blocked worker with work stealing",
+                   testPoolBlockedWorker, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Contention benchmark",
+                   testPoolContentionBench, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
@@ -457,8 +457,11 @@ cmdSrvThreadpoolInfo(vshControl *ctl, const vshCmd *cmd)
         goto cleanup;
     }
 
-    for (i = 0; i < nparams; i++)
-        vshPrint(ctl, "%-15s: %d\n", params[i].field, params[i].value.ui);
+    for (i = 0; i < nparams; i++) {
+        char *str = vshGetTypedParamValue(ctl, &params[i]);
+        vshPrint(ctl, "%-20s: %s\n", params[i].field, str);
+        VIR_FREE(str);
+    }
 
     ret = true;
 